@@ -35,11 +35,20 @@ bool Common::initialize(HINSTANCE hInstance, WNDPROC wndproc, int nCmdShow, PHAN
 static float timer = 0.0f;
 void Common::render_loop()
 {
+	// A minimized window, or one with nothing to redraw, sleeps until it receives a message
+	if (IsIconic(win32_vars.hWnd) || !vk_renderer->needs_redraw()) {
+		WaitMessage();
+		system_events_loop();
+		return;
+	}
+
+	// The frame pacer sleeps until the frame should start, the input is read once it woke up
+	auto start_time = std::chrono::high_resolution_clock::now();
+	vk_renderer->wait_for_frame();
+
 	system_events_loop();
 	if (!IsIconic(win32_vars.hWnd)) {
 
-		auto start_time = std::chrono::high_resolution_clock::now();
-
 		vk_renderer->render();
 		vk_renderer->update(timer);
 
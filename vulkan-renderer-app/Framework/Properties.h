@@ -4,6 +4,4 @@
 #define	WIN32_WINDOW_CLASS_NAME			"VK_RENDERING_ENGINE_WINDOW"
 
 #define DEFAULT_WINDOW_WIDTH			1280
-#define DEFAULT_WINDOW_HEIGHT			720
-
-#define ENABLE_DEBUG_LAYERS
\ No newline at end of file
+#define DEFAULT_WINDOW_HEIGHT			720
\ No newline at end of file
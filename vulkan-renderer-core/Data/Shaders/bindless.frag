@@ -0,0 +1,43 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+#define INVALID_HANDLE 0xFFFFFFFF
+
+layout (location = 0) in vec3 inColor;
+layout (location = 1) in vec2 inUV;
+
+layout (location = 0) out vec4 outFragColor;
+
+// Smallest level of detail sampled per streamed texture
+layout (std430, binding = 1) buffer TextureFeedback
+{
+	int textureFeedback[];
+};
+
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+// Per draw data, the material of the draw and the bindless handle of its texture
+layout (push_constant) uniform DrawConstants
+{
+	vec4 transform[3];
+	uint object;
+	uint material;
+	uint texture;
+	uint flags;
+} draw;
+
+void main() 
+{
+	vec3 color = inColor;
+
+	// The handle is uniform over the draw
+	if (draw.texture != INVALID_HANDLE) {
+		color *= texture(textures[draw.texture], inUV).rgb;
+		atomicMin(textureFeedback[draw.material], int(floor(textureQueryLod(textures[draw.texture], inUV).y)));
+	}
+
+	outFragColor = vec4(color, 1.0);
+}
@@ -6,6 +6,10 @@
 layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inColor;
 
+// Per instance stream
+layout (location = 2) in mat4 inInstanceModel;
+layout (location = 6) in vec4 inInstanceColor;
+
 layout (binding = 0) uniform UBO 
 {
 	mat4 projectionMatrix;
@@ -13,7 +17,18 @@ layout (binding = 0) uniform UBO
 	mat4 viewMatrix;
 } ubo;
 
+// Per draw data, the transform replaces the model matrix of the uniform buffer
+layout (push_constant) uniform DrawConstants
+{
+	vec4 transform[3];
+	uint object;
+	uint material;
+	uint texture;
+	uint flags;
+} draw;
+
 layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec2 outUV;
 
 out gl_PerVertex 
 {
@@ -23,6 +38,11 @@ out gl_PerVertex
 
 void main() 
 {
-	outColor = inColor;
-	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * ubo.modelMatrix * vec4(inPos.xyz, 1.0);
+	outColor = inColor * inInstanceColor.rgb;
+	// The meshes have no texture coordinates, the textures are projected on the object xy plane
+	outUV = inPos.xy * 0.5 + 0.5;
+
+	vec4 instancePosition = inInstanceModel * vec4(inPos.xyz, 1.0);
+	vec4 worldPosition = vec4(dot(draw.transform[0], instancePosition), dot(draw.transform[1], instancePosition), dot(draw.transform[2], instancePosition), 1.0);
+	gl_Position = ubo.projectionMatrix * ubo.viewMatrix * worldPosition;
 }
@@ -6,10 +6,31 @@
 #define DEFAULT_WINDOW_WIDTH			1280
 #define DEFAULT_WINDOW_HEIGHT			720
 
-#define ENABLE_DEBUG_LAYERS
+/* Default debug level of the instance, the renderer may change it before initialize, the release builds load no layer */
+#ifdef _DEBUG
+#define DEFAULT_DEBUG_LEVEL				DEBUG_LEVEL_VALIDATION
+#else
+#define DEFAULT_DEBUG_LEVEL				DEBUG_LEVEL_NONE
+#endif
+
+/* Least severe validation messages reported by default */
+#define DEFAULT_DEBUG_SEVERITY			DEBUG_SEVERITY_WARNING
 
+/* Default samples per pixel, the renderer may change it at runtime */
 #define MULTISAMPLE_LEVEL				VK_SAMPLE_COUNT_1_BIT
 
+/* Default present policy, the renderer may change it at runtime */
+#define DEFAULT_PRESENT_POLICY			PRESENT_POLICY_THROUGHPUT
+
+/* Default frame rate cap, 0 does not cap the frame rate */
+#define DEFAULT_TARGET_FPS				60.0f
+
+/* Render only the frames where something changed by default */
+#define DEFAULT_ON_DEMAND_RENDERING		true
+
+/* UUID or part of the name of the physical device to render with, empty selects the device with the best score */
+#define DEFAULT_PREFERRED_DEVICE		""
+
 #ifdef VULKAN_RENDERER_EXPORTS
 #define VULKAN_RENDERER_API __declspec(dllexport)
 #else
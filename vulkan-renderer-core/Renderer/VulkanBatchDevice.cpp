@@ -0,0 +1,628 @@
+#include "VulkanBatchDevice.h"
+
+VulkanBatchDevice::VulkanBatchDevice()
+	: width(0)
+	, height(0)
+	, depth_format(VK_FORMAT_UNDEFINED)
+	, command_pool(VK_NULL_HANDLE)
+	, render_pass(VK_NULL_HANDLE)
+	, descriptor_set_layout(VK_NULL_HANDLE)
+	, descriptor_pool(VK_NULL_HANDLE)
+	, pipeline_layout(VK_NULL_HANDLE)
+	, pipeline(VK_NULL_HANDLE)
+	, next_slot(0)
+	, instance_buffer({})
+{
+	for (auto& slot : slots) {
+		slot = {};
+	}
+}
+
+VulkanBatchDevice::~VulkanBatchDevice()
+{
+}
+
+/**
+* Create the context on a physical device, the frames of the jobs are width x height
+*
+* @param debug Debug names and labels of the instance, null when debugging is disabled
+* @return False when the physical device cannot run the renderer
+*/
+bool VulkanBatchDevice::create(VkInstance instance, VulkanDebug* debug, VkPhysicalDevice physical_device, uint32_t width, uint32_t height)
+{
+	this->width = width;
+	this->height = height;
+
+	device.debug = debug;
+	if (!device.create(instance, physical_device)) {
+		return false;
+	}
+	sync.create(&device);
+	transfer_queue.create(&device, &sync);
+
+	depth_format = device.get_supported_format({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM }, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	if (depth_format == VK_FORMAT_UNDEFINED) {
+		std::cout << "No supported depth format.\n";
+		shutdown();
+		return false;
+	}
+
+	VkCommandPoolCreateInfo command_pool_create_info = {};
+	command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	command_pool_create_info.queueFamilyIndex = device.graphics_queue_family_index;
+	VK_CHECK_RESULT(vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool));
+
+	VkDescriptorSetLayoutBinding layout_binding = {};
+	layout_binding.binding = 0;
+	layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	layout_binding.descriptorCount = 1;
+	layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
+	descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptor_set_layout_create_info.bindingCount = 1;
+	descriptor_set_layout_create_info.pBindings = &layout_binding;
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptor_set_layout_create_info, nullptr, &descriptor_set_layout));
+
+	VkDescriptorPoolSize pool_size = {};
+	pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	pool_size.descriptorCount = BATCH_JOBS_IN_FLIGHT;
+
+	VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
+	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptor_pool_create_info.maxSets = BATCH_JOBS_IN_FLIGHT;
+	descriptor_pool_create_info.poolSizeCount = 1;
+	descriptor_pool_create_info.pPoolSizes = &pool_size;
+	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptor_pool_create_info, nullptr, &descriptor_pool));
+
+	// The draws push the same constants as in the renderer
+	VkPushConstantRange push_constant_range = VulkanRenderQueue::get_push_constant_range();
+
+	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {};
+	pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_create_info.pushConstantRangeCount = 1;
+	pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
+	pipeline_layout_create_info.setLayoutCount = 1;
+	pipeline_layout_create_info.pSetLayouts = &descriptor_set_layout;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipeline_layout_create_info, nullptr, &pipeline_layout));
+
+	create_render_pass();
+	create_pipeline();
+
+	for (auto& slot : slots) {
+		create_slot(slot);
+	}
+	next_slot = 0;
+
+	return true;
+}
+
+void VulkanBatchDevice::shutdown()
+{
+	if (device.logical_device == VK_NULL_HANDLE) {
+		return;
+	}
+
+	std::cout << "Destroy batch device " << get_name() << "\n";
+	destroy_scene();
+	sync.wait_idle();
+
+	if (command_pool != VK_NULL_HANDLE) {
+		for (auto& slot : slots) {
+			destroy_slot(slot);
+		}
+	}
+	vkDestroyPipeline(device, pipeline, nullptr);
+	pipeline = VK_NULL_HANDLE;
+	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+	pipeline_layout = VK_NULL_HANDLE;
+	vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+	descriptor_pool = VK_NULL_HANDLE;
+	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
+	descriptor_set_layout = VK_NULL_HANDLE;
+	vkDestroyRenderPass(device, render_pass, nullptr);
+	render_pass = VK_NULL_HANDLE;
+	vkDestroyCommandPool(device, command_pool, nullptr);
+	command_pool = VK_NULL_HANDLE;
+
+	transfer_queue.shutdown();
+	sync.shutdown();
+	device.shutdown();
+}
+
+/**
+* Upload the buffers of a scene into the device local memory, nothing is done when the scene is already uploaded
+* The previous scene is released once the jobs in flight are complete
+*/
+void VulkanBatchDevice::upload_scene(const std::shared_ptr<const BatchScene>& scene)
+{
+	if (scene == this->scene) {
+		return;
+	}
+
+	destroy_scene();
+	this->scene = scene;
+	if (!scene) {
+		return;
+	}
+
+	meshes.resize(scene->meshes.size());
+	for (uint32_t i = 0; i < meshes.size(); ++i) {
+		const BatchMesh& mesh = scene->meshes[i];
+		MeshBuffers& buffers = meshes[i];
+		buffers = {};
+		if (mesh.vertices.empty() || mesh.indices.empty()) {
+			continue;
+		}
+
+		const VkDeviceSize vertices_size = mesh.vertices.size() * sizeof(Vertex);
+		const VkDeviceSize indices_size = mesh.indices.size() * sizeof(uint32_t);
+		device.create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertices_size, &buffers.vertex_buffer);
+		device.create_buffer(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indices_size, &buffers.index_buffer);
+		transfer_queue.upload_buffer(buffers.vertex_buffer.buffer, 0, mesh.vertices.data(), vertices_size);
+		transfer_queue.upload_buffer(buffers.index_buffer.buffer, 0, mesh.indices.data(), indices_size);
+		buffers.index_count = static_cast<uint32_t>(mesh.indices.size());
+	}
+
+	const VkDeviceSize instances_size = std::max<VkDeviceSize>(scene->instances.size(), 1) * sizeof(InstanceData);
+	device.create_buffer(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instances_size, &instance_buffer);
+	if (!scene->instances.empty()) {
+		transfer_queue.upload_buffer(instance_buffer.buffer, 0, scene->instances.data(), scene->instances.size() * sizeof(InstanceData));
+	}
+
+	// The jobs only start once the scene is resident
+	transfer_queue.wait(transfer_queue.flush());
+}
+
+/**
+* Render a job, the output of the job submitted BATCH_JOBS_IN_FLIGHT jobs before is delivered first
+*/
+void VulkanBatchDevice::render(const BatchJob& job, const BatchOutput& output)
+{
+	assert(job.region.offset.x >= 0 && job.region.offset.x + job.region.extent.width <= width);
+	assert(job.region.offset.y >= 0 && job.region.offset.y + job.region.extent.height <= height);
+
+	JobSlot& slot = slots[next_slot];
+	next_slot = (next_slot + 1) % BATCH_JOBS_IN_FLIGHT;
+	complete(slot, output);
+
+	slot.job = job;
+	Uniforms uniforms = { job.projection, glm::mat4(1.0f), job.view };
+	memcpy(slot.uniform_buffer.mapped, &uniforms, sizeof(uniforms));
+
+	record(slot);
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &slot.command_buffer;
+	slot.value = sync.get_timeline(SYNC_QUEUE_GRAPHICS).submit(submit_info);
+	slot.pending = true;
+}
+
+/**
+* Deliver the outputs of the jobs in flight, in their submission order
+*/
+void VulkanBatchDevice::finish(const BatchOutput& output)
+{
+	for (uint32_t i = 0; i < BATCH_JOBS_IN_FLIGHT; ++i) {
+		complete(slots[(next_slot + i) % BATCH_JOBS_IN_FLIGHT], output);
+	}
+}
+
+/**
+* Render pass of a job, the color is cleared to transparent so that the outputs can be composited
+* and left in the transfer layout for the readback
+*/
+void VulkanBatchDevice::create_render_pass()
+{
+	std::array<VkAttachmentDescription, 2> attachments{};
+	attachments[0].format = BATCH_COLOR_FORMAT;
+	attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+	attachments[1].format = depth_format;
+	attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference color_reference = {};
+	color_reference.attachment = 0;
+	color_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depth_reference = {};
+	depth_reference.attachment = 1;
+	depth_reference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkSubpassDescription sub_pass_description = {};
+	sub_pass_description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	sub_pass_description.colorAttachmentCount = 1;
+	sub_pass_description.pColorAttachments = &color_reference;
+	sub_pass_description.pDepthStencilAttachment = &depth_reference;
+
+	// The attachments were last read by the readback of the previous job of the slot,
+	// the color is written before it is copied
+	std::array<VkSubpassDependency, 2> dependencies{};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].srcAccessMask = 0;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	VkRenderPassCreateInfo render_pass_create_info = {};
+	render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	render_pass_create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+	render_pass_create_info.pAttachments = attachments.data();
+	render_pass_create_info.subpassCount = 1;
+	render_pass_create_info.pSubpasses = &sub_pass_description;
+	render_pass_create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
+	render_pass_create_info.pDependencies = dependencies.data();
+	VK_CHECK_RESULT(vkCreateRenderPass(device, &render_pass_create_info, nullptr, &render_pass));
+}
+
+/**
+* Pipeline of the opaque draws of the renderer, with the shaders that do not sample textures
+*/
+void VulkanBatchDevice::create_pipeline()
+{
+	std::vector<VkDynamicState> dynamic_state_enables{
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo dynamic_state = {};
+	dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state.pDynamicStates = dynamic_state_enables.data();
+	dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_state_enables.size());
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	input_assembly.primitiveRestartEnable = VK_FALSE;
+
+	// Binding 0 is the per vertex stream, binding 1 the per instance stream
+	std::array<VkVertexInputBindingDescription, 2> vertex_input_bindings;
+	vertex_input_bindings[0].binding = 0;
+	vertex_input_bindings[0].stride = sizeof(Vertex);
+	vertex_input_bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	vertex_input_bindings[1].binding = 1;
+	vertex_input_bindings[1].stride = sizeof(InstanceData);
+	vertex_input_bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	std::array<VkVertexInputAttributeDescription, 7> vertex_input_attributes;
+	vertex_input_attributes[0].binding = 0;
+	vertex_input_attributes[0].location = 0;
+	vertex_input_attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+	vertex_input_attributes[0].offset = offsetof(Vertex, position);
+	vertex_input_attributes[1].binding = 0;
+	vertex_input_attributes[1].location = 1;
+	vertex_input_attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+	vertex_input_attributes[1].offset = offsetof(Vertex, color);
+	for (uint32_t i = 0; i < 4; i++) {
+		vertex_input_attributes[2 + i].binding = 1;
+		vertex_input_attributes[2 + i].location = 2 + i;
+		vertex_input_attributes[2 + i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		vertex_input_attributes[2 + i].offset = offsetof(InstanceData, model) + i * sizeof(glm::vec4);
+	}
+	vertex_input_attributes[6].binding = 1;
+	vertex_input_attributes[6].location = 6;
+	vertex_input_attributes[6].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	vertex_input_attributes[6].offset = offsetof(InstanceData, color);
+
+	VkPipelineVertexInputStateCreateInfo vertex_input_state = {};
+	vertex_input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input_state.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_input_bindings.size());
+	vertex_input_state.pVertexBindingDescriptions = vertex_input_bindings.data();
+	vertex_input_state.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_input_attributes.size());
+	vertex_input_state.pVertexAttributeDescriptions = vertex_input_attributes.data();
+
+	std::array<VkPipelineShaderStageCreateInfo, 2> shader_stages{};
+	shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shader_stages[0].pName = "main";
+	shader_stages[0].module = shader_loader.load(device, "D:\\Documents\\Vulkan\\Projects\\vulkan-renderer\\vulkan-renderer-core\\Data\\shaders\\simple.vert.spv");
+	shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shader_stages[1].pName = "main";
+	shader_stages[1].module = shader_loader.load(device, "D:\\Documents\\Vulkan\\Projects\\vulkan-renderer\\vulkan-renderer-core\\Data\\shaders\\simple.frag.spv");
+
+	VkPipelineRasterizationStateCreateInfo rasterization_state = {};
+	rasterization_state.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterization_state.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterization_state.cullMode = VK_CULL_MODE_NONE;
+	rasterization_state.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterization_state.lineWidth = 1.0f;
+
+	VkPipelineColorBlendAttachmentState blend_attachment_state = {};
+	blend_attachment_state.colorWriteMask = 0xf;
+	blend_attachment_state.blendEnable = VK_FALSE;
+	VkPipelineColorBlendStateCreateInfo color_blend_state = {};
+	color_blend_state.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	color_blend_state.attachmentCount = 1;
+	color_blend_state.pAttachments = &blend_attachment_state;
+
+	VkPipelineViewportStateCreateInfo viewport_state = {};
+	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewport_state.viewportCount = 1;
+	viewport_state.scissorCount = 1;
+
+	VkPipelineDepthStencilStateCreateInfo depth_stencil_state = {};
+	depth_stencil_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depth_stencil_state.depthTestEnable = VK_TRUE;
+	depth_stencil_state.depthWriteEnable = VK_TRUE;
+	depth_stencil_state.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	depth_stencil_state.back.compareOp = VK_COMPARE_OP_ALWAYS;
+	depth_stencil_state.front = depth_stencil_state.back;
+
+	VkPipelineMultisampleStateCreateInfo multisample_state = {};
+	multisample_state.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisample_state.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkGraphicsPipelineCreateInfo pipeline_create_info = {};
+	pipeline_create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_create_info.layout = pipeline_layout;
+	pipeline_create_info.pVertexInputState = &vertex_input_state;
+	pipeline_create_info.pInputAssemblyState = &input_assembly;
+	pipeline_create_info.pRasterizationState = &rasterization_state;
+	pipeline_create_info.pColorBlendState = &color_blend_state;
+	pipeline_create_info.pMultisampleState = &multisample_state;
+	pipeline_create_info.pDynamicState = &dynamic_state;
+	pipeline_create_info.pViewportState = &viewport_state;
+	pipeline_create_info.pDepthStencilState = &depth_stencil_state;
+	pipeline_create_info.pStages = shader_stages.data();
+	pipeline_create_info.stageCount = static_cast<uint32_t>(shader_stages.size());
+	pipeline_create_info.renderPass = render_pass;
+	pipeline_create_info.subpass = 0;
+	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &pipeline));
+
+	vkDestroyShaderModule(device, shader_stages[0].module, nullptr);
+	vkDestroyShaderModule(device, shader_stages[1].module, nullptr);
+}
+
+void VulkanBatchDevice::create_slot(JobSlot& slot)
+{
+	slot = {};
+
+	VkCommandBufferAllocateInfo command_buffer_allocate_info = {};
+	command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	command_buffer_allocate_info.commandPool = command_pool;
+	command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	command_buffer_allocate_info.commandBufferCount = 1;
+	VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &slot.command_buffer));
+
+	device.create_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, sizeof(Uniforms), &slot.uniform_buffer);
+
+	VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {};
+	descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptor_set_allocate_info.descriptorPool = descriptor_pool;
+	descriptor_set_allocate_info.descriptorSetCount = 1;
+	descriptor_set_allocate_info.pSetLayouts = &descriptor_set_layout;
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &slot.descriptor_set));
+
+	VkDescriptorBufferInfo buffer_info = { slot.uniform_buffer.buffer, 0, sizeof(Uniforms) };
+	VkWriteDescriptorSet write_descriptor_set = {};
+	write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_descriptor_set.dstSet = slot.descriptor_set;
+	write_descriptor_set.dstBinding = 0;
+	write_descriptor_set.descriptorCount = 1;
+	write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	write_descriptor_set.pBufferInfo = &buffer_info;
+	vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+
+	create_image(BATCH_COLOR_FORMAT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT, &slot.color_image, &slot.color_memory, &slot.color_view);
+	create_image(depth_format, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, &slot.depth_image, &slot.depth_memory, &slot.depth_view);
+
+	std::array<VkImageView, 2> attachments = { slot.color_view, slot.depth_view };
+	VkFramebufferCreateInfo frame_buffer_create_info = {};
+	frame_buffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	frame_buffer_create_info.renderPass = render_pass;
+	frame_buffer_create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+	frame_buffer_create_info.pAttachments = attachments.data();
+	frame_buffer_create_info.width = width;
+	frame_buffer_create_info.height = height;
+	frame_buffer_create_info.layers = 1;
+	VK_CHECK_RESULT(vkCreateFramebuffer(device, &frame_buffer_create_info, nullptr, &slot.frame_buffer));
+
+	// The readback is read by the CPU, cached memory is much faster to read when there is one
+	VkMemoryPropertyFlags readback_properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	uint32_t memory_type_index;
+	if (!device.get_memory_type(~0u, readback_properties, &memory_type_index)) {
+		readback_properties &= ~VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	}
+	device.create_buffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT, readback_properties, static_cast<VkDeviceSize>(width) * height * BATCH_PIXEL_SIZE, &slot.readback_buffer);
+}
+
+void VulkanBatchDevice::destroy_slot(JobSlot& slot)
+{
+	vkDestroyFramebuffer(device, slot.frame_buffer, nullptr);
+	vkDestroyImageView(device, slot.color_view, nullptr);
+	vkDestroyImage(device, slot.color_image, nullptr);
+	vkFreeMemory(device, slot.color_memory, nullptr);
+	vkDestroyImageView(device, slot.depth_view, nullptr);
+	vkDestroyImage(device, slot.depth_image, nullptr);
+	vkFreeMemory(device, slot.depth_memory, nullptr);
+	device.destroy_buffer(&slot.uniform_buffer);
+	device.destroy_buffer(&slot.readback_buffer);
+	vkFreeCommandBuffers(device, command_pool, 1, &slot.command_buffer);
+	slot = {};
+}
+
+void VulkanBatchDevice::create_image(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkImage* image, VkDeviceMemory* memory, VkImageView* view)
+{
+	VkImageCreateInfo image_create_info = {};
+	image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_create_info.imageType = VK_IMAGE_TYPE_2D;
+	image_create_info.format = format;
+	image_create_info.extent = { width, height, 1 };
+	image_create_info.mipLevels = 1;
+	image_create_info.arrayLayers = 1;
+	image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_create_info.usage = usage;
+	image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VK_CHECK_RESULT(vkCreateImage(device, &image_create_info, nullptr, image));
+
+	VkMemoryRequirements memory_requirements;
+	vkGetImageMemoryRequirements(device, *image, &memory_requirements);
+
+	VkMemoryAllocateInfo memory_allocate_info = {};
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = memory_requirements.size;
+	device.get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memory_allocate_info.memoryTypeIndex);
+	VK_CHECK_RESULT(vkAllocateMemory(device, &memory_allocate_info, nullptr, memory));
+	VK_CHECK_RESULT(vkBindImageMemory(device, *image, *memory, 0));
+
+	VkImageViewCreateInfo view_create_info = {};
+	view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_create_info.image = *image;
+	view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_create_info.format = format;
+	view_create_info.subresourceRange = { aspect, 0, 1, 0, 1 };
+	VK_CHECK_RESULT(vkCreateImageView(device, &view_create_info, nullptr, view));
+}
+
+void VulkanBatchDevice::destroy_scene()
+{
+	if (!scene) {
+		return;
+	}
+
+	// The jobs in flight draw the scene
+	sync.wait_idle();
+	for (auto& buffers : meshes) {
+		device.destroy_buffer(&buffers.vertex_buffer);
+		device.destroy_buffer(&buffers.index_buffer);
+	}
+	meshes.clear();
+	device.destroy_buffer(&instance_buffer);
+	scene.reset();
+}
+
+/**
+* Record the draws of the scene restricted to the region of the job, then the copy of the region into the readback buffer
+*/
+void VulkanBatchDevice::record(JobSlot& slot)
+{
+	const BatchJob& job = slot.job;
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK_CHECK_RESULT(vkBeginCommandBuffer(slot.command_buffer, &begin_info));
+
+	std::array<VkClearValue, 2> clear_values{};
+	clear_values[0].color = { { 0.0f, 0.0f, 0.0f, 0.0f } };
+	clear_values[1].depthStencil = { 1.0f, 0 };
+
+	// Only the region is cleared and rasterized, the viewport is the one of the whole frame
+	VkRenderPassBeginInfo render_pass_begin_info = {};
+	render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	render_pass_begin_info.renderPass = render_pass;
+	render_pass_begin_info.framebuffer = slot.frame_buffer;
+	render_pass_begin_info.renderArea = job.region;
+	render_pass_begin_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+	render_pass_begin_info.pClearValues = clear_values.data();
+	device.begin_label(slot.command_buffer, "batch_job");
+	vkCmdBeginRenderPass(slot.command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height), 0.0f, 1.0f };
+	vkCmdSetViewport(slot.command_buffer, 0, 1, &viewport);
+	vkCmdSetScissor(slot.command_buffer, 0, 1, &job.region);
+
+	render_queue.clear();
+	const uint32_t pipeline_id = render_queue.get_pipeline_id(pipeline);
+	const uint32_t descriptor_set_id = render_queue.get_descriptor_set_id(slot.descriptor_set);
+	if (scene) {
+		for (uint32_t batch_index = 0; batch_index < scene->batches.size(); ++batch_index) {
+			const InstanceBatch& batch = scene->batches[batch_index];
+			const MeshBuffers& mesh = meshes[batch.mesh];
+			if (mesh.index_count == 0) {
+				continue;
+			}
+
+			DrawPacket packet = {};
+			packet.key = VulkanRenderQueue::make_sort_key(0, pipeline_id, descriptor_set_id, batch.mesh, 0.0f);
+			packet.pipeline = pipeline;
+			packet.pipeline_layout = pipeline_layout;
+			packet.descriptor_set = slot.descriptor_set;
+			VulkanRenderQueue::pack_transform(batch.transform, packet.constants);
+			packet.constants.object = batch_index;
+			packet.constants.material = batch.material;
+			packet.constants.texture = 0;
+			packet.constants.flags = 0;
+			packet.vertex_buffer = mesh.vertex_buffer.buffer;
+			packet.instance_buffer = instance_buffer.buffer;
+			packet.index_buffer = mesh.index_buffer.buffer;
+			packet.first_index = 0;
+			packet.index_count = mesh.index_count;
+			packet.first_instance = batch.first_instance;
+			packet.instance_count = batch.instance_count;
+			render_queue.push(packet);
+		}
+	}
+	render_queue.sort();
+	render_queue.record(slot.command_buffer, 0);
+
+	vkCmdEndRenderPass(slot.command_buffer);
+
+	// The rows of the region are tightly packed in the readback buffer
+	VkBufferImageCopy copy_region = {};
+	copy_region.bufferOffset = 0;
+	copy_region.bufferRowLength = 0;
+	copy_region.bufferImageHeight = 0;
+	copy_region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+	copy_region.imageOffset = { job.region.offset.x, job.region.offset.y, 0 };
+	copy_region.imageExtent = { job.region.extent.width, job.region.extent.height, 1 };
+	vkCmdCopyImageToBuffer(slot.command_buffer, slot.color_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.readback_buffer.buffer, 1, &copy_region);
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = slot.readback_buffer.buffer;
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(slot.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+	device.end_label(slot.command_buffer);
+
+	VK_CHECK_RESULT(vkEndCommandBuffer(slot.command_buffer));
+}
+
+/**
+* Wait for the job of a slot and hand its pixels to the output, nothing is done when the slot is free
+*/
+void VulkanBatchDevice::complete(JobSlot& slot, const BatchOutput& output)
+{
+	if (!slot.pending) {
+		return;
+	}
+
+	SyncPoint point = { SYNC_QUEUE_GRAPHICS, slot.value };
+	sync.wait(point);
+	slot.pending = false;
+
+	if (output) {
+		output(slot.job, static_cast<const uint8_t*>(slot.readback_buffer.mapped));
+	}
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <iostream>
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "VulkanTools.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanSync.h"
+#include "VulkanTransferQueue.h"
+#include "VulkanShader.h"
+#include "VulkanMesh.h"
+#include "VulkanInstancing.h"
+#include "VulkanRenderQueue.h"
+
+/* Jobs in flight on a device, the pixels of a job are read back while the next one renders */
+#define BATCH_JOBS_IN_FLIGHT			2
+/* Format of the pixels handed to the batch output */
+#define BATCH_COLOR_FORMAT				VK_FORMAT_R8G8B8A8_UNORM
+#define BATCH_PIXEL_SIZE				4
+
+struct BatchMesh {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+};
+
+/**
+* Immutable CPU data of a batch scene, shared by every device which uploads its own copy
+* The objects are already grouped into instance batches, all of them at the full resolution level
+*/
+struct BatchScene {
+	std::vector<BatchMesh> meshes;
+	std::vector<InstanceBatch> batches;
+	std::vector<InstanceData> instances;
+};
+
+/** @brief Frame or tile of a frame, a tile is rendered with the projection of its whole frame */
+struct BatchJob {
+	uint32_t frame;
+	glm::mat4 view;
+	glm::mat4 projection;
+	/** @brief Pixels of the frame rendered by the job */
+	VkRect2D region;
+};
+
+/**
+* Receives the pixels of a job, the rows of its region tightly packed in BATCH_COLOR_FORMAT
+* Called on the thread of the device which rendered the job, the pixels are only valid during the call
+*/
+typedef std::function<void(const BatchJob& job, const uint8_t* pixels)> BatchOutput;
+
+/**
+* Device context of the batch renderer, renders the jobs of one physical device on its own thread
+*
+* The device has its own logical device, timelines, pipeline and copy of the scene, nothing is shared
+* with the other contexts but the CPU scene data
+*/
+class VulkanBatchDevice
+{
+public:
+	VulkanBatchDevice();
+	~VulkanBatchDevice();
+
+	bool								create(VkInstance instance, VulkanDebug* debug, VkPhysicalDevice physical_device, uint32_t width, uint32_t height);
+	void								shutdown();
+
+	void								upload_scene(const std::shared_ptr<const BatchScene>& scene);
+	void								render(const BatchJob& job, const BatchOutput& output);
+	void								finish(const BatchOutput& output);
+
+	std::string							get_name() const { return device.properties.deviceName; };
+
+private:
+	/* uniform buffer read by simple.vert, same layout as the one of the renderer */
+	struct Uniforms {
+		glm::mat4 projection;
+		glm::mat4 model;
+		glm::mat4 view;
+	};
+
+	struct MeshBuffers {
+		VulkanBuffer vertex_buffer;
+		VulkanBuffer index_buffer;
+		uint32_t index_count;
+	};
+
+	/* targets and readback of a job in flight, the value is the graphics timeline value of its submission */
+	struct JobSlot {
+		VkCommandBuffer command_buffer;
+		VulkanBuffer uniform_buffer;
+		VkDescriptorSet descriptor_set;
+		VkImage color_image;
+		VkDeviceMemory color_memory;
+		VkImageView color_view;
+		VkImage depth_image;
+		VkDeviceMemory depth_memory;
+		VkImageView depth_view;
+		VkFramebuffer frame_buffer;
+		VulkanBuffer readback_buffer;
+		uint64_t value;
+		bool pending;
+		BatchJob job;
+	};
+
+	VulkanDevice						device;
+	VulkanSync							sync;
+	VulkanTransferQueue					transfer_queue;
+	VulkanShader						shader_loader;
+	VulkanRenderQueue					render_queue;
+
+	uint32_t							width;
+	uint32_t							height;
+	VkFormat							depth_format;
+
+	VkCommandPool						command_pool;
+	VkRenderPass						render_pass;
+	VkDescriptorSetLayout				descriptor_set_layout;
+	VkDescriptorPool					descriptor_pool;
+	VkPipelineLayout					pipeline_layout;
+	VkPipeline							pipeline;
+
+	std::array<JobSlot, BATCH_JOBS_IN_FLIGHT>	slots;
+	uint32_t							next_slot;
+
+	/* scene the buffers were uploaded from */
+	std::shared_ptr<const BatchScene>	scene;
+	std::vector<MeshBuffers>			meshes;
+	VulkanBuffer						instance_buffer;
+
+	void								create_render_pass();
+	void								create_pipeline();
+	void								create_slot(JobSlot& slot);
+	void								destroy_slot(JobSlot& slot);
+	void								create_image(VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, VkImage* image, VkDeviceMemory* memory, VkImageView* view);
+	void								destroy_scene();
+
+	void								record(JobSlot& slot);
+	void								complete(JobSlot& slot, const BatchOutput& output);
+};
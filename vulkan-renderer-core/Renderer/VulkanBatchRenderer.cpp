@@ -0,0 +1,341 @@
+#include "VulkanBatchRenderer.h"
+
+#define BATCH_CAMERA_FOV				60.0f
+#define BATCH_CAMERA_Z_NEAR				0.1f
+#define BATCH_CAMERA_Z_FAR				256.0f
+
+VulkanBatchRenderer::VulkanBatchRenderer()
+	: width(0)
+	, height(0)
+	, scene_changed(false)
+	, jobs(nullptr)
+	, next_job(0)
+	, remaining_pixels(0)
+	, active_count(0)
+{
+}
+
+VulkanBatchRenderer::~VulkanBatchRenderer()
+{
+}
+
+/**
+* Create a device context on every physical device able to run the renderer
+*
+* @param width Width of the frames of the jobs
+* @param height Height of the frames of the jobs
+* @param include_cpu_devices Render on the CPU devices as well, otherwise they are only used when there is no other device
+*
+* @return False when no device can render
+*/
+bool VulkanBatchRenderer::create(uint32_t width, uint32_t height, bool include_cpu_devices)
+{
+	this->width = width;
+	this->height = height;
+
+	if (!instance.create()) {
+		return false;
+	}
+
+	uint32_t physical_devices_count = 0;
+	VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance, &physical_devices_count, nullptr));
+	std::vector<VkPhysicalDevice> physical_devices(physical_devices_count);
+	VK_CHECK_RESULT(vkEnumeratePhysicalDevices(instance, &physical_devices_count, physical_devices.data()));
+
+	std::vector<VkPhysicalDevice> selected_devices;
+	std::vector<VkPhysicalDevice> cpu_devices;
+	for (auto physical_device : physical_devices) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physical_device, &properties);
+		if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+			cpu_devices.push_back(physical_device);
+		}
+		else {
+			selected_devices.push_back(physical_device);
+		}
+	}
+	if (include_cpu_devices || selected_devices.empty()) {
+		selected_devices.insert(selected_devices.end(), cpu_devices.begin(), cpu_devices.end());
+	}
+
+	for (auto physical_device : selected_devices) {
+		VulkanBatchDevice* device = new VulkanBatchDevice();
+		if (!device->create(instance, instance.get_debug(), physical_device, width, height)) {
+			delete device;
+			continue;
+		}
+		devices.push_back(device);
+
+		BatchDeviceStatistics device_statistics = {};
+		device_statistics.name = device->get_name();
+		statistics.push_back(device_statistics);
+	}
+
+	std::cout << "Batch rendering on " << devices.size() << " devices\n";
+	return !devices.empty();
+}
+
+void VulkanBatchRenderer::shutdown()
+{
+	std::cout << "Destroy batch renderer\n";
+	for (auto device : devices) {
+		device->shutdown();
+		delete device;
+	}
+	devices.clear();
+	statistics.clear();
+	scene.reset();
+
+	instance.shutdown();
+}
+
+/**
+* Add a mesh to the scene, the scene is shared with the devices at the next render
+*
+* @return Index of the mesh
+*/
+uint32_t VulkanBatchRenderer::add_mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	BatchMesh mesh;
+	mesh.vertices = vertices;
+	mesh.indices = indices;
+	meshes.push_back(mesh);
+
+	scene_changed = true;
+	return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+/**
+* Add an object to the scene, objects sharing a mesh are drawn with a single instanced draw
+*
+* @return Index of the object
+*/
+uint32_t VulkanBatchRenderer::add_object(uint32_t mesh, const glm::mat4& transform, const glm::vec4& color)
+{
+	RenderObject object = {};
+	object.mesh = mesh;
+	object.material = 0;
+	object.lod = 0;
+	object.transform = transform;
+	object.color = color;
+	objects.push_back(object);
+
+	scene_changed = true;
+	return static_cast<uint32_t>(objects.size() - 1);
+}
+
+/**
+* Render the jobs on every device and hand the pixels of each job to the output
+* The output is called concurrently by the threads of the devices, in no particular order across the devices
+* Returns once every job is delivered
+*/
+void VulkanBatchRenderer::render(const std::vector<BatchJob>& jobs, const BatchOutput& output)
+{
+	if (devices.empty() || jobs.empty()) {
+		return;
+	}
+	if (scene_changed || !scene) {
+		build_scene();
+	}
+
+	this->jobs = &jobs;
+	next_job = 0;
+	remaining_pixels = 0;
+	for (auto& job : jobs) {
+		remaining_pixels += get_pixels(job);
+	}
+	active_devices.assign(devices.size(), true);
+	active_count = static_cast<uint32_t>(devices.size());
+
+	std::vector<std::thread> threads;
+	for (uint32_t device = 0; device < devices.size(); ++device) {
+		threads.push_back(std::thread(&VulkanBatchRenderer::run_device, this, device, std::cref(output)));
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	this->jobs = nullptr;
+}
+
+/**
+* Jobs of a turntable around the origin, one full frame per angle
+*
+* @param distance Distance of the camera to the vertical axis
+* @param elevation Height of the camera above the origin
+*/
+void VulkanBatchRenderer::make_turntable(uint32_t frames, float distance, float elevation, std::vector<BatchJob>& jobs) const
+{
+	const glm::mat4 projection = glm::perspective(glm::radians(BATCH_CAMERA_FOV), (float)width / (float)height, BATCH_CAMERA_Z_NEAR, BATCH_CAMERA_Z_FAR);
+
+	for (uint32_t frame = 0; frame < frames; ++frame) {
+		const float angle = glm::two_pi<float>() * frame / frames;
+
+		BatchJob job = {};
+		job.frame = frame;
+		job.view = glm::lookAt(
+			glm::vec3(distance * std::sin(angle), elevation, -distance * std::cos(angle)),
+			glm::vec3(0.0f, 0.0f, 0.0f),
+			glm::vec3(0.0f, 1.0f, 0.0f));
+		job.projection = projection;
+		job.region.offset = { 0, 0 };
+		job.region.extent = { width, height };
+		jobs.push_back(job);
+	}
+}
+
+/**
+* Split the region of each job into tiles of at most tile_size x tile_size pixels
+* The tiles of large frames spread a few frames over all the devices and balance better at the end of the queue
+*/
+void VulkanBatchRenderer::split_tiles(const std::vector<BatchJob>& jobs, uint32_t tile_size, std::vector<BatchJob>& tiles)
+{
+	for (auto& job : jobs) {
+		const uint32_t end_x = job.region.offset.x + job.region.extent.width;
+		const uint32_t end_y = job.region.offset.y + job.region.extent.height;
+		for (uint32_t y = job.region.offset.y; y < end_y; y += tile_size) {
+			for (uint32_t x = job.region.offset.x; x < end_x; x += tile_size) {
+				BatchJob tile = job;
+				tile.region.offset = { static_cast<int32_t>(x), static_cast<int32_t>(y) };
+				tile.region.extent = { std::min(tile_size, end_x - x), std::min(tile_size, end_y - y) };
+				tiles.push_back(tile);
+			}
+		}
+	}
+}
+
+/**
+* Snapshot the scene into the immutable scene shared by the devices, the objects are grouped into instance batches once
+*/
+void VulkanBatchRenderer::build_scene()
+{
+	std::shared_ptr<BatchScene> built_scene = std::make_shared<BatchScene>();
+	built_scene->meshes = meshes;
+
+	VulkanInstanceBatcher batcher;
+	batcher.build(objects);
+	built_scene->batches = batcher.get_batches();
+	built_scene->instances = batcher.get_instances();
+
+	scene = built_scene;
+	scene_changed = false;
+}
+
+/**
+* Thread of a device, renders the chunks of jobs it takes until the queue is empty
+* The throughput of the device is measured on the jobs completed between two chunks
+*/
+void VulkanBatchRenderer::run_device(uint32_t device, const BatchOutput& output)
+{
+	typedef std::chrono::steady_clock clock;
+
+	VulkanBatchDevice* batch_device = devices[device];
+	batch_device->upload_scene(scene);
+
+	uint32_t completed_jobs = 0;
+	uint64_t completed_pixels = 0;
+	BatchOutput device_output = [&](const BatchJob& job, const uint8_t* pixels) {
+		completed_jobs++;
+		completed_pixels += get_pixels(job);
+		if (output) {
+			output(job, pixels);
+		}
+	};
+
+	clock::time_point measure_start = clock::now();
+	size_t first;
+	size_t count;
+	while (take_jobs(device, &first, &count)) {
+		for (size_t i = first; i < first + count; ++i) {
+			batch_device->render((*jobs)[i], device_output);
+		}
+
+		if (completed_jobs > 0) {
+			const clock::time_point now = clock::now();
+			update_throughput(device, completed_jobs, completed_pixels, std::chrono::duration<double>(now - measure_start).count());
+			completed_jobs = 0;
+			completed_pixels = 0;
+			measure_start = now;
+		}
+	}
+
+	batch_device->finish(device_output);
+	if (completed_jobs > 0) {
+		update_throughput(device, completed_jobs, completed_pixels, std::chrono::duration<double>(clock::now() - measure_start).count());
+	}
+}
+
+/**
+* Take the next chunk of jobs of a device
+* A measured device takes its share of the remaining pixels divided by BATCH_CHUNK_DIVISOR, at least one job,
+* the devices not measured yet count as fast as it
+*
+* @param first Index of the first job of the chunk
+* @param count Jobs of the chunk
+*
+* @return False when the device has no more jobs to render
+*/
+bool VulkanBatchRenderer::take_jobs(uint32_t device, size_t* first, size_t* count)
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+
+	*first = next_job;
+	*count = 0;
+	if (next_job >= jobs->size()) {
+		active_devices[device] = false;
+		active_count--;
+		return false;
+	}
+
+	const double throughput = statistics[device].throughput;
+	uint64_t target_pixels = 0;
+	if (throughput > 0.0) {
+		double total_throughput = 0.0;
+		for (uint32_t i = 0; i < devices.size(); ++i) {
+			if (active_devices[i]) {
+				total_throughput += statistics[i].throughput > 0.0 ? statistics[i].throughput : throughput;
+			}
+		}
+
+		// A slow device finishing its next job after the others finished the whole queue leaves them the job
+		const double remaining_time = remaining_pixels / total_throughput;
+		if (active_count > 1 && get_pixels((*jobs)[next_job]) / throughput > remaining_time) {
+			active_devices[device] = false;
+			active_count--;
+			return false;
+		}
+
+		target_pixels = static_cast<uint64_t>(remaining_pixels * (throughput / total_throughput) / BATCH_CHUNK_DIVISOR);
+	}
+
+	uint64_t pixels = 0;
+	do {
+		pixels += get_pixels((*jobs)[next_job]);
+		next_job++;
+		(*count)++;
+	} while (next_job < jobs->size() && pixels + get_pixels((*jobs)[next_job]) <= target_pixels);
+	remaining_pixels -= pixels;
+
+	return true;
+}
+
+void VulkanBatchRenderer::update_throughput(uint32_t device, uint32_t jobs, uint64_t pixels, double time)
+{
+	std::lock_guard<std::mutex> lock(queue_mutex);
+
+	BatchDeviceStatistics& device_statistics = statistics[device];
+	device_statistics.jobs += jobs;
+	device_statistics.pixels += pixels;
+	device_statistics.busy_time += time;
+	if (time <= 0.0) {
+		return;
+	}
+
+	const double measured = pixels / time;
+	if (device_statistics.throughput > 0.0) {
+		device_statistics.throughput += (measured - device_statistics.throughput) * BATCH_THROUGHPUT_SMOOTHING;
+	}
+	else {
+		device_statistics.throughput = measured;
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include "VulkanInstance.h"
+#include "VulkanBatchDevice.h"
+
+#include "VulkanTools.h"
+#include "../Framework/Properties.h"
+
+/* Share of its part of the remaining pixels a device takes at once, the chunks shrink as the queue empties */
+#define BATCH_CHUNK_DIVISOR				2
+/* Weight of the last measure in the throughput of a device */
+#define BATCH_THROUGHPUT_SMOOTHING		0.5
+
+struct BatchDeviceStatistics {
+	std::string name;
+	/** @brief Jobs and pixels rendered since the creation */
+	uint32_t jobs;
+	uint64_t pixels;
+	/** @brief Seconds spent rendering since the creation */
+	double busy_time;
+	/** @brief Measured pixels per second, 0 until a job of the device is complete */
+	double throughput;
+};
+
+/**
+* Offline rendering of frames or tiles on every physical device, for the turntables and the thumbnails
+*
+* Each physical device gets its own device context and thread, the scene is built once on the CPU
+* and shared read only, each device uploading its own copy of it
+* The jobs are taken from a shared queue by chunks proportional to the measured throughput of each device,
+* a device not measured yet takes a single job, and a device that would finish its next job after the
+* others finished all the remaining ones leaves them the last jobs
+*
+* The CPU devices are skipped unless there is no other device or they are included explicitly, several
+* lavapipe ICDs then act as several devices
+*/
+class VULKAN_RENDERER_API VulkanBatchRenderer
+{
+public:
+	VulkanBatchRenderer();
+	~VulkanBatchRenderer();
+
+	bool								create(uint32_t width, uint32_t height, bool include_cpu_devices = false);
+	void								shutdown();
+
+	uint32_t							add_mesh(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+	uint32_t							add_object(uint32_t mesh, const glm::mat4& transform, const glm::vec4& color);
+
+	void								render(const std::vector<BatchJob>& jobs, const BatchOutput& output);
+
+	void								make_turntable(uint32_t frames, float distance, float elevation, std::vector<BatchJob>& jobs) const;
+	static void							split_tiles(const std::vector<BatchJob>& jobs, uint32_t tile_size, std::vector<BatchJob>& tiles);
+
+	uint32_t							get_device_count() const { return static_cast<uint32_t>(devices.size()); };
+	const BatchDeviceStatistics&		get_statistics(uint32_t device) const { return statistics[device]; };
+
+private:
+	VulkanInstance						instance;
+	std::vector<VulkanBatchDevice*>		devices;
+	std::vector<BatchDeviceStatistics>	statistics;
+
+	uint32_t							width;
+	uint32_t							height;
+
+	/* scene being built, snapshotted into the shared scene by the next render */
+	std::vector<BatchMesh>				meshes;
+	std::vector<RenderObject>			objects;
+	std::shared_ptr<const BatchScene>	scene;
+	bool								scene_changed;
+
+	/* work queue of the current render, guarded by the mutex with the statistics */
+	std::mutex							queue_mutex;
+	const std::vector<BatchJob>*		jobs;
+	size_t								next_job;
+	uint64_t							remaining_pixels;
+	std::vector<bool>					active_devices;
+	uint32_t							active_count;
+
+	void								build_scene();
+	void								run_device(uint32_t device, const BatchOutput& output);
+	bool								take_jobs(uint32_t device, size_t* first, size_t* count);
+	void								update_throughput(uint32_t device, uint32_t jobs, uint64_t pixels, double time);
+
+	static uint64_t						get_pixels(const BatchJob& job) { return static_cast<uint64_t>(job.region.extent.width) * job.region.extent.height; };
+};
@@ -0,0 +1,346 @@
+#include "VulkanBindlessTable.h"
+
+VulkanBindlessTable::VulkanBindlessTable()
+	: device(nullptr)
+	, frames_count(0)
+	, frame(0)
+	, descriptor_set_layout(VK_NULL_HANDLE)
+	, descriptor_pool(VK_NULL_HANDLE)
+{
+}
+
+VulkanBindlessTable::~VulkanBindlessTable()
+{
+}
+
+/**
+* Check the descriptor indexing features the bindless descriptors rely on
+*
+* @param device Device
+*/
+bool VulkanBindlessTable::is_supported(const VulkanDevice& device)
+{
+	const VkPhysicalDeviceDescriptorIndexingFeaturesEXT& features = device.descriptor_indexing_features;
+	return features.shaderSampledImageArrayNonUniformIndexing &&
+		features.descriptorBindingSampledImageUpdateAfterBind &&
+		features.descriptorBindingStorageBufferUpdateAfterBind &&
+		features.descriptorBindingPartiallyBound &&
+		features.runtimeDescriptorArray;
+}
+
+bool VulkanBindlessTable::create(VulkanDevice* device, uint32_t frames_count)
+{
+	if (!is_supported(*device)) {
+		std::cout << "Descriptor indexing is not supported, bindless descriptors are disabled\n";
+		return false;
+	}
+
+	this->device = device;
+	this->frames_count = frames_count;
+	frame = 0;
+
+	// Clamp the arrays to the update after bind limits, every frame in flight holds a copy of them
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing_properties = {};
+	indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2 properties2 = {};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &indexing_properties;
+	vkGetPhysicalDeviceProperties2(device->physical_device, &properties2);
+
+	uint32_t texture_limit = std::min(std::min(
+		indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+		indexing_properties.maxDescriptorSetUpdateAfterBindSamplers),
+		std::min(indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers));
+	uint32_t buffer_limit = std::min(
+		indexing_properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+		indexing_properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers);
+	uint32_t pool_limit = indexing_properties.maxUpdateAfterBindDescriptorsInAllPools / std::max(frames_count, 1u);
+
+	slots[BINDLESS_RESOURCE_TEXTURE].capacity = std::min<uint32_t>(std::min<uint32_t>(BINDLESS_MAX_TEXTURES, texture_limit), pool_limit * 3 / 4);
+	slots[BINDLESS_RESOURCE_BUFFER].capacity = std::min<uint32_t>(std::min<uint32_t>(BINDLESS_MAX_BUFFERS, buffer_limit), pool_limit / 4);
+	for (auto& slot_array : slots) {
+		slot_array.next = 0;
+		slot_array.free_handles.clear();
+		slot_array.image_infos.assign(slot_array.capacity, {});
+		slot_array.buffer_infos.assign(slot_array.capacity, {});
+		slot_array.dirty_handles.assign(frames_count, {});
+	}
+	slots[BINDLESS_RESOURCE_BUFFER].image_infos.clear();
+	slots[BINDLESS_RESOURCE_TEXTURE].buffer_infos.clear();
+
+	// The arrays are partially bound, only the written handles may be read by the shaders
+	std::array<VkDescriptorSetLayoutBinding, 2> layout_bindings = {};
+	layout_bindings[0].binding = BINDLESS_BINDING_TEXTURES;
+	layout_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layout_bindings[0].descriptorCount = slots[BINDLESS_RESOURCE_TEXTURE].capacity;
+	layout_bindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+	layout_bindings[1].binding = BINDLESS_BINDING_BUFFERS;
+	layout_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layout_bindings[1].descriptorCount = slots[BINDLESS_RESOURCE_BUFFER].capacity;
+	layout_bindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+
+	VkDescriptorBindingFlagsEXT binding_flags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT;
+	if (device->descriptor_indexing_features.descriptorBindingUpdateUnusedWhilePending) {
+		binding_flags |= VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+	}
+	std::array<VkDescriptorBindingFlagsEXT, 2> layout_binding_flags = { binding_flags, binding_flags };
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_create_info = {};
+	binding_flags_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	binding_flags_create_info.bindingCount = static_cast<uint32_t>(layout_binding_flags.size());
+	binding_flags_create_info.pBindingFlags = layout_binding_flags.data();
+
+	VkDescriptorSetLayoutCreateInfo descriptor_layout = {};
+	descriptor_layout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptor_layout.pNext = &binding_flags_create_info;
+	descriptor_layout.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	descriptor_layout.bindingCount = static_cast<uint32_t>(layout_bindings.size());
+	descriptor_layout.pBindings = layout_bindings.data();
+
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*device, &descriptor_layout, nullptr, &descriptor_set_layout));
+
+	create_descriptor_sets();
+
+	return true;
+}
+
+void VulkanBindlessTable::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy bindless descriptors\n";
+	vkDestroyDescriptorPool(*device, descriptor_pool, nullptr);
+	vkDestroyDescriptorSetLayout(*device, descriptor_set_layout, nullptr);
+	descriptor_pool = VK_NULL_HANDLE;
+	descriptor_set_layout = VK_NULL_HANDLE;
+	descriptor_sets.clear();
+	retired.clear();
+
+	device = nullptr;
+}
+
+/**
+* Recreate the sets for a new count of frames in flight, the handles are kept
+* The device must be idle
+*
+* @param frames_count Count of frames in flight
+*/
+void VulkanBindlessTable::set_frames_count(uint32_t frames_count)
+{
+	if (device == nullptr || frames_count == this->frames_count) {
+		return;
+	}
+	this->frames_count = frames_count;
+
+	// No frame is in flight, the released handles can be recycled now
+	while (!retired.empty()) {
+		release(retired.front().type, retired.front().handle);
+		retired.pop_front();
+	}
+
+	vkDestroyDescriptorPool(*device, descriptor_pool, nullptr);
+	create_descriptor_sets();
+
+	// Every set is written again with the live descriptors
+	for (uint32_t type = 0; type < BINDLESS_RESOURCE_TYPES_COUNT; ++type) {
+		SlotArray& slot_array = slots[type];
+		slot_array.dirty_handles.assign(frames_count, {});
+		for (uint32_t handle = 0; handle < slot_array.next; ++handle) {
+			bool live = (type == BINDLESS_RESOURCE_TEXTURE) ?
+				slot_array.image_infos[handle].imageView != VK_NULL_HANDLE :
+				slot_array.buffer_infos[handle].buffer != VK_NULL_HANDLE;
+			if (live) {
+				mark_dirty(static_cast<BindlessResourceType>(type), handle);
+			}
+		}
+	}
+}
+
+void VulkanBindlessTable::create_descriptor_sets()
+{
+	std::array<VkDescriptorPoolSize, 2> pool_sizes;
+	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes[0].descriptorCount = slots[BINDLESS_RESOURCE_TEXTURE].capacity * frames_count;
+	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	pool_sizes[1].descriptorCount = slots[BINDLESS_RESOURCE_BUFFER].capacity * frames_count;
+
+	VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
+	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptor_pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	descriptor_pool_create_info.maxSets = frames_count;
+	descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	descriptor_pool_create_info.pPoolSizes = pool_sizes.data();
+
+	VK_CHECK_RESULT(vkCreateDescriptorPool(*device, &descriptor_pool_create_info, nullptr, &descriptor_pool));
+
+	std::vector<VkDescriptorSetLayout> layouts(frames_count, descriptor_set_layout);
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = descriptor_pool;
+	alloc_info.descriptorSetCount = frames_count;
+	alloc_info.pSetLayouts = layouts.data();
+
+	descriptor_sets.resize(frames_count);
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(*device, &alloc_info, descriptor_sets.data()));
+}
+
+/**
+* Add a texture to the table
+*
+* @param view Image view, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when sampled
+* @param sampler Sampler
+* @return Handle of the texture, BINDLESS_INVALID_HANDLE when the table is full
+*/
+uint32_t VulkanBindlessTable::add_texture(VkImageView view, VkSampler sampler)
+{
+	uint32_t handle = allocate(BINDLESS_RESOURCE_TEXTURE);
+	if (handle != BINDLESS_INVALID_HANDLE) {
+		set_texture(handle, view, sampler);
+	}
+	return handle;
+}
+
+/**
+* Replace the texture of a handle, the frames in flight keep reading the previous one
+*
+* @param handle Handle of the texture
+* @param view Image view
+* @param sampler Sampler
+*/
+void VulkanBindlessTable::set_texture(uint32_t handle, VkImageView view, VkSampler sampler)
+{
+	VkDescriptorImageInfo& image_info = slots[BINDLESS_RESOURCE_TEXTURE].image_infos[handle];
+	image_info.sampler = sampler;
+	image_info.imageView = view;
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	mark_dirty(BINDLESS_RESOURCE_TEXTURE, handle);
+}
+
+/**
+* Add a storage buffer to the table
+*
+* @param buffer_info Buffer range
+* @return Handle of the buffer, BINDLESS_INVALID_HANDLE when the table is full
+*/
+uint32_t VulkanBindlessTable::add_buffer(const VkDescriptorBufferInfo& buffer_info)
+{
+	uint32_t handle = allocate(BINDLESS_RESOURCE_BUFFER);
+	if (handle != BINDLESS_INVALID_HANDLE) {
+		set_buffer(handle, buffer_info);
+	}
+	return handle;
+}
+
+void VulkanBindlessTable::set_buffer(uint32_t handle, const VkDescriptorBufferInfo& buffer_info)
+{
+	slots[BINDLESS_RESOURCE_BUFFER].buffer_infos[handle] = buffer_info;
+	mark_dirty(BINDLESS_RESOURCE_BUFFER, handle);
+}
+
+/**
+* Release a handle, it is handed out again once the frames in flight are complete
+* The resource must stay alive until then
+*
+* @param type Type of the resource
+* @param handle Handle of the resource
+*/
+void VulkanBindlessTable::remove(BindlessResourceType type, uint32_t handle)
+{
+	if (handle == BINDLESS_INVALID_HANDLE) {
+		return;
+	}
+
+	RetiredHandle retired_handle = {};
+	retired_handle.frame = frame;
+	retired_handle.type = type;
+	retired_handle.handle = handle;
+	retired.push_back(retired_handle);
+}
+
+/**
+* Write the descriptors changed since the last update of a frame in its set
+* and recycle the handles no frame in flight reads anymore
+*
+* @param frame_index Index of the frame in flight, its previous submission is complete
+*/
+void VulkanBindlessTable::update(uint32_t frame_index)
+{
+	frame++;
+
+	while (!retired.empty() && retired.front().frame + frames_count < frame) {
+		release(retired.front().type, retired.front().handle);
+		retired.pop_front();
+	}
+
+	std::vector<VkWriteDescriptorSet> write_descriptor_sets;
+	for (uint32_t type = 0; type < BINDLESS_RESOURCE_TYPES_COUNT; ++type) {
+		SlotArray& slot_array = slots[type];
+		std::vector<uint32_t>& dirty_handles = slot_array.dirty_handles[frame_index];
+
+		// Handles written several times are only written once
+		std::sort(dirty_handles.begin(), dirty_handles.end());
+		dirty_handles.erase(std::unique(dirty_handles.begin(), dirty_handles.end()), dirty_handles.end());
+
+		for (auto handle : dirty_handles) {
+			VkWriteDescriptorSet write_descriptor_set = {};
+			write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			write_descriptor_set.dstSet = descriptor_sets[frame_index];
+			write_descriptor_set.dstArrayElement = handle;
+			write_descriptor_set.descriptorCount = 1;
+			if (type == BINDLESS_RESOURCE_TEXTURE) {
+				write_descriptor_set.dstBinding = BINDLESS_BINDING_TEXTURES;
+				write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				write_descriptor_set.pImageInfo = &slot_array.image_infos[handle];
+			}
+			else {
+				write_descriptor_set.dstBinding = BINDLESS_BINDING_BUFFERS;
+				write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				write_descriptor_set.pBufferInfo = &slot_array.buffer_infos[handle];
+			}
+			write_descriptor_sets.push_back(write_descriptor_set);
+		}
+		dirty_handles.clear();
+	}
+
+	if (!write_descriptor_sets.empty()) {
+		vkUpdateDescriptorSets(*device, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+	}
+}
+
+uint32_t VulkanBindlessTable::allocate(BindlessResourceType type)
+{
+	SlotArray& slot_array = slots[type];
+	if (!slot_array.free_handles.empty()) {
+		uint32_t handle = slot_array.free_handles.back();
+		slot_array.free_handles.pop_back();
+		return handle;
+	}
+	if (slot_array.next < slot_array.capacity) {
+		return slot_array.next++;
+	}
+
+	std::cout << "Bindless descriptor table is full\n";
+	return BINDLESS_INVALID_HANDLE;
+}
+
+void VulkanBindlessTable::release(BindlessResourceType type, uint32_t handle)
+{
+	SlotArray& slot_array = slots[type];
+	if (type == BINDLESS_RESOURCE_TEXTURE) {
+		slot_array.image_infos[handle] = {};
+	}
+	else {
+		slot_array.buffer_infos[handle] = {};
+	}
+	slot_array.free_handles.push_back(handle);
+}
+
+void VulkanBindlessTable::mark_dirty(BindlessResourceType type, uint32_t handle)
+{
+	for (auto& dirty_handles : slots[type].dirty_handles) {
+		dirty_handles.push_back(handle);
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <iostream>
+#include <array>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+
+#define BINDLESS_MAX_TEXTURES			16384
+#define BINDLESS_MAX_BUFFERS			4096
+
+/* Bindings of the arrays in the bindless descriptor set */
+#define BINDLESS_BINDING_TEXTURES		0
+#define BINDLESS_BINDING_BUFFERS		1
+
+#define BINDLESS_INVALID_HANDLE			0xFFFFFFFF
+
+enum BindlessResourceType {
+	BINDLESS_RESOURCE_TEXTURE,
+	BINDLESS_RESOURCE_BUFFER,
+	BINDLESS_RESOURCE_TYPES_COUNT
+};
+
+/**
+* Bindless descriptors on top of VK_EXT_descriptor_indexing
+*
+* Textures and storage buffers are written once in large partially bound arrays and addressed
+* in the shaders by a stable integer handle, so that the draws only differ by the handles they read:
+*
+*   layout (set = 1, binding = 0) uniform sampler2D textures[];
+*   texture(textures[nonuniformEXT(handle)], uv);
+*
+* Each frame in flight owns a copy of the set, a write is applied to the copy of a frame when
+* the frame is recorded so that the descriptors read by the pending frames are never modified
+* The handles released are only handed out again once every frame that may read them is complete
+*/
+class VulkanBindlessTable
+{
+public:
+	VulkanBindlessTable();
+	~VulkanBindlessTable();
+
+	static bool							is_supported(const VulkanDevice& device);
+
+	bool								create(VulkanDevice* device, uint32_t frames_count);
+	void								shutdown();
+	void								set_frames_count(uint32_t frames_count);
+
+	uint32_t							add_texture(VkImageView view, VkSampler sampler);
+	void								set_texture(uint32_t handle, VkImageView view, VkSampler sampler);
+	uint32_t							add_buffer(const VkDescriptorBufferInfo& buffer_info);
+	void								set_buffer(uint32_t handle, const VkDescriptorBufferInfo& buffer_info);
+	void								remove(BindlessResourceType type, uint32_t handle);
+
+	void								update(uint32_t frame_index);
+
+	bool								is_created() const { return device != nullptr; };
+	VkDescriptorSetLayout				get_layout() const { return descriptor_set_layout; };
+	VkDescriptorSet						get_descriptor_set(uint32_t frame_index) const { return descriptor_sets[frame_index]; };
+	uint32_t							get_capacity(BindlessResourceType type) const { return slots[type].capacity; };
+
+private:
+	/* free list of the handles of one array, the descriptors written since each frame last updated its set */
+	struct SlotArray {
+		uint32_t capacity;
+		uint32_t next;
+		std::vector<uint32_t> free_handles;
+		std::vector<VkDescriptorImageInfo> image_infos;
+		std::vector<VkDescriptorBufferInfo> buffer_infos;
+		std::vector<std::vector<uint32_t>> dirty_handles;
+	};
+
+	struct RetiredHandle {
+		uint64_t frame;
+		BindlessResourceType type;
+		uint32_t handle;
+	};
+
+	VulkanDevice*						device;
+	uint32_t							frames_count;
+	uint64_t							frame;
+
+	VkDescriptorSetLayout				descriptor_set_layout;
+	VkDescriptorPool					descriptor_pool;
+	std::vector<VkDescriptorSet>		descriptor_sets;
+
+	SlotArray							slots[BINDLESS_RESOURCE_TYPES_COUNT];
+	std::deque<RetiredHandle>			retired;
+
+	void								create_descriptor_sets();
+	uint32_t							allocate(BindlessResourceType type);
+	void								release(BindlessResourceType type, uint32_t handle);
+	void								mark_dirty(BindlessResourceType type, uint32_t handle);
+};
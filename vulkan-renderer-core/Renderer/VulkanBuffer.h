@@ -0,0 +1,11 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+struct VulkanBuffer {
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	VkDescriptorBufferInfo buffer_info;
+	VkDeviceSize size;
+	void* mapped;
+};
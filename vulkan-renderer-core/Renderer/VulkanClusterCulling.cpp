@@ -0,0 +1,368 @@
+#include "VulkanClusterCulling.h"
+
+/* Size of the dispatch arguments ahead of the late meshlets */
+#define LATE_MESHLETS_HEADER_SIZE		(4 * sizeof(uint32_t))
+/* Size of a late meshlet entry (batch, meshlet, instance, padding) */
+#define LATE_MESHLET_SIZE				(4 * sizeof(uint32_t))
+
+/* Extract the view space frustum planes (xyz normal pointing inside, w distance) of a projection matrix */
+static void get_frustum_planes(const glm::mat4& projection, glm::vec4 planes[6])
+{
+	glm::vec4 rows[4];
+	for (uint32_t i = 0; i < 4; ++i) {
+		rows[i] = glm::vec4(projection[0][i], projection[1][i], projection[2][i], projection[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+	for (uint32_t i = 0; i < 6; ++i) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+VulkanClusterCulling::VulkanClusterCulling()
+	: cone_culling(false)
+	, occlusion_culling(true)
+	, device(nullptr)
+	, descriptor_set_layout(VK_NULL_HANDLE)
+	, descriptor_pool(VK_NULL_HANDLE)
+	, pipeline_layout(VK_NULL_HANDLE)
+	, pipeline(VK_NULL_HANDLE)
+	, pyramid_view(1.0f)
+{
+}
+
+VulkanClusterCulling::~VulkanClusterCulling()
+{
+}
+
+bool VulkanClusterCulling::create(VulkanDevice* device, uint32_t frames_count)
+{
+	this->device = device;
+
+	create_descriptor_set_layout();
+	create_descriptor_pool(frames_count);
+	create_pipeline();
+
+	std::vector<VkDescriptorSetLayout> layouts(frames_count, descriptor_set_layout);
+	std::vector<VkDescriptorSet> descriptor_sets(frames_count);
+
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = descriptor_pool;
+	alloc_info.descriptorSetCount = frames_count;
+	alloc_info.pSetLayouts = layouts.data();
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(*device, &alloc_info, descriptor_sets.data()));
+
+	frames.resize(frames_count);
+	for (uint32_t i = 0; i < frames_count; ++i) {
+		frames[i] = {};
+		frames[i].descriptor_set = descriptor_sets[i];
+		device->create_buffer(
+			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			sizeof(CullData),
+			&frames[i].cull_data);
+	}
+
+	return true;
+}
+
+void VulkanClusterCulling::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy cluster culling\n";
+	for (auto& frame : frames) {
+		device->destroy_buffer(&frame.cull_data);
+		device->destroy_buffer(&frame.batches);
+		device->destroy_buffer(&frame.draw_commands);
+		device->destroy_buffer(&frame.draw_counts);
+		device->destroy_buffer(&frame.late_meshlets);
+	}
+	frames.clear();
+
+	vkDestroyPipeline(*device, pipeline, nullptr);
+	vkDestroyPipelineLayout(*device, pipeline_layout, nullptr);
+	vkDestroyDescriptorPool(*device, descriptor_pool, nullptr);
+	vkDestroyDescriptorSetLayout(*device, descriptor_set_layout, nullptr);
+	pipeline = VK_NULL_HANDLE;
+	pipeline_layout = VK_NULL_HANDLE;
+	descriptor_pool = VK_NULL_HANDLE;
+	descriptor_set_layout = VK_NULL_HANDLE;
+
+	device = nullptr;
+}
+
+/**
+* Record the early culling of the meshlets of the batches
+* Must be recorded outside of a render pass, before the draws of get_draw
+* The draws and the late phase must wait for the compute writes of the culling
+*
+* @param command_buffer Command buffer of the frame
+* @param frame_index Index of the frame in flight
+* @param batches Instanced batches of the frame
+* @param mesh_cache Meshes of the batches
+* @param instance_buffer Instance stream of the frame
+* @param view View matrix, including the scene transform
+* @param projection Projection matrix
+* @param z_near Distance of the near plane of the projection
+* @param depth_pyramid Depth pyramid, rebuilt between the early and the late phases
+*/
+void VulkanClusterCulling::cull_early(VkCommandBuffer command_buffer, uint32_t frame_index, const std::vector<InstanceBatch>& batches, const VulkanMeshCache& mesh_cache, VkBuffer instance_buffer, const glm::mat4& view, const glm::mat4& projection, float z_near, const VulkanDepthPyramid& depth_pyramid)
+{
+	CullFrame& frame = frames[frame_index];
+
+	// Each batch owns instance_count * meshlet_count draw commands and one draw count per phase,
+	// the late commands and counts follow the early ones
+	std::vector<CullBatch> cull_batches(batches.size());
+	draws.resize(batches.size());
+	late_draws.resize(batches.size());
+
+	uint32_t draw_count = 0;
+	for (uint32_t i = 0; i < batches.size(); ++i) {
+		const VulkanMesh& mesh = mesh_cache.get(batches[i].mesh);
+		const VulkanMeshLod& lod = mesh.lods[batches[i].lod];
+
+		cull_batches[i] = {};
+		cull_batches[i].transform = batches[i].transform;
+		cull_batches[i].bounding_sphere = mesh.bounding_sphere;
+		cull_batches[i].first_instance = batches[i].first_instance;
+		cull_batches[i].instance_count = batches[i].instance_count;
+		cull_batches[i].first_meshlet = lod.first_meshlet;
+		cull_batches[i].meshlet_count = lod.meshlet_count;
+		cull_batches[i].first_draw = draw_count;
+
+		draws[i].indirect_offset = draw_count * sizeof(VkDrawIndexedIndirectCommand);
+		draws[i].count_offset = i * sizeof(uint32_t);
+		draws[i].max_draw_count = batches[i].instance_count * lod.meshlet_count;
+		draw_count += draws[i].max_draw_count;
+	}
+
+	for (uint32_t i = 0; i < batches.size(); ++i) {
+		late_draws[i] = draws[i];
+		late_draws[i].indirect_offset += draw_count * sizeof(VkDrawIndexedIndirectCommand);
+		late_draws[i].count_offset += batches.size() * sizeof(uint32_t);
+		if (!occlusion_culling) {
+			late_draws[i].max_draw_count = 0;
+		}
+	}
+
+	if (draw_count == 0 || mesh_cache.get_meshlet_buffer().buffer == VK_NULL_HANDLE) {
+		for (uint32_t i = 0; i < batches.size(); ++i) {
+			draws[i].max_draw_count = 0;
+			late_draws[i].max_draw_count = 0;
+		}
+		return;
+	}
+
+	const VkBufferUsageFlags gpu_usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+	reserve(frame.batches, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cull_batches.size() * sizeof(CullBatch));
+	reserve(frame.draw_commands, gpu_usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 2 * draw_count * sizeof(VkDrawIndexedIndirectCommand));
+	reserve(frame.draw_counts, gpu_usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 2 * batches.size() * sizeof(uint32_t));
+	reserve(frame.late_meshlets, gpu_usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, LATE_MESHLETS_HEADER_SIZE + draw_count * LATE_MESHLET_SIZE);
+
+	VkBuffer count_buffer = device->cmd_draw_indexed_indirect_count != nullptr ? frame.draw_counts.buffer : VK_NULL_HANDLE;
+	for (uint32_t i = 0; i < batches.size(); ++i) {
+		draws[i].indirect_buffer = frame.draw_commands.buffer;
+		draws[i].count_buffer = count_buffer;
+		late_draws[i].indirect_buffer = frame.draw_commands.buffer;
+		late_draws[i].count_buffer = count_buffer;
+	}
+
+	memcpy(frame.batches.mapped, cull_batches.data(), cull_batches.size() * sizeof(CullBatch));
+
+	CullData cull_data = {};
+	cull_data.view = view;
+	cull_data.pyramid_view = pyramid_view;
+	cull_data.projection = projection;
+	get_frustum_planes(projection, cull_data.frustum);
+	cull_data.cone_culling = cone_culling ? 1 : 0;
+	cull_data.occlusion_culling = occlusion_culling ? 1 : 0;
+	cull_data.pyramid_valid = depth_pyramid.is_valid() ? 1 : 0;
+	cull_data.z_near = z_near;
+	cull_data.draw_count = draw_count;
+	cull_data.batch_count = static_cast<uint32_t>(batches.size());
+	memcpy(frame.cull_data.mapped, &cull_data, sizeof(cull_data));
+
+	// The pyramid built after the early phase is seen from the current view
+	pyramid_view = view;
+
+	update_descriptor_set(frame, mesh_cache, instance_buffer, depth_pyramid);
+
+	// Reset the draw counts, the late dispatch, and the commands when they are drawn without a count
+	const uint32_t late_dispatch[4] = { 0, 1, 1, 0 };
+	vkCmdFillBuffer(command_buffer, frame.draw_counts.buffer, 0, VK_WHOLE_SIZE, 0);
+	vkCmdUpdateBuffer(command_buffer, frame.late_meshlets.buffer, 0, sizeof(late_dispatch), late_dispatch);
+	if (count_buffer == VK_NULL_HANDLE) {
+		vkCmdFillBuffer(command_buffer, frame.draw_commands.buffer, 0, VK_WHOLE_SIZE, 0);
+	}
+
+	VkMemoryBarrier memory_barrier = {};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &frame.descriptor_set, 0, nullptr);
+
+	// One invocation per meshlet along x, one row of groups per instance along y
+	for (uint32_t i = 0; i < cull_batches.size(); ++i) {
+		if (cull_batches[i].instance_count == 0 || cull_batches[i].meshlet_count == 0) {
+			continue;
+		}
+		CullPhase phase = { i, CLUSTER_CULL_PHASE_EARLY };
+		vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPhase), &phase);
+		vkCmdDispatch(command_buffer, (cull_batches[i].meshlet_count + CLUSTER_CULL_GROUP_SIZE - 1) / CLUSTER_CULL_GROUP_SIZE, cull_batches[i].instance_count, 1);
+	}
+}
+
+/**
+* Record the late culling of the meshlets occluded in the early phase
+* Must be recorded after the depth pyramid was rebuilt, before the draws of get_late_draw
+* The late draws must wait for the compute writes of the culling
+*
+* @param command_buffer Command buffer of the frame
+* @param frame_index Index of the frame in flight
+*/
+void VulkanClusterCulling::cull_late(VkCommandBuffer command_buffer, uint32_t frame_index)
+{
+	CullFrame& frame = frames[frame_index];
+	if (!occlusion_culling || frame.late_meshlets.buffer == VK_NULL_HANDLE || draws.empty()) {
+		return;
+	}
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &frame.descriptor_set, 0, nullptr);
+
+	CullPhase phase = { 0, CLUSTER_CULL_PHASE_LATE };
+	vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPhase), &phase);
+	vkCmdDispatchIndirect(command_buffer, frame.late_meshlets.buffer, 0);
+}
+
+void VulkanClusterCulling::create_descriptor_set_layout()
+{
+	// 0: cull data, 1: meshlets, 2: instances, 3: batches, 4: draw commands, 5: draw counts,
+	// 6: late meshlets, 7: depth pyramid
+	std::array<VkDescriptorSetLayoutBinding, 8> layout_bindings = {};
+	for (uint32_t i = 0; i < layout_bindings.size(); ++i) {
+		layout_bindings[i].binding = i;
+		layout_bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		layout_bindings[i].descriptorCount = 1;
+		layout_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		layout_bindings[i].pImmutableSamplers = nullptr;
+	}
+	layout_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	layout_bindings[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	VkDescriptorSetLayoutCreateInfo descriptor_layout = {};
+	descriptor_layout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptor_layout.bindingCount = static_cast<uint32_t>(layout_bindings.size());
+	descriptor_layout.pBindings = layout_bindings.data();
+
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*device, &descriptor_layout, nullptr, &descriptor_set_layout));
+}
+
+void VulkanClusterCulling::create_descriptor_pool(uint32_t frames_count)
+{
+	std::array<VkDescriptorPoolSize, 3> type_counts;
+	type_counts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	type_counts[0].descriptorCount = frames_count;
+	type_counts[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	type_counts[1].descriptorCount = 6 * frames_count;
+	type_counts[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	type_counts[2].descriptorCount = frames_count;
+
+	VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
+	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptor_pool_create_info.maxSets = frames_count;
+	descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(type_counts.size());
+	descriptor_pool_create_info.pPoolSizes = type_counts.data();
+
+	VK_CHECK_RESULT(vkCreateDescriptorPool(*device, &descriptor_pool_create_info, nullptr, &descriptor_pool));
+}
+
+void VulkanClusterCulling::create_pipeline()
+{
+	VkPushConstantRange push_constant_range = {};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(CullPhase);
+
+	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {};
+	pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_create_info.setLayoutCount = 1;
+	pipeline_layout_create_info.pSetLayouts = &descriptor_set_layout;
+	pipeline_layout_create_info.pushConstantRangeCount = 1;
+	pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
+
+	VK_CHECK_RESULT(vkCreatePipelineLayout(*device, &pipeline_layout_create_info, nullptr, &pipeline_layout));
+
+	VkComputePipelineCreateInfo pipeline_create_info = {};
+	pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_create_info.layout = pipeline_layout;
+	pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_create_info.stage.pName = "main";
+	pipeline_create_info.stage.module = shader_loader.load(*device, "D:\\Documents\\Vulkan\\Projects\\vulkan-renderer\\vulkan-renderer-core\\Data\\shaders\\cluster_cull.comp.spv");
+
+	VK_CHECK_RESULT(vkCreateComputePipelines(*device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &pipeline));
+
+	vkDestroyShaderModule(*device, pipeline_create_info.stage.module, nullptr);
+}
+
+void VulkanClusterCulling::reserve(VulkanBuffer& buffer, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkDeviceSize size)
+{
+	if (buffer.buffer != VK_NULL_HANDLE && buffer.size >= size) {
+		return;
+	}
+
+	VkDeviceSize capacity = std::max<VkDeviceSize>(size, buffer.size * 2);
+	device->destroy_buffer(&buffer);
+	device->create_buffer(usage, memory_properties, capacity, &buffer);
+}
+
+/**
+* Point the descriptor set of the frame to its buffers
+* The instance and draw buffers may have been reallocated since the previous frame
+*/
+void VulkanClusterCulling::update_descriptor_set(CullFrame& frame, const VulkanMeshCache& mesh_cache, VkBuffer instance_buffer, const VulkanDepthPyramid& depth_pyramid)
+{
+	std::array<VkDescriptorBufferInfo, 7> buffer_infos;
+	buffer_infos[0] = frame.cull_data.buffer_info;
+	buffer_infos[1] = mesh_cache.get_meshlet_buffer().buffer_info;
+	buffer_infos[2] = { instance_buffer, 0, VK_WHOLE_SIZE };
+	buffer_infos[3] = frame.batches.buffer_info;
+	buffer_infos[4] = frame.draw_commands.buffer_info;
+	buffer_infos[5] = frame.draw_counts.buffer_info;
+	buffer_infos[6] = frame.late_meshlets.buffer_info;
+
+	VkDescriptorImageInfo image_info = {};
+	image_info.sampler = depth_pyramid.get_sampler();
+	image_info.imageView = depth_pyramid.get_view();
+	image_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	std::array<VkWriteDescriptorSet, 8> write_descriptor_sets = {};
+	for (uint32_t i = 0; i < write_descriptor_sets.size(); ++i) {
+		write_descriptor_sets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write_descriptor_sets[i].dstSet = frame.descriptor_set;
+		write_descriptor_sets[i].dstBinding = i;
+		write_descriptor_sets[i].dstArrayElement = 0;
+		write_descriptor_sets[i].descriptorCount = 1;
+		if (i < buffer_infos.size()) {
+			write_descriptor_sets[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write_descriptor_sets[i].pBufferInfo = &buffer_infos[i];
+		}
+	}
+	write_descriptor_sets[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write_descriptor_sets[7].pImageInfo = &image_info;
+
+	vkUpdateDescriptorSets(*device, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+}
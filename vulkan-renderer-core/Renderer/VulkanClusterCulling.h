@@ -0,0 +1,127 @@
+#pragma once
+
+#include <iostream>
+#include <array>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "VulkanTools.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanShader.h"
+#include "VulkanMesh.h"
+#include "VulkanInstancing.h"
+#include "VulkanDepthPyramid.h"
+
+#define CLUSTER_CULL_GROUP_SIZE			64
+
+/* Phases of cluster_cull.comp */
+#define CLUSTER_CULL_PHASE_EARLY		0
+#define CLUSTER_CULL_PHASE_LATE			1
+
+/** @brief Indirect draw of the visible meshlets of a batch */
+struct ClusterDraw {
+	VkBuffer indirect_buffer;
+	VkDeviceSize indirect_offset;
+	VkBuffer count_buffer;
+	VkDeviceSize count_offset;
+	uint32_t max_draw_count;
+};
+
+/**
+* GPU culling of the meshlets of every instance against the view frustum,
+* the depth pyramid and, for single sided geometry, the meshlet normal cones
+* The visible meshlets of each batch are compacted into indirect draw commands
+*
+* Occlusion culling runs in two phases
+* - early: object and meshlet bounds are tested against the pyramid of the previous frame,
+*   the occluded meshlets are kept for the late phase
+* - late: once the early draws are in the depth buffer and the pyramid is rebuilt,
+*   the meshlets occluded in the early phase are tested again and the falsely culled ones drawn
+*/
+class VulkanClusterCulling
+{
+public:
+	VulkanClusterCulling();
+	~VulkanClusterCulling();
+
+	bool							create(VulkanDevice* device, uint32_t frames_count);
+	void							shutdown();
+
+	void							cull_early(VkCommandBuffer command_buffer, uint32_t frame_index, const std::vector<InstanceBatch>& batches, const VulkanMeshCache& mesh_cache, VkBuffer instance_buffer, const glm::mat4& view, const glm::mat4& projection, float z_near, const VulkanDepthPyramid& depth_pyramid);
+	void							cull_late(VkCommandBuffer command_buffer, uint32_t frame_index);
+
+	const ClusterDraw&				get_draw(uint32_t batch) const { return draws[batch]; };
+	const ClusterDraw&				get_late_draw(uint32_t batch) const { return late_draws[batch]; };
+
+	/** @brief Cull the back facing meshlets, only valid when back faces are not rendered */
+	bool							cone_culling;
+	/** @brief Cull the meshlets hidden in the depth pyramid */
+	bool							occlusion_culling;
+
+private:
+	/* std140 layout of the CullData uniform block of cluster_cull.comp */
+	struct CullData {
+		glm::mat4 view;
+		glm::mat4 pyramid_view;
+		glm::mat4 projection;
+		glm::vec4 frustum[6];
+		uint32_t cone_culling;
+		uint32_t occlusion_culling;
+		uint32_t pyramid_valid;
+		float z_near;
+		uint32_t draw_count;
+		uint32_t batch_count;
+	};
+
+	/* std430 layout of the Batch structure of cluster_cull.comp */
+	struct CullBatch {
+		glm::mat4 transform;
+		glm::vec4 bounding_sphere;
+		uint32_t first_instance;
+		uint32_t instance_count;
+		uint32_t first_meshlet;
+		uint32_t meshlet_count;
+		uint32_t first_draw;
+		uint32_t padding[3];
+	};
+
+	/* push constants of cluster_cull.comp */
+	struct CullPhase {
+		uint32_t batch;
+		uint32_t phase;
+	};
+
+	struct CullFrame {
+		VulkanBuffer cull_data;
+		VulkanBuffer batches;
+		VulkanBuffer draw_commands;
+		VulkanBuffer draw_counts;
+		/* dispatch arguments of the late phase followed by the meshlets to test again */
+		VulkanBuffer late_meshlets;
+		VkDescriptorSet descriptor_set;
+	};
+
+	VulkanDevice*					device;
+	VulkanShader					shader_loader;
+
+	VkDescriptorSetLayout			descriptor_set_layout;
+	VkDescriptorPool				descriptor_pool;
+	VkPipelineLayout				pipeline_layout;
+	VkPipeline						pipeline;
+
+	std::vector<CullFrame>			frames;
+	std::vector<ClusterDraw>		draws;
+	std::vector<ClusterDraw>		late_draws;
+
+	/* view the depth pyramid was built with */
+	glm::mat4						pyramid_view;
+
+	void							create_descriptor_set_layout();
+	void							create_descriptor_pool(uint32_t frames_count);
+	void							create_pipeline();
+	void							reserve(VulkanBuffer& buffer, VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkDeviceSize size);
+	void							update_descriptor_set(CullFrame& frame, const VulkanMeshCache& mesh_cache, VkBuffer instance_buffer, const VulkanDepthPyramid& depth_pyramid);
+};
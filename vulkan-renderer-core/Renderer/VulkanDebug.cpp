@@ -0,0 +1,305 @@
+#include "VulkanDebug.h"
+
+#include "../Framework/Properties.h"
+
+VulkanDebug::VulkanDebug()
+	: instance(VK_NULL_HANDLE)
+	, settings(get_default_settings())
+	, messenger(VK_NULL_HANDLE)
+	, create_debug_utils_messenger(nullptr)
+	, destroy_debug_utils_messenger(nullptr)
+	, set_debug_utils_object_name(nullptr)
+	, cmd_begin_debug_utils_label(nullptr)
+	, cmd_end_debug_utils_label(nullptr)
+	, cmd_insert_debug_utils_label(nullptr)
+	, window_messages(0)
+	, window_suppressed(0)
+	, statistics({})
+{
+}
+
+VulkanDebug::~VulkanDebug()
+{
+}
+
+DebugSettings VulkanDebug::get_default_settings()
+{
+	DebugSettings settings = {};
+	settings.level = DEFAULT_DEBUG_LEVEL;
+	settings.severity = DEFAULT_DEBUG_SEVERITY;
+	settings.max_repeats = DEBUG_MAX_REPEATS;
+	settings.max_messages_per_second = DEBUG_MAX_MESSAGES_PER_SECOND;
+	return settings;
+}
+
+/**
+* Add the layers and the extensions of the debug level to the ones of the instance
+* The Khronos validation layer is preferred to the deprecated LunarG meta layer, the level is lowered when none is installed
+*
+* @return False when no debugging is requested or VK_EXT_debug_utils is not supported, nothing is added then
+*/
+bool VulkanDebug::configure(const DebugSettings& settings, std::vector<const char*>& layers, std::vector<const char*>& extensions)
+{
+	this->settings = settings;
+	if (settings.level == DEBUG_LEVEL_NONE) {
+		return false;
+	}
+
+	uint32_t layers_count = 0;
+	VK_CHECK_RESULT(vkEnumerateInstanceLayerProperties(&layers_count, nullptr));
+	std::vector<VkLayerProperties> available_layers(layers_count);
+	VK_CHECK_RESULT(vkEnumerateInstanceLayerProperties(&layers_count, available_layers.data()));
+
+	const char* validation_layer = nullptr;
+	if (settings.level == DEBUG_LEVEL_VALIDATION) {
+		if (has_layer(available_layers, "VK_LAYER_KHRONOS_validation")) {
+			validation_layer = "VK_LAYER_KHRONOS_validation";
+		}
+		else if (has_layer(available_layers, "VK_LAYER_LUNARG_standard_validation")) {
+			validation_layer = "VK_LAYER_LUNARG_standard_validation";
+		}
+		else {
+			std::cout << "No validation layer is installed, only the debug labels are enabled\n";
+			this->settings.level = DEBUG_LEVEL_LABELS;
+		}
+	}
+
+	// The extension is implemented by the loader or by the validation layer
+	bool debug_utils = has_extension(nullptr, VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	if (!debug_utils && validation_layer != nullptr) {
+		debug_utils = has_extension(validation_layer, VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	}
+	if (!debug_utils) {
+		std::cout << "VK_EXT_debug_utils is not supported, debugging is disabled\n";
+		return false;
+	}
+
+	if (validation_layer != nullptr) {
+		layers.push_back(validation_layer);
+	}
+	extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+	return true;
+}
+
+/**
+* Load the functions of VK_EXT_debug_utils and register the messenger, on an instance created with the configured extensions
+*/
+bool VulkanDebug::create(VkInstance instance)
+{
+	this->instance = instance;
+
+	create_debug_utils_messenger = reinterpret_cast<PFN_vkCreateDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT"));
+	destroy_debug_utils_messenger = reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT"));
+	set_debug_utils_object_name = reinterpret_cast<PFN_vkSetDebugUtilsObjectNameEXT>(vkGetInstanceProcAddr(instance, "vkSetDebugUtilsObjectNameEXT"));
+	cmd_begin_debug_utils_label = reinterpret_cast<PFN_vkCmdBeginDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdBeginDebugUtilsLabelEXT"));
+	cmd_end_debug_utils_label = reinterpret_cast<PFN_vkCmdEndDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdEndDebugUtilsLabelEXT"));
+	cmd_insert_debug_utils_label = reinterpret_cast<PFN_vkCmdInsertDebugUtilsLabelEXT>(vkGetInstanceProcAddr(instance, "vkCmdInsertDebugUtilsLabelEXT"));
+	if (create_debug_utils_messenger == nullptr || set_debug_utils_object_name == nullptr || cmd_begin_debug_utils_label == nullptr) {
+		return false;
+	}
+
+	window_start = clock::now();
+
+	VkDebugUtilsMessengerCreateInfoEXT messenger_create_info = {};
+	messenger_create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+	messenger_create_info.messageSeverity = get_severity_mask(settings.severity);
+	messenger_create_info.messageType =
+		VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+		VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+		VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+	messenger_create_info.pfnUserCallback = messenger_callback;
+	messenger_create_info.pUserData = this;
+	VK_CHECK_RESULT(create_debug_utils_messenger(instance, &messenger_create_info, nullptr, &messenger));
+
+	return true;
+}
+
+void VulkanDebug::shutdown()
+{
+	if (messenger == VK_NULL_HANDLE) {
+		return;
+	}
+
+	std::cout << "Destroy debug messenger\n";
+	destroy_debug_utils_messenger(instance, messenger, nullptr);
+	messenger = VK_NULL_HANDLE;
+
+	if (statistics.repeated > 0 || statistics.rate_limited > 0) {
+		std::cout << "Debug messages: " << statistics.messages << " received, " << statistics.repeated << " repeats and " << statistics.rate_limited << " rate limited not reported\n";
+	}
+}
+
+/**
+* Name an object, the name appears in the messages about it and in the capture tools
+*
+* @param handle Handle of the object, cast with reinterpret_cast or (uint64_t) for the dispatchable handles
+*/
+void VulkanDebug::set_object_name(VkDevice device, VkObjectType type, uint64_t handle, const char* name)
+{
+	VkDebugUtilsObjectNameInfoEXT name_info = {};
+	name_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+	name_info.objectType = type;
+	name_info.objectHandle = handle;
+	name_info.pObjectName = name;
+	set_debug_utils_object_name(device, &name_info);
+}
+
+/**
+* Open a label region of a command buffer, closed by end_label, the regions may be nested
+*/
+void VulkanDebug::begin_label(VkCommandBuffer command_buffer, const char* name)
+{
+	VkDebugUtilsLabelEXT label = {};
+	label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+	label.pLabelName = name;
+	cmd_begin_debug_utils_label(command_buffer, &label);
+}
+
+void VulkanDebug::end_label(VkCommandBuffer command_buffer)
+{
+	cmd_end_debug_utils_label(command_buffer);
+}
+
+void VulkanDebug::insert_label(VkCommandBuffer command_buffer, const char* name)
+{
+	VkDebugUtilsLabelEXT label = {};
+	label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+	label.pLabelName = name;
+	cmd_insert_debug_utils_label(command_buffer, &label);
+}
+
+DebugStatistics VulkanDebug::get_statistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return statistics;
+}
+
+VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebug::messenger_callback(
+	VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+	VkDebugUtilsMessageTypeFlagsEXT /*types*/,
+	const VkDebugUtilsMessengerCallbackDataEXT* callback_data,
+	void* user_data)
+{
+	static_cast<VulkanDebug*>(user_data)->report(severity, *callback_data);
+
+	// The calls reporting a message are never aborted
+	return VK_FALSE;
+}
+
+/**
+* Write a message, unless it was already reported max_repeats times or max_messages_per_second were written this second
+*/
+void VulkanDebug::report(VkDebugUtilsMessageSeverityFlagBitsEXT severity, const VkDebugUtilsMessengerCallbackDataEXT& callback_data)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	statistics.messages++;
+	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+		statistics.errors++;
+	}
+
+	// The messages without an identifier, like the ones of the loader, are identified by their text
+	const uint64_t id = callback_data.messageIdNumber != 0 ?
+		static_cast<uint32_t>(callback_data.messageIdNumber) :
+		std::hash<std::string>()(callback_data.pMessage != nullptr ? callback_data.pMessage : "");
+	const uint32_t count = ++repeats[id];
+	if (count > settings.max_repeats) {
+		statistics.repeated++;
+		return;
+	}
+
+	const clock::time_point now = clock::now();
+	if (now - window_start >= std::chrono::seconds(1)) {
+		if (window_suppressed > 0) {
+			std::cout << "[vulkan] " << window_suppressed << " messages not reported, more than " << settings.max_messages_per_second << " per second\n";
+		}
+		window_start = now;
+		window_messages = 0;
+		window_suppressed = 0;
+	}
+	if (window_messages >= settings.max_messages_per_second) {
+		window_suppressed++;
+		statistics.rate_limited++;
+		return;
+	}
+	window_messages++;
+
+	std::ostream& stream = (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) ? std::cerr : std::cout;
+	stream << "[vulkan " << get_severity_name(severity) << "] "
+		<< (callback_data.pMessageIdName != nullptr ? callback_data.pMessageIdName : "") << " (" << callback_data.messageIdNumber << "): "
+		<< (callback_data.pMessage != nullptr ? callback_data.pMessage : "") << "\n";
+	for (uint32_t i = 0; i < callback_data.objectCount; ++i) {
+		const VkDebugUtilsObjectNameInfoEXT& object = callback_data.pObjects[i];
+		stream << "    object " << i << ": type " << object.objectType << " handle 0x" << std::hex << object.objectHandle << std::dec;
+		if (object.pObjectName != nullptr) {
+			stream << " \"" << object.pObjectName << "\"";
+		}
+		stream << "\n";
+	}
+	for (uint32_t i = 0; i < callback_data.cmdBufLabelCount; ++i) {
+		stream << "    label: " << callback_data.pCmdBufLabels[i].pLabelName << "\n";
+	}
+	if (count == settings.max_repeats) {
+		stream << "    the next repeats of this message are not reported\n";
+	}
+}
+
+bool VulkanDebug::has_layer(const std::vector<VkLayerProperties>& layers, const char* name)
+{
+	for (auto& layer : layers) {
+		if (strcmp(layer.layerName, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+* Instance extension implemented by the loader and the drivers, or by a layer
+*
+* @param layer Layer implementing the extension, null for the loader and the drivers
+*/
+bool VulkanDebug::has_extension(const char* layer, const char* name)
+{
+	uint32_t extensions_count = 0;
+	if (vkEnumerateInstanceExtensionProperties(layer, &extensions_count, nullptr) != VK_SUCCESS) {
+		return false;
+	}
+	std::vector<VkExtensionProperties> extensions(extensions_count);
+	VK_CHECK_RESULT(vkEnumerateInstanceExtensionProperties(layer, &extensions_count, extensions.data()));
+	for (auto& extension : extensions) {
+		if (strcmp(extension.extensionName, name) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+VkDebugUtilsMessageSeverityFlagsEXT VulkanDebug::get_severity_mask(DebugSeverity severity)
+{
+	VkDebugUtilsMessageSeverityFlagsEXT mask = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+	if (severity >= DEBUG_SEVERITY_WARNING) {
+		mask |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
+	}
+	if (severity >= DEBUG_SEVERITY_INFO) {
+		mask |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
+	}
+	if (severity >= DEBUG_SEVERITY_VERBOSE) {
+		mask |= VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+	}
+	return mask;
+}
+
+const char* VulkanDebug::get_severity_name(VkDebugUtilsMessageSeverityFlagBitsEXT severity)
+{
+	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+		return "error";
+	}
+	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+		return "warning";
+	}
+	if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+		return "info";
+	}
+	return "verbose";
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+
+/* Reports of a message before its repeats are only counted */
+#define DEBUG_MAX_REPEATS				3
+/* Messages reported per second, the next ones are only counted until the next second */
+#define DEBUG_MAX_MESSAGES_PER_SECOND	20
+
+/** @brief Debugging support loaded with the instance */
+enum DebugLevel {
+	/* no layer and no extension, the names and labels are not recorded */
+	DEBUG_LEVEL_NONE,
+	/* VK_EXT_debug_utils only, the names and labels are seen by the capture tools */
+	DEBUG_LEVEL_LABELS,
+	/* the validation layer as well, its messages are reported by the messenger */
+	DEBUG_LEVEL_VALIDATION
+};
+
+/** @brief Least severe messages reported, the more severe ones are reported as well */
+enum DebugSeverity {
+	DEBUG_SEVERITY_ERROR,
+	DEBUG_SEVERITY_WARNING,
+	DEBUG_SEVERITY_INFO,
+	DEBUG_SEVERITY_VERBOSE
+};
+
+struct DebugSettings {
+	DebugLevel level;
+	DebugSeverity severity;
+	uint32_t max_repeats;
+	uint32_t max_messages_per_second;
+};
+
+struct DebugStatistics {
+	/* messages received from the layers, reported or not */
+	uint32_t messages;
+	uint32_t errors;
+	/* messages only counted, repeated more than max_repeats times or beyond the rate limit */
+	uint32_t repeated;
+	uint32_t rate_limited;
+};
+
+/**
+* VK_EXT_debug_utils messenger, object names and command buffer labels
+*
+* Only created when the debug level is not DEBUG_LEVEL_NONE, the instance and the devices then hold no
+* debug object, no layer is loaded, and the names and labels cost a null pointer test
+* The severities are filtered by the messenger itself, the messages received are deduplicated on their
+* identifier and rate limited, and written with the names of their objects and the labels of their command buffers
+*/
+class VulkanDebug
+{
+public:
+	VulkanDebug();
+	~VulkanDebug();
+
+	static DebugSettings				get_default_settings();
+
+	bool								configure(const DebugSettings& settings, std::vector<const char*>& layers, std::vector<const char*>& extensions);
+	bool								create(VkInstance instance);
+	void								shutdown();
+
+	void								set_object_name(VkDevice device, VkObjectType type, uint64_t handle, const char* name);
+	void								begin_label(VkCommandBuffer command_buffer, const char* name);
+	void								end_label(VkCommandBuffer command_buffer);
+	void								insert_label(VkCommandBuffer command_buffer, const char* name);
+
+	DebugStatistics						get_statistics();
+
+private:
+	typedef std::chrono::steady_clock	clock;
+
+	VkInstance							instance;
+	DebugSettings						settings;
+	VkDebugUtilsMessengerEXT			messenger;
+
+	PFN_vkCreateDebugUtilsMessengerEXT	create_debug_utils_messenger;
+	PFN_vkDestroyDebugUtilsMessengerEXT	destroy_debug_utils_messenger;
+	PFN_vkSetDebugUtilsObjectNameEXT	set_debug_utils_object_name;
+	PFN_vkCmdBeginDebugUtilsLabelEXT	cmd_begin_debug_utils_label;
+	PFN_vkCmdEndDebugUtilsLabelEXT		cmd_end_debug_utils_label;
+	PFN_vkCmdInsertDebugUtilsLabelEXT	cmd_insert_debug_utils_label;
+
+	/* the layers may report from any thread */
+	std::mutex							mutex;
+	/* times each message was received, by identifier */
+	std::unordered_map<uint64_t, uint32_t>	repeats;
+	clock::time_point					window_start;
+	uint32_t							window_messages;
+	uint32_t							window_suppressed;
+	DebugStatistics						statistics;
+
+	static VKAPI_ATTR VkBool32 VKAPI_CALL	messenger_callback(
+		VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+		VkDebugUtilsMessageTypeFlagsEXT types,
+		const VkDebugUtilsMessengerCallbackDataEXT* callback_data,
+		void* user_data);
+
+	void								report(VkDebugUtilsMessageSeverityFlagBitsEXT severity, const VkDebugUtilsMessengerCallbackDataEXT& callback_data);
+
+	static bool							has_layer(const std::vector<VkLayerProperties>& layers, const char* name);
+	static bool							has_extension(const char* layer, const char* name);
+	static VkDebugUtilsMessageSeverityFlagsEXT	get_severity_mask(DebugSeverity severity);
+	static const char*					get_severity_name(VkDebugUtilsMessageSeverityFlagBitsEXT severity);
+};
@@ -0,0 +1,214 @@
+#include "VulkanDeletionQueue.h"
+
+VulkanDeletionQueue::VulkanDeletionQueue()
+	: device(nullptr)
+	, sync(nullptr)
+	, statistics({})
+{
+}
+
+VulkanDeletionQueue::~VulkanDeletionQueue()
+{
+}
+
+bool VulkanDeletionQueue::create(VulkanDevice* device, VulkanSync* sync)
+{
+	this->device = device;
+	this->sync = sync;
+	statistics = {};
+	return true;
+}
+
+void VulkanDeletionQueue::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy deletion queue\n";
+	flush();
+
+	device = nullptr;
+	sync = nullptr;
+}
+
+/**
+* Point of the next submission to a queue, the point of the objects released while it is recorded
+*/
+SyncPoint VulkanDeletionQueue::get_next_point(SyncQueue queue) const
+{
+	SyncPoint point = sync->get_submitted_point(queue);
+	point.value++;
+	return point;
+}
+
+/**
+* Destroy a buffer created by VulkanDevice::create_buffer and free its memory, the buffer is reset
+*/
+void VulkanDeletionQueue::destroy_buffer(const SyncPoint& point, VulkanBuffer* buffer)
+{
+	if (buffer->mapped != nullptr) {
+		vkUnmapMemory(*device, buffer->memory);
+	}
+	destroy_buffer(point, buffer->buffer);
+	free_memory(point, buffer->memory);
+	*buffer = {};
+}
+
+void VulkanDeletionQueue::destroy_buffer(const SyncPoint& point, VkBuffer buffer)
+{
+	push(point, DELETION_TYPE_BUFFER, reinterpret_cast<uint64_t>(buffer));
+}
+
+void VulkanDeletionQueue::destroy_image(const SyncPoint& point, VkImage image)
+{
+	push(point, DELETION_TYPE_IMAGE, reinterpret_cast<uint64_t>(image));
+}
+
+void VulkanDeletionQueue::destroy_image_view(const SyncPoint& point, VkImageView view)
+{
+	push(point, DELETION_TYPE_IMAGE_VIEW, reinterpret_cast<uint64_t>(view));
+}
+
+void VulkanDeletionQueue::destroy_framebuffer(const SyncPoint& point, VkFramebuffer frame_buffer)
+{
+	push(point, DELETION_TYPE_FRAMEBUFFER, reinterpret_cast<uint64_t>(frame_buffer));
+}
+
+void VulkanDeletionQueue::destroy_render_pass(const SyncPoint& point, VkRenderPass render_pass)
+{
+	push(point, DELETION_TYPE_RENDER_PASS, reinterpret_cast<uint64_t>(render_pass));
+}
+
+void VulkanDeletionQueue::destroy_pipeline(const SyncPoint& point, VkPipeline pipeline)
+{
+	push(point, DELETION_TYPE_PIPELINE, reinterpret_cast<uint64_t>(pipeline));
+}
+
+/**
+* Destroy a descriptor pool, the sets allocated from it are freed with it
+*/
+void VulkanDeletionQueue::destroy_descriptor_pool(const SyncPoint& point, VkDescriptorPool descriptor_pool)
+{
+	push(point, DELETION_TYPE_DESCRIPTOR_POOL, reinterpret_cast<uint64_t>(descriptor_pool));
+}
+
+/**
+* Free a memory allocation, the objects bound to it must be destroyed at the same point or before
+*/
+void VulkanDeletionQueue::free_memory(const SyncPoint& point, VkDeviceMemory memory)
+{
+	push(point, DELETION_TYPE_MEMORY, reinterpret_cast<uint64_t>(memory));
+}
+
+/**
+* Run a deletion once the GPU reaches a point, the objects it deletes may be used until then
+*
+* @param point Point after the last use, usually the submitted point of the queue or the next point
+*/
+void VulkanDeletionQueue::defer(const SyncPoint& point, std::function<void()> deletion)
+{
+	push(point, DELETION_TYPE_FUNCTION, 0, std::move(deletion));
+}
+
+/**
+* Destroy the objects whose point is reached, called once per frame
+*/
+void VulkanDeletionQueue::collect()
+{
+	statistics.collected = 0;
+	for (uint32_t queue = 0; queue < SYNC_QUEUE_COUNT; ++queue) {
+		std::deque<Deletion>& queue_deletions = deletions[queue];
+		if (queue_deletions.empty()) {
+			continue;
+		}
+		const uint64_t completed_value = sync->get_timeline(static_cast<SyncQueue>(queue)).get_completed_value();
+		while (!queue_deletions.empty() && queue_deletions.front().value <= completed_value) {
+			// A deferred function may release more objects
+			Deletion deletion = std::move(queue_deletions.front());
+			queue_deletions.pop_front();
+			destroy(deletion);
+			statistics.collected++;
+			statistics.pending--;
+		}
+	}
+}
+
+/**
+* Wait for every submission and destroy all the objects, for the shutdown
+* The objects queued at a point no submission reaches, such as a next point, are destroyed as well
+*/
+void VulkanDeletionQueue::flush()
+{
+	sync->wait_idle();
+
+	// A deferred function may release more objects, on any queue
+	statistics.collected = 0;
+	while (statistics.pending > 0) {
+		for (uint32_t queue = 0; queue < SYNC_QUEUE_COUNT; ++queue) {
+			std::deque<Deletion>& queue_deletions = deletions[queue];
+			while (!queue_deletions.empty()) {
+				Deletion deletion = std::move(queue_deletions.front());
+				queue_deletions.pop_front();
+				destroy(deletion);
+				statistics.collected++;
+				statistics.pending--;
+			}
+		}
+	}
+}
+
+void VulkanDeletionQueue::push(const SyncPoint& point, DeletionType type, uint64_t handle, std::function<void()> function)
+{
+	if (handle == 0 && type != DELETION_TYPE_FUNCTION) {
+		return;
+	}
+
+	Deletion deletion = {};
+	deletion.value = point.value;
+	deletion.type = type;
+	deletion.handle = handle;
+	deletion.function = std::move(function);
+
+	// The points are usually increasing, a point older than the last one is inserted before it
+	std::deque<Deletion>& queue_deletions = deletions[point.queue];
+	auto position = queue_deletions.end();
+	while (position != queue_deletions.begin() && std::prev(position)->value > point.value) {
+		--position;
+	}
+	queue_deletions.insert(position, std::move(deletion));
+	statistics.pending++;
+}
+
+void VulkanDeletionQueue::destroy(Deletion& deletion)
+{
+	switch (deletion.type) {
+	case DELETION_TYPE_BUFFER:
+		vkDestroyBuffer(*device, reinterpret_cast<VkBuffer>(deletion.handle), nullptr);
+		break;
+	case DELETION_TYPE_IMAGE:
+		vkDestroyImage(*device, reinterpret_cast<VkImage>(deletion.handle), nullptr);
+		break;
+	case DELETION_TYPE_IMAGE_VIEW:
+		vkDestroyImageView(*device, reinterpret_cast<VkImageView>(deletion.handle), nullptr);
+		break;
+	case DELETION_TYPE_FRAMEBUFFER:
+		vkDestroyFramebuffer(*device, reinterpret_cast<VkFramebuffer>(deletion.handle), nullptr);
+		break;
+	case DELETION_TYPE_RENDER_PASS:
+		vkDestroyRenderPass(*device, reinterpret_cast<VkRenderPass>(deletion.handle), nullptr);
+		break;
+	case DELETION_TYPE_PIPELINE:
+		vkDestroyPipeline(*device, reinterpret_cast<VkPipeline>(deletion.handle), nullptr);
+		break;
+	case DELETION_TYPE_DESCRIPTOR_POOL:
+		vkDestroyDescriptorPool(*device, reinterpret_cast<VkDescriptorPool>(deletion.handle), nullptr);
+		break;
+	case DELETION_TYPE_MEMORY:
+		vkFreeMemory(*device, reinterpret_cast<VkDeviceMemory>(deletion.handle), nullptr);
+		break;
+	case DELETION_TYPE_FUNCTION:
+		deletion.function();
+		break;
+	}
+}
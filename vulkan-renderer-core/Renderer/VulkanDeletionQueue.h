@@ -0,0 +1,92 @@
+#pragma once
+
+#include <iostream>
+#include <deque>
+#include <array>
+#include <functional>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanSync.h"
+
+struct DeletionStatistics {
+	/* objects and deletions waiting for their point */
+	uint32_t pending;
+	/* objects and deletions destroyed by the last collection */
+	uint32_t collected;
+};
+
+/**
+* Deferred destruction of the objects the GPU may still use
+*
+* An object released at runtime is tagged with the point of the last submission using it, the frame
+* of the graphics timeline or the value of another queue, and destroyed by the first collection after
+* the timeline reached the point, replacing a resource never waits for the device
+* The objects released while a frame is recorded may be used by its submission, get_next_point gives its point
+*
+* The objects composed of several handles, like the depth pyramid, are destroyed by a deferred function
+*/
+class VulkanDeletionQueue
+{
+public:
+	VulkanDeletionQueue();
+	~VulkanDeletionQueue();
+
+	bool								create(VulkanDevice* device, VulkanSync* sync);
+	void								shutdown();
+
+	/** @brief Point of the last submission to a queue, the point of the objects released between the frames */
+	SyncPoint							get_submitted_point(SyncQueue queue) const { return sync->get_submitted_point(queue); };
+	SyncPoint							get_next_point(SyncQueue queue) const;
+
+	void								destroy_buffer(const SyncPoint& point, VulkanBuffer* buffer);
+	void								destroy_buffer(const SyncPoint& point, VkBuffer buffer);
+	void								destroy_image(const SyncPoint& point, VkImage image);
+	void								destroy_image_view(const SyncPoint& point, VkImageView view);
+	void								destroy_framebuffer(const SyncPoint& point, VkFramebuffer frame_buffer);
+	void								destroy_render_pass(const SyncPoint& point, VkRenderPass render_pass);
+	void								destroy_pipeline(const SyncPoint& point, VkPipeline pipeline);
+	void								destroy_descriptor_pool(const SyncPoint& point, VkDescriptorPool descriptor_pool);
+	void								free_memory(const SyncPoint& point, VkDeviceMemory memory);
+	void								defer(const SyncPoint& point, std::function<void()> deletion);
+
+	void								collect();
+	void								flush();
+
+	const DeletionStatistics&			get_statistics() const { return statistics; };
+
+private:
+	enum DeletionType {
+		DELETION_TYPE_BUFFER,
+		DELETION_TYPE_IMAGE,
+		DELETION_TYPE_IMAGE_VIEW,
+		DELETION_TYPE_FRAMEBUFFER,
+		DELETION_TYPE_RENDER_PASS,
+		DELETION_TYPE_PIPELINE,
+		DELETION_TYPE_DESCRIPTOR_POOL,
+		DELETION_TYPE_MEMORY,
+		DELETION_TYPE_FUNCTION
+	};
+
+	struct Deletion {
+		uint64_t value;
+		DeletionType type;
+		/* non dispatchable handle, null for a function */
+		uint64_t handle;
+		std::function<void()> function;
+	};
+
+	VulkanDevice*						device;
+	VulkanSync*							sync;
+
+	/* deletions of each timeline, by order of value */
+	std::array<std::deque<Deletion>, SYNC_QUEUE_COUNT>		deletions;
+
+	DeletionStatistics					statistics;
+
+	void								push(const SyncPoint& point, DeletionType type, uint64_t handle, std::function<void()> function = nullptr);
+	void								destroy(Deletion& deletion);
+};
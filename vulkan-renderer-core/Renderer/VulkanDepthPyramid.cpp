@@ -0,0 +1,353 @@
+#include "VulkanDepthPyramid.h"
+
+VulkanDepthPyramid::VulkanDepthPyramid()
+	: device(nullptr)
+	, image(VK_NULL_HANDLE)
+	, memory(VK_NULL_HANDLE)
+	, view(VK_NULL_HANDLE)
+	, sampler(VK_NULL_HANDLE)
+	, depth_view(VK_NULL_HANDLE)
+	, depth_samples(VK_SAMPLE_COUNT_1_BIT)
+	, depth_width(0)
+	, depth_height(0)
+	, width(0)
+	, height(0)
+	, levels(0)
+	, is_built(false)
+	, descriptor_set_layout(VK_NULL_HANDLE)
+	, descriptor_pool(VK_NULL_HANDLE)
+	, pipeline_layout(VK_NULL_HANDLE)
+	, pipeline(VK_NULL_HANDLE)
+	, multisample_pipeline(VK_NULL_HANDLE)
+{
+}
+
+VulkanDepthPyramid::~VulkanDepthPyramid()
+{
+}
+
+/**
+* Create the pyramid of a depth buffer
+*
+* The depth buffer view must be set before the first build
+*
+* @param device Device
+* @param depth_width Width of the depth buffer
+* @param depth_height Height of the depth buffer
+*/
+bool VulkanDepthPyramid::create(VulkanDevice* device, uint32_t depth_width, uint32_t depth_height)
+{
+	this->device = device;
+	this->depth_view = VK_NULL_HANDLE;
+	this->depth_samples = VK_SAMPLE_COUNT_1_BIT;
+	this->depth_width = depth_width;
+	this->depth_height = depth_height;
+
+	width = std::max(depth_width / 2, 1u);
+	height = std::max(depth_height / 2, 1u);
+	levels = 1;
+	while ((std::max(width, height) >> levels) > 0) {
+		levels++;
+	}
+
+	is_built = false;
+
+	create_image();
+	create_sampler();
+	create_pipeline();
+	create_descriptor_sets();
+
+	return true;
+}
+
+void VulkanDepthPyramid::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy depth pyramid\n";
+	vkDestroyPipeline(*device, pipeline, nullptr);
+	vkDestroyPipeline(*device, multisample_pipeline, nullptr);
+	vkDestroyPipelineLayout(*device, pipeline_layout, nullptr);
+	vkDestroyDescriptorPool(*device, descriptor_pool, nullptr);
+	vkDestroyDescriptorSetLayout(*device, descriptor_set_layout, nullptr);
+	descriptor_sets.clear();
+
+	vkDestroySampler(*device, sampler, nullptr);
+	for (auto& level_view : level_views) {
+		vkDestroyImageView(*device, level_view, nullptr);
+	}
+	level_views.clear();
+	vkDestroyImageView(*device, view, nullptr);
+	vkDestroyImage(*device, image, nullptr);
+	vkFreeMemory(*device, memory, nullptr);
+
+	depth_view = VK_NULL_HANDLE;
+	image = VK_NULL_HANDLE;
+	memory = VK_NULL_HANDLE;
+	view = VK_NULL_HANDLE;
+	sampler = VK_NULL_HANDLE;
+	pipeline = VK_NULL_HANDLE;
+	multisample_pipeline = VK_NULL_HANDLE;
+	pipeline_layout = VK_NULL_HANDLE;
+	descriptor_pool = VK_NULL_HANDLE;
+	descriptor_set_layout = VK_NULL_HANDLE;
+
+	device = nullptr;
+}
+
+/**
+* Set the depth buffer the first level is reduced from
+* The descriptor set of the first level is shared by the frames in flight,
+* the view may only change while no pending frame builds the pyramid
+*
+* @param depth_view Depth aspect view of the depth buffer
+* @param depth_samples Samples of the depth buffer
+*/
+void VulkanDepthPyramid::set_depth_view(VkImageView depth_view, VkSampleCountFlagBits depth_samples)
+{
+	if (depth_view == this->depth_view && depth_samples == this->depth_samples) {
+		return;
+	}
+	this->depth_view = depth_view;
+	this->depth_samples = depth_samples;
+
+	VkDescriptorImageInfo source_info = {};
+	source_info.sampler = sampler;
+	source_info.imageView = depth_view;
+	source_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+	VkWriteDescriptorSet write_descriptor_set = {};
+	write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	write_descriptor_set.dstSet = descriptor_sets[0];
+	write_descriptor_set.dstBinding = 0;
+	write_descriptor_set.descriptorCount = 1;
+	write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	write_descriptor_set.pImageInfo = &source_info;
+	vkUpdateDescriptorSets(*device, 1, &write_descriptor_set, 0, nullptr);
+}
+
+/**
+* Record the reduction of the depth buffer into the pyramid
+* Must be recorded outside of a render pass, the depth buffer is expected in
+* VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL and the pyramid in VK_IMAGE_LAYOUT_GENERAL
+*
+* @param command_buffer Command buffer of the frame
+*/
+void VulkanDepthPyramid::build(VkCommandBuffer command_buffer)
+{
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, depth_samples != VK_SAMPLE_COUNT_1_BIT ? multisample_pipeline : pipeline);
+
+	uint32_t source_width = depth_width;
+	uint32_t source_height = depth_height;
+	for (uint32_t level = 0; level < levels; ++level) {
+		ReduceSize size = {};
+		size.source_width = source_width;
+		size.source_height = source_height;
+		size.width = std::max(width >> level, 1u);
+		size.height = std::max(height >> level, 1u);
+
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_sets[level], 0, nullptr);
+		vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ReduceSize), &size);
+		vkCmdDispatch(command_buffer,
+			(size.width + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+			(size.height + DEPTH_PYRAMID_GROUP_SIZE - 1) / DEPTH_PYRAMID_GROUP_SIZE,
+			1);
+
+		// The next level reads this one
+		VkImageMemoryBarrier level_barrier = {};
+		level_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		level_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		level_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		level_barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		level_barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		level_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		level_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		level_barrier.image = image;
+		level_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &level_barrier);
+
+		source_width = size.width;
+		source_height = size.height;
+
+		// The levels above the first one are single sampled
+		if (level == 0 && depth_samples != VK_SAMPLE_COUNT_1_BIT) {
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		}
+	}
+
+	is_built = true;
+}
+
+void VulkanDepthPyramid::create_image()
+{
+	VkImageCreateInfo image_create_info = {};
+	image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_create_info.imageType = VK_IMAGE_TYPE_2D;
+	image_create_info.format = VK_FORMAT_R32_SFLOAT;
+	image_create_info.extent = { width, height, 1 };
+	image_create_info.mipLevels = levels;
+	image_create_info.arrayLayers = 1;
+	image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+	image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	VK_CHECK_RESULT(vkCreateImage(*device, &image_create_info, nullptr, &image));
+
+	VkMemoryRequirements memory_requirements;
+	vkGetImageMemoryRequirements(*device, image, &memory_requirements);
+
+	VkMemoryAllocateInfo memory_allocate_info = {};
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = memory_requirements.size;
+	device->get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memory_allocate_info.memoryTypeIndex);
+	VK_CHECK_RESULT(vkAllocateMemory(*device, &memory_allocate_info, nullptr, &memory));
+	VK_CHECK_RESULT(vkBindImageMemory(*device, image, memory, 0));
+
+	VkImageViewCreateInfo view_create_info = {};
+	view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_create_info.image = image;
+	view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_create_info.format = VK_FORMAT_R32_SFLOAT;
+	view_create_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levels, 0, 1 };
+	VK_CHECK_RESULT(vkCreateImageView(*device, &view_create_info, nullptr, &view));
+
+	level_views.resize(levels);
+	for (uint32_t level = 0; level < levels; ++level) {
+		view_create_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+		VK_CHECK_RESULT(vkCreateImageView(*device, &view_create_info, nullptr, &level_views[level]));
+	}
+}
+
+void VulkanDepthPyramid::create_sampler()
+{
+	// Texels are only fetched, the sampler never filters
+	VkSamplerCreateInfo sampler_create_info = {};
+	sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_create_info.magFilter = VK_FILTER_NEAREST;
+	sampler_create_info.minFilter = VK_FILTER_NEAREST;
+	sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_create_info.minLod = 0.0f;
+	sampler_create_info.maxLod = static_cast<float>(levels);
+	sampler_create_info.maxAnisotropy = 1.0f;
+	VK_CHECK_RESULT(vkCreateSampler(*device, &sampler_create_info, nullptr, &sampler));
+}
+
+/**
+* One descriptor set per level, reading the level below (or the depth buffer) and writing the level
+* The depth buffer is written in the first set by set_depth_view
+*/
+void VulkanDepthPyramid::create_descriptor_sets()
+{
+	std::array<VkDescriptorPoolSize, 2> type_counts;
+	type_counts[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	type_counts[0].descriptorCount = levels;
+	type_counts[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	type_counts[1].descriptorCount = levels;
+
+	VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
+	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptor_pool_create_info.maxSets = levels;
+	descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(type_counts.size());
+	descriptor_pool_create_info.pPoolSizes = type_counts.data();
+	VK_CHECK_RESULT(vkCreateDescriptorPool(*device, &descriptor_pool_create_info, nullptr, &descriptor_pool));
+
+	std::vector<VkDescriptorSetLayout> layouts(levels, descriptor_set_layout);
+	descriptor_sets.resize(levels);
+
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = descriptor_pool;
+	alloc_info.descriptorSetCount = levels;
+	alloc_info.pSetLayouts = layouts.data();
+	VK_CHECK_RESULT(vkAllocateDescriptorSets(*device, &alloc_info, descriptor_sets.data()));
+
+	for (uint32_t level = 0; level < levels; ++level) {
+		VkDescriptorImageInfo source_info = {};
+		source_info.sampler = sampler;
+		source_info.imageView = level == 0 ? VK_NULL_HANDLE : level_views[level - 1];
+		source_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo destination_info = {};
+		destination_info.imageView = level_views[level];
+		destination_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> write_descriptor_sets = {};
+		write_descriptor_sets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write_descriptor_sets[0].dstSet = descriptor_sets[level];
+		write_descriptor_sets[0].dstBinding = 0;
+		write_descriptor_sets[0].descriptorCount = 1;
+		write_descriptor_sets[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write_descriptor_sets[0].pImageInfo = &source_info;
+		write_descriptor_sets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write_descriptor_sets[1].dstSet = descriptor_sets[level];
+		write_descriptor_sets[1].dstBinding = 1;
+		write_descriptor_sets[1].descriptorCount = 1;
+		write_descriptor_sets[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		write_descriptor_sets[1].pImageInfo = &destination_info;
+
+		// Only the destination of the first level is written
+		if (level == 0) {
+			vkUpdateDescriptorSets(*device, 1, &write_descriptor_sets[1], 0, nullptr);
+		}
+		else {
+			vkUpdateDescriptorSets(*device, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+		}
+	}
+}
+
+void VulkanDepthPyramid::create_pipeline()
+{
+	std::array<VkDescriptorSetLayoutBinding, 2> layout_bindings = {};
+	layout_bindings[0].binding = 0;
+	layout_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layout_bindings[0].descriptorCount = 1;
+	layout_bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	layout_bindings[1].binding = 1;
+	layout_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	layout_bindings[1].descriptorCount = 1;
+	layout_bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo descriptor_layout = {};
+	descriptor_layout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptor_layout.bindingCount = static_cast<uint32_t>(layout_bindings.size());
+	descriptor_layout.pBindings = layout_bindings.data();
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*device, &descriptor_layout, nullptr, &descriptor_set_layout));
+
+	VkPushConstantRange push_constant_range = {};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(ReduceSize);
+
+	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {};
+	pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_create_info.setLayoutCount = 1;
+	pipeline_layout_create_info.pSetLayouts = &descriptor_set_layout;
+	pipeline_layout_create_info.pushConstantRangeCount = 1;
+	pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
+	VK_CHECK_RESULT(vkCreatePipelineLayout(*device, &pipeline_layout_create_info, nullptr, &pipeline_layout));
+
+	VkComputePipelineCreateInfo pipeline_create_info = {};
+	pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_create_info.layout = pipeline_layout;
+	pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipeline_create_info.stage.pName = "main";
+	pipeline_create_info.stage.module = shader_loader.load(*device, "D:\\Documents\\Vulkan\\Projects\\vulkan-renderer\\vulkan-renderer-core\\Data\\shaders\\depth_pyramid.comp.spv");
+
+	VK_CHECK_RESULT(vkCreateComputePipelines(*device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &pipeline));
+
+	vkDestroyShaderModule(*device, pipeline_create_info.stage.module, nullptr);
+
+	// Same layout, the source of the first level is a multisampled combined image sampler
+	pipeline_create_info.stage.module = shader_loader.load(*device, "D:\\Documents\\Vulkan\\Projects\\vulkan-renderer\\vulkan-renderer-core\\Data\\shaders\\depth_pyramid_multisample.comp.spv");
+
+	VK_CHECK_RESULT(vkCreateComputePipelines(*device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &multisample_pipeline));
+
+	vkDestroyShaderModule(*device, pipeline_create_info.stage.module, nullptr);
+}
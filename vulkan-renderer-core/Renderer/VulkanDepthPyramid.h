@@ -0,0 +1,91 @@
+#pragma once
+
+#include <iostream>
+#include <array>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanShader.h"
+
+#define DEPTH_PYRAMID_GROUP_SIZE		8
+
+/**
+* Hierarchical depth (Hi-Z) mip pyramid
+* Each texel holds the farthest depth of the texels it covers in the level below,
+* the first level being half the resolution of the depth buffer
+* A multisampled depth buffer is reduced over all its samples
+* The image stays in VK_IMAGE_LAYOUT_GENERAL once it was first transitioned to it,
+* the render graph orders the build after the depth writes and before the reads of the pyramid
+*/
+class VulkanDepthPyramid
+{
+public:
+	VulkanDepthPyramid();
+	~VulkanDepthPyramid();
+
+	bool							create(VulkanDevice* device, uint32_t depth_width, uint32_t depth_height);
+	void							shutdown();
+
+	void							set_depth_view(VkImageView depth_view, VkSampleCountFlagBits depth_samples);
+
+	void							build(VkCommandBuffer command_buffer);
+
+	/** @brief The pyramid holds the depth of a previous build */
+	bool							is_valid() const { return is_built; };
+	/** @brief Layout of the pyramid before the first use of a frame */
+	VkImageLayout					get_layout() const { return is_built ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED; };
+
+	VkImage							get_image() const { return image; };
+	VkImageView						get_depth_view() const { return depth_view; };
+	VkSampleCountFlagBits			get_depth_samples() const { return depth_samples; };
+	VkImageView						get_view() const { return view; };
+	VkSampler						get_sampler() const { return sampler; };
+	uint32_t						get_width() const { return width; };
+	uint32_t						get_height() const { return height; };
+	uint32_t						get_levels() const { return levels; };
+
+private:
+	/* push constants of depth_pyramid.comp */
+	struct ReduceSize {
+		uint32_t source_width;
+		uint32_t source_height;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	VulkanDevice*					device;
+	VulkanShader					shader_loader;
+
+	VkImage							image;
+	VkDeviceMemory					memory;
+	VkImageView						view;
+	std::vector<VkImageView>		level_views;
+	VkSampler						sampler;
+
+	/* depth aspect view of the depth buffer, sampled by the first level */
+	VkImageView						depth_view;
+	VkSampleCountFlagBits			depth_samples;
+	uint32_t						depth_width;
+	uint32_t						depth_height;
+	uint32_t						width;
+	uint32_t						height;
+	uint32_t						levels;
+
+	bool							is_built;
+
+	VkDescriptorSetLayout			descriptor_set_layout;
+	VkDescriptorPool				descriptor_pool;
+	std::vector<VkDescriptorSet>	descriptor_sets;
+	VkPipelineLayout				pipeline_layout;
+	VkPipeline						pipeline;
+	/* reduces the first level from a multisampled depth buffer */
+	VkPipeline						multisample_pipeline;
+
+	void							create_image();
+	void							create_sampler();
+	void							create_descriptor_sets();
+	void							create_pipeline();
+};
@@ -0,0 +1,343 @@
+#include "VulkanDescriptorAllocator.h"
+
+#include <cstring>
+
+/* Descriptors of each type per set of a pool, every type accepted by write must be listed */
+static const std::array<std::pair<VkDescriptorType, uint32_t>, 8> pool_ratios = { {
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2 },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1 },
+	{ VK_DESCRIPTOR_TYPE_SAMPLER, 1 },
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4 },
+	{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1 },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
+} };
+
+/* FNV-1a of the bytes of a value */
+template <typename T>
+static uint64_t hash_value(uint64_t hash, const T& value)
+{
+	uint8_t bytes[sizeof(T)];
+	memcpy(bytes, &value, sizeof(T));
+	for (auto byte : bytes) {
+		hash = (hash ^ byte) * 0x100000001B3ull;
+	}
+	return hash;
+}
+
+static uint64_t hash_layout_bindings(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (auto& binding : bindings) {
+		hash = hash_value(hash, binding.binding);
+		hash = hash_value(hash, binding.descriptorType);
+		hash = hash_value(hash, binding.descriptorCount);
+		hash = hash_value(hash, binding.stageFlags);
+		hash = hash_value(hash, binding.pImmutableSamplers);
+	}
+	return hash;
+}
+
+static bool equal_layout_bindings(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const VkDescriptorSetLayoutBinding& x, const VkDescriptorSetLayoutBinding& y) {
+		return x.binding == y.binding && x.descriptorType == y.descriptorType && x.descriptorCount == y.descriptorCount &&
+			x.stageFlags == y.stageFlags && x.pImmutableSamplers == y.pImmutableSamplers;
+	});
+}
+
+static uint64_t hash_set(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	uint64_t hash = hash_value(0xCBF29CE484222325ull, layout);
+	for (auto& binding : bindings) {
+		hash = hash_value(hash, binding.binding);
+		hash = hash_value(hash, binding.type);
+		hash = hash_value(hash, binding.buffer_info.buffer);
+		hash = hash_value(hash, binding.buffer_info.offset);
+		hash = hash_value(hash, binding.buffer_info.range);
+		hash = hash_value(hash, binding.image_info.sampler);
+		hash = hash_value(hash, binding.image_info.imageView);
+		hash = hash_value(hash, binding.image_info.imageLayout);
+	}
+	return hash;
+}
+
+static bool equal_bindings(const std::vector<DescriptorBinding>& a, const std::vector<DescriptorBinding>& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const DescriptorBinding& x, const DescriptorBinding& y) {
+		return x.binding == y.binding && x.type == y.type &&
+			x.buffer_info.buffer == y.buffer_info.buffer && x.buffer_info.offset == y.buffer_info.offset && x.buffer_info.range == y.buffer_info.range &&
+			x.image_info.sampler == y.image_info.sampler && x.image_info.imageView == y.image_info.imageView && x.image_info.imageLayout == y.image_info.imageLayout;
+	});
+}
+
+VulkanDescriptorAllocator::VulkanDescriptorAllocator()
+	: device(nullptr)
+	, frame_index(0)
+	, cache_pools({})
+	, statistics({})
+{
+}
+
+VulkanDescriptorAllocator::~VulkanDescriptorAllocator()
+{
+}
+
+bool VulkanDescriptorAllocator::create(VulkanDevice* device, uint32_t frames_count)
+{
+	this->device = device;
+	frame_index = 0;
+	statistics = {};
+
+	frame_pools.resize(frames_count);
+	for (auto& chain : frame_pools) {
+		chain = {};
+	}
+	cache_pools = {};
+
+	return true;
+}
+
+void VulkanDescriptorAllocator::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy descriptor pools\n";
+	for (auto& chain : frame_pools) {
+		destroy_chain(chain);
+	}
+	frame_pools.clear();
+	destroy_chain(cache_pools);
+	set_cache.clear();
+
+	for (auto& entry : layout_cache) {
+		vkDestroyDescriptorSetLayout(*device, entry.second.layout, nullptr);
+	}
+	layout_cache.clear();
+
+	device = nullptr;
+}
+
+/**
+* Change the count of frames in flight, the transient sets of every frame are released
+* The device must be idle
+*
+* @param frames_count Count of frames in flight
+*/
+void VulkanDescriptorAllocator::set_frames_count(uint32_t frames_count)
+{
+	for (auto& chain : frame_pools) {
+		destroy_chain(chain);
+	}
+	frame_pools.resize(frames_count);
+	frame_index = 0;
+}
+
+/**
+* Release the transient sets of the previous submission of a frame
+*
+* @param frame_index Index of the frame in flight, its previous submission is complete
+*/
+void VulkanDescriptorAllocator::begin_frame(uint32_t frame_index)
+{
+	this->frame_index = frame_index;
+
+	PoolChain& chain = frame_pools[frame_index];
+	for (uint32_t i = 0; i < chain.pools.size() && i <= chain.current; ++i) {
+		VK_CHECK_RESULT(vkResetDescriptorPool(*device, chain.pools[i], 0));
+	}
+	chain.current = 0;
+	chain.allocations = 0;
+
+	statistics.frame_allocations = 0;
+	statistics.frame_pools = static_cast<uint32_t>(chain.pools.size());
+}
+
+/**
+* Get the layout of a set of bindings, created on first use
+*
+* @param bindings Bindings of the layout
+*/
+VkDescriptorSetLayout VulkanDescriptorAllocator::get_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+{
+	uint64_t hash = hash_layout_bindings(bindings);
+	auto range = layout_cache.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (equal_layout_bindings(it->second.bindings, bindings)) {
+			return it->second.layout;
+		}
+	}
+
+	CachedLayout entry;
+	entry.bindings = bindings;
+
+	VkDescriptorSetLayoutCreateInfo descriptor_layout = {};
+	descriptor_layout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptor_layout.bindingCount = static_cast<uint32_t>(bindings.size());
+	descriptor_layout.pBindings = bindings.data();
+	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(*device, &descriptor_layout, nullptr, &entry.layout));
+
+	layout_cache.emplace(hash, entry);
+	statistics.cached_layouts++;
+
+	return entry.layout;
+}
+
+/**
+* Allocate and write a set used by the current frame only
+*
+* @param layout Layout of the set
+* @param bindings Resources of the set
+* @return Set, valid until the frame retires, VK_NULL_HANDLE when the layout does not fit in a pool
+*/
+VkDescriptorSet VulkanDescriptorAllocator::allocate(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	VkDescriptorSet descriptor_set = allocate_from(frame_pools[frame_index], layout);
+	if (descriptor_set == VK_NULL_HANDLE) {
+		return VK_NULL_HANDLE;
+	}
+	write(descriptor_set, bindings);
+
+	statistics.frame_allocations++;
+	statistics.frame_pools = static_cast<uint32_t>(frame_pools[frame_index].pools.size());
+
+	return descriptor_set;
+}
+
+/**
+* Get the immutable set of a layout and resources, allocated and written on first use
+*
+* @param layout Layout of the set
+* @param bindings Resources of the set
+* @return Set, valid until the cache is cleared, VK_NULL_HANDLE when the layout does not fit in a pool
+*/
+VkDescriptorSet VulkanDescriptorAllocator::get_cached(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings)
+{
+	uint64_t hash = hash_set(layout, bindings);
+	auto range = set_cache.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it) {
+		if (it->second.layout == layout && equal_bindings(it->second.bindings, bindings)) {
+			statistics.cache_hits++;
+			return it->second.descriptor_set;
+		}
+	}
+
+	CachedSet entry;
+	entry.layout = layout;
+	entry.bindings = bindings;
+	entry.descriptor_set = allocate_from(cache_pools, layout);
+	if (entry.descriptor_set == VK_NULL_HANDLE) {
+		return VK_NULL_HANDLE;
+	}
+	write(entry.descriptor_set, bindings);
+
+	set_cache.emplace(hash, entry);
+	statistics.cache_misses++;
+	statistics.cached_sets = static_cast<uint32_t>(set_cache.size());
+
+	return entry.descriptor_set;
+}
+
+/**
+* Release the cached sets, the pending frames must not use them anymore
+*/
+void VulkanDescriptorAllocator::clear_cache()
+{
+	for (uint32_t i = 0; i < cache_pools.pools.size(); ++i) {
+		VK_CHECK_RESULT(vkResetDescriptorPool(*device, cache_pools.pools[i], 0));
+	}
+	cache_pools.current = 0;
+	cache_pools.allocations = 0;
+	set_cache.clear();
+	statistics.cached_sets = 0;
+}
+
+VkDescriptorSet VulkanDescriptorAllocator::allocate_from(PoolChain& chain, VkDescriptorSetLayout layout)
+{
+	VkDescriptorSetAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &layout;
+
+	// Move along the chain until a pool has room, a new pool is added at the end of the chain
+	// A new pool without room means the layout needs more or other descriptors than a pool holds
+	VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+	while (true) {
+		bool new_pool = false;
+		if (chain.current == chain.pools.size()) {
+			uint32_t max_sets = std::min<uint32_t>(DESCRIPTOR_POOL_SETS << std::min<size_t>(chain.pools.size(), 16), DESCRIPTOR_POOL_MAX_SETS);
+			chain.pools.push_back(create_pool(max_sets));
+			new_pool = true;
+		}
+
+		alloc_info.descriptorPool = chain.pools[chain.current];
+		VkResult result = vkAllocateDescriptorSets(*device, &alloc_info, &descriptor_set);
+		if (result == VK_SUCCESS) {
+			break;
+		}
+		if ((result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) || new_pool) {
+			VK_CHECK_RESULT(result);
+			std::cout << "Descriptor set layout not allocatable from the descriptor pools\n";
+			return VK_NULL_HANDLE;
+		}
+		chain.current++;
+	}
+	chain.allocations++;
+
+	return descriptor_set;
+}
+
+VkDescriptorPool VulkanDescriptorAllocator::create_pool(uint32_t max_sets)
+{
+	std::array<VkDescriptorPoolSize, pool_ratios.size()> pool_sizes;
+	for (uint32_t i = 0; i < pool_ratios.size(); ++i) {
+		pool_sizes[i].type = pool_ratios[i].first;
+		pool_sizes[i].descriptorCount = pool_ratios[i].second * max_sets;
+	}
+
+	VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
+	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptor_pool_create_info.maxSets = max_sets;
+	descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+	descriptor_pool_create_info.pPoolSizes = pool_sizes.data();
+
+	VkDescriptorPool descriptor_pool;
+	VK_CHECK_RESULT(vkCreateDescriptorPool(*device, &descriptor_pool_create_info, nullptr, &descriptor_pool));
+	statistics.pools_created++;
+
+	return descriptor_pool;
+}
+
+void VulkanDescriptorAllocator::destroy_chain(PoolChain& chain)
+{
+	for (auto pool : chain.pools) {
+		vkDestroyDescriptorPool(*device, pool, nullptr);
+	}
+	chain = {};
+}
+
+void VulkanDescriptorAllocator::write(VkDescriptorSet descriptor_set, const std::vector<DescriptorBinding>& bindings)
+{
+	std::vector<VkWriteDescriptorSet> write_descriptor_sets(bindings.size());
+	for (uint32_t i = 0; i < bindings.size(); ++i) {
+		const DescriptorBinding& binding = bindings[i];
+		bool is_image = binding.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+			binding.type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+			binding.type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+			binding.type == VK_DESCRIPTOR_TYPE_SAMPLER;
+
+		write_descriptor_sets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write_descriptor_sets[i].dstSet = descriptor_set;
+		write_descriptor_sets[i].dstBinding = binding.binding;
+		write_descriptor_sets[i].dstArrayElement = 0;
+		write_descriptor_sets[i].descriptorCount = 1;
+		write_descriptor_sets[i].descriptorType = binding.type;
+		write_descriptor_sets[i].pImageInfo = is_image ? &binding.image_info : nullptr;
+		write_descriptor_sets[i].pBufferInfo = is_image ? nullptr : &binding.buffer_info;
+	}
+
+	vkUpdateDescriptorSets(*device, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+}
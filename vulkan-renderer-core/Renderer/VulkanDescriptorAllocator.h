@@ -0,0 +1,104 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+
+/* Sets of the first pool of a chain, each new pool of the chain doubles it */
+#define DESCRIPTOR_POOL_SETS			64
+#define DESCRIPTOR_POOL_MAX_SETS		4096
+
+/** @brief Resource written in one binding of a descriptor set */
+struct DescriptorBinding {
+	uint32_t binding;
+	VkDescriptorType type;
+	VkDescriptorBufferInfo buffer_info;
+	VkDescriptorImageInfo image_info;
+};
+
+struct DescriptorAllocatorStatistics {
+	/** @brief Sets allocated for the current frame */
+	uint32_t frame_allocations;
+	/** @brief Pools in the chain of the current frame */
+	uint32_t frame_pools;
+	uint32_t pools_created;
+	uint32_t cached_layouts;
+	uint32_t cached_sets;
+	uint32_t cache_hits;
+	uint32_t cache_misses;
+};
+
+/**
+* Descriptor set allocation service
+*
+* - transient sets are allocated from a chain of pools owned by each frame in flight, the chain
+*   grows when a pool runs out and is reset wholesale with vkResetDescriptorPool once the frame retires
+* - immutable sets are cached for the lifetime of the allocator, keyed by a hash of their layout
+*   and of the resources of their bindings, so that the same material always gets the same set
+* - set layouts are cached by a hash of their bindings
+*
+* The cached sets hold the handles of their resources, they must be cleared with clear_cache
+* when these resources are destroyed
+*/
+class VulkanDescriptorAllocator
+{
+public:
+	VulkanDescriptorAllocator();
+	~VulkanDescriptorAllocator();
+
+	bool								create(VulkanDevice* device, uint32_t frames_count);
+	void								shutdown();
+	void								set_frames_count(uint32_t frames_count);
+
+	void								begin_frame(uint32_t frame_index);
+
+	VkDescriptorSetLayout				get_layout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+	VkDescriptorSet						allocate(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+	VkDescriptorSet						get_cached(VkDescriptorSetLayout layout, const std::vector<DescriptorBinding>& bindings);
+	void								clear_cache();
+
+	const DescriptorAllocatorStatistics&	get_statistics() const { return statistics; };
+
+private:
+	struct PoolChain {
+		std::vector<VkDescriptorPool> pools;
+		/* pool the sets are allocated from, the previous ones are full */
+		uint32_t current;
+		uint32_t allocations;
+	};
+
+	struct CachedLayout {
+		std::vector<VkDescriptorSetLayoutBinding> bindings;
+		VkDescriptorSetLayout layout;
+	};
+
+	struct CachedSet {
+		VkDescriptorSetLayout layout;
+		std::vector<DescriptorBinding> bindings;
+		VkDescriptorSet descriptor_set;
+	};
+
+	VulkanDevice*						device;
+	uint32_t							frame_index;
+
+	std::vector<PoolChain>				frame_pools;
+	/* pools of the cached sets, never reset */
+	PoolChain							cache_pools;
+
+	std::unordered_multimap<uint64_t, CachedLayout>		layout_cache;
+	std::unordered_multimap<uint64_t, CachedSet>		set_cache;
+
+	DescriptorAllocatorStatistics		statistics;
+
+	VkDescriptorSet						allocate_from(PoolChain& chain, VkDescriptorSetLayout layout);
+	VkDescriptorPool					create_pool(uint32_t max_sets);
+	void								destroy_chain(PoolChain& chain);
+	void								write(VkDescriptorSet descriptor_set, const std::vector<DescriptorBinding>& bindings);
+};
@@ -2,8 +2,31 @@
 
 
 VulkanDevice::VulkanDevice()
-	: physical_device(VK_NULL_HANDLE)
-	, logical_device(VK_NULL_HANDLE)
+	: logical_device(VK_NULL_HANDLE)
+	, physical_device(VK_NULL_HANDLE)
+	, async_compute(false)
+	, async_transfer(false)
+	, properties({})
+	, features({})
+	, descriptor_indexing_features({})
+	, cmd_draw_indexed_indirect_count(nullptr)
+	, dynamic_rendering(false)
+#ifdef VK_KHR_dynamic_rendering
+	, cmd_begin_rendering(nullptr)
+	, cmd_end_rendering(nullptr)
+#endif
+	, get_refresh_cycle_duration(nullptr)
+	, get_past_presentation_timing(nullptr)
+	, timeline_semaphore(false)
+#ifdef VK_KHR_timeline_semaphore
+	, get_semaphore_counter_value(nullptr)
+	, wait_semaphores(nullptr)
+#endif
+	, present_wait(false)
+#ifdef VK_KHR_present_wait
+	, wait_for_present(nullptr)
+#endif
+	, debug(nullptr)
 {
 }
 
@@ -12,10 +35,38 @@ VulkanDevice::~VulkanDevice()
 {
 }
 
-bool VulkanDevice::create(VkInstance instance, VkSurfaceKHR presentation_surface)
+/**
+* Create the logical device on the physical device with the best score
+*
+* @param preferred_device UUID or part of the name of the physical device to create the device on, empty to select it by score
+*/
+bool VulkanDevice::create(VkInstance instance, VkSurfaceKHR presentation_surface, const std::string& preferred_device)
 {
 	this->instance = instance;
 	this->presentation_surface = presentation_surface;
+
+	std::vector<const char*> device_extensions = get_required_extensions();
+	select_physical_device(device_extensions, preferred_device);
+	if (this->physical_device == VK_NULL_HANDLE) {
+		throw std::runtime_error("Cannot find a physical device");
+	}
+	return this->create_device();
+}
+
+/**
+* Create a logical device without presentation on a given physical device, for the offline rendering
+*
+* @return False when the physical device cannot run the renderer
+*/
+bool VulkanDevice::create(VkInstance instance, VkPhysicalDevice physical_device)
+{
+	this->instance = instance;
+	this->presentation_surface = VK_NULL_HANDLE;
+
+	if (score_physical_device(physical_device, get_required_extensions()) < 0) {
+		return false;
+	}
+	this->physical_device = physical_device;
 	return this->create_device();
 }
 
@@ -32,30 +83,19 @@ void VulkanDevice::shutdown()
 
 bool VulkanDevice::create_device()
 {
-	std::vector<VkPhysicalDevice> physical_devices;
-	get_physical_devices(physical_devices);
-
-	std::vector<const char*> device_extensions;
-	device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
-
-	for (auto& physical_device : physical_devices) {
-		if (check_physical_device(physical_device, device_extensions)) {
-			this->physical_device = physical_device;
-			break;
-		}
-	}
-
-	if (this->physical_device == VK_NULL_HANDLE) {
-		throw std::runtime_error("Cannot find a physical device");
-	}
+	std::vector<const char*> device_extensions = get_required_extensions();
+	vkGetPhysicalDeviceProperties(physical_device, &properties);
 
 	// Create the queues and logical device
+	add_optional_extensions(device_extensions);
 	create_logical_device(device_extensions);
+	load_extension_functions();
 
 	// Get the graphic and compute queue from the device
 	vkGetDeviceQueue(logical_device, graphics_queue_family_index, 0, &graphics_queue);
 	vkGetDeviceQueue(logical_device, compute_queue_family_index, 0, &compute_queue);
 	vkGetDeviceQueue(logical_device, present_queue_family_index, 0, &present_queue);
+	vkGetDeviceQueue(logical_device, transfer_queue_family_index, 0, &transfer_queue);
 
 	// Get the memory properties of the physical device
 	get_physical_device_memory_properties(memory_properties);
@@ -65,9 +105,115 @@ bool VulkanDevice::create_device()
 
 void VulkanDevice::create_logical_device(std::vector<const char *> &device_extensions)
 {
-	// Get the physical device features
-	VkPhysicalDeviceFeatures device_features;
-	vkGetPhysicalDeviceFeatures(physical_device, &device_features);
+	enabled_extensions = device_extensions;
+
+	// The supported features of the enabled extensions are queried in one chain
+	VkPhysicalDeviceFeatures2 supported_features = {};
+	supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported_descriptor_indexing = {};
+	supported_descriptor_indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	if (is_extension_enabled(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+		supported_descriptor_indexing.pNext = supported_features.pNext;
+		supported_features.pNext = &supported_descriptor_indexing;
+	}
+#ifdef VK_KHR_dynamic_rendering
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR supported_dynamic_rendering = {};
+	supported_dynamic_rendering.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+	if (is_extension_enabled(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+		supported_dynamic_rendering.pNext = supported_features.pNext;
+		supported_features.pNext = &supported_dynamic_rendering;
+	}
+#endif
+#ifdef VK_KHR_timeline_semaphore
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR supported_timeline_semaphore = {};
+	supported_timeline_semaphore.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	if (is_extension_enabled(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+		supported_timeline_semaphore.pNext = supported_features.pNext;
+		supported_features.pNext = &supported_timeline_semaphore;
+	}
+#endif
+#ifdef VK_KHR_present_wait
+	VkPhysicalDevicePresentIdFeaturesKHR supported_present_id = {};
+	supported_present_id.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	VkPhysicalDevicePresentWaitFeaturesKHR supported_present_wait = {};
+	supported_present_wait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	if (is_extension_enabled(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+		supported_present_wait.pNext = supported_features.pNext;
+		supported_present_id.pNext = &supported_present_wait;
+		supported_features.pNext = &supported_present_id;
+	}
+#endif
+	vkGetPhysicalDeviceFeatures2(physical_device, &supported_features);
+
+	// Only the features the renderer uses are enabled, enabling the others may disable fast paths of the driver
+	const VkPhysicalDeviceFeatures& supported = supported_features.features;
+	features = {};
+	features.samplerAnisotropy = supported.samplerAnisotropy;
+	features.multiDrawIndirect = supported.multiDrawIndirect;
+	features.drawIndirectFirstInstance = supported.drawIndirectFirstInstance;
+	// The fragment shaders write the texture streaming feedback
+	features.fragmentStoresAndAtomics = supported.fragmentStoresAndAtomics;
+	// The streamed textures keep the block compressed formats of their files
+	features.textureCompressionBC = supported.textureCompressionBC;
+	features.textureCompressionETC2 = supported.textureCompressionETC2;
+	features.textureCompressionASTC_LDR = supported.textureCompressionASTC_LDR;
+
+	VkPhysicalDeviceFeatures2 enabled_features = {};
+	enabled_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	enabled_features.features = features;
+
+	// Only the descriptor indexing features used by the bindless descriptors are enabled
+	descriptor_indexing_features = {};
+	descriptor_indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	if (is_extension_enabled(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+		descriptor_indexing_features.shaderSampledImageArrayNonUniformIndexing = supported_descriptor_indexing.shaderSampledImageArrayNonUniformIndexing;
+		descriptor_indexing_features.shaderStorageBufferArrayNonUniformIndexing = supported_descriptor_indexing.shaderStorageBufferArrayNonUniformIndexing;
+		descriptor_indexing_features.descriptorBindingSampledImageUpdateAfterBind = supported_descriptor_indexing.descriptorBindingSampledImageUpdateAfterBind;
+		descriptor_indexing_features.descriptorBindingStorageBufferUpdateAfterBind = supported_descriptor_indexing.descriptorBindingStorageBufferUpdateAfterBind;
+		descriptor_indexing_features.descriptorBindingUpdateUnusedWhilePending = supported_descriptor_indexing.descriptorBindingUpdateUnusedWhilePending;
+		descriptor_indexing_features.descriptorBindingPartiallyBound = supported_descriptor_indexing.descriptorBindingPartiallyBound;
+		descriptor_indexing_features.runtimeDescriptorArray = supported_descriptor_indexing.runtimeDescriptorArray;
+		descriptor_indexing_features.pNext = enabled_features.pNext;
+		enabled_features.pNext = &descriptor_indexing_features;
+	}
+
+	// The render passes are begun without render pass and frame buffer objects when dynamic rendering is supported
+#ifdef VK_KHR_dynamic_rendering
+	VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features = {};
+	dynamic_rendering_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR;
+	dynamic_rendering = supported_dynamic_rendering.dynamicRendering == VK_TRUE;
+	if (dynamic_rendering) {
+		dynamic_rendering_features.dynamicRendering = VK_TRUE;
+		dynamic_rendering_features.pNext = enabled_features.pNext;
+		enabled_features.pNext = &dynamic_rendering_features;
+	}
+#endif
+#ifdef VK_KHR_timeline_semaphore
+	// The queue timelines signal a timeline semaphore instead of a fence per submission
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_semaphore_features = {};
+	timeline_semaphore_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	timeline_semaphore = supported_timeline_semaphore.timelineSemaphore == VK_TRUE;
+	if (timeline_semaphore) {
+		timeline_semaphore_features.timelineSemaphore = VK_TRUE;
+		timeline_semaphore_features.pNext = enabled_features.pNext;
+		enabled_features.pNext = &timeline_semaphore_features;
+	}
+#endif
+#ifdef VK_KHR_present_wait
+	// Presents are waited for by their identifier, both features are needed
+	VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {};
+	present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {};
+	present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	present_wait = supported_present_id.presentId == VK_TRUE && supported_present_wait.presentWait == VK_TRUE;
+	if (present_wait) {
+		present_id_features.presentId = VK_TRUE;
+		present_wait_features.presentWait = VK_TRUE;
+		present_wait_features.pNext = enabled_features.pNext;
+		present_id_features.pNext = &present_wait_features;
+		enabled_features.pNext = &present_id_features;
+	}
+#endif
 
 	// Create the queues creation informations
 	const float default_queue_priority(0.0f);
@@ -86,9 +232,10 @@ void VulkanDevice::create_logical_device(std::vector<const char *> &device_exten
 	// Create the logical device
 	VkDeviceCreateInfo device_create_info = {};
 	device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());;
+	device_create_info.pNext = &enabled_features;
+	device_create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
 	device_create_info.pQueueCreateInfos = queue_create_infos.data();
-	device_create_info.pEnabledFeatures = &device_features;
+	device_create_info.pEnabledFeatures = nullptr;
 	device_create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
 	device_create_info.ppEnabledExtensionNames = device_extensions.data();
 
@@ -98,6 +245,160 @@ void VulkanDevice::create_logical_device(std::vector<const char *> &device_exten
 	}
 }
 
+/**
+* Extensions the device must support, the swapchain is only needed with a presentation surface
+*/
+std::vector<const char*> VulkanDevice::get_required_extensions() const
+{
+	std::vector<const char*> device_extensions;
+	if (presentation_surface != VK_NULL_HANDLE) {
+		device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+	}
+	return device_extensions;
+}
+
+/**
+* Extensions the renderer can use when the physical device supports them
+*/
+const std::vector<const char*>& VulkanDevice::get_optional_extensions()
+{
+	static const std::vector<const char*> optional_extensions = {
+		VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+		VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+#ifdef VK_EXT_memory_budget
+		VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+#endif
+#ifdef VK_KHR_dynamic_rendering
+		// Dependencies of VK_KHR_dynamic_rendering on a Vulkan 1.1 device
+		VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME,
+		VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME,
+		VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME,
+#endif
+		VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME,
+#ifdef VK_KHR_timeline_semaphore
+		VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME,
+#endif
+#ifdef VK_KHR_present_wait
+		VK_KHR_PRESENT_ID_EXTENSION_NAME,
+		VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+#endif
+	};
+	return optional_extensions;
+}
+
+/**
+* Enable the extensions the renderer can use when the physical device supports them
+*
+* @param device_extensions Extensions to enable, the supported optional extensions are appended
+*/
+void VulkanDevice::add_optional_extensions(std::vector<const char *> &device_extensions)
+{
+	std::vector<VkExtensionProperties> device_extensions_properties;
+	get_device_extensions_properties(physical_device, device_extensions_properties);
+
+	for (auto& extension : get_optional_extensions()) {
+		if (vks::tools::is_extension_supported(device_extensions_properties, extension)) {
+			device_extensions.push_back(extension);
+		}
+	}
+
+	// The presentation extensions depend on VK_KHR_swapchain
+	if (presentation_surface == VK_NULL_HANDLE) {
+		device_extensions.erase(std::remove_if(device_extensions.begin(), device_extensions.end(), [](const char* extension) {
+			return strcmp(extension, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME) == 0
+#ifdef VK_KHR_present_wait
+				|| strcmp(extension, VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0 || strcmp(extension, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0
+#endif
+				;
+		}), device_extensions.end());
+	}
+
+#ifdef VK_KHR_dynamic_rendering
+	if (!vks::tools::is_extension_supported(device_extensions_properties, VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME)
+		|| !vks::tools::is_extension_supported(device_extensions_properties, VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME)) {
+		device_extensions.erase(std::remove_if(device_extensions.begin(), device_extensions.end(), [](const char* extension) {
+			return strcmp(extension, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) == 0;
+		}), device_extensions.end());
+	}
+#endif
+#ifdef VK_KHR_present_wait
+	if (!vks::tools::is_extension_supported(device_extensions_properties, VK_KHR_PRESENT_ID_EXTENSION_NAME)) {
+		device_extensions.erase(std::remove_if(device_extensions.begin(), device_extensions.end(), [](const char* extension) {
+			return strcmp(extension, VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0;
+		}), device_extensions.end());
+	}
+#endif
+}
+
+void VulkanDevice::load_extension_functions()
+{
+	if (is_extension_enabled(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+		cmd_draw_indexed_indirect_count = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+			vkGetDeviceProcAddr(logical_device, "vkCmdDrawIndexedIndirectCountKHR"));
+	}
+#ifdef VK_KHR_dynamic_rendering
+	if (dynamic_rendering) {
+		cmd_begin_rendering = reinterpret_cast<PFN_vkCmdBeginRenderingKHR>(vkGetDeviceProcAddr(logical_device, "vkCmdBeginRenderingKHR"));
+		cmd_end_rendering = reinterpret_cast<PFN_vkCmdEndRenderingKHR>(vkGetDeviceProcAddr(logical_device, "vkCmdEndRenderingKHR"));
+	}
+#endif
+	if (is_extension_enabled(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME)) {
+		get_refresh_cycle_duration = reinterpret_cast<PFN_vkGetRefreshCycleDurationGOOGLE>(vkGetDeviceProcAddr(logical_device, "vkGetRefreshCycleDurationGOOGLE"));
+		get_past_presentation_timing = reinterpret_cast<PFN_vkGetPastPresentationTimingGOOGLE>(vkGetDeviceProcAddr(logical_device, "vkGetPastPresentationTimingGOOGLE"));
+	}
+#ifdef VK_KHR_timeline_semaphore
+	if (timeline_semaphore) {
+		get_semaphore_counter_value = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(logical_device, "vkGetSemaphoreCounterValueKHR"));
+		wait_semaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(logical_device, "vkWaitSemaphoresKHR"));
+	}
+#endif
+#ifdef VK_KHR_present_wait
+	if (present_wait) {
+		wait_for_present = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(logical_device, "vkWaitForPresentKHR"));
+	}
+#endif
+}
+
+/**
+* Check the optimal tiling features of a format
+*
+* @param format Format
+* @param features Features the format must support
+*/
+bool VulkanDevice::is_format_supported(VkFormat format, VkFormatFeatureFlags features) const
+{
+	VkFormatProperties format_properties;
+	vkGetPhysicalDeviceFormatProperties(physical_device, format, &format_properties);
+	return (format_properties.optimalTilingFeatures & features) == features;
+}
+
+/**
+* Get the first supported format of a list
+*
+* @param candidates Formats, by order of preference
+* @param features Features the format must support
+* @return Supported format, VK_FORMAT_UNDEFINED when none is supported
+*/
+VkFormat VulkanDevice::get_supported_format(const std::vector<VkFormat>& candidates, VkFormatFeatureFlags features) const
+{
+	for (auto& format : candidates) {
+		if (is_format_supported(format, features)) {
+			return format;
+		}
+	}
+	return VK_FORMAT_UNDEFINED;
+}
+
+bool VulkanDevice::is_extension_enabled(const char* extension) const
+{
+	for (auto& enabled_extension : enabled_extensions) {
+		if (strcmp(enabled_extension, extension) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 bool VulkanDevice::get_physical_devices(std::vector<VkPhysicalDevice>& physical_devices)
 {
 	uint32_t devices_count = 0;
@@ -117,23 +418,180 @@ bool VulkanDevice::get_physical_devices(std::vector<VkPhysicalDevice>& physical_
 	return true;
 }
 
-bool VulkanDevice::check_physical_device(VkPhysicalDevice physical_device, const std::vector<const char*> device_extensions)
+/**
+* Select the physical device the logical device is created on
+* The preferred device is selected when it supports the renderer, otherwise the device with the best score
+*
+* @param device_extensions Extensions the device must support
+* @param preferred_device UUID or part of the name of the physical device, empty to select it by score
+*/
+void VulkanDevice::select_physical_device(const std::vector<const char*>& device_extensions, const std::string& preferred_device)
 {
-	// Get the features and properties of the physical device
-	VkPhysicalDeviceFeatures device_features;
-	VkPhysicalDeviceProperties device_properties;
-	vkGetPhysicalDeviceFeatures(physical_device, &device_features);
-	vkGetPhysicalDeviceProperties(physical_device, &device_properties);
-
-	// If the physical device doesn't support geometry shader,
-	// skip to the next device
-	if (!device_features.geometryShader) {
-		return false;
+	std::vector<VkPhysicalDevice> physical_devices;
+	get_physical_devices(physical_devices);
+
+	physical_device = VK_NULL_HANDLE;
+	int64_t best_score = -1;
+	bool preferred_found = false;
+	for (auto& candidate : physical_devices) {
+		VkPhysicalDeviceIDProperties id_properties = {};
+		id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+		VkPhysicalDeviceProperties2 candidate_properties = {};
+		candidate_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		candidate_properties.pNext = &id_properties;
+		vkGetPhysicalDeviceProperties2(candidate, &candidate_properties);
+		const std::string name = candidate_properties.properties.deviceName;
+		const std::string uuid = format_uuid(id_properties.deviceUUID);
+
+		const int64_t score = score_physical_device(candidate, device_extensions);
+		std::cout << "Physical device '" << name << "' " << uuid << ", score " << score << std::endl;
+		if (score < 0 || preferred_found) {
+			continue;
+		}
+
+		if (!preferred_device.empty() && matches_device(name, uuid, preferred_device)) {
+			physical_device = candidate;
+			preferred_found = true;
+		}
+		else if (score > best_score) {
+			physical_device = candidate;
+			best_score = score;
+		}
+	}
+
+	if (!preferred_device.empty() && !preferred_found) {
+		std::cout << "Preferred physical device '" << preferred_device << "' not found or not supported, selecting by score" << std::endl;
+	}
+}
+
+/**
+* Score of a physical device for the renderer, a discrete device is preferred whatever the rest of its score,
+* then the devices with the most device local memory, queues running next to the graphics queue and optional extensions
+*
+* @param device_extensions Extensions the device must support
+* @return Score of the device, -1 when it cannot run the renderer
+*/
+int64_t VulkanDevice::score_physical_device(VkPhysicalDevice candidate, const std::vector<const char*>& device_extensions)
+{
+	VkPhysicalDeviceProperties candidate_properties;
+	vkGetPhysicalDeviceProperties(candidate, &candidate_properties);
+	// The features are negotiated with vkGetPhysicalDeviceFeatures2
+	if (candidate_properties.apiVersion < VK_API_VERSION_1_1) {
+		return -1;
+	}
+	if (!check_physical_device_extensions(candidate, device_extensions)) {
+		return -1;
+	}
+
+	uint32_t queue_families_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(candidate, &queue_families_count, nullptr);
+	std::vector<VkQueueFamilyProperties> queue_families(queue_families_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(candidate, &queue_families_count, queue_families.data());
+
+	// A family must present to the surface, the presentation on another family than the graphics family needs an ownership transfer
+	bool graphics = false;
+	bool present = false;
+	bool graphics_present = false;
+	bool compute_only = false;
+	bool transfer_only = false;
+	for (uint32_t i = 0; i < queue_families_count; ++i) {
+		const VkQueueFlags flags = queue_families[i].queueFlags;
+		if (queue_families[i].queueCount == 0) {
+			continue;
+		}
+		VkBool32 presentation_supported = VK_FALSE;
+		if (presentation_surface != VK_NULL_HANDLE) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(candidate, i, presentation_surface, &presentation_supported);
+		}
+		graphics |= (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
+		present |= presentation_supported == VK_TRUE;
+		graphics_present |= (flags & VK_QUEUE_GRAPHICS_BIT) != 0 && presentation_supported == VK_TRUE;
+		compute_only |= (flags & VK_QUEUE_COMPUTE_BIT) != 0 && (flags & VK_QUEUE_GRAPHICS_BIT) == 0;
+		transfer_only |= (flags & VK_QUEUE_TRANSFER_BIT) != 0 && (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0;
+	}
+	if (!graphics || (presentation_surface != VK_NULL_HANDLE && !present)) {
+		return -1;
+	}
+
+	int64_t score = 0;
+	switch (candidate_properties.deviceType) {
+	case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+		score += DEVICE_SCORE_DISCRETE;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+		score += DEVICE_SCORE_INTEGRATED;
+		break;
+	case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+		score += DEVICE_SCORE_VIRTUAL;
+		break;
+	default:
+		break;
+	}
+
+	// The largest device local heap holds the textures and the meshes
+	VkPhysicalDeviceMemoryProperties candidate_memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(candidate, &candidate_memory_properties);
+	VkDeviceSize local_memory = 0;
+	for (uint32_t heap = 0; heap < candidate_memory_properties.memoryHeapCount; ++heap) {
+		if (candidate_memory_properties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			local_memory = std::max(local_memory, candidate_memory_properties.memoryHeaps[heap].size);
+		}
+	}
+	score += static_cast<int64_t>(local_memory >> 30) * DEVICE_SCORE_LOCAL_MEMORY_GB;
+
+	score += graphics_present ? DEVICE_SCORE_GRAPHICS_PRESENT : 0;
+	score += compute_only ? DEVICE_SCORE_ASYNC_COMPUTE : 0;
+	score += transfer_only ? DEVICE_SCORE_ASYNC_TRANSFER : 0;
+
+	std::vector<VkExtensionProperties> device_extensions_properties;
+	get_device_extensions_properties(candidate, device_extensions_properties);
+	for (auto& extension : get_optional_extensions()) {
+		if (vks::tools::is_extension_supported(device_extensions_properties, extension)) {
+			score += DEVICE_SCORE_OPTIONAL_EXTENSION;
+		}
+	}
+
+	return score;
+}
+
+/**
+* Check if a physical device is named by a UUID, with or without dashes, or by a part of its name
+*/
+bool VulkanDevice::matches_device(const std::string& name, const std::string& uuid, const std::string& device)
+{
+	std::string lower_device;
+	std::string compact_device;
+	for (auto c : device) {
+		lower_device.push_back(static_cast<char>(tolower(static_cast<unsigned char>(c))));
+		if (c != '-') {
+			compact_device.push_back(lower_device.back());
+		}
+	}
+	std::string compact_uuid = uuid;
+	compact_uuid.erase(std::remove(compact_uuid.begin(), compact_uuid.end(), '-'), compact_uuid.end());
+	if (compact_device == compact_uuid) {
+		return true;
+	}
+
+	std::string lower_name;
+	for (auto c : name) {
+		lower_name.push_back(static_cast<char>(tolower(static_cast<unsigned char>(c))));
 	}
+	return lower_name.find(lower_device) != std::string::npos;
+}
 
-	if (!check_physical_device_extensions(physical_device, device_extensions)) {
-		return false;;
+std::string VulkanDevice::format_uuid(const uint8_t uuid[VK_UUID_SIZE])
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string text;
+	for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+		if (i == 4 || i == 6 || i == 8 || i == 10) {
+			text.push_back('-');
+		}
+		text.push_back(digits[uuid[i] >> 4]);
+		text.push_back(digits[uuid[i] & 0xF]);
 	}
+	return text;
 }
 
 bool VulkanDevice::check_physical_device_extensions(VkPhysicalDevice physical_device, const std::vector<const char *> & desired_extensions)
@@ -194,29 +652,128 @@ bool VulkanDevice::get_memory_type(uint32_t type_bits, VkFlags requirements_mask
 	return false;
 }
 
+/**
+* Create a buffer, allocate and bind its memory
+* Host visible buffers stay persistently mapped in buffer->mapped
+*
+* @param usage Usage flags of the buffer
+* @param memory_properties Memory properties required for the allocation
+* @param size Size of the buffer in bytes
+* @param buffer Buffer to fill
+* @param data Optional data copied into the buffer (host visible memory only)
+*/
+bool VulkanDevice::create_buffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkDeviceSize size, VulkanBuffer* buffer, const void* data)
+{
+	buffer->buffer = VK_NULL_HANDLE;
+	buffer->memory = VK_NULL_HANDLE;
+	buffer->mapped = nullptr;
+	buffer->size = size;
+
+	VkBufferCreateInfo buffer_create_info = {};
+	buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_create_info.usage = usage;
+	buffer_create_info.size = size;
+	buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// The buffers are used by the graphics, the async compute and the transfer queues without ownership transfers
+	std::vector<uint32_t> queue_family_indices = { graphics_queue_family_index };
+	if (async_compute) {
+		queue_family_indices.push_back(compute_queue_family_index);
+	}
+	if (async_transfer) {
+		queue_family_indices.push_back(transfer_queue_family_index);
+	}
+	if (queue_family_indices.size() > 1) {
+		buffer_create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		buffer_create_info.queueFamilyIndexCount = static_cast<uint32_t>(queue_family_indices.size());
+		buffer_create_info.pQueueFamilyIndices = queue_family_indices.data();
+	}
+	VK_CHECK_RESULT(vkCreateBuffer(logical_device, &buffer_create_info, nullptr, &buffer->buffer));
+
+	VkMemoryRequirements memory_requirements;
+	vkGetBufferMemoryRequirements(logical_device, buffer->buffer, &memory_requirements);
+
+	VkMemoryAllocateInfo memory_allocate_info = {};
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = memory_requirements.size;
+	if (!get_memory_type(memory_requirements.memoryTypeBits, memory_properties, &memory_allocate_info.memoryTypeIndex)) {
+		std::cout << "Could not find a memory type for a buffer." << std::endl;
+		vkDestroyBuffer(logical_device, buffer->buffer, nullptr);
+		buffer->buffer = VK_NULL_HANDLE;
+		return false;
+	}
+	VK_CHECK_RESULT(vkAllocateMemory(logical_device, &memory_allocate_info, nullptr, &buffer->memory));
+	VK_CHECK_RESULT(vkBindBufferMemory(logical_device, buffer->buffer, buffer->memory, 0));
+
+	if (memory_properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		VK_CHECK_RESULT(vkMapMemory(logical_device, buffer->memory, 0, VK_WHOLE_SIZE, 0, &buffer->mapped));
+		if (data != nullptr) {
+			memcpy(buffer->mapped, data, static_cast<size_t>(size));
+		}
+	}
+
+	buffer->buffer_info.buffer = buffer->buffer;
+	buffer->buffer_info.offset = 0;
+	buffer->buffer_info.range = size;
+
+	return true;
+}
+
+void VulkanDevice::destroy_buffer(VulkanBuffer* buffer)
+{
+	if (buffer->mapped != nullptr) {
+		vkUnmapMemory(logical_device, buffer->memory);
+		buffer->mapped = nullptr;
+	}
+	if (buffer->buffer != VK_NULL_HANDLE) {
+		vkDestroyBuffer(logical_device, buffer->buffer, nullptr);
+		buffer->buffer = VK_NULL_HANDLE;
+	}
+	if (buffer->memory != VK_NULL_HANDLE) {
+		vkFreeMemory(logical_device, buffer->memory, nullptr);
+		buffer->memory = VK_NULL_HANDLE;
+	}
+}
+
 std::vector<uint32_t> VulkanDevice::get_queue_indices()
 {
 	// Get the queue family indices
 	graphics_queue_family_index = get_queue_family_index(VK_QUEUE_GRAPHICS_BIT);
-	compute_queue_family_index = get_queue_family_index(VK_QUEUE_COMPUTE_BIT);
-	present_queue_family_index = get_surface_queue_index(presentation_surface);
+	// A compute only family runs the compute passes next to the graphics work
+	compute_queue_family_index = get_queue_family_index(VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+	if (compute_queue_family_index == UINT32_MAX) {
+		compute_queue_family_index = get_queue_family_index(VK_QUEUE_COMPUTE_BIT);
+	}
+	async_compute = compute_queue_family_index != graphics_queue_family_index;
+	// A transfer only family copies on the DMA engines without taking time from the graphics queue
+	transfer_queue_family_index = get_queue_family_index(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+	if (transfer_queue_family_index == UINT32_MAX) {
+		transfer_queue_family_index = graphics_queue_family_index;
+	}
+	async_transfer = transfer_queue_family_index != graphics_queue_family_index;
+	// Without a surface nothing is presented, the present queue is the graphics queue
+	present_queue_family_index = presentation_surface != VK_NULL_HANDLE ? get_surface_queue_index(presentation_surface) : graphics_queue_family_index;
 	if (graphics_queue_family_index == UINT32_MAX ||
 		present_queue_family_index == UINT32_MAX) {
 		throw std::runtime_error("Could not find queues for graphics and presentation");
 	}
 
-	std::vector<uint32_t> queue_indices = { graphics_queue_family_index };
-	if (graphics_queue_family_index != compute_queue_family_index) {
-		queue_indices.push_back(compute_queue_family_index);
-	}
-	if ((graphics_queue_family_index != present_queue_family_index) &&
-		(compute_queue_family_index != present_queue_family_index)) {
-		queue_indices.push_back(present_queue_family_index);
+	// One queue is created per distinct family
+	std::vector<uint32_t> queue_indices;
+	for (auto queue_index : { graphics_queue_family_index, compute_queue_family_index, present_queue_family_index, transfer_queue_family_index }) {
+		if (std::find(queue_indices.begin(), queue_indices.end(), queue_index) == queue_indices.end()) {
+			queue_indices.push_back(queue_index);
+		}
 	}
 	return queue_indices;
 }
 
-uint32_t VulkanDevice::get_queue_family_index(VkQueueFlags desired_queue_flags)
+/**
+* Find the first queue family with the desired flags
+*
+* @param excluded_queue_flags Flags the family must not have
+*/
+uint32_t VulkanDevice::get_queue_family_index(VkQueueFlags desired_queue_flags, VkQueueFlags excluded_queue_flags)
 {
 	std::vector<VkQueueFamilyProperties> queue_family_properties;
 	if (!get_physical_device_queue_family_properties(queue_family_properties)) {
@@ -225,7 +782,8 @@ uint32_t VulkanDevice::get_queue_family_index(VkQueueFlags desired_queue_flags)
 
 	for (uint32_t i = 0; i < static_cast<uint32_t>(queue_family_properties.size()); ++i) {
 		if ((queue_family_properties[i].queueCount > 0) &&
-			((queue_family_properties[i].queueFlags & desired_queue_flags) == desired_queue_flags)) {
+			((queue_family_properties[i].queueFlags & desired_queue_flags) == desired_queue_flags) &&
+			((queue_family_properties[i].queueFlags & excluded_queue_flags) == 0)) {
 			return i;
 		}
 	}
@@ -263,6 +821,15 @@ uint32_t VulkanDevice::get_surface_queue_index(VkSurfaceKHR presentation_surface
 		return UINT32_MAX;
 	}
 
+	// The graphics family presents without ownership transfers when it can
+	if (graphics_queue_family_index != UINT32_MAX) {
+		VkBool32 presentation_supported = VK_FALSE;
+		VkResult result = vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, graphics_queue_family_index, presentation_surface, &presentation_supported);
+		if ((VK_SUCCESS == result) && (VK_TRUE == presentation_supported)) {
+			return graphics_queue_family_index;
+		}
+	}
+
 	for (uint32_t i = 0; i < static_cast<uint32_t>(queue_family_properties.size()); ++i) {
 		VkBool32 presentation_supported = VK_FALSE;
 		VkResult result = vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, presentation_surface, &presentation_supported);
@@ -2,11 +2,28 @@
 
 #include <cassert>
 #include <iostream>
+#include <string>
 #include <vector>
+#include <cstring>
+#include <algorithm>
 
 #include <vulkan/vulkan.h>
 
 #include "VulkanTools.h"
+#include "VulkanBuffer.h"
+#include "VulkanDebug.h"
+
+/* Weights of the score of the physical devices, a discrete device is preferred whatever the rest of its score */
+#define DEVICE_SCORE_DISCRETE				1000000
+#define DEVICE_SCORE_INTEGRATED				100000
+#define DEVICE_SCORE_VIRTUAL				10000
+/* per GiB of the largest device local heap */
+#define DEVICE_SCORE_LOCAL_MEMORY_GB		100
+/* a graphics family presents without ownership transfers */
+#define DEVICE_SCORE_GRAPHICS_PRESENT		500
+#define DEVICE_SCORE_ASYNC_COMPUTE			500
+#define DEVICE_SCORE_ASYNC_TRANSFER			250
+#define DEVICE_SCORE_OPTIONAL_EXTENSION		100
 
 class VulkanDevice
 {
@@ -14,7 +31,8 @@ public:
 	VulkanDevice();
 	~VulkanDevice();
 
-	bool					create(VkInstance instance, VkSurfaceKHR presentation_surface);
+	bool					create(VkInstance instance, VkSurfaceKHR presentation_surface, const std::string& preferred_device = "");
+	bool					create(VkInstance instance, VkPhysicalDevice physical_device);
 	void					shutdown();
 
 	VkDevice				logical_device;
@@ -24,14 +42,73 @@ public:
 	VkQueue					graphics_queue;
 	VkQueue					compute_queue;
 	VkQueue					present_queue;
+	/** @brief Queue of the uploads, the graphics queue when the device has no transfer only family */
+	VkQueue					transfer_queue;
 
 	uint32_t				graphics_queue_family_index;
 	uint32_t				compute_queue_family_index;
 	uint32_t				present_queue_family_index;
+	uint32_t				transfer_queue_family_index;
+	/** @brief The compute queue is of another family than the graphics queue, the buffers are shared by both families */
+	bool					async_compute;
+	/** @brief The transfer queue is of a transfer only family, the buffers are shared with it and the images are transferred from it */
+	bool					async_transfer;
+
+	/** @brief Properties of the physical device */
+	VkPhysicalDeviceProperties	properties;
+
+	/** @brief Core features enabled on the logical device, only the features the renderer uses */
+	VkPhysicalDeviceFeatures	features;
+
+	/** @brief VK_EXT_descriptor_indexing features enabled on the logical device, all false when the extension is not enabled */
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT	descriptor_indexing_features;
+
+	/** @brief VK_KHR_draw_indirect_count, null when the extension is not enabled */
+	PFN_vkCmdDrawIndexedIndirectCountKHR	cmd_draw_indexed_indirect_count;
+
+	/** @brief VK_KHR_dynamic_rendering is enabled with its dynamicRendering feature, always false with headers older than the extension */
+	bool					dynamic_rendering;
+#ifdef VK_KHR_dynamic_rendering
+	PFN_vkCmdBeginRenderingKHR				cmd_begin_rendering;
+	PFN_vkCmdEndRenderingKHR				cmd_end_rendering;
+#endif
+
+	/** @brief VK_GOOGLE_display_timing, null when the extension is not enabled */
+	PFN_vkGetRefreshCycleDurationGOOGLE		get_refresh_cycle_duration;
+	PFN_vkGetPastPresentationTimingGOOGLE	get_past_presentation_timing;
+
+	/** @brief VK_KHR_timeline_semaphore is enabled with its timelineSemaphore feature, always false with headers older than the extension */
+	bool					timeline_semaphore;
+#ifdef VK_KHR_timeline_semaphore
+	PFN_vkGetSemaphoreCounterValueKHR		get_semaphore_counter_value;
+	PFN_vkWaitSemaphoresKHR					wait_semaphores;
+#endif
+
+	/** @brief VK_KHR_present_wait is enabled with VK_KHR_present_id and their features, always false with headers older than the extension */
+	bool					present_wait;
+#ifdef VK_KHR_present_wait
+	PFN_vkWaitForPresentKHR					wait_for_present;
+#endif
+
+	/** @brief Debug names and labels of the instance, null when debugging is disabled and the names and labels are skipped */
+	VulkanDebug*			debug;
 
 	operator VkDevice() { return logical_device; };
 
+	void					set_object_name(VkObjectType type, uint64_t handle, const char* name) { if (debug != nullptr) debug->set_object_name(logical_device, type, handle, name); };
+	void					begin_label(VkCommandBuffer command_buffer, const char* name) { if (debug != nullptr) debug->begin_label(command_buffer, name); };
+	void					end_label(VkCommandBuffer command_buffer) { if (debug != nullptr) debug->end_label(command_buffer); };
+
+	bool					is_extension_enabled(const char* extension) const;
+
 	bool					get_memory_type(uint32_t type_bits, VkFlags requirement_mask, uint32_t * type_index);
+	const VkPhysicalDeviceMemoryProperties&	get_memory_properties() const { return memory_properties; };
+
+	bool					is_format_supported(VkFormat format, VkFormatFeatureFlags features) const;
+	VkFormat				get_supported_format(const std::vector<VkFormat>& candidates, VkFormatFeatureFlags features) const;
+
+	bool					create_buffer(VkBufferUsageFlags usage, VkMemoryPropertyFlags memory_properties, VkDeviceSize size, VulkanBuffer* buffer, const void* data = nullptr);
+	void					destroy_buffer(VulkanBuffer* buffer);
 
 private:
 	/** @brief Device */
@@ -39,17 +116,26 @@ private:
 		
 	VkPhysicalDeviceMemoryProperties		memory_properties;
 
+	std::vector<const char*>				enabled_extensions;
+
 	bool									create_device();
+	std::vector<const char*>				get_required_extensions() const;
 	void create_logical_device(std::vector<const char *> &device_extensions);
+	static const std::vector<const char*>&	get_optional_extensions();
+	void									add_optional_extensions(std::vector<const char *> &device_extensions);
+	void									load_extension_functions();
 	bool									get_physical_devices(std::vector<VkPhysicalDevice>& physical_devices);
-	bool									check_physical_device(VkPhysicalDevice physical_device, const std::vector<const char*> device_extensions);
+	void									select_physical_device(const std::vector<const char*>& device_extensions, const std::string& preferred_device);
+	int64_t									score_physical_device(VkPhysicalDevice candidate, const std::vector<const char*>& device_extensions);
+	static bool								matches_device(const std::string& name, const std::string& uuid, const std::string& device);
+	static std::string						format_uuid(const uint8_t uuid[VK_UUID_SIZE]);
 	bool									check_physical_device_extensions(VkPhysicalDevice physical_device, const std::vector<const char *> & desired_extensions);
 	bool									get_device_extensions_properties(VkPhysicalDevice physical_device, std::vector<VkExtensionProperties>& device_extensions);
 	void									get_physical_device_features_and_properties(VkPhysicalDeviceFeatures& device_features, VkPhysicalDeviceProperties& device_properties);
 	void									get_physical_device_memory_properties(VkPhysicalDeviceMemoryProperties& device_memory_properties);
 	bool									get_physical_device_queue_family_properties(std::vector<VkQueueFamilyProperties>& queue_family_properties);
 
-	uint32_t								get_queue_family_index(VkQueueFlags desired_queue_flags);
+	uint32_t								get_queue_family_index(VkQueueFlags desired_queue_flags, VkQueueFlags excluded_queue_flags = 0);
 	uint32_t								get_surface_queue_index(VkSurfaceKHR presentation_surface);
 	std::vector<uint32_t>					get_queue_indices();
 };
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "VulkanFramePacer.h"
+
+VulkanFramePacer::VulkanFramePacer()
+	: device(nullptr)
+	, swapchain(VK_NULL_HANDLE)
+	, target_fps(0.0f)
+	, latency_reduction(false)
+	, present_wait_time(0.0)
+	, present_id(0)
+	, present_time({})
+	, present_times({})
+	, statistics({})
+{
+}
+
+VulkanFramePacer::~VulkanFramePacer()
+{
+}
+
+bool VulkanFramePacer::create(VulkanDevice* device)
+{
+	this->device = device;
+
+	statistics = {};
+	statistics.display_timing = device->get_past_presentation_timing != nullptr;
+	statistics.present_wait = device->present_wait;
+	return true;
+}
+
+void VulkanFramePacer::shutdown()
+{
+	swapchain = VK_NULL_HANDLE;
+	past_timings.clear();
+}
+
+/**
+* Set the swapchain the frames are presented to, the present identifiers restart from 1
+*/
+void VulkanFramePacer::set_swapchain(VkSwapchainKHR swapchain)
+{
+	this->swapchain = swapchain;
+	present_id = 0;
+
+	statistics.refresh_duration = 0.0;
+	if (device->get_refresh_cycle_duration != nullptr) {
+		VkRefreshCycleDurationGOOGLE refresh_cycle = {};
+		if (device->get_refresh_cycle_duration(*device, swapchain, &refresh_cycle) == VK_SUCCESS) {
+			statistics.refresh_duration = refresh_cycle.refreshDuration * 1e-9;
+		}
+	}
+}
+
+/**
+* Time, in seconds, the host should wait before starting the next frame
+* Hosts driven by a timer start it with this delay after each frame
+*/
+double VulkanFramePacer::get_frame_delay() const
+{
+	if (frame_start == clock::time_point()) {
+		return 0.0;
+	}
+
+	const clock::time_point now = clock::now();
+	double delay = get_frame_interval() - std::chrono::duration<double>(now - frame_start).count();
+	if (latency_reduction) {
+		delay = std::max(delay, statistics.start_delay - std::chrono::duration<double>(now - frame_end).count());
+	}
+	return std::max(delay, 0.0);
+}
+
+/**
+* Sleep until the next frame should start, without spinning but for the end of the sleep
+*/
+void VulkanFramePacer::wait_for_frame()
+{
+	wait_for_present();
+
+	const double delay = get_frame_delay();
+	if (delay <= 0.0) {
+		return;
+	}
+
+	const clock::time_point deadline = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(delay));
+	if (delay > FRAME_PACER_SPIN_TIME) {
+		std::this_thread::sleep_for(std::chrono::duration<double>(delay - FRAME_PACER_SPIN_TIME));
+	}
+	while (clock::now() < deadline) {
+		std::this_thread::yield();
+	}
+}
+
+/**
+* Start a frame, called before the image of the frame is acquired
+*
+* @param target_fps Frame rate cap, not capped when 0
+* @param latency_reduction Delay the start of the frames by the slack of the previous ones
+*/
+void VulkanFramePacer::begin_frame(float target_fps, bool latency_reduction)
+{
+	this->target_fps = target_fps;
+	this->latency_reduction = latency_reduction;
+
+	present_wait_time = wait_for_present();
+	frame_start = clock::now();
+	statistics.frame_interval = get_frame_interval();
+}
+
+/**
+* End a frame once it was presented and update the delay of the start of the next frames
+*
+* @param blocked_time Time, in seconds, the frame was blocked acquiring its image and waiting for its fence
+*/
+void VulkanFramePacer::end_frame(double blocked_time)
+{
+	frame_end = clock::now();
+
+	// The present margins of the frames are known once they were displayed, some frames read none
+	double slack = blocked_time + present_wait_time;
+	if (statistics.display_timing && !read_present_margin(&slack)) {
+		return;
+	}
+	statistics.slack = slack;
+
+	if (latency_reduction) {
+		statistics.start_delay += FRAME_PACER_GAIN * (slack - FRAME_PACER_SAFETY_MARGIN);
+		statistics.start_delay = std::min(std::max(statistics.start_delay, 0.0), FRAME_PACER_MAX_DELAY);
+	}
+	else {
+		statistics.start_delay = 0.0;
+	}
+}
+
+/**
+* Structures to chain to the present info of the frame, they identify the present for the present timings
+*/
+const void* VulkanFramePacer::get_present_next()
+{
+	++present_id;
+
+	const void* next = nullptr;
+	if (statistics.display_timing) {
+		present_time.presentID = static_cast<uint32_t>(present_id);
+		present_time.desiredPresentTime = 0;
+
+		present_times.sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE;
+		present_times.pNext = next;
+		present_times.swapchainCount = 1;
+		present_times.pTimes = &present_time;
+		next = &present_times;
+	}
+#ifdef VK_KHR_present_wait
+	if (statistics.present_wait) {
+		present_id_info = {};
+		present_id_info.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		present_id_info.pNext = next;
+		present_id_info.swapchainCount = 1;
+		present_id_info.pPresentIds = &present_id;
+		next = &present_id_info;
+	}
+#endif
+	return next;
+}
+
+/**
+* Period of the frames, 0 when the frame rate is not capped
+*/
+double VulkanFramePacer::get_frame_interval() const
+{
+	if (target_fps <= 0.0f) {
+		return 0.0;
+	}
+
+	// A period that is not a whole number of refresh cycles would alternate between two frame durations
+	double interval = 1.0 / target_fps;
+	if (statistics.refresh_duration > 0.0) {
+		interval = std::max(std::ceil(interval / statistics.refresh_duration - 0.01), 1.0) * statistics.refresh_duration;
+	}
+	return interval;
+}
+
+/**
+* Wait until the frame before the last presented one was displayed
+*
+* @return Time waited, in seconds
+*/
+double VulkanFramePacer::wait_for_present()
+{
+#ifdef VK_KHR_present_wait
+	if (statistics.present_wait && swapchain != VK_NULL_HANDLE && present_id > 1) {
+		const clock::time_point start = clock::now();
+		// A timeout or an out of date swapchain starts the frame anyway
+		device->wait_for_present(*device, swapchain, present_id - 1, FRAME_PACER_PRESENT_TIMEOUT);
+		return std::chrono::duration<double>(clock::now() - start).count();
+	}
+#endif
+	return 0.0;
+}
+
+/**
+* Read the timings of the frames displayed since the last read
+*
+* @param present_margin Smallest present margin of the frames, in seconds, the frame closest to missing its vertical blank
+* @return False when no frame was displayed since the last read
+*/
+bool VulkanFramePacer::read_present_margin(double* present_margin)
+{
+	if (swapchain == VK_NULL_HANDLE) {
+		return false;
+	}
+
+	uint32_t count = 0;
+	VkResult result = device->get_past_presentation_timing(*device, swapchain, &count, nullptr);
+	if (result != VK_SUCCESS || count == 0) {
+		return false;
+	}
+	past_timings.resize(count);
+	result = device->get_past_presentation_timing(*device, swapchain, &count, past_timings.data());
+	if ((result != VK_SUCCESS && result != VK_INCOMPLETE) || count == 0) {
+		return false;
+	}
+
+	uint64_t margin = UINT64_MAX;
+	for (uint32_t i = 0; i < count; ++i) {
+		margin = std::min(margin, past_timings[i].presentMargin);
+	}
+	*present_margin = margin * 1e-9;
+	return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+
+/* Slack kept between the end of a frame and its deadline, in seconds */
+#define FRAME_PACER_SAFETY_MARGIN		0.002
+/* Fraction of the measured slack the start of the next frames is moved by */
+#define FRAME_PACER_GAIN				0.25
+/* Longest delay of the start of a frame, in seconds */
+#define FRAME_PACER_MAX_DELAY			0.1
+/* The end of a sleep is spun on, the system timer may wake the thread up late */
+#define FRAME_PACER_SPIN_TIME			0.002
+/* Longest wait for the present of the previous frame, in nanoseconds */
+#define FRAME_PACER_PRESENT_TIMEOUT		100000000
+
+struct FramePacerStatistics {
+	/* the slack is the present margin of VK_GOOGLE_display_timing, otherwise the time blocked on the swapchain and the fences */
+	bool display_timing;
+	/* the frames wait for the present of the frame before them */
+	bool present_wait;
+	/* in seconds, 0 when unknown */
+	double refresh_duration;
+	double frame_interval;
+	double slack;
+	double start_delay;
+};
+
+/**
+* Frame pacer
+* Starts the CPU frames as late as they can be while still being ready for their vertical blank,
+* so that the input sampled at the start of a frame is displayed sooner, and caps the frame rate
+*
+* The host sleeps in wait_for_frame, or for get_frame_delay, before sampling the input and rendering
+* - the frames are spaced by the period of the target frame rate, rounded up to whole refresh cycles
+*   when VK_GOOGLE_display_timing gives the refresh duration
+* - the start of a frame is delayed by the slack measured on the previous frames minus a safety margin,
+*   the slack is the present margin reported by VK_GOOGLE_display_timing, or otherwise the time the CPU
+*   was blocked acquiring the image and waiting for the fence of the frame
+* - with VK_KHR_present_wait a frame starts once the frame before the previous one was presented,
+*   at most one frame is queued for presentation
+*/
+class VulkanFramePacer
+{
+public:
+	VulkanFramePacer();
+	~VulkanFramePacer();
+
+	bool							create(VulkanDevice* device);
+	void							shutdown();
+
+	void							set_swapchain(VkSwapchainKHR swapchain);
+
+	double							get_frame_delay() const;
+	void							wait_for_frame();
+
+	void							begin_frame(float target_fps, bool latency_reduction);
+	void							end_frame(double blocked_time);
+	const void*						get_present_next();
+
+	const FramePacerStatistics&		get_statistics() const { return statistics; };
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	VulkanDevice*					device;
+	VkSwapchainKHR					swapchain;
+
+	/* settings of the last frame */
+	float							target_fps;
+	bool							latency_reduction;
+
+	clock::time_point				frame_start;
+	clock::time_point				frame_end;
+	/* time waited for a present by the last begin_frame */
+	double							present_wait_time;
+
+	/* identifier of the last present to the swapchain, the presents are numbered from 1 */
+	uint64_t						present_id;
+	VkPresentTimeGOOGLE				present_time;
+	VkPresentTimesInfoGOOGLE		present_times;
+#ifdef VK_KHR_present_wait
+	VkPresentIdKHR					present_id_info;
+#endif
+	std::vector<VkPastPresentationTimingGOOGLE>	past_timings;
+
+	FramePacerStatistics			statistics;
+
+	double							get_frame_interval() const;
+	double							wait_for_present();
+	bool							read_present_margin(double* present_margin);
+};
@@ -8,6 +8,7 @@
 #include <vulkan/vulkan.h>
 
 #include "VulkanTools.h"
+#include "VulkanDebug.h"
 #include "../Framework/Properties.h"
 
 class VulkanInstance
@@ -16,13 +17,17 @@ public:
 	VulkanInstance();
 	~VulkanInstance();
 
-	bool					create();
+	bool					create(const DebugSettings& debug_settings = VulkanDebug::get_default_settings());
 	void					shutdown();
 
 	operator VkInstance() { return instance; };
 
+	/** @brief Debug messenger, names and labels, null when the debug level is DEBUG_LEVEL_NONE or debug_utils is not supported */
+	VulkanDebug*			get_debug() const { return debug; };
+
 private:
 	/** @brief Instance */
 	VkInstance				instance;
-	bool					create_instance();
+	VulkanDebug*			debug;
+	bool					create_instance(const DebugSettings& debug_settings);
 };
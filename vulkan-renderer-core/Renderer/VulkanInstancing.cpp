@@ -0,0 +1,131 @@
+#include "VulkanInstancing.h"
+
+VulkanInstanceBatcher::VulkanInstanceBatcher()
+	: device(nullptr)
+	, version(1)
+{
+}
+
+VulkanInstanceBatcher::~VulkanInstanceBatcher()
+{
+}
+
+bool VulkanInstanceBatcher::create(VulkanDevice* device, uint32_t frames_count)
+{
+	this->device = device;
+
+	instance_buffers.resize(frames_count);
+	instance_buffer_versions.resize(frames_count, 0);
+	for (auto& instance_buffer : instance_buffers) {
+		instance_buffer = {};
+	}
+
+	return true;
+}
+
+void VulkanInstanceBatcher::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy instance buffers\n";
+	for (auto& instance_buffer : instance_buffers) {
+		device->destroy_buffer(&instance_buffer);
+	}
+	instance_buffers.clear();
+	instance_buffer_versions.clear();
+}
+
+/**
+* Group the objects sharing a mesh level of detail and a material into batches
+* and gather their per-instance data contiguously
+*
+* @param objects Objects of the scene
+*/
+void VulkanInstanceBatcher::build(const std::vector<RenderObject>& objects)
+{
+	std::vector<uint32_t> order(objects.size());
+	for (uint32_t i = 0; i < order.size(); ++i) {
+		order[i] = i;
+	}
+
+	// Sort on (mesh, lod, material) so that each batch is a contiguous range of instances
+	std::stable_sort(order.begin(), order.end(), [&objects](uint32_t a, uint32_t b) {
+		if (objects[a].mesh != objects[b].mesh) {
+			return objects[a].mesh < objects[b].mesh;
+		}
+		if (objects[a].lod != objects[b].lod) {
+			return objects[a].lod < objects[b].lod;
+		}
+		return objects[a].material < objects[b].material;
+	});
+
+	batches.clear();
+	instances.resize(objects.size());
+
+	for (uint32_t i = 0; i < order.size(); ++i) {
+		auto& object = objects[order[i]];
+		if (batches.empty() ||
+			batches.back().mesh != object.mesh ||
+			batches.back().lod != object.lod ||
+			batches.back().material != object.material) {
+			InstanceBatch batch = {};
+			batch.mesh = object.mesh;
+			batch.lod = object.lod;
+			batch.material = object.material;
+			batch.first_instance = i;
+			batch.instance_count = 0;
+			batch.transform = glm::mat4(1.0f);
+			batch.transform[3] = glm::vec4(glm::vec3(object.transform[3]), 1.0f);
+			batches.push_back(batch);
+		}
+		batches.back().instance_count++;
+
+		// The instances keep small translations, the batch transform pushed with the draw moves them back
+		instances[i].model = object.transform;
+		instances[i].model[3] -= glm::vec4(glm::vec3(batches.back().transform[3]), 0.0f);
+		instances[i].color = object.color;
+	}
+
+	version++;
+}
+
+/**
+* Copy the instance streams into the buffer of a frame
+* The buffer is only written when the batches changed since its last upload
+*
+* @param frame_index Index of the frame in flight owning the buffer
+*/
+void VulkanInstanceBatcher::upload(uint32_t frame_index)
+{
+	if (instance_buffer_versions[frame_index] == version) {
+		return;
+	}
+
+	VkDeviceSize size = std::max<VkDeviceSize>(instances.size(), 1) * sizeof(InstanceData);
+	reserve(frame_index, size);
+
+	if (!instances.empty()) {
+		memcpy(instance_buffers[frame_index].mapped, instances.data(), instances.size() * sizeof(InstanceData));
+	}
+	instance_buffer_versions[frame_index] = version;
+}
+
+void VulkanInstanceBatcher::reserve(uint32_t frame_index, VkDeviceSize size)
+{
+	auto& instance_buffer = instance_buffers[frame_index];
+	if (instance_buffer.buffer != VK_NULL_HANDLE && instance_buffer.size >= size) {
+		return;
+	}
+
+	// Grow geometrically to avoid reallocating when objects are added one by one
+	VkDeviceSize capacity = std::max<VkDeviceSize>(size, instance_buffer.size * 2);
+
+	device->destroy_buffer(&instance_buffer);
+	device->create_buffer(
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		capacity,
+		&instance_buffer);
+}
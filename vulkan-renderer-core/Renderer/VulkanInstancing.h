@@ -0,0 +1,68 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "VulkanTools.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+
+/** @brief Per-instance vertex stream (VK_VERTEX_INPUT_RATE_INSTANCE), also read by the cluster culling */
+struct InstanceData {
+	glm::mat4 model;
+	glm::vec4 color;
+};
+
+struct RenderObject {
+	uint32_t mesh;
+	uint32_t material;
+	/** @brief Level of detail selected for the object */
+	uint32_t lod;
+	glm::mat4 transform;
+	glm::vec4 color;
+};
+
+/** @brief Objects sharing a mesh level of detail and a material, drawn with a single instanced draw */
+struct InstanceBatch {
+	uint32_t mesh;
+	uint32_t lod;
+	uint32_t material;
+	uint32_t first_instance;
+	uint32_t instance_count;
+	/** @brief Translation to the first object of the batch, the model matrices of the instances are relative to it */
+	glm::mat4 transform;
+};
+
+class VulkanInstanceBatcher
+{
+public:
+	VulkanInstanceBatcher();
+	~VulkanInstanceBatcher();
+
+	bool								create(VulkanDevice* device, uint32_t frames_count);
+	void								shutdown();
+
+	void								build(const std::vector<RenderObject>& objects);
+	void								upload(uint32_t frame_index);
+
+	const std::vector<InstanceBatch>&	get_batches() const { return batches; };
+	const std::vector<InstanceData>&	get_instances() const { return instances; };
+	VkBuffer							get_instance_buffer(uint32_t frame_index) const { return instance_buffers[frame_index].buffer; };
+
+private:
+	VulkanDevice*						device;
+
+	std::vector<InstanceBatch>			batches;
+	std::vector<InstanceData>			instances;
+
+	/* one instance stream per frame in flight */
+	std::vector<VulkanBuffer>			instance_buffers;
+	std::vector<uint64_t>				instance_buffer_versions;
+	uint64_t							version;
+
+	void								reserve(uint32_t frame_index, VkDeviceSize size);
+};
@@ -0,0 +1,185 @@
+#include "VulkanMesh.h"
+#include "VulkanMeshSimplifier.h"
+
+/* Each level of detail targets half the triangles of the previous one */
+#define MESH_LOD_REDUCTION				0.5f
+/* The chain stops when a level removes less than a quarter of the triangles */
+#define MESH_LOD_MIN_REDUCTION			0.75f
+
+VulkanMeshCache::VulkanMeshCache()
+	: device(nullptr)
+	, meshlet_buffer({})
+{
+}
+
+VulkanMeshCache::~VulkanMeshCache()
+{
+}
+
+bool VulkanMeshCache::create(VulkanDevice* device)
+{
+	this->device = device;
+	return true;
+}
+
+void VulkanMeshCache::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy meshes\n";
+	for (auto& mesh : meshes) {
+		device->destroy_buffer(&mesh.vertex_buffer);
+		device->destroy_buffer(&mesh.index_buffer);
+	}
+	meshes.clear();
+
+	device->destroy_buffer(&meshlet_buffer);
+	meshlets.clear();
+}
+
+/**
+* Upload a mesh into host visible vertex and index buffers
+* The levels of detail are appended to the index buffer and share the vertex buffer
+* Every level is split into meshlets whose triangles are contiguous in the index buffer
+*
+* @param vertices Vertices of the mesh
+* @param indices Triangle list of the mesh
+* @param build_lods Generate the level of detail chain of the mesh
+*
+* @return Index of the mesh in the cache
+*/
+uint32_t VulkanMeshCache::add(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, bool build_lods)
+{
+	VulkanMesh mesh = {};
+
+	std::vector<uint32_t> lod_indices = indices;
+	VulkanMeshLod lod = {};
+	lod.first_index = 0;
+	lod.index_count = static_cast<uint32_t>(indices.size());
+	lod.error = 0.0f;
+	mesh.lods.push_back(lod);
+	if (build_lods) {
+		build_lod_chain(vertices, lod_indices, mesh.lods);
+	}
+	build_meshlets(vertices, lod_indices, mesh.lods);
+
+	device->create_buffer(
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		vertices.size() * sizeof(Vertex),
+		&mesh.vertex_buffer,
+		vertices.data());
+
+	device->create_buffer(
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		lod_indices.size() * sizeof(uint32_t),
+		&mesh.index_buffer,
+		lod_indices.data());
+	mesh.index_count = static_cast<uint32_t>(indices.size());
+
+	mesh.bounding_sphere = compute_bounding_sphere(vertices);
+
+	meshes.push_back(mesh);
+	upload_meshlets();
+
+	return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+/**
+* Split each level of detail into meshlets
+*
+* @param vertices Vertices of the mesh
+* @param indices Indices of all the levels, the triangles of each level are reordered by meshlet
+* @param lods Levels of detail of the mesh
+*/
+void VulkanMeshCache::build_meshlets(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<VulkanMeshLod>& lods)
+{
+	VulkanMeshletBuilder builder;
+
+	for (auto& lod : lods) {
+		lod.first_meshlet = static_cast<uint32_t>(meshlets.size());
+		builder.build(vertices, &indices[lod.first_index], lod.index_count, lod.first_index, meshlets);
+		lod.meshlet_count = static_cast<uint32_t>(meshlets.size()) - lod.first_meshlet;
+	}
+}
+
+/**
+* Recreate the meshlet buffer after meshes were added
+* Meshes are added while loading, before any frame reads the buffer
+*/
+void VulkanMeshCache::upload_meshlets()
+{
+	device->destroy_buffer(&meshlet_buffer);
+	if (meshlets.empty()) {
+		return;
+	}
+
+	device->create_buffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		meshlets.size() * sizeof(Meshlet),
+		&meshlet_buffer,
+		meshlets.data());
+}
+
+/**
+* Simplify the mesh into successive levels of detail with a quadric error metric
+*
+* @param vertices Vertices of the mesh
+* @param indices Indices of the full resolution mesh, the levels are appended to it
+* @param lods Levels of detail of the mesh, starting with the full resolution level
+*/
+void VulkanMeshCache::build_lod_chain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<VulkanMeshLod>& lods)
+{
+	VulkanMeshSimplifier simplifier;
+
+	std::vector<uint32_t> source(indices.begin(), indices.end());
+	while (lods.size() < MESH_MAX_LODS && source.size() / 3 > MESH_LOD_MIN_TRIANGLES) {
+		uint32_t source_triangles = static_cast<uint32_t>(source.size() / 3);
+		uint32_t target_triangles = static_cast<uint32_t>(source_triangles * MESH_LOD_REDUCTION);
+
+		std::vector<uint32_t> simplified;
+		float error = simplifier.simplify(vertices, source, target_triangles, FLT_MAX, simplified);
+		if (simplified.size() / 3 > source_triangles * MESH_LOD_MIN_REDUCTION) {
+			break;
+		}
+
+		// Each level is simplified from the previous one, so the errors accumulate
+		VulkanMeshLod lod = {};
+		lod.first_index = static_cast<uint32_t>(indices.size());
+		lod.index_count = static_cast<uint32_t>(simplified.size());
+		lod.error = lods.back().error + error;
+		lods.push_back(lod);
+
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		source.swap(simplified);
+	}
+}
+
+glm::vec4 VulkanMeshCache::compute_bounding_sphere(const std::vector<Vertex>& vertices)
+{
+	if (vertices.empty()) {
+		return glm::vec4(0.0f);
+	}
+
+	// Center of the axis aligned bounding box, radius to the farthest vertex
+	glm::vec3 min_position(vertices[0].position[0], vertices[0].position[1], vertices[0].position[2]);
+	glm::vec3 max_position = min_position;
+	for (auto& vertex : vertices) {
+		glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+		min_position = glm::min(min_position, position);
+		max_position = glm::max(max_position, position);
+	}
+
+	glm::vec3 center = (min_position + max_position) * 0.5f;
+	float radius = 0.0f;
+	for (auto& vertex : vertices) {
+		glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+		radius = glm::max(radius, glm::length(position - center));
+	}
+
+	return glm::vec4(center, radius);
+}
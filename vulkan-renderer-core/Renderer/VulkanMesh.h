@@ -0,0 +1,72 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <cfloat>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "VulkanTools.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanMeshlet.h"
+
+#define MESH_MAX_LODS					8
+/* Meshes below this number of triangles are not simplified further */
+#define MESH_LOD_MIN_TRIANGLES			64
+
+struct Vertex {
+	float position[3];
+	float color[3];
+};
+
+struct VulkanMeshLod {
+	uint32_t first_index;
+	uint32_t index_count;
+	/** @brief Geometric error of the level, in object space units */
+	float error;
+	/** @brief Range of the level in the meshlets of the cache */
+	uint32_t first_meshlet;
+	uint32_t meshlet_count;
+};
+
+struct VulkanMesh {
+	VulkanBuffer vertex_buffer;
+	VulkanBuffer index_buffer;
+	uint32_t index_count;
+	/** @brief Level of detail chain, the first level is the full resolution mesh */
+	std::vector<VulkanMeshLod> lods;
+	/** @brief Bounding sphere in object space (xyz center, w radius) */
+	glm::vec4 bounding_sphere;
+};
+
+class VulkanMeshCache
+{
+public:
+	VulkanMeshCache();
+	~VulkanMeshCache();
+
+	bool							create(VulkanDevice* device);
+	void							shutdown();
+
+	uint32_t						add(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, bool build_lods = true);
+	const VulkanMesh&				get(uint32_t mesh) const { return meshes[mesh]; };
+	uint32_t						size() const { return static_cast<uint32_t>(meshes.size()); };
+
+	const VulkanBuffer&				get_meshlet_buffer() const { return meshlet_buffer; };
+
+private:
+	VulkanDevice*					device;
+	std::vector<VulkanMesh>			meshes;
+
+	/* meshlets of every level of every mesh, read by the cluster culling pass */
+	std::vector<Meshlet>			meshlets;
+	VulkanBuffer					meshlet_buffer;
+
+	void							build_meshlets(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<VulkanMeshLod>& lods);
+	void							upload_meshlets();
+
+	glm::vec4						compute_bounding_sphere(const std::vector<Vertex>& vertices);
+	void							build_lod_chain(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, std::vector<VulkanMeshLod>& lods);
+};
@@ -0,0 +1,296 @@
+#include "VulkanMeshSimplifier.h"
+
+#include <unordered_map>
+
+/* Weight of the planes preserving the open borders of the mesh */
+#define SIMPLIFIER_BOUNDARY_WEIGHT		10.0
+
+VulkanMeshSimplifier::VulkanMeshSimplifier()
+{
+}
+
+VulkanMeshSimplifier::~VulkanMeshSimplifier()
+{
+}
+
+float VulkanMeshSimplifier::simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t target_triangles, float max_error, std::vector<uint32_t>& result_indices)
+{
+	positions.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		positions[i] = glm::vec3(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]);
+	}
+
+	triangles = indices;
+	uint32_t triangles_count = static_cast<uint32_t>(triangles.size() / 3);
+	removed_triangles.assign(triangles_count, false);
+
+	quadrics.assign(vertices.size(), Quadric{});
+	vertex_triangles.assign(vertices.size(), std::vector<uint32_t>());
+	vertex_versions.assign(vertices.size(), 0);
+	collapses = std::priority_queue<Collapse>();
+
+	// Accumulate the planes of the triangles around each vertex
+	// The planes are not area weighted so that the error stays a squared distance
+	for (uint32_t t = 0; t < triangles_count; ++t) {
+		const glm::vec3& p0 = positions[triangles[t * 3 + 0]];
+		const glm::vec3& p1 = positions[triangles[t * 3 + 1]];
+		const glm::vec3& p2 = positions[triangles[t * 3 + 2]];
+
+		glm::dvec3 normal = glm::cross(glm::dvec3(p1 - p0), glm::dvec3(p2 - p0));
+		double length = glm::length(normal);
+		if (length > 0.0) {
+			normal /= length;
+			glm::dvec4 plane(normal, -glm::dot(normal, glm::dvec3(p0)));
+			for (uint32_t k = 0; k < 3; ++k) {
+				add_plane(quadrics[triangles[t * 3 + k]], plane, 1.0);
+			}
+		}
+
+		for (uint32_t k = 0; k < 3; ++k) {
+			vertex_triangles[triangles[t * 3 + k]].push_back(t);
+		}
+	}
+
+	add_boundary_quadrics();
+
+	for (uint32_t t = 0; t < triangles_count; ++t) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			push_collapse(triangles[t * 3 + k], triangles[t * 3 + (k + 1) % 3]);
+		}
+	}
+
+	// Collapse the cheapest edges first
+	uint32_t live_triangles = triangles_count;
+	double max_cost = static_cast<double>(max_error) * static_cast<double>(max_error);
+	double error = 0.0;
+	while (live_triangles > target_triangles && !collapses.empty()) {
+		Collapse candidate = collapses.top();
+		collapses.pop();
+
+		if (candidate.cost > max_cost) {
+			break;
+		}
+
+		// Skip the collapses computed before one of the vertices moved
+		if (candidate.from_version != vertex_versions[candidate.from] ||
+			candidate.to_version != vertex_versions[candidate.to]) {
+			continue;
+		}
+
+		if (flips_triangles(candidate.from, candidate.to)) {
+			continue;
+		}
+
+		live_triangles -= collapse(candidate.from, candidate.to);
+		error = std::max(error, static_cast<double>(candidate.cost));
+	}
+
+	result_indices.clear();
+	result_indices.reserve(live_triangles * 3);
+	for (uint32_t t = 0; t < triangles_count; ++t) {
+		if (!removed_triangles[t]) {
+			result_indices.push_back(triangles[t * 3 + 0]);
+			result_indices.push_back(triangles[t * 3 + 1]);
+			result_indices.push_back(triangles[t * 3 + 2]);
+		}
+	}
+
+	return static_cast<float>(std::sqrt(error));
+}
+
+void VulkanMeshSimplifier::add_plane(Quadric& quadric, const glm::dvec4& plane, double weight)
+{
+	quadric.a2 += weight * plane.x * plane.x;
+	quadric.ab += weight * plane.x * plane.y;
+	quadric.ac += weight * plane.x * plane.z;
+	quadric.ad += weight * plane.x * plane.w;
+	quadric.b2 += weight * plane.y * plane.y;
+	quadric.bc += weight * plane.y * plane.z;
+	quadric.bd += weight * plane.y * plane.w;
+	quadric.c2 += weight * plane.z * plane.z;
+	quadric.cd += weight * plane.z * plane.w;
+	quadric.d2 += weight * plane.w * plane.w;
+}
+
+double VulkanMeshSimplifier::evaluate(const Quadric& quadric, const glm::vec3& position)
+{
+	double x = position.x;
+	double y = position.y;
+	double z = position.z;
+
+	double error =
+		quadric.a2 * x * x + 2.0 * quadric.ab * x * y + 2.0 * quadric.ac * x * z + 2.0 * quadric.ad * x +
+		quadric.b2 * y * y + 2.0 * quadric.bc * y * z + 2.0 * quadric.bd * y +
+		quadric.c2 * z * z + 2.0 * quadric.cd * z +
+		quadric.d2;
+
+	return std::max(error, 0.0);
+}
+
+void VulkanMeshSimplifier::push_collapses(uint32_t vertex)
+{
+	for (auto t : vertex_triangles[vertex]) {
+		if (removed_triangles[t]) {
+			continue;
+		}
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t other = triangles[t * 3 + k];
+			if (other != vertex) {
+				push_collapse(vertex, other);
+			}
+		}
+	}
+}
+
+void VulkanMeshSimplifier::push_collapse(uint32_t a, uint32_t b)
+{
+	Quadric quadric;
+	quadric.a2 = quadrics[a].a2 + quadrics[b].a2;
+	quadric.ab = quadrics[a].ab + quadrics[b].ab;
+	quadric.ac = quadrics[a].ac + quadrics[b].ac;
+	quadric.ad = quadrics[a].ad + quadrics[b].ad;
+	quadric.b2 = quadrics[a].b2 + quadrics[b].b2;
+	quadric.bc = quadrics[a].bc + quadrics[b].bc;
+	quadric.bd = quadrics[a].bd + quadrics[b].bd;
+	quadric.c2 = quadrics[a].c2 + quadrics[b].c2;
+	quadric.cd = quadrics[a].cd + quadrics[b].cd;
+	quadric.d2 = quadrics[a].d2 + quadrics[b].d2;
+
+	// Keep the end point giving the smallest error
+	double cost_to_b = evaluate(quadric, positions[b]);
+	double cost_to_a = evaluate(quadric, positions[a]);
+
+	Collapse candidate;
+	if (cost_to_b <= cost_to_a) {
+		candidate.cost = static_cast<float>(cost_to_b);
+		candidate.from = a;
+		candidate.to = b;
+	}
+	else {
+		candidate.cost = static_cast<float>(cost_to_a);
+		candidate.from = b;
+		candidate.to = a;
+	}
+	candidate.from_version = vertex_versions[candidate.from];
+	candidate.to_version = vertex_versions[candidate.to];
+
+	collapses.push(candidate);
+}
+
+bool VulkanMeshSimplifier::flips_triangles(uint32_t from, uint32_t to)
+{
+	for (auto t : vertex_triangles[from]) {
+		if (removed_triangles[t]) {
+			continue;
+		}
+
+		uint32_t* triangle = &triangles[t * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+			continue;
+		}
+
+		glm::vec3 before[3];
+		glm::vec3 after[3];
+		for (uint32_t k = 0; k < 3; ++k) {
+			before[k] = positions[triangle[k]];
+			after[k] = triangle[k] == from ? positions[to] : before[k];
+		}
+
+		glm::vec3 normal_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::vec3 normal_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(normal_before, normal_after) <= 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t VulkanMeshSimplifier::collapse(uint32_t from, uint32_t to)
+{
+	uint32_t removed = 0;
+	for (auto t : vertex_triangles[from]) {
+		if (removed_triangles[t]) {
+			continue;
+		}
+
+		uint32_t* triangle = &triangles[t * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+			// The triangle degenerates into the collapsed edge
+			removed_triangles[t] = true;
+			removed++;
+			continue;
+		}
+
+		for (uint32_t k = 0; k < 3; ++k) {
+			if (triangle[k] == from) {
+				triangle[k] = to;
+			}
+		}
+		vertex_triangles[to].push_back(t);
+	}
+	vertex_triangles[from].clear();
+
+	Quadric& target = quadrics[to];
+	const Quadric& source = quadrics[from];
+	target.a2 += source.a2;
+	target.ab += source.ab;
+	target.ac += source.ac;
+	target.ad += source.ad;
+	target.b2 += source.b2;
+	target.bc += source.bc;
+	target.bd += source.bd;
+	target.c2 += source.c2;
+	target.cd += source.cd;
+	target.d2 += source.d2;
+
+	vertex_versions[from]++;
+	vertex_versions[to]++;
+
+	push_collapses(to);
+
+	return removed;
+}
+
+void VulkanMeshSimplifier::add_boundary_quadrics()
+{
+	// Count the triangles sharing each edge, edges used once are on the border
+	std::unordered_map<uint64_t, uint32_t> edges;
+	uint32_t triangles_count = static_cast<uint32_t>(triangles.size() / 3);
+	for (uint32_t t = 0; t < triangles_count; ++t) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint64_t a = triangles[t * 3 + k];
+			uint64_t b = triangles[t * 3 + (k + 1) % 3];
+			edges[(std::min(a, b) << 32) | std::max(a, b)]++;
+		}
+	}
+
+	// Constrain the border vertices with planes perpendicular to their triangle
+	for (uint32_t t = 0; t < triangles_count; ++t) {
+		const glm::vec3& p0 = positions[triangles[t * 3 + 0]];
+		const glm::vec3& p1 = positions[triangles[t * 3 + 1]];
+		const glm::vec3& p2 = positions[triangles[t * 3 + 2]];
+		glm::dvec3 normal = glm::cross(glm::dvec3(p1 - p0), glm::dvec3(p2 - p0));
+		if (glm::length(normal) == 0.0) {
+			continue;
+		}
+		normal = glm::normalize(normal);
+
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint64_t a = triangles[t * 3 + k];
+			uint64_t b = triangles[t * 3 + (k + 1) % 3];
+			if (edges[(std::min(a, b) << 32) | std::max(a, b)] != 1) {
+				continue;
+			}
+
+			glm::dvec3 edge = glm::dvec3(positions[b] - positions[a]);
+			if (glm::length(edge) == 0.0) {
+				continue;
+			}
+			glm::dvec3 border_normal = glm::normalize(glm::cross(edge, normal));
+			glm::dvec4 plane(border_normal, -glm::dot(border_normal, glm::dvec3(positions[a])));
+
+			add_plane(quadrics[a], plane, SIMPLIFIER_BOUNDARY_WEIGHT);
+			add_plane(quadrics[b], plane, SIMPLIFIER_BOUNDARY_WEIGHT);
+		}
+	}
+}
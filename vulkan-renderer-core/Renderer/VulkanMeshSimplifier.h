@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "VulkanMesh.h"
+
+/**
+* Quadric error metric simplification (Garland and Heckbert)
+* Edges are collapsed onto one of their end points so the simplified
+* index list keeps referencing the original vertices, and the levels
+* of detail of a mesh can share its vertex buffer
+*/
+class VulkanMeshSimplifier
+{
+public:
+	VulkanMeshSimplifier();
+	~VulkanMeshSimplifier();
+
+	/**
+	* Simplify the mesh until the target triangles count or the maximum error is reached
+	*
+	* @param vertices Vertices of the mesh
+	* @param indices Triangle list of the mesh
+	* @param target_triangles Number of triangles to reach
+	* @param max_error Maximum geometric error allowed, in object space units
+	* @param result_indices Simplified triangle list
+	*
+	* @return Geometric error of the simplified mesh, in object space units
+	*/
+	float						simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t target_triangles, float max_error, std::vector<uint32_t>& result_indices);
+
+private:
+	struct Quadric {
+		double a2, ab, ac, ad;
+		double b2, bc, bd;
+		double c2, cd;
+		double d2;
+	};
+
+	struct Collapse {
+		float cost;
+		uint32_t from;
+		uint32_t to;
+		uint32_t from_version;
+		uint32_t to_version;
+
+		bool operator<(const Collapse& other) const { return cost > other.cost; };
+	};
+
+	std::vector<glm::vec3>					positions;
+	std::vector<Quadric>					quadrics;
+	std::vector<uint32_t>					triangles;
+	std::vector<bool>						removed_triangles;
+	std::vector<std::vector<uint32_t>>		vertex_triangles;
+	std::vector<uint32_t>					vertex_versions;
+	std::priority_queue<Collapse>			collapses;
+
+	void						add_plane(Quadric& quadric, const glm::dvec4& plane, double weight);
+	double						evaluate(const Quadric& quadric, const glm::vec3& position);
+	void						push_collapses(uint32_t vertex);
+	void						push_collapse(uint32_t a, uint32_t b);
+	bool						flips_triangles(uint32_t from, uint32_t to);
+	uint32_t					collapse(uint32_t from, uint32_t to);
+	void						add_boundary_quadrics();
+};
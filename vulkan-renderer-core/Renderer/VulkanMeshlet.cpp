@@ -0,0 +1,187 @@
+#include "VulkanMeshlet.h"
+#include "VulkanMesh.h"
+
+/* Clusters whose triangle normals spread further than this (cosine) are never cone culled */
+#define MESHLET_CONE_MIN_DOT			0.1f
+
+VulkanMeshletBuilder::VulkanMeshletBuilder()
+{
+}
+
+VulkanMeshletBuilder::~VulkanMeshletBuilder()
+{
+}
+
+/**
+* Greedily grow meshlets over the triangle adjacency
+* Each meshlet starts from the first unused triangle, then adds the neighbouring
+* triangle introducing the fewest new vertices until one of the limits is reached
+*
+* @param vertices Vertices of the mesh
+* @param indices Triangle list to split, reordered in place
+* @param index_count Number of indices of the triangle list
+* @param first_index Offset of the triangle list in the index buffer of the mesh
+* @param meshlets Meshlets to append to
+*/
+void VulkanMeshletBuilder::build(const std::vector<Vertex>& vertices, uint32_t* indices, uint32_t index_count, uint32_t first_index, std::vector<Meshlet>& meshlets)
+{
+	const uint32_t triangles_count = index_count / 3;
+	if (triangles_count == 0) {
+		return;
+	}
+
+	build_adjacency(indices, triangles_count, vertices.size());
+	used_triangles.assign(triangles_count, false);
+	meshlet_vertex_marks.assign(vertices.size(), 0);
+
+	std::vector<uint32_t> ordered;
+	ordered.reserve(index_count);
+	std::vector<uint32_t> candidates;
+
+	uint32_t mark = 0;
+	uint32_t seed = 0;
+	while (true) {
+		while (seed < triangles_count && used_triangles[seed]) {
+			seed++;
+		}
+		if (seed == triangles_count) {
+			break;
+		}
+
+		Meshlet meshlet = {};
+		meshlet.first_index = static_cast<uint32_t>(ordered.size());
+		mark++;
+		candidates.clear();
+
+		uint32_t triangle = seed;
+		while (triangle != UINT32_MAX) {
+			used_triangles[triangle] = true;
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t vertex = indices[triangle * 3 + k];
+				ordered.push_back(vertex);
+				if (meshlet_vertex_marks[vertex] != mark) {
+					meshlet_vertex_marks[vertex] = mark;
+					meshlet.vertex_count++;
+
+					// Triangles around the new vertex become candidates
+					for (uint32_t i = vertex_triangles_offsets[vertex]; i < vertex_triangles_offsets[vertex + 1]; ++i) {
+						if (!used_triangles[vertex_triangles[i]]) {
+							candidates.push_back(vertex_triangles[i]);
+						}
+					}
+				}
+			}
+			meshlet.triangle_count++;
+
+			if (meshlet.triangle_count == MESHLET_MAX_TRIANGLES) {
+				break;
+			}
+
+			// Pick the candidate adding the fewest vertices, dropping the ones used meanwhile
+			triangle = UINT32_MAX;
+			uint32_t best_new_vertices = UINT32_MAX;
+			for (size_t i = 0; i < candidates.size();) {
+				uint32_t candidate = candidates[i];
+				if (used_triangles[candidate]) {
+					candidates[i] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+
+				uint32_t new_vertices = 0;
+				for (uint32_t k = 0; k < 3; ++k) {
+					new_vertices += meshlet_vertex_marks[indices[candidate * 3 + k]] != mark ? 1 : 0;
+				}
+				if (meshlet.vertex_count + new_vertices <= MESHLET_MAX_VERTICES && new_vertices < best_new_vertices) {
+					best_new_vertices = new_vertices;
+					triangle = candidate;
+				}
+				++i;
+			}
+		}
+
+		compute_bounds(vertices, &ordered[meshlet.first_index], meshlet);
+		meshlet.first_index += first_index;
+		meshlets.push_back(meshlet);
+	}
+
+	std::copy(ordered.begin(), ordered.end(), indices);
+}
+
+void VulkanMeshletBuilder::build_adjacency(const uint32_t* indices, uint32_t triangles_count, size_t vertices_count)
+{
+	vertex_triangles_offsets.assign(vertices_count + 1, 0);
+	for (uint32_t i = 0; i < triangles_count * 3; ++i) {
+		vertex_triangles_offsets[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertices_count; ++v) {
+		vertex_triangles_offsets[v + 1] += vertex_triangles_offsets[v];
+	}
+
+	std::vector<uint32_t> cursors(vertex_triangles_offsets.begin(), vertex_triangles_offsets.end() - 1);
+	vertex_triangles.resize(triangles_count * 3);
+	for (uint32_t t = 0; t < triangles_count; ++t) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			vertex_triangles[cursors[indices[t * 3 + k]]++] = t;
+		}
+	}
+}
+
+/**
+* Compute the bounding sphere and the normal cone of a meshlet
+*
+* @param vertices Vertices of the mesh
+* @param indices Triangles of the meshlet
+* @param meshlet Meshlet to fill
+*/
+void VulkanMeshletBuilder::compute_bounds(const std::vector<Vertex>& vertices, const uint32_t* indices, Meshlet& meshlet)
+{
+	auto position = [&vertices, indices](uint32_t i) {
+		const Vertex& vertex = vertices[indices[i]];
+		return glm::vec3(vertex.position[0], vertex.position[1], vertex.position[2]);
+	};
+
+	const uint32_t index_count = meshlet.triangle_count * 3;
+
+	glm::vec3 center(0.0f);
+	for (uint32_t i = 0; i < index_count; ++i) {
+		center += position(i);
+	}
+	center /= static_cast<float>(index_count);
+
+	float radius = 0.0f;
+	for (uint32_t i = 0; i < index_count; ++i) {
+		radius = std::max(radius, glm::length(position(i) - center));
+	}
+	meshlet.bounding_sphere = glm::vec4(center, radius);
+
+	// The cone axis is the average of the triangle normals,
+	// its cutoff is the sine of the largest angle between the axis and a normal
+	std::vector<glm::vec3> normals;
+	normals.reserve(meshlet.triangle_count);
+	glm::vec3 axis(0.0f);
+	for (uint32_t t = 0; t < meshlet.triangle_count; ++t) {
+		glm::vec3 p0 = position(t * 3 + 0);
+		glm::vec3 normal = glm::cross(position(t * 3 + 1) - p0, position(t * 3 + 2) - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f) {
+			normals.push_back(normal / length);
+			axis += normals.back();
+		}
+	}
+
+	meshlet.cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	if (normals.empty() || glm::length(axis) == 0.0f) {
+		return;
+	}
+	axis = glm::normalize(axis);
+
+	float min_dot = 1.0f;
+	for (auto& normal : normals) {
+		min_dot = std::min(min_dot, glm::dot(axis, normal));
+	}
+	if (min_dot <= MESHLET_CONE_MIN_DOT) {
+		return;
+	}
+	meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - min_dot * min_dot));
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+struct Vertex;
+
+#define MESHLET_MAX_VERTICES			64
+#define MESHLET_MAX_TRIANGLES			124
+
+/**
+* Cluster of triangles culled as a whole on the GPU
+* The layout matches the std430 Meshlet structure of cluster_cull.comp
+*/
+struct Meshlet {
+	/** @brief Bounding sphere in object space (xyz center, w radius) */
+	glm::vec4 bounding_sphere;
+	/** @brief Normal cone (xyz axis, w cutoff), the cluster is back facing when seen from inside the cone */
+	glm::vec4 cone;
+	uint32_t first_index;
+	uint32_t triangle_count;
+	uint32_t vertex_count;
+	uint32_t padding;
+};
+
+/**
+* Split triangle lists into meshlets of at most MESHLET_MAX_VERTICES vertices
+* and MESHLET_MAX_TRIANGLES triangles
+* The triangles of each meshlet are rewritten contiguously in the index list,
+* so that a meshlet can be drawn with a single indexed draw
+*/
+class VulkanMeshletBuilder
+{
+public:
+	VulkanMeshletBuilder();
+	~VulkanMeshletBuilder();
+
+	void						build(const std::vector<Vertex>& vertices, uint32_t* indices, uint32_t index_count, uint32_t first_index, std::vector<Meshlet>& meshlets);
+
+private:
+	std::vector<uint32_t>					vertex_triangles_offsets;
+	std::vector<uint32_t>					vertex_triangles;
+	std::vector<bool>						used_triangles;
+	std::vector<uint32_t>					meshlet_vertex_marks;
+
+	void						build_adjacency(const uint32_t* indices, uint32_t triangles_count, size_t vertices_count);
+	void						compute_bounds(const std::vector<Vertex>& vertices, const uint32_t* indices, Meshlet& meshlet);
+};
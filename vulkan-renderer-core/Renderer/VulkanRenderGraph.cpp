@@ -0,0 +1,827 @@
+#include "VulkanRenderGraph.h"
+
+/* Usage of the images that may be transient attachments */
+#define RENDER_GRAPH_ATTACHMENT_USAGE	(VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)
+
+#define RENDER_GRAPH_WRITE_ACCESS		(VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | \
+										 VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT)
+
+VulkanRenderGraph::VulkanRenderGraph()
+	: device(nullptr)
+	, deletion_queue(nullptr)
+	, async_compute(false)
+	, final_barriers({})
+	, statistics({})
+{
+}
+
+VulkanRenderGraph::~VulkanRenderGraph()
+{
+}
+
+/**
+* Create the graph
+*
+* @param device Device
+* @param deletion_queue Destroys the transient images once the frames using them are complete
+*/
+bool VulkanRenderGraph::create(VulkanDevice* device, VulkanDeletionQueue* deletion_queue)
+{
+	this->device = device;
+	this->deletion_queue = deletion_queue;
+	async_compute = device->async_compute;
+	statistics = {};
+	return true;
+}
+
+void VulkanRenderGraph::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy render graph\n";
+	retire_transients();
+
+	passes.clear();
+	resources.clear();
+	device = nullptr;
+}
+
+/**
+* Start the declaration of the graph of a new frame
+* The transient images are kept and reused by the next compilation when their descriptions match
+*/
+void VulkanRenderGraph::reset()
+{
+	passes.clear();
+	resources.clear();
+	final_barriers = {};
+	submissions.clear();
+}
+
+/**
+* Import an image living outside of the graph
+*
+* @param name Name of the resource
+* @param image Image
+* @param view View of the image
+* @param aspect Aspects of the image format
+* @param initial_state Last use of the image before the graph, the stages of the previous frames included
+* @param final_layout Layout the image is transitioned to after the last pass, or VK_IMAGE_LAYOUT_UNDEFINED to leave it in the layout of its last use
+*/
+uint32_t VulkanRenderGraph::import_image(const std::string& name, VkImage image, VkImageView view, VkImageAspectFlags aspect, const RenderGraphState& initial_state, VkImageLayout final_layout)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.is_image = true;
+	resource.imported = true;
+	resource.image = image;
+	resource.view = view;
+	resource.aspect = aspect;
+	resource.initial_state = initial_state;
+	resource.final_layout = final_layout;
+	resource.transient = RENDER_GRAPH_INVALID;
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+/**
+* Import a buffer living outside of the graph
+*
+* @param name Name of the resource
+* @param initial_state Last use of the buffer before the graph, the stages of the previous frames included
+*/
+uint32_t VulkanRenderGraph::import_buffer(const std::string& name, const RenderGraphState& initial_state)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.is_image = false;
+	resource.imported = true;
+	resource.initial_state = initial_state;
+	resource.transient = RENDER_GRAPH_INVALID;
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+/**
+* Declare a transient image, created by the graph and only valid during the passes using it
+* Its content is undefined at its first use
+*
+* @param name Name of the resource
+* @param description Format, size and samples of the image
+*/
+uint32_t VulkanRenderGraph::create_image(const std::string& name, const RenderGraphImageDescription& description)
+{
+	Resource resource = {};
+	resource.name = name;
+	resource.is_image = true;
+	resource.imported = false;
+	resource.aspect = description.aspect;
+	resource.initial_state = { 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, RENDER_GRAPH_QUEUE_GRAPHICS };
+	resource.final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	resource.description = description;
+	resource.usage = description.usage;
+	resource.transient = RENDER_GRAPH_INVALID;
+	resources.push_back(resource);
+	return static_cast<uint32_t>(resources.size() - 1);
+}
+
+/**
+* Add a pass, executed after the previously added passes
+*
+* @param name Name of the pass
+* @param callback Records the commands of the pass
+* @param side_effects The pass has effects outside of the graph resources and is never culled
+* @param queue Queue of the pass, a compute pass only records compute and transfer commands
+*/
+uint32_t VulkanRenderGraph::add_pass(const std::string& name, PassCallback callback, bool side_effects, RenderGraphQueue queue)
+{
+	Pass pass = {};
+	pass.name = name;
+	pass.callback = callback;
+	pass.side_effects = side_effects;
+	pass.queue = async_compute ? queue : RENDER_GRAPH_QUEUE_GRAPHICS;
+	passes.push_back(pass);
+	return static_cast<uint32_t>(passes.size() - 1);
+}
+
+/**
+* Declare a resource read by a pass
+*
+* @param pass Pass
+* @param resource Resource
+* @param access How the pass uses the resource
+* @param shader_stages Stages of the shaders accessing the resource, for the sampled and storage accesses
+*/
+void VulkanRenderGraph::read(uint32_t pass, uint32_t resource, RenderGraphAccess access, VkPipelineStageFlags shader_stages)
+{
+	add_use(pass, resource, access, shader_stages, false);
+}
+
+/**
+* Declare a resource written by a pass
+* A pass loading the previous content of an attachment must also declare it read
+*/
+void VulkanRenderGraph::write(uint32_t pass, uint32_t resource, RenderGraphAccess access, VkPipelineStageFlags shader_stages)
+{
+	add_use(pass, resource, access, shader_stages, true);
+}
+
+/**
+* Cull the passes, place the transient images and compute the barriers of the declared graph
+*/
+void VulkanRenderGraph::compile()
+{
+	cull_passes();
+	split_submissions();
+
+	for (auto& resource : resources) {
+		resource.first_pass = RENDER_GRAPH_INVALID;
+		resource.last_pass = RENDER_GRAPH_INVALID;
+	}
+	for (uint32_t i = 0; i < passes.size(); ++i) {
+		if (passes[i].culled) {
+			continue;
+		}
+		for (auto& use : passes[i].uses) {
+			Resource& resource = resources[use.resource];
+			if (resource.first_pass == RENDER_GRAPH_INVALID) {
+				resource.first_pass = i;
+			}
+			resource.last_pass = i;
+		}
+	}
+
+	allocate_transients();
+	compute_barriers();
+
+	statistics.passes = 0;
+	statistics.culled_passes = 0;
+	statistics.barrier_batches = 0;
+	statistics.image_barriers = 0;
+	statistics.memory_barriers = 0;
+	statistics.submissions = static_cast<uint32_t>(submissions.size());
+	statistics.ownership_transfers = 0;
+	for (const auto& submission : submissions) {
+		statistics.ownership_transfers += static_cast<uint32_t>(submission.release_barriers.image_barriers.size());
+		if (submission.release_barriers.source_stages != 0) {
+			statistics.barrier_batches++;
+		}
+	}
+	for (const auto& pass : passes) {
+		if (pass.culled) {
+			statistics.culled_passes++;
+			continue;
+		}
+		statistics.passes++;
+		if (pass.source_stages != 0) {
+			statistics.barrier_batches++;
+		}
+		statistics.image_barriers += static_cast<uint32_t>(pass.image_barriers.size());
+		statistics.memory_barriers += (pass.memory_barrier.srcAccessMask != 0 || pass.memory_barrier.dstAccessMask != 0) ? 1 : 0;
+	}
+	if (final_barriers.source_stages != 0) {
+		statistics.barrier_batches++;
+	}
+	statistics.image_barriers += static_cast<uint32_t>(final_barriers.image_barriers.size());
+}
+
+/**
+* Record the barriers and the commands of the passes of a submission
+*
+* @param submission Submission, in [0, get_submission_count()[
+* @param command_buffer Command buffer allocated from a pool of the family of the submission queue, outside of a render pass
+*/
+void VulkanRenderGraph::execute(uint32_t submission, VkCommandBuffer command_buffer)
+{
+	for (auto index : submissions[submission].passes) {
+		const Pass& pass = passes[index];
+		record_barriers(command_buffer, pass);
+		if (pass.callback) {
+			device->begin_label(command_buffer, pass.name.c_str());
+			pass.callback(command_buffer);
+			device->end_label(command_buffer);
+		}
+	}
+	record_barriers(command_buffer, submissions[submission].release_barriers);
+	if (submission + 1 == submissions.size()) {
+		record_barriers(command_buffer, final_barriers);
+	}
+}
+
+/**
+* Write the dependency graph of the last compilation in the Graphviz dot format
+* Culled passes are dashed, imported resources are filled, passes are labelled with their barriers
+*/
+void VulkanRenderGraph::write_graphviz(std::ostream& stream) const
+{
+	stream << "digraph render_graph {\n";
+	stream << "\trankdir=LR;\n";
+
+	for (uint32_t i = 0; i < passes.size(); ++i) {
+		const Pass& pass = passes[i];
+		stream << "\tpass" << i << " [shape=box, label=\"" << pass.name;
+		if (pass.queue == RENDER_GRAPH_QUEUE_COMPUTE) {
+			stream << "\\ncompute queue";
+		}
+		if (!pass.culled) {
+			stream << "\\nimage barriers: " << pass.image_barriers.size();
+			if (pass.memory_barrier.srcAccessMask != 0 || pass.memory_barrier.dstAccessMask != 0) {
+				stream << ", memory barrier";
+			}
+		}
+		stream << "\"" << (pass.culled ? ", style=dashed" : "") << (pass.side_effects ? ", peripheries=2" : "") << "];\n";
+	}
+
+	for (uint32_t i = 0; i < resources.size(); ++i) {
+		const Resource& resource = resources[i];
+		stream << "\tresource" << i << " [shape=ellipse, label=\"" << resource.name;
+		if (resource.transient != RENDER_GRAPH_INVALID) {
+			const TransientImage& image = transient_images[resource.transient];
+			stream << "\\nblock " << image.block << (memory_blocks[image.block].lazily_allocated ? ", lazily allocated" : "");
+		}
+		stream << "\"" << (resource.imported ? ", style=filled" : "") << "];\n";
+	}
+
+	for (uint32_t i = 0; i < passes.size(); ++i) {
+		const char* style = passes[i].culled ? " [style=dashed]" : "";
+		for (const auto& use : passes[i].uses) {
+			if (use.read) {
+				stream << "\tresource" << use.resource << " -> pass" << i << style << ";\n";
+			}
+			if (use.write) {
+				stream << "\tpass" << i << " -> resource" << use.resource << style << ";\n";
+			}
+		}
+	}
+
+	stream << "}\n";
+}
+
+/**
+* Stages, access and layout of a use of a resource
+*/
+RenderGraphState VulkanRenderGraph::get_use_state(RenderGraphAccess access, VkPipelineStageFlags shader_stages, bool write)
+{
+	RenderGraphState state = {};
+	switch (access) {
+	case RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT:
+		state.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		state.access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | (write ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT : 0);
+		state.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		break;
+	case RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT:
+		state.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		state.access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | (write ? VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT : 0);
+		state.layout = write ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+		break;
+	case RENDER_GRAPH_ACCESS_SAMPLED:
+		state.stages = shader_stages;
+		state.access = VK_ACCESS_SHADER_READ_BIT;
+		state.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		break;
+	case RENDER_GRAPH_ACCESS_STORAGE:
+		state.stages = shader_stages;
+		state.access = VK_ACCESS_SHADER_READ_BIT | (write ? VK_ACCESS_SHADER_WRITE_BIT : 0);
+		state.layout = VK_IMAGE_LAYOUT_GENERAL;
+		break;
+	case RENDER_GRAPH_ACCESS_INDIRECT:
+		state.stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		state.access = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+		state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		break;
+	case RENDER_GRAPH_ACCESS_TRANSFER:
+		state.stages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		state.access = write ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_TRANSFER_READ_BIT;
+		state.layout = write ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		break;
+	}
+	return state;
+}
+
+VkImageUsageFlags VulkanRenderGraph::get_image_usage(RenderGraphAccess access, bool write)
+{
+	switch (access) {
+	case RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT:
+		return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	case RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT:
+		return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	case RENDER_GRAPH_ACCESS_SAMPLED:
+		return VK_IMAGE_USAGE_SAMPLED_BIT;
+	case RENDER_GRAPH_ACCESS_STORAGE:
+		return VK_IMAGE_USAGE_STORAGE_BIT;
+	case RENDER_GRAPH_ACCESS_TRANSFER:
+		return write ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	default:
+		return 0;
+	}
+}
+
+VkAccessFlags VulkanRenderGraph::get_write_access(VkAccessFlags access)
+{
+	return access & RENDER_GRAPH_WRITE_ACCESS;
+}
+
+/**
+* Add a use of a resource to a pass, the uses of the same resource by a pass are merged
+*/
+void VulkanRenderGraph::add_use(uint32_t pass, uint32_t resource, RenderGraphAccess access, VkPipelineStageFlags shader_stages, bool write)
+{
+	assert(pass < passes.size() && resource < resources.size());
+
+	RenderGraphState state = get_use_state(access, shader_stages, write);
+	resources[resource].usage |= get_image_usage(access, write);
+
+	for (auto& use : passes[pass].uses) {
+		if (use.resource != resource) {
+			continue;
+		}
+		// An image has a single layout during a pass, the layout of the write wins
+		if (write || !use.write) {
+			use.state.layout = state.layout;
+		}
+		use.state.stages |= state.stages;
+		use.state.access |= state.access;
+		use.read |= !write;
+		use.write |= write;
+		return;
+	}
+
+	ResourceUse use = {};
+	use.resource = resource;
+	use.state = state;
+	use.read = !write;
+	use.write = write;
+	passes[pass].uses.push_back(use);
+}
+
+/**
+* Cull the passes whose results are never used
+* Walking the passes backwards, a pass is kept when it has side effects, writes an imported
+* resource or writes a resource read by a kept pass, the resources it reads are then needed
+*/
+void VulkanRenderGraph::cull_passes()
+{
+	std::vector<bool> needed(resources.size(), false);
+
+	for (uint32_t i = static_cast<uint32_t>(passes.size()); i-- > 0; ) {
+		Pass& pass = passes[i];
+
+		bool kept = pass.side_effects;
+		for (const auto& use : pass.uses) {
+			if (use.write && (resources[use.resource].imported || needed[use.resource])) {
+				kept = true;
+			}
+		}
+		pass.culled = !kept;
+		if (pass.culled) {
+			continue;
+		}
+
+		for (const auto& use : pass.uses) {
+			if (use.read) {
+				needed[use.resource] = true;
+			}
+		}
+	}
+}
+
+/**
+* Split the kept passes into runs of consecutive passes on the same queue
+* The final barriers are recorded by the last submission, an empty graph still has one
+*/
+void VulkanRenderGraph::split_submissions()
+{
+	submissions.clear();
+	for (uint32_t i = 0; i < passes.size(); ++i) {
+		Pass& pass = passes[i];
+		if (pass.culled) {
+			continue;
+		}
+		if (submissions.empty() || submissions.back().queue != pass.queue) {
+			Submission submission = {};
+			submission.queue = pass.queue;
+			submissions.push_back(submission);
+		}
+		pass.submission = static_cast<uint32_t>(submissions.size() - 1);
+		submissions.back().passes.push_back(i);
+	}
+	if (submissions.empty()) {
+		submissions.push_back({});
+	}
+	assert(submissions.back().queue == RENDER_GRAPH_QUEUE_GRAPHICS);
+}
+
+uint32_t VulkanRenderGraph::get_queue_family(RenderGraphQueue queue) const
+{
+	return queue == RENDER_GRAPH_QUEUE_COMPUTE ? device->compute_queue_family_index : device->graphics_queue_family_index;
+}
+
+/**
+* Create the transient images used by the kept passes and place them in memory
+* The images are sorted by decreasing size and each one goes to the first block whose images
+* are used by other passes than its own, so that images with disjoint lifetimes share memory
+* The images of the previous compilation are reused when the descriptions and lifetimes match
+*/
+void VulkanRenderGraph::allocate_transients()
+{
+	std::vector<TransientImage> images;
+	for (auto& resource : resources) {
+		if (resource.imported || resource.first_pass == RENDER_GRAPH_INVALID) {
+			continue;
+		}
+		TransientImage image = {};
+		image.name = resource.name;
+		image.description = resource.description;
+		image.usage = resource.usage;
+		image.first_pass = resource.first_pass;
+		image.last_pass = resource.last_pass;
+		image.block = RENDER_GRAPH_INVALID;
+		image.transient_attachment = (image.usage & ~RENDER_GRAPH_ATTACHMENT_USAGE) == 0;
+		if (image.transient_attachment) {
+			image.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		}
+		resource.transient = static_cast<uint32_t>(images.size());
+		images.push_back(image);
+	}
+
+	bool cached = images.size() == transient_images.size();
+	for (uint32_t i = 0; cached && i < images.size(); ++i) {
+		const TransientImage& a = images[i];
+		const TransientImage& b = transient_images[i];
+		cached = a.description.format == b.description.format && a.description.width == b.description.width && a.description.height == b.description.height
+			&& a.description.samples == b.description.samples && a.description.aspect == b.description.aspect && a.usage == b.usage
+			&& a.first_pass == b.first_pass && a.last_pass == b.last_pass;
+	}
+
+	if (!cached) {
+		retire_transients();
+
+		for (auto& image : images) {
+			VkImageCreateInfo image_create_info = {};
+			image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			image_create_info.imageType = VK_IMAGE_TYPE_2D;
+			image_create_info.format = image.description.format;
+			image_create_info.extent = { image.description.width, image.description.height, 1 };
+			image_create_info.mipLevels = 1;
+			image_create_info.arrayLayers = 1;
+			image_create_info.samples = image.description.samples;
+			image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+			image_create_info.usage = image.usage;
+			image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VK_CHECK_RESULT(vkCreateImage(*device, &image_create_info, nullptr, &image.image));
+			device->set_object_name(VK_OBJECT_TYPE_IMAGE, reinterpret_cast<uint64_t>(image.image), image.name.c_str());
+			vkGetImageMemoryRequirements(*device, image.image, &image.memory_requirements);
+		}
+
+		std::vector<uint32_t> order(images.size());
+		for (uint32_t i = 0; i < order.size(); ++i) {
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&images](uint32_t a, uint32_t b) {
+			return images[a].memory_requirements.size > images[b].memory_requirements.size;
+		});
+
+		for (auto index : order) {
+			TransientImage& image = images[index];
+			for (uint32_t block = 0; block < memory_blocks.size() && image.block == RENDER_GRAPH_INVALID; ++block) {
+				MemoryBlock& memory_block = memory_blocks[block];
+				if (memory_block.transient_attachment != image.transient_attachment || (memory_block.memory_type_bits & image.memory_requirements.memoryTypeBits) == 0) {
+					continue;
+				}
+				bool disjoint = true;
+				for (auto other : memory_block.images) {
+					if (!(images[other].last_pass < image.first_pass || image.last_pass < images[other].first_pass)) {
+						disjoint = false;
+						break;
+					}
+				}
+				if (disjoint) {
+					memory_block.memory_type_bits &= image.memory_requirements.memoryTypeBits;
+					memory_block.size = std::max(memory_block.size, image.memory_requirements.size);
+					memory_block.images.push_back(index);
+					image.block = block;
+				}
+			}
+			if (image.block == RENDER_GRAPH_INVALID) {
+				MemoryBlock memory_block = {};
+				memory_block.size = image.memory_requirements.size;
+				memory_block.memory_type_bits = image.memory_requirements.memoryTypeBits;
+				memory_block.transient_attachment = image.transient_attachment;
+				memory_block.images.push_back(index);
+				image.block = static_cast<uint32_t>(memory_blocks.size());
+				memory_blocks.push_back(memory_block);
+			}
+		}
+
+		// Every image of a block is bound at its start, the size being the largest of their sizes
+		// their alignments are satisfied by the allocation itself
+		for (auto& memory_block : memory_blocks) {
+			VkMemoryAllocateInfo memory_allocate_info = {};
+			memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			memory_allocate_info.allocationSize = memory_block.size;
+			memory_block.lazily_allocated = memory_block.transient_attachment
+				&& device->get_memory_type(memory_block.memory_type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, &memory_allocate_info.memoryTypeIndex);
+			if (!memory_block.lazily_allocated) {
+				device->get_memory_type(memory_block.memory_type_bits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memory_allocate_info.memoryTypeIndex);
+			}
+			VK_CHECK_RESULT(vkAllocateMemory(*device, &memory_allocate_info, nullptr, &memory_block.memory));
+
+			for (auto index : memory_block.images) {
+				VK_CHECK_RESULT(vkBindImageMemory(*device, images[index].image, memory_block.memory, 0));
+			}
+		}
+
+		for (auto& image : images) {
+			VkImageViewCreateInfo view_create_info = {};
+			view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			view_create_info.image = image.image;
+			view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			view_create_info.format = image.description.format;
+			view_create_info.subresourceRange = { image.description.aspect, 0, 1, 0, 1 };
+			VK_CHECK_RESULT(vkCreateImageView(*device, &view_create_info, nullptr, &image.view));
+		}
+
+		transient_images = images;
+	}
+
+	statistics.transient_bytes = 0;
+	statistics.unaliased_bytes = 0;
+	statistics.lazily_allocated_bytes = 0;
+	statistics.committed_bytes = 0;
+	for (const auto& memory_block : memory_blocks) {
+		statistics.transient_bytes += memory_block.size;
+		if (memory_block.lazily_allocated) {
+			VkDeviceSize committed_bytes = 0;
+			vkGetDeviceMemoryCommitment(*device, memory_block.memory, &committed_bytes);
+			statistics.lazily_allocated_bytes += memory_block.size;
+			statistics.committed_bytes += committed_bytes;
+		}
+	}
+	for (const auto& image : transient_images) {
+		statistics.unaliased_bytes += image.memory_requirements.size;
+	}
+
+	for (auto& resource : resources) {
+		if (resource.transient != RENDER_GRAPH_INVALID) {
+			resource.image = transient_images[resource.transient].image;
+			resource.view = transient_images[resource.transient].view;
+		}
+	}
+}
+
+/**
+* Release the transient images and their memory, the frames in flight may still use them
+* The last submission of a frame is on the graphics queue, it completes after the compute submissions of the frame
+*/
+void VulkanRenderGraph::retire_transients()
+{
+	const SyncPoint point = deletion_queue->get_submitted_point(SYNC_QUEUE_GRAPHICS);
+	for (auto& image : transient_images) {
+		deletion_queue->destroy_image_view(point, image.view);
+		deletion_queue->destroy_image(point, image.image);
+	}
+	for (auto& memory_block : memory_blocks) {
+		deletion_queue->free_memory(point, memory_block.memory);
+	}
+	transient_images.clear();
+	memory_blocks.clear();
+}
+
+/**
+* Compute the barriers recorded before each kept pass, and the final transitions of the imported images
+*/
+void VulkanRenderGraph::compute_barriers()
+{
+	std::vector<TrackedState> tracked(resources.size());
+	for (uint32_t i = 0; i < resources.size(); ++i) {
+		const Resource& resource = resources[i];
+		tracked[i] = {};
+		tracked[i].layout = resource.initial_state.layout;
+		tracked[i].write_stages = resource.initial_state.stages;
+		tracked[i].write_access = get_write_access(resource.initial_state.access);
+		tracked[i].queue = async_compute ? resource.initial_state.queue : RENDER_GRAPH_QUEUE_GRAPHICS;
+		tracked[i].submission = RENDER_GRAPH_INVALID;
+	}
+	for (auto& submission : submissions) {
+		submission.release_barriers = {};
+		submission.release_barriers.memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	}
+
+	for (uint32_t i = 0; i < passes.size(); ++i) {
+		Pass& pass = passes[i];
+		pass.image_barriers.clear();
+		pass.memory_barrier = {};
+		pass.memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		pass.source_stages = 0;
+		pass.destination_stages = 0;
+		if (pass.culled) {
+			continue;
+		}
+
+		for (const auto& use : pass.uses) {
+			const Resource& resource = resources[use.resource];
+
+			// The first use of a transient image waits for the previous uses of its memory, by the image
+			// aliased with it in this frame or by the last image using it in the previous frame,
+			// the uses on the other queue are ordered by the semaphores between the submissions
+			if (resource.transient != RENDER_GRAPH_INVALID) {
+				MemoryBlock& memory_block = memory_blocks[transient_images[resource.transient].block];
+				if (resource.first_pass == i) {
+					const bool same_queue = memory_block.queue == pass.queue;
+					tracked[use.resource].write_stages = same_queue ? memory_block.stages : 0;
+					tracked[use.resource].write_access = same_queue ? memory_block.write_access : 0;
+					tracked[use.resource].queue = pass.queue;
+					memory_block.stages = 0;
+					memory_block.write_access = 0;
+				}
+				if (memory_block.queue != pass.queue) {
+					memory_block.queue = pass.queue;
+					memory_block.stages = 0;
+					memory_block.write_access = 0;
+				}
+				memory_block.stages |= use.state.stages;
+				memory_block.write_access |= use.write ? get_write_access(use.state.access) : 0;
+			}
+
+			add_barrier(pass, resource, tracked[use.resource], use);
+		}
+	}
+
+	final_barriers = {};
+	final_barriers.memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	final_barriers.queue = submissions.back().queue;
+	final_barriers.submission = static_cast<uint32_t>(submissions.size() - 1);
+	for (uint32_t i = 0; i < resources.size(); ++i) {
+		const Resource& resource = resources[i];
+		if (!resource.is_image || resource.final_layout == VK_IMAGE_LAYOUT_UNDEFINED || resource.final_layout == tracked[i].layout) {
+			continue;
+		}
+		// The consumer of the final layout, the presentation engine or the next frame, waits on a semaphore or a fence
+		ResourceUse use = {};
+		use.resource = i;
+		use.state = { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, resource.final_layout, RENDER_GRAPH_QUEUE_GRAPHICS };
+		use.read = true;
+		add_barrier(final_barriers, resource, tracked[i], use);
+	}
+}
+
+/**
+* Add the barrier ordering a use of a resource after its previous uses to the barriers of a pass
+* - reading after a write in the same layout waits for the write, unless a previous barrier already made it visible to the reading stages
+* - writing, or changing the layout, waits for the last write and for all the reads since
+*/
+void VulkanRenderGraph::add_barrier(Pass& pass, const Resource& resource, TrackedState& tracked, const ResourceUse& use)
+{
+	// The previous uses on the other queue are complete and visible once the semaphores were waited,
+	// an image keeping its content is released by the queue family of its last use and acquired by the one of the pass
+	if (tracked.queue != pass.queue) {
+		if (resource.is_image && tracked.submission != RENDER_GRAPH_INVALID && tracked.layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+			VkImageMemoryBarrier image_barrier = {};
+			image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			image_barrier.oldLayout = tracked.layout;
+			image_barrier.newLayout = use.state.layout;
+			image_barrier.srcQueueFamilyIndex = get_queue_family(tracked.queue);
+			image_barrier.dstQueueFamilyIndex = get_queue_family(pass.queue);
+			image_barrier.image = resource.image;
+			image_barrier.subresourceRange = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+
+			Pass& release = submissions[tracked.submission].release_barriers;
+			const VkPipelineStageFlags release_stages = tracked.write_stages | tracked.read_stages;
+			release.source_stages |= release_stages != 0 ? release_stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+			release.destination_stages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+			image_barrier.srcAccessMask = tracked.write_access;
+			release.image_barriers.push_back(image_barrier);
+
+			pass.source_stages |= VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			pass.destination_stages |= use.state.stages;
+			image_barrier.srcAccessMask = 0;
+			image_barrier.dstAccessMask = use.state.access;
+			pass.image_barriers.push_back(image_barrier);
+
+			tracked.layout = use.state.layout;
+		}
+		tracked.queue = pass.queue;
+		tracked.write_stages = 0;
+		tracked.write_access = 0;
+		tracked.read_stages = 0;
+		tracked.visible_stages = 0;
+		tracked.visible_access = 0;
+	}
+	tracked.submission = pass.submission;
+
+	const bool layout_change = resource.is_image && use.state.layout != tracked.layout;
+
+	VkPipelineStageFlags source_stages;
+	VkAccessFlags source_access;
+	VkImageLayout old_layout = tracked.layout;
+
+	if (!layout_change && !use.write) {
+		tracked.read_stages |= use.state.stages;
+		if ((use.state.stages & ~tracked.visible_stages) == 0 && (use.state.access & ~tracked.visible_access) == 0) {
+			return;
+		}
+		source_stages = tracked.write_stages;
+		source_access = tracked.write_access;
+		tracked.visible_stages |= use.state.stages;
+		tracked.visible_access |= use.state.access;
+	}
+	else {
+		source_stages = tracked.write_stages | tracked.read_stages;
+		source_access = tracked.write_access;
+		tracked.layout = use.state.layout;
+		tracked.write_stages = use.state.stages;
+		tracked.write_access = use.write ? get_write_access(use.state.access) : 0;
+		tracked.read_stages = 0;
+		// A write is visible to none of the following uses, a layout transition to the stages it was made for
+		tracked.visible_stages = use.write ? 0 : use.state.stages;
+		tracked.visible_access = use.write ? 0 : use.state.access;
+	}
+
+	// Nothing to wait for, the previous uses are ordered by the semaphores and fences of the frame
+	if (source_stages == 0 && !layout_change) {
+		return;
+	}
+
+	pass.source_stages |= source_stages != 0 ? source_stages : static_cast<VkPipelineStageFlags>(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+	pass.destination_stages |= use.state.stages;
+
+	if (resource.is_image) {
+		VkImageMemoryBarrier image_barrier = {};
+		image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		image_barrier.srcAccessMask = source_access;
+		image_barrier.dstAccessMask = use.state.access;
+		image_barrier.oldLayout = old_layout;
+		image_barrier.newLayout = use.state.layout;
+		image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		image_barrier.image = resource.image;
+		image_barrier.subresourceRange = { resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS };
+		pass.image_barriers.push_back(image_barrier);
+	}
+	else if (source_access != 0) {
+		pass.memory_barrier.srcAccessMask |= source_access;
+		pass.memory_barrier.dstAccessMask |= use.state.access;
+	}
+}
+
+/**
+* Record the barriers of a pass in a single vkCmdPipelineBarrier
+*/
+void VulkanRenderGraph::record_barriers(VkCommandBuffer command_buffer, const Pass& pass)
+{
+	if (pass.source_stages == 0) {
+		return;
+	}
+
+	const bool memory_barrier = pass.memory_barrier.srcAccessMask != 0 || pass.memory_barrier.dstAccessMask != 0;
+	vkCmdPipelineBarrier(command_buffer,
+		pass.source_stages,
+		pass.destination_stages,
+		0,
+		memory_barrier ? 1 : 0, memory_barrier ? &pass.memory_barrier : nullptr,
+		0, nullptr,
+		static_cast<uint32_t>(pass.image_barriers.size()), pass.image_barriers.empty() ? nullptr : pass.image_barriers.data());
+}
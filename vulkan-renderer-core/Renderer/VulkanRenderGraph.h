@@ -0,0 +1,262 @@
+#pragma once
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+#include "VulkanDeletionQueue.h"
+
+#define RENDER_GRAPH_INVALID			0xFFFFFFFF
+
+/** @brief How a pass uses a resource, gives the stages, access and layout of the use */
+enum RenderGraphAccess {
+	RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT,
+	RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT,
+	/* sampled in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL */
+	RENDER_GRAPH_ACCESS_SAMPLED,
+	/* storage buffers, and images in VK_IMAGE_LAYOUT_GENERAL whether they are sampled or not */
+	RENDER_GRAPH_ACCESS_STORAGE,
+	RENDER_GRAPH_ACCESS_INDIRECT,
+	RENDER_GRAPH_ACCESS_TRANSFER
+};
+
+/** @brief Queue a pass is submitted to, the compute passes run on the graphics queue without an async compute family */
+enum RenderGraphQueue {
+	RENDER_GRAPH_QUEUE_GRAPHICS,
+	RENDER_GRAPH_QUEUE_COMPUTE
+};
+
+/** @brief Synchronization state of a resource */
+struct RenderGraphState {
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	/* ignored for buffers */
+	VkImageLayout layout;
+	/* queue of the use, for an imported resource the queue of its last use before the graph */
+	RenderGraphQueue queue;
+};
+
+struct RenderGraphImageDescription {
+	VkFormat format;
+	uint32_t width;
+	uint32_t height;
+	VkSampleCountFlagBits samples;
+	VkImageAspectFlags aspect;
+	/* usage added to the usage the passes declare */
+	VkImageUsageFlags usage;
+};
+
+struct RenderGraphStatistics {
+	uint32_t passes;
+	uint32_t culled_passes;
+	uint32_t barrier_batches;
+	uint32_t image_barriers;
+	uint32_t memory_barriers;
+	/** @brief Command buffers the frame is split into, one per run of passes on the same queue */
+	uint32_t submissions;
+	uint32_t ownership_transfers;
+	VkDeviceSize transient_bytes;
+	/** @brief Bytes the transient images would take without aliasing */
+	VkDeviceSize unaliased_bytes;
+	/** @brief Part of the transient bytes in lazily allocated memory, and the part of it actually committed */
+	VkDeviceSize lazily_allocated_bytes;
+	VkDeviceSize committed_bytes;
+};
+
+/**
+* Frame graph of the passes of a frame
+*
+* The graph is declared every frame: resources are imported or described as transient images,
+* then each pass declares the resources it reads and writes and records its commands in a callback
+*
+*   uint32_t depth = graph.create_image("depth", description);
+*   uint32_t pass = graph.add_pass("opaque", [&](VkCommandBuffer command_buffer) { ... });
+*   graph.write(pass, depth, RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT);
+*
+* Compiling the graph
+* - culls the passes whose writes are neither read by a kept pass nor imported, unless they have side effects
+* - places the transient images with disjoint lifetimes in the same memory, the images are kept
+*   from frame to frame while their descriptions do not change
+* - creates the transient images only used as attachments with VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT
+*   in lazily allocated memory when the device has some, tiled GPUs then never commit the memory
+*   of the attachments that no render pass loads or stores
+* - computes the layout transitions and the memory dependencies between the uses of every resource,
+*   the barriers needed before a pass are recorded in a single vkCmdPipelineBarrier
+*
+* Buffers are synchronized with global memory barriers, the graph does not need their handles
+* The passes are executed in declaration order, render passes must neither transition
+* their attachments nor declare external dependencies
+*
+* With an async compute family, the compute passes run on the compute queue: the kept passes
+* are split into submissions, runs of consecutive passes on the same queue, each recorded in
+* its own command buffer by execute(submission, command_buffer)
+* - the caller submits them in order, each one waiting for the previous one on a semaphore
+*   at VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, so the uses of a resource on two queues need no barrier
+* - the images whose content is kept from one queue to the other change of queue family, the release
+*   is recorded at the end of the submission of their last use and the acquire before their next use,
+*   the buffers must be created with VK_SHARING_MODE_CONCURRENT
+* - an imported resource must be first used on the queue of its initial state, the passes
+*   preceding the first graphics pass overlap with the end of the previous frame
+* - the last pass must run on the graphics queue, the imported images are transitioned to their final layout after it
+*/
+class VulkanRenderGraph
+{
+public:
+	typedef std::function<void(VkCommandBuffer)> PassCallback;
+
+	VulkanRenderGraph();
+	~VulkanRenderGraph();
+
+	bool								create(VulkanDevice* device, VulkanDeletionQueue* deletion_queue);
+	void								shutdown();
+
+	void								reset();
+
+	uint32_t							import_image(const std::string& name, VkImage image, VkImageView view, VkImageAspectFlags aspect, const RenderGraphState& initial_state, VkImageLayout final_layout);
+	uint32_t							import_buffer(const std::string& name, const RenderGraphState& initial_state);
+	uint32_t							create_image(const std::string& name, const RenderGraphImageDescription& description);
+
+	uint32_t							add_pass(const std::string& name, PassCallback callback, bool side_effects = false, RenderGraphQueue queue = RENDER_GRAPH_QUEUE_GRAPHICS);
+	void								read(uint32_t pass, uint32_t resource, RenderGraphAccess access, VkPipelineStageFlags shader_stages = 0);
+	void								write(uint32_t pass, uint32_t resource, RenderGraphAccess access, VkPipelineStageFlags shader_stages = 0);
+
+	void								compile();
+	void								execute(uint32_t submission, VkCommandBuffer command_buffer);
+
+	uint32_t							get_submission_count() const { return static_cast<uint32_t>(submissions.size()); };
+	RenderGraphQueue					get_submission_queue(uint32_t submission) const { return submissions[submission].queue; };
+
+	VkImage								get_image(uint32_t resource) const { return resources[resource].image; };
+	VkImageView							get_image_view(uint32_t resource) const { return resources[resource].view; };
+	void								write_graphviz(std::ostream& stream) const;
+	const RenderGraphStatistics&		get_statistics() const { return statistics; };
+
+private:
+	struct ResourceUse {
+		uint32_t resource;
+		RenderGraphState state;
+		bool read;
+		bool write;
+	};
+
+	struct Pass {
+		std::string name;
+		PassCallback callback;
+		bool side_effects;
+		bool culled;
+		RenderGraphQueue queue;
+		uint32_t submission;
+		std::vector<ResourceUse> uses;
+		std::vector<VkImageMemoryBarrier> image_barriers;
+		VkMemoryBarrier memory_barrier;
+		VkPipelineStageFlags source_stages;
+		VkPipelineStageFlags destination_stages;
+	};
+
+	struct Resource {
+		std::string name;
+		bool is_image;
+		bool imported;
+		VkImage image;
+		VkImageView view;
+		VkImageAspectFlags aspect;
+		RenderGraphState initial_state;
+		VkImageLayout final_layout;
+		RenderGraphImageDescription description;
+		/* usage declared by the passes */
+		VkImageUsageFlags usage;
+		/* index of the transient image */
+		uint32_t transient;
+		/* first and last kept passes using the resource */
+		uint32_t first_pass;
+		uint32_t last_pass;
+	};
+
+	/* consecutive kept passes on the same queue */
+	struct Submission {
+		RenderGraphQueue queue;
+		std::vector<uint32_t> passes;
+		/* releases of the images acquired by a later submission on the other queue, after the last pass */
+		Pass release_barriers;
+	};
+
+	/* image of a transient resource, bound at the start of a memory block shared by images used by disjoint passes */
+	struct TransientImage {
+		/* name of the resource, the debug name of the image */
+		std::string name;
+		RenderGraphImageDescription description;
+		VkImageUsageFlags usage;
+		uint32_t first_pass;
+		uint32_t last_pass;
+		VkImage image;
+		VkImageView view;
+		VkMemoryRequirements memory_requirements;
+		uint32_t block;
+		bool transient_attachment;
+	};
+
+	struct MemoryBlock {
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint32_t memory_type_bits;
+		bool transient_attachment;
+		bool lazily_allocated;
+		std::vector<uint32_t> images;
+		/* uses of the block by its last image, across frames */
+		VkPipelineStageFlags stages;
+		VkAccessFlags write_access;
+		RenderGraphQueue queue;
+	};
+
+	/* synchronization state of a resource while the barriers are computed */
+	struct TrackedState {
+		VkImageLayout layout;
+		VkPipelineStageFlags write_stages;
+		VkAccessFlags write_access;
+		/* stages reading the resource since its last write, and the stages and access the write is visible to */
+		VkPipelineStageFlags read_stages;
+		VkPipelineStageFlags visible_stages;
+		VkAccessFlags visible_access;
+		/* queue and submission of the last use, no submission before the first use in the graph */
+		RenderGraphQueue queue;
+		uint32_t submission;
+	};
+
+	VulkanDevice*						device;
+	VulkanDeletionQueue*				deletion_queue;
+	/* the compute passes run on the compute queue of another family */
+	bool								async_compute;
+
+	std::vector<Pass>					passes;
+	std::vector<Resource>				resources;
+	/* transitions of the imported images to their final layout, after the last pass */
+	Pass								final_barriers;
+	std::vector<Submission>				submissions;
+
+	std::vector<TransientImage>			transient_images;
+	std::vector<MemoryBlock>			memory_blocks;
+
+	RenderGraphStatistics				statistics;
+
+	static RenderGraphState				get_use_state(RenderGraphAccess access, VkPipelineStageFlags shader_stages, bool write);
+	static VkImageUsageFlags			get_image_usage(RenderGraphAccess access, bool write);
+	static VkAccessFlags				get_write_access(VkAccessFlags access);
+
+	void								add_use(uint32_t pass, uint32_t resource, RenderGraphAccess access, VkPipelineStageFlags shader_stages, bool write);
+	void								cull_passes();
+	void								split_submissions();
+	uint32_t							get_queue_family(RenderGraphQueue queue) const;
+	void								allocate_transients();
+	void								retire_transients();
+	void								compute_barriers();
+	void								add_barrier(Pass& pass, const Resource& resource, TrackedState& tracked, const ResourceUse& use);
+	void								record_barriers(VkCommandBuffer command_buffer, const Pass& pass);
+};
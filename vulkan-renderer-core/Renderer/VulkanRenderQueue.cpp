@@ -0,0 +1,318 @@
+#include "VulkanRenderQueue.h"
+
+/* Below this number of entries per thread the sort stays on the calling thread */
+#define RADIX_SORT_MIN_ENTRIES_PER_WORKER	4096
+
+VulkanRenderQueue::VulkanRenderQueue()
+	: statistics({})
+	, multi_draw_indirect(false)
+	, draw_indexed_indirect_count(nullptr)
+{
+}
+
+VulkanRenderQueue::~VulkanRenderQueue()
+{
+}
+
+/**
+* Start the worker pool of the sort, the threads are kept until shutdown
+*/
+void VulkanRenderQueue::create()
+{
+	worker_pool.create(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+}
+
+void VulkanRenderQueue::shutdown()
+{
+	worker_pool.shutdown();
+}
+
+/**
+* Build the 64 bits sort key of a draw packet
+*
+* @param pass Index of the pass the draw belongs to
+* @param pipeline Identifier of the pipeline, see get_pipeline_id
+* @param descriptor_set Identifier of the descriptor set, see get_descriptor_set_id
+* @param mesh Index of the mesh
+* @param depth Normalized view depth in [0, 1], smaller is closer
+*/
+uint64_t VulkanRenderQueue::make_sort_key(uint32_t pass, uint32_t pipeline, uint32_t descriptor_set, uint32_t mesh, float depth)
+{
+	const uint64_t depth_max = (1ull << SORT_KEY_DEPTH_BITS) - 1;
+	uint64_t quantized_depth = static_cast<uint64_t>(std::min(std::max(depth, 0.0f), 1.0f) * depth_max);
+
+	uint64_t key = pass & ((1ull << SORT_KEY_PASS_BITS) - 1);
+	key = (key << SORT_KEY_PIPELINE_BITS) | (pipeline & ((1ull << SORT_KEY_PIPELINE_BITS) - 1));
+	key = (key << SORT_KEY_DESCRIPTOR_SET_BITS) | (descriptor_set & ((1ull << SORT_KEY_DESCRIPTOR_SET_BITS) - 1));
+	key = (key << SORT_KEY_MESH_BITS) | (mesh & ((1ull << SORT_KEY_MESH_BITS) - 1));
+	key = (key << SORT_KEY_DEPTH_BITS) | quantized_depth;
+	return key;
+}
+
+/**
+* Push constant range of the draw constants, declared by the pipeline layouts of the queued draws
+*/
+VkPushConstantRange VulkanRenderQueue::get_push_constant_range()
+{
+	VkPushConstantRange push_constant_range = {};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(DrawConstants);
+	return push_constant_range;
+}
+
+/**
+* Store the affine part of a transform as the rows of the draw constants
+*
+* @param transform Transform, its last row must be (0, 0, 0, 1)
+* @param constants Draw constants
+*/
+void VulkanRenderQueue::pack_transform(const glm::mat4& transform, DrawConstants& constants)
+{
+	for (uint32_t row = 0; row < 3; ++row) {
+		constants.transform[row] = glm::vec4(transform[0][row], transform[1][row], transform[2][row], transform[3][row]);
+	}
+}
+
+/**
+* Sort key identifier of a pipeline, the same until the next clear
+*/
+uint32_t VulkanRenderQueue::get_pipeline_id(VkPipeline pipeline)
+{
+	auto it = pipeline_ids.find(pipeline);
+	if (it != pipeline_ids.end()) {
+		return it->second;
+	}
+	const uint32_t id = static_cast<uint32_t>(pipeline_ids.size());
+	pipeline_ids[pipeline] = id;
+	return id;
+}
+
+/**
+* Sort key identifier of a descriptor set, the same until the next clear
+*/
+uint32_t VulkanRenderQueue::get_descriptor_set_id(VkDescriptorSet descriptor_set)
+{
+	auto it = descriptor_set_ids.find(descriptor_set);
+	if (it != descriptor_set_ids.end()) {
+		return it->second;
+	}
+	const uint32_t id = static_cast<uint32_t>(descriptor_set_ids.size());
+	descriptor_set_ids[descriptor_set] = id;
+	return id;
+}
+
+void VulkanRenderQueue::clear()
+{
+	packets.clear();
+	entries.clear();
+	pipeline_ids.clear();
+	descriptor_set_ids.clear();
+}
+
+void VulkanRenderQueue::push(const DrawPacket& packet)
+{
+	SortEntry entry = {};
+	entry.key = packet.key;
+	entry.packet = static_cast<uint32_t>(packets.size());
+
+	packets.push_back(packet);
+	entries.push_back(entry);
+}
+
+void VulkanRenderQueue::sort()
+{
+	radix_sort(entries, scratch);
+	statistics = {};
+}
+
+/**
+* Record the sorted draw packets of a pass
+* Binds and push constants matching the currently bound state are skipped
+*
+* @param command_buffer Command buffer inside the render pass
+* @param pass Index of the pass of the sort keys to record
+*/
+void VulkanRenderQueue::record(VkCommandBuffer command_buffer, uint32_t pass)
+{
+	const uint32_t pass_shift = 64 - SORT_KEY_PASS_BITS;
+
+	VkPipeline bound_pipeline = VK_NULL_HANDLE;
+	VkDescriptorSet bound_descriptor_set = VK_NULL_HANDLE;
+	VkPipelineLayout bound_pipeline_layout = VK_NULL_HANDLE;
+	DrawConstants bound_constants = {};
+	std::array<VkBuffer, 2> bound_vertex_buffers = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+	VkBuffer bound_index_buffer = VK_NULL_HANDLE;
+
+	// The entries are sorted on the pass first, skip to the range of the pass
+	auto first = std::lower_bound(entries.begin(), entries.end(), pass, [pass_shift](const SortEntry& entry, uint32_t pass) {
+		return (entry.key >> pass_shift) < pass;
+	});
+
+	for (auto entry = first; entry != entries.end() && (entry->key >> pass_shift) == pass; ++entry) {
+		const DrawPacket& packet = packets[entry->packet];
+
+		if (packet.pipeline != bound_pipeline) {
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipeline);
+			bound_pipeline = packet.pipeline;
+			statistics.pipeline_binds++;
+		}
+		else {
+			statistics.skipped_binds++;
+		}
+
+		if (packet.descriptor_set != bound_descriptor_set) {
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, packet.pipeline_layout, 0, 1, &packet.descriptor_set, 0, nullptr);
+			bound_descriptor_set = packet.descriptor_set;
+			statistics.descriptor_set_binds++;
+		}
+		else {
+			statistics.skipped_binds++;
+		}
+
+		// The constants are pushed again when the layout changes, the ranges of two layouts may not be compatible
+		if (packet.pipeline_layout != bound_pipeline_layout || memcmp(&packet.constants, &bound_constants, sizeof(DrawConstants)) != 0) {
+			vkCmdPushConstants(command_buffer, packet.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(DrawConstants), &packet.constants);
+			bound_pipeline_layout = packet.pipeline_layout;
+			bound_constants = packet.constants;
+			statistics.push_constant_updates++;
+		}
+		else {
+			statistics.skipped_binds++;
+		}
+
+		if (packet.vertex_buffer != bound_vertex_buffers[0] || packet.instance_buffer != bound_vertex_buffers[1]) {
+			bound_vertex_buffers = { packet.vertex_buffer, packet.instance_buffer };
+			std::array<VkDeviceSize, 2> offsets = { 0, 0 };
+			vkCmdBindVertexBuffers(command_buffer, 0, static_cast<uint32_t>(bound_vertex_buffers.size()), bound_vertex_buffers.data(), offsets.data());
+			statistics.vertex_buffer_binds++;
+		}
+		else {
+			statistics.skipped_binds++;
+		}
+
+		if (packet.index_buffer != bound_index_buffer) {
+			vkCmdBindIndexBuffer(command_buffer, packet.index_buffer, 0, VK_INDEX_TYPE_UINT32);
+			bound_index_buffer = packet.index_buffer;
+			statistics.index_buffer_binds++;
+		}
+		else {
+			statistics.skipped_binds++;
+		}
+
+		if (packet.indirect_buffer != VK_NULL_HANDLE) {
+			draw_indirect(command_buffer, packet);
+		}
+		else {
+			vkCmdDrawIndexed(command_buffer, packet.index_count, packet.instance_count, packet.first_index, packet.vertex_offset, packet.first_instance);
+		}
+		statistics.draws++;
+	}
+}
+
+/**
+* Set the indirect draw capabilities of the device
+*
+* @param multi_draw_indirect The multiDrawIndirect feature is enabled
+* @param draw_indexed_indirect_count vkCmdDrawIndexedIndirectCountKHR, or null when not supported
+*/
+void VulkanRenderQueue::set_indirect_support(bool multi_draw_indirect, PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count)
+{
+	this->multi_draw_indirect = multi_draw_indirect;
+	this->draw_indexed_indirect_count = draw_indexed_indirect_count;
+}
+
+/**
+* Record an indirect draw packet
+* The GPU written draw count is used when available, otherwise all the commands
+* up to max_draw_count are drawn and the unused ones must have a zero index count
+*/
+void VulkanRenderQueue::draw_indirect(VkCommandBuffer command_buffer, const DrawPacket& packet)
+{
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+	if (packet.count_buffer != VK_NULL_HANDLE && draw_indexed_indirect_count != nullptr) {
+		draw_indexed_indirect_count(command_buffer, packet.indirect_buffer, packet.indirect_offset, packet.count_buffer, packet.count_offset, packet.max_draw_count, stride);
+		statistics.indirect_draws++;
+	}
+	else if (multi_draw_indirect) {
+		vkCmdDrawIndexedIndirect(command_buffer, packet.indirect_buffer, packet.indirect_offset, packet.max_draw_count, stride);
+		statistics.indirect_draws++;
+	}
+	else {
+		for (uint32_t i = 0; i < packet.max_draw_count; ++i) {
+			vkCmdDrawIndexedIndirect(command_buffer, packet.indirect_buffer, packet.indirect_offset + i * stride, 1, stride);
+		}
+		statistics.indirect_draws += packet.max_draw_count;
+	}
+}
+
+/**
+* Stable LSD radix sort of the entries on their 64 bits key, 8 bits per pass
+* Each pass builds per thread histograms of its chunk, then every thread
+* scatters its chunk at the offsets given by the prefix sum of the histograms
+* Passes where all the keys share the same digit are skipped
+*/
+void VulkanRenderQueue::radix_sort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+{
+	const size_t count = entries.size();
+	if (count < 2) {
+		return;
+	}
+	scratch.resize(count);
+
+	uint32_t workers = static_cast<uint32_t>(std::min<size_t>(worker_pool.get_workers_count(), count / RADIX_SORT_MIN_ENTRIES_PER_WORKER));
+	workers = std::max(workers, 1u);
+	const size_t chunk_size = (count + workers - 1) / workers;
+
+	std::vector<std::array<size_t, 256>> histograms(workers);
+
+	SortEntry* source = entries.data();
+	SortEntry* destination = scratch.data();
+
+	for (uint32_t shift = 0; shift < 64; shift += 8) {
+		worker_pool.run(workers, [&](uint32_t worker) {
+			auto& histogram = histograms[worker];
+			histogram.fill(0);
+			size_t begin = worker * chunk_size;
+			size_t end = std::min(begin + chunk_size, count);
+			for (size_t i = begin; i < end; ++i) {
+				histogram[(source[i].key >> shift) & 0xff]++;
+			}
+		});
+
+		// Exclusive prefix sum in digit major then worker order to keep the sort stable
+		bool single_digit = false;
+		size_t offset = 0;
+		for (uint32_t digit = 0; digit < 256; ++digit) {
+			size_t digit_count = 0;
+			for (auto& histogram : histograms) {
+				size_t histogram_count = histogram[digit];
+				histogram[digit] = offset;
+				offset += histogram_count;
+				digit_count += histogram_count;
+			}
+			if (digit_count == count) {
+				single_digit = true;
+			}
+		}
+		if (single_digit) {
+			continue;
+		}
+
+		worker_pool.run(workers, [&](uint32_t worker) {
+			auto& offsets = histograms[worker];
+			size_t begin = worker * chunk_size;
+			size_t end = std::min(begin + chunk_size, count);
+			for (size_t i = begin; i < end; ++i) {
+				destination[offsets[(source[i].key >> shift) & 0xff]++] = source[i];
+			}
+		});
+
+		std::swap(source, destination);
+	}
+
+	if (source != entries.data()) {
+		entries.swap(scratch);
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+
+#include "VulkanTools.h"
+#include "VulkanWorkerPool.h"
+
+/**
+* Sort key layout, most significant bits first
+*
+* | pass (4) | pipeline (12) | descriptor set (12) | mesh (12) | depth (24) |
+*
+* Sorting on the key groups the draws by pass, then minimizes the state changes,
+* and finally orders the draws sharing the same state front to back
+* The pipeline and descriptor set fields are the identifiers given by the queue to the bound handles,
+* the material is pushed with the draw constants and causes no bind, so it is not part of the key
+*/
+#define SORT_KEY_PASS_BITS				4
+#define SORT_KEY_PIPELINE_BITS			12
+#define SORT_KEY_DESCRIPTOR_SET_BITS	12
+#define SORT_KEY_MESH_BITS				12
+#define SORT_KEY_DEPTH_BITS				24
+
+/* Push constant bytes every device supports */
+#define DRAW_CONSTANTS_MAX_SIZE			128
+
+/**
+* Per draw data pushed with vkCmdPushConstants, visible to the vertex and fragment stages
+*
+*   layout (push_constant) uniform DrawConstants { vec4 transform[3]; uint object; uint material; uint texture; uint flags; } draw;
+*/
+struct DrawConstants {
+	/** @brief Rows of the 3x4 affine transform of the draw, applied to the instance transforms */
+	glm::vec4 transform[3];
+	uint32_t object;
+	uint32_t material;
+	/** @brief Bindless handle of the texture of the material */
+	uint32_t texture;
+	uint32_t flags;
+};
+
+static_assert(sizeof(DrawConstants) <= DRAW_CONSTANTS_MAX_SIZE, "Draw constants exceed the guaranteed push constant size");
+
+struct DrawPacket {
+	uint64_t key;
+
+	VkPipeline pipeline;
+	VkPipelineLayout pipeline_layout;
+	VkDescriptorSet descriptor_set;
+	DrawConstants constants;
+
+	VkBuffer vertex_buffer;
+	VkBuffer instance_buffer;
+	VkBuffer index_buffer;
+
+	uint32_t index_count;
+	uint32_t first_index;
+	int32_t vertex_offset;
+	uint32_t first_instance;
+	uint32_t instance_count;
+
+	/* indirect draws, the direct draw parameters are ignored when set */
+	VkBuffer indirect_buffer;
+	VkDeviceSize indirect_offset;
+	VkBuffer count_buffer;
+	VkDeviceSize count_offset;
+	uint32_t max_draw_count;
+};
+
+struct RenderQueueStatistics {
+	uint32_t draws;
+	uint32_t indirect_draws;
+	uint32_t pipeline_binds;
+	uint32_t descriptor_set_binds;
+	uint32_t push_constant_updates;
+	uint32_t vertex_buffer_binds;
+	uint32_t index_buffer_binds;
+	uint32_t skipped_binds;
+};
+
+class VulkanRenderQueue
+{
+public:
+	VulkanRenderQueue();
+	~VulkanRenderQueue();
+
+	void							create();
+	void							shutdown();
+
+	static uint64_t					make_sort_key(uint32_t pass, uint32_t pipeline, uint32_t descriptor_set, uint32_t mesh, float depth);
+	static VkPushConstantRange		get_push_constant_range();
+	static void						pack_transform(const glm::mat4& transform, DrawConstants& constants);
+
+	uint32_t						get_pipeline_id(VkPipeline pipeline);
+	uint32_t						get_descriptor_set_id(VkDescriptorSet descriptor_set);
+
+	/** @brief Pool of the sort, shared with the other parallel CPU work of the renderer */
+	VulkanWorkerPool*				get_worker_pool() { return &worker_pool; };
+
+	void							clear();
+	void							push(const DrawPacket& packet);
+	void							sort();
+	void							record(VkCommandBuffer command_buffer, uint32_t pass);
+
+	void							set_indirect_support(bool multi_draw_indirect, PFN_vkCmdDrawIndexedIndirectCountKHR draw_indexed_indirect_count);
+
+	const RenderQueueStatistics&	get_statistics() const { return statistics; };
+
+private:
+	struct SortEntry {
+		uint64_t key;
+		uint32_t packet;
+	};
+
+	std::vector<DrawPacket>			packets;
+	std::vector<SortEntry>			entries;
+	std::vector<SortEntry>			scratch;
+
+	/* sort key identifiers of the handles queued since the last clear, in order of first use */
+	std::unordered_map<VkPipeline, uint32_t>		pipeline_ids;
+	std::unordered_map<VkDescriptorSet, uint32_t>	descriptor_set_ids;
+
+	RenderQueueStatistics			statistics;
+
+	bool									multi_draw_indirect;
+	PFN_vkCmdDrawIndexedIndirectCountKHR	draw_indexed_indirect_count;
+
+	VulkanWorkerPool				worker_pool;
+
+	void							draw_indirect(VkCommandBuffer command_buffer, const DrawPacket& packet);
+
+	void							radix_sort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+};
@@ -1,8 +1,47 @@
 #include "VulkanRenderer.h"
 
+#define CAMERA_FOV						60.0f
+#define CAMERA_Z_NEAR					0.1f
+#define CAMERA_Z_FAR					256.0f
+
+/* Screen space error, in pixels, tolerated when selecting a level of detail */
+#define LOD_PIXEL_ERROR					1.0f
+/* Fraction of the tolerated error a coarser level must be under before switching to it */
+#define LOD_HYSTERESIS					0.25f
+
+/* Descriptor set of the bindless textures */
+#define DESCRIPTOR_SET_BINDLESS			1
+
+/* Passes of the render queue sort keys */
+#define RENDER_PASS_OPAQUE				0
+#define RENDER_PASS_OPAQUE_LATE			1
+
+/* Time the window size must stay unchanged before the swapchain is recreated */
+#define RESIZE_DEBOUNCE_MS				50
+
 VulkanRenderer::VulkanRenderer()
-	: is_ready(false)
-	, is_paused(false)
+	: is_paused(false)
+	, lod_bias(0.0f)
+	, cluster_culling_enabled(true)
+	, occlusion_culling(true)
+	, msaa_samples(MULTISAMPLE_LEVEL)
+	, present_policy(DEFAULT_PRESENT_POLICY)
+	, target_fps(DEFAULT_TARGET_FPS)
+	, frame_pacing(true)
+	, on_demand_rendering(DEFAULT_ON_DEMAND_RENDERING)
+	, preferred_device(DEFAULT_PREFERRED_DEVICE)
+	, debug_level(DEFAULT_DEBUG_LEVEL)
+	, debug_severity(DEFAULT_DEBUG_SEVERITY)
+	, render_objects_dirty(true)
+	, rendered_settings({})
+	, redraw_frames(0)
+	, compute_command_pool(VK_NULL_HANDLE)
+	, dynamic_rendering(false)
+	, sample_count(VK_SAMPLE_COUNT_1_BIT)
+	, resize_pending(false)
+	, pending_width(0)
+	, pending_height(0)
+	, is_ready(false)
 {
 }
 
@@ -20,114 +59,303 @@ VulkanRenderer::~VulkanRenderer()
 */
 bool VulkanRenderer::initialize(HINSTANCE hInstance, HWND hWnd, uint32_t width, uint32_t height)
 {
-	instance.create();
+	DebugSettings debug_settings = VulkanDebug::get_default_settings();
+	debug_settings.level = debug_level;
+	debug_settings.severity = debug_severity;
+	instance.create(debug_settings);
 	presentation_surface.create(instance, hInstance, hWnd);
 
-	device.create(instance, presentation_surface);
+	device.debug = instance.get_debug();
+	device.create(instance, presentation_surface, preferred_device);
+	swapchain.set_policy(present_policy);
 	swapchain.create(instance, device, presentation_surface, &width, &height);
-
-	create_depth_buffer(width, height, &depth_buffer);
+	frame_pacer.create(&device);
+	frame_pacer.set_swapchain(swapchain);
+
+	select_depth_format(&depth_buffer);
+	sample_count = select_sample_count(msaa_samples);
+	msaa_samples = sample_count;
+
+	mesh_cache.create(&device);
+	instance_batcher.create(&device, static_cast<uint32_t>(swapchain.images.size()));
+	sync.create(&device);
+	deletion_queue.create(&device, &sync);
+	transfer_queue.create(&device, &sync);
+	render_queue.create();
+	texture_streamer.create(&device, static_cast<uint32_t>(swapchain.images.size()), &transfer_queue, &deletion_queue, render_queue.get_worker_pool());
+	bindless_table.create(&device, static_cast<uint32_t>(swapchain.images.size()));
+	render_queue.set_indirect_support(device.features.multiDrawIndirect == VK_TRUE, device.cmd_draw_indexed_indirect_count);
 
 	create_command_pool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, device.graphics_queue_family_index, &command_pool);
-	allocate_command_buffer(device, command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, swapchain.images.size(), command_buffers);
+	if (device.async_compute) {
+		create_command_pool(device, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, device.compute_queue_family_index, &compute_command_pool);
+	}
+	frame_submissions.resize(swapchain.images.size());
 
+	descriptor_allocator.create(&device, static_cast<uint32_t>(swapchain.images.size()));
 	create_descriptor_set_layout(&descriptor_set_layout);
 	create_pipeline_layout(&pipeline_layout);
 
-	create_render_pass(&render_pass);
-	create_frame_buffer(width, height, frame_buffers);
+	// Dynamic rendering needs neither render passes nor frame buffers
+	dynamic_rendering = device.dynamic_rendering;
+	if (!dynamic_rendering) {
+		create_render_passes();
+	}
+	frame_buffers.resize(swapchain.images.size(), VK_NULL_HANDLE);
+	frame_buffer_views.resize(swapchain.images.size());
 
-	create_uniform_buffer(&uniform_buffer);
-	update_uniform_buffer(width, height, &uniform_buffer);
-	create_vertex_buffer(&vertex_buffer, &index_buffer);
+	update_camera(width, height);
+	mvp_matrix.model = glm::mat4(1.0f);
+	mvp_matrix.model = glm::translate(mvp_matrix.model, glm::vec3(0.0f, 0.0f, 0.0f));
+	mvp_matrix.model = glm::rotate(mvp_matrix.model, glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	create_scene();
 
-	create_descriptor_pool(&descriptor_pool);
-	create_descriptor_set(&descriptor_set);
+	create_frame_uniforms(static_cast<uint32_t>(swapchain.images.size()));
 
 	create_pipeline_cache(&pipeline_cache);
 	create_graphics_pipeline(&graphics_pipeline);
 
+	// The graphics pipeline renders both faces, the meshlets cannot be cone culled
+	cluster_culling.create(&device, static_cast<uint32_t>(swapchain.images.size()));
+	cluster_culling.cone_culling = false;
+	depth_pyramid.create(&device, width, height);
+	render_graph.create(&device, &deletion_queue);
+
 	create_semaphores();
-	create_command_buffer(width, height, command_buffers);
+	frame_values.assign(swapchain.images.size(), 0);
 
 	is_ready = true;
+	request_redraw();
 
 	return true;
 }
 
 void VulkanRenderer::render()
 {
-	if (is_paused || !is_ready) {
+	if (!is_ready) {
 		return;
 	}
 
-	swapchain.acquire_next_image_index(image_acquired_semaphore, (VkFence)nullptr, &current_buffer_index);
+	// Paused and minimized frames are paced as well, the hosts do not spin on them
+	frame_pacer.begin_frame(target_fps, frame_pacing);
+	if (is_paused || !needs_redraw()) {
+		return;
+	}
+	rendered_settings = { lod_bias, cluster_culling_enabled, occlusion_culling };
+	redraw_frames = redraw_frames > 0 ? redraw_frames - 1 : 0;
 
-	VK_CHECK_RESULT(vkWaitForFences(device, 1, &draw_fences[current_buffer_index], VK_TRUE, UINT64_MAX));
-	VK_CHECK_RESULT(vkResetFences(device, 1, &draw_fences[current_buffer_index]));
+	// A new sample count takes effect before the frame is recorded
+	if (msaa_samples != sample_count) {
+		set_sample_count(select_sample_count(msaa_samples));
+	}
 
-	VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	// Nothing is rendered to a minimized window
+	if (resize_pending && (pending_width == 0 || pending_height == 0)) {
+		return;
+	}
 
-	// The submit info structure specifices a command buffer queue submission batch
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.pWaitDstStageMask = &waitStageMask;
-	submitInfo.pWaitSemaphores = &image_acquired_semaphore;
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = &render_complete_semaphore;
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pCommandBuffers = &command_buffers[current_buffer_index];
-	submitInfo.commandBufferCount = 1;
+	// A new present policy recreates the swapchain as a resize does
+	if (present_policy != swapchain.get_configuration().policy) {
+		swapchain.set_policy(present_policy);
+		if (!recreate_swapchain(resize_pending ? pending_width : swapchain.width, resize_pending ? pending_height : swapchain.height)) {
+			return;
+		}
+	}
+
+	if (resize_pending && std::chrono::steady_clock::now() - resize_time >= std::chrono::milliseconds(RESIZE_DEBOUNCE_MS)) {
+		if (!recreate_swapchain(pending_width, pending_height)) {
+			return;
+		}
+	}
+
+	// The time blocked on the swapchain and the fence is slack the pacer moves before the start of the next frames
+	const std::chrono::steady_clock::time_point blocked_start = std::chrono::steady_clock::now();
+	VkResult result = swapchain.acquire_next_image_index(image_acquired_semaphore, (VkFence)nullptr, &current_buffer_index);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		recreate_swapchain(resize_pending ? pending_width : swapchain.width, resize_pending ? pending_height : swapchain.height);
+		return;
+	}
+	if (result != VK_SUBOPTIMAL_KHR) {
+		VK_CHECK_RESULT(result);
+	}
+
+	// The previous frame rendered to the image is complete once the graphics timeline reaches its value
+	VulkanTimeline& graphics_timeline = sync.get_timeline(SYNC_QUEUE_GRAPHICS);
+	graphics_timeline.wait(frame_values[current_buffer_index]);
+	const double blocked_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - blocked_start).count();
+
+	// The frames complete in submission order, the resources retired before the completed frame are no longer used
+	const uint64_t completed_frame = graphics_timeline.get_completed_value();
+	release_retired(completed_frame);
+	transfer_queue.update();
+
+	// The uniform buffer of the frame is no longer read by its previous frame
+	write_uniform_buffer(current_buffer_index);
+
+	select_lods(swapchain.height);
+
+	// Regroup the objects into instanced batches when the scene or the levels of detail changed
+	if (render_objects_dirty) {
+		instance_batcher.build(render_objects);
+		render_objects_dirty = false;
+	}
+	instance_batcher.upload(current_buffer_index);
+
+	record_command_buffer(current_buffer_index, swapchain.width, swapchain.height);
+
+	// The uploads recorded by the frame are submitted in one batch, before the frame waiting for them
+	transfer_queue.flush();
+	submit_frame(current_buffer_index);
+
+	// A swapchain that no longer matches the surface is recreated by the next frame, after the pending resizes
+	result = swapchain.queue_present(device.present_queue, current_buffer_index, render_complete_semaphore, frame_pacer.get_present_next());
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+		if (!resize_pending) {
+			resize(swapchain.width, swapchain.height);
+		}
+	}
+	else {
+		VK_CHECK_RESULT(result);
+	}
 
-	VK_CHECK_RESULT(vkQueueSubmit(device.present_queue, 1, &submitInfo, draw_fences[current_buffer_index]));
-	VK_CHECK_RESULT(swapchain.queue_present(device.present_queue, current_buffer_index, render_complete_semaphore));
+	frame_pacer.end_frame(blocked_time);
 }
 
 void VulkanRenderer::update(float time)
 {
-	mvp_matrix.model = glm::mat4(1.0f);
-	mvp_matrix.model = glm::translate(mvp_matrix.model, glm::vec3(0.0f, 0.0f, 0.0f));
-	mvp_matrix.model = glm::rotate(mvp_matrix.model, glm::radians(45.0f*time), glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 model = glm::mat4(1.0f);
+	model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
+	model = glm::rotate(model, glm::radians(45.0f*time), glm::vec3(0.0f, 1.0f, 0.0f));
 
-	uint8_t* data;
-	VK_CHECK_RESULT(vkMapMemory(device, uniform_buffer.memory, 0, sizeof(mvp_matrix), 0, (void**)&data));
-	memcpy(data, &mvp_matrix, sizeof(mvp_matrix));
-	vkUnmapMemory(device, uniform_buffer.memory);
+	// An unchanged model asks for no frame, the next frame writes the model to its own uniform buffer
+	if (model == mvp_matrix.model) {
+		return;
+	}
+	mvp_matrix.model = model;
+	request_redraw();
 }
 
+/**
+* Request a new size
+* Live resizing sends many requests, the swapchain is only recreated by the frame rendered once
+* the size stopped changing for RESIZE_DEBOUNCE_MS, or sooner when the swapchain is out of date
+*/
 void VulkanRenderer::resize(uint32_t width, uint32_t height)
 {
 	if (!is_ready) {
 		return;
 	}
-	is_ready = false;
 
-	// Recreate the swapchain
-	swapchain.create(instance, device, presentation_surface, &width, &height);
+	resize_pending = true;
+	pending_width = width;
+	pending_height = height;
+	resize_time = std::chrono::steady_clock::now();
+}
 
-	// Recreate the frame buffers
-	vkDestroyImageView(device, depth_buffer.view, nullptr);
-	vkDestroyImage(device, depth_buffer.image, nullptr);
-	vkFreeMemory(device, depth_buffer.memory, nullptr);
-	create_depth_buffer(width, height, &depth_buffer);
-	for (uint32_t i = 0; i < frame_buffers.size(); i++) {
-		vkDestroyFramebuffer(device, frame_buffers[i], nullptr);
+/**
+* With on demand rendering, whether the next render draws a frame
+* Hosts can sleep until their next event while it is false
+*/
+bool VulkanRenderer::needs_redraw() const
+{
+	if (!is_ready || is_paused) {
+		return false;
+	}
+	if (!on_demand_rendering) {
+		return true;
 	}
-	create_frame_buffer(width, height, frame_buffers);
 
-	// Command buffers need to be recreated as they may store
-	// references to the recreated frame buffer
-	vkFreeCommandBuffers(device, command_pool, static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
-	allocate_command_buffer(device, command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, swapchain.images.size(), command_buffers);
-	create_command_buffer(width, height, command_buffers);
+	return redraw_frames > 0
+		|| resize_pending
+		|| msaa_samples != sample_count
+		|| present_policy != swapchain.get_configuration().policy
+		|| lod_bias != rendered_settings.lod_bias
+		|| cluster_culling_enabled != rendered_settings.cluster_culling
+		|| occlusion_culling != rendered_settings.occlusion_culling
+		|| texture_streamer.get_statistics().pending_loads > 0;
+}
 
-	vkDeviceWaitIdle(device);
+/**
+* Render the next frames, then as many as the frames in flight so that the GPU feedback
+* of the texture streaming and of the occlusion culling reaches the displayed image
+*/
+void VulkanRenderer::request_redraw()
+{
+	redraw_frames = static_cast<uint32_t>(swapchain.images.size()) + 1;
+}
 
-	update_uniform_buffer(width, height, &uniform_buffer);
+/**
+* Recreate the swapchain and the resources depending on its size without waiting for the device
+* The old swapchain, frame buffers and depth pyramid are retired until the frames in flight completed,
+* the render graph creates the transient images of the new size and retires the old ones itself
+* Only a change of the swapchain images count, which the per frame resources are indexed by,
+* waits for the frames in flight
+*
+* @return False when the swapchain could not be recreated, the pending resize is then tried again by the next frame
+*/
+bool VulkanRenderer::recreate_swapchain(uint32_t width, uint32_t height)
+{
+	const size_t frames_count = swapchain.images.size();
 
-	is_ready = true;
+	// The old swapchain and the resources of its size stay in use when no new swapchain could be created
+	const SyncPoint submitted_point = sync.get_submitted_point(SYNC_QUEUE_GRAPHICS);
+	if (!swapchain.recreate(&width, &height, submitted_point.value)) {
+		std::cout << "Could not recreate the swapchain\n";
+		return false;
+	}
+	resize_pending = false;
+	frame_pacer.set_swapchain(swapchain);
+	request_redraw();
+
+	// The frames in flight may still use the frame buffers and the depth pyramid
+	for (auto frame_buffer : frame_buffers) {
+		deletion_queue.destroy_framebuffer(submitted_point, frame_buffer);
+	}
+	VulkanDepthPyramid retired_depth_pyramid = depth_pyramid;
+	deletion_queue.defer(submitted_point, [retired_depth_pyramid]() mutable {
+		retired_depth_pyramid.shutdown();
+	});
+
+	frame_buffers.assign(swapchain.images.size(), VK_NULL_HANDLE);
+	frame_buffer_views.assign(swapchain.images.size(), {});
+	depth_pyramid = VulkanDepthPyramid();
+	depth_pyramid.create(&device, width, height);
+
+	if (swapchain.images.size() != frames_count) {
+		sync.wait(submitted_point);
+		release_retired(submitted_point.value);
+
+		// Command buffers are recorded every frame, only their count changes
+		destroy_frame_submissions();
+		frame_submissions.resize(swapchain.images.size());
+		frame_values.assign(swapchain.images.size(), 0);
+
+		// Recreate the per frame instance streams for the new swapchain images count
+		instance_batcher.shutdown();
+		instance_batcher.create(&device, static_cast<uint32_t>(swapchain.images.size()));
+		cluster_culling.shutdown();
+		cluster_culling.create(&device, static_cast<uint32_t>(swapchain.images.size()));
+		cluster_culling.cone_culling = false;
+		bindless_table.set_frames_count(static_cast<uint32_t>(swapchain.images.size()));
+		descriptor_allocator.set_frames_count(static_cast<uint32_t>(swapchain.images.size()));
+		create_frame_uniforms(static_cast<uint32_t>(swapchain.images.size()));
+	}
+
+	// The frames write the new camera to their own uniform buffer
+	update_camera(width, height);
+	return true;
 }
 
+/**
+* Destroy the resources retired by the swapchain recreations and the objects of the deletion queue whose frames completed
+*
+* @param completed_frame Last frame known to be completed
+*/
+void VulkanRenderer::release_retired(uint64_t completed_frame)
+{
+	swapchain.release_retired(completed_frame);
+	deletion_queue.collect();
+}
 
 void VulkanRenderer::shutdown()
 {
@@ -138,46 +366,49 @@ void VulkanRenderer::shutdown()
 	std::cout << "Destroy pipeline\n";
 	vkDestroyPipeline(device, graphics_pipeline, nullptr);
 
-	std::cout << "Destroy vertex buffer\n";
-	vkDestroyBuffer(device, vertex_buffer.buffer, nullptr);
-	vkFreeMemory(device, vertex_buffer.memory, nullptr);
-
-	std::cout << "Destroy index buffer\n";
-	vkDestroyBuffer(device, index_buffer.buffer, nullptr);
-	vkFreeMemory(device, index_buffer.memory, nullptr);
+	frame_pacer.shutdown();
+	render_graph.shutdown();
+	depth_pyramid.shutdown();
+	cluster_culling.shutdown();
+	bindless_table.shutdown();
+	texture_streamer.shutdown();
+	render_queue.shutdown();
+	transfer_queue.shutdown();
+	instance_batcher.shutdown();
+	mesh_cache.shutdown();
 
 	std::cout << "Destroy frame buffers\n";
-	for (uint32_t i = 0; i < frame_buffers.size(); i++) {
-		vkDestroyFramebuffer(device, frame_buffers[i], nullptr);
-	}
+	destroy_frame_buffers();
+	sync.wait_idle();
+	release_retired(sync.get_submitted_point(SYNC_QUEUE_GRAPHICS).value);
+	deletion_queue.shutdown();
 
 	std::cout << "Destroy render pass\n";
 	vkDestroyRenderPass(device, render_pass, nullptr);
+	vkDestroyRenderPass(device, late_render_pass, nullptr);
+	vkDestroyRenderPass(device, discard_render_pass, nullptr);
 
 	std::cout << "Destroy semaphores\n";
 	vkDestroySemaphore(device, image_acquired_semaphore, nullptr);
 	vkDestroySemaphore(device, render_complete_semaphore, nullptr);
 
-	std::cout << "Destroy fences\n";
-	for (auto& fence : draw_fences) {
-		vkDestroyFence(device, fence, nullptr);
-	}
-
-	vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
-
-	vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
 	vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+	descriptor_allocator.shutdown();
 
-	vkDestroyBuffer(device, uniform_buffer.buffer, nullptr);
-	vkFreeMemory(device, uniform_buffer.memory, nullptr);
+	for (auto& uniform_buffer : uniform_buffers) {
+		vkDestroyBuffer(device, uniform_buffer.buffer, nullptr);
+		vkFreeMemory(device, uniform_buffer.memory, nullptr);
+	}
+	uniform_buffers.clear();
+	descriptor_sets.clear();
 
-	vkFreeCommandBuffers(device, command_pool, static_cast<uint32_t>(command_buffers.size()), command_buffers.data());
+	destroy_frame_submissions();
 	vkDestroyCommandPool(device, command_pool, nullptr);
+	if (compute_command_pool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(device, compute_command_pool, nullptr);
+	}
 
-	vkDestroyImageView(device, depth_buffer.view, nullptr);
-	vkDestroyImage(device, depth_buffer.image, nullptr);
-	vkFreeMemory(device, depth_buffer.memory, nullptr);
-
+	sync.shutdown();
 	swapchain.shutdown();
 	presentation_surface.shutdown();
 	device.shutdown();
@@ -239,130 +470,174 @@ bool VulkanRenderer::allocate_command_buffer(
 	return true;
 }
 
-bool VulkanRenderer::create_depth_buffer(const uint32_t width, const uint32_t height, DepthBuffer* depth_buffer)
-{
-	// specify the depth buffer format
-	VkFormat depth_format = VK_FORMAT_D32_SFLOAT_S8_UINT;
-	bool valid_depth_format = vks::tools::get_supported_depth_format(device.physical_device, &depth_format);
-	depth_buffer->format = depth_format;
-
-	VkImageCreateInfo depth_image_create_info = {};
-	depth_image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-	depth_image_create_info.imageType = VK_IMAGE_TYPE_2D;
-	depth_image_create_info.format = depth_format;
-	depth_image_create_info.extent.width = width;
-	depth_image_create_info.extent.height = height;
-	depth_image_create_info.extent.depth = 1;
-	depth_image_create_info.mipLevels = 1;
-	depth_image_create_info.arrayLayers = 1;
-	depth_image_create_info.samples = MULTISAMPLE_LEVEL;
-	depth_image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depth_image_create_info.usage = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
-	depth_image_create_info.queueFamilyIndexCount = 0;
-	depth_image_create_info.pQueueFamilyIndices = nullptr;
-	depth_image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-	// check tiling mode
-	VkFormatProperties format_properties;
-	vkGetPhysicalDeviceFormatProperties(device.physical_device, depth_format, &format_properties);
-	if (format_properties.linearTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
-		depth_image_create_info.tiling = VK_IMAGE_TILING_LINEAR;
-	}
-	else if (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
-		depth_image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+/**
+* Select the format of the depth attachment, a transient image of the render graph
+* The stencil is not used, the depth only formats can be sampled through the views of the graph
+*/
+bool VulkanRenderer::select_depth_format(DepthBuffer* depth_buffer)
+{
+	depth_buffer->format = device.get_supported_format({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM }, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	if (depth_buffer->format == VK_FORMAT_UNDEFINED) {
+		depth_buffer->format = device.get_supported_format({ VK_FORMAT_D32_SFLOAT, VK_FORMAT_D16_UNORM }, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 	}
-	else {
-		std::cout << "VK_FORMAT_D16_UNORM not supported.\n";
+	depth_buffer->aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+	if (depth_buffer->format == VK_FORMAT_UNDEFINED) {
+		std::cout << "No supported depth format.\n";
 		return false;
 	}
-
-	// Create image
-	VK_CHECK_RESULT(vkCreateImage(device, &depth_image_create_info, nullptr, &depth_buffer->image));
-
-	// use the memory properties to determine the type of memory required
-	VkMemoryRequirements depth_memory_requirements;
-	vkGetImageMemoryRequirements(device, depth_buffer->image, &depth_memory_requirements);
-
-	VkMemoryAllocateInfo depth_buffer_memory = {};
-	depth_buffer_memory.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	depth_buffer_memory.allocationSize = depth_memory_requirements.size;
-	depth_buffer_memory.memoryTypeIndex = get_memory_type_index(depth_memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-	// Allocate memory
-	VK_CHECK_RESULT(vkAllocateMemory(device, &depth_buffer_memory, nullptr, &depth_buffer->memory));
-
-	// Bind memory
-	VK_CHECK_RESULT(vkBindImageMemory(device, depth_buffer->image, depth_buffer->memory, 0));
-
-	// Create the image view
-	VkImageViewCreateInfo depth_image_view_create_info = {};
-	depth_image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-	depth_image_view_create_info.image = depth_buffer->image;
-	depth_image_view_create_info.format = depth_format;
-	depth_image_view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
-	depth_image_view_create_info.subresourceRange.baseMipLevel = 0;
-	depth_image_view_create_info.subresourceRange.levelCount = 1;
-	depth_image_view_create_info.subresourceRange.baseArrayLayer = 0;
-	depth_image_view_create_info.subresourceRange.layerCount = 1;
-	depth_image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-
-	VK_CHECK_RESULT(vkCreateImageView(device, &depth_image_view_create_info, nullptr, &depth_buffer->view));
-
 	return true;
 }
 
-bool VulkanRenderer::create_descriptor_set_layout(VkDescriptorSetLayout* descriptor_set_layout)
+/**
+* Highest sample count, not above the requested samples, supported by the color and depth attachments
+* and by the sampled depth the depth pyramid reduces
+*
+* @param samples Requested samples per pixel
+*/
+VkSampleCountFlagBits VulkanRenderer::select_sample_count(uint32_t samples)
 {
-	VkDescriptorSetLayoutBinding layout_binding = {};
-	layout_binding.binding = 0;
-	layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	layout_binding.descriptorCount = 1;
-	layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	layout_binding.pImmutableSamplers = nullptr;
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device.physical_device, &properties);
+	VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts & properties.limits.sampledImageDepthSampleCounts;
+
+	for (uint32_t count = VK_SAMPLE_COUNT_8_BIT; count > VK_SAMPLE_COUNT_1_BIT; count >>= 1) {
+		if (count <= samples && (supported & count) != 0) {
+			return static_cast<VkSampleCountFlagBits>(count);
+		}
+	}
+	return VK_SAMPLE_COUNT_1_BIT;
+}
 
-	VkDescriptorSetLayoutCreateInfo descriptor_layout = {};
-	descriptor_layout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	descriptor_layout.bindingCount = 1;
-	descriptor_layout.pBindings = &layout_binding;
+/**
+* Change the samples of the attachments
+* The render passes, the frame buffers and the pipeline are recreated, the previous ones are destroyed
+* once the frames in flight are complete, the render graph creates the attachments of the next frame with the new samples
+*
+* @param sample_count Sample count supported by the device
+*/
+void VulkanRenderer::set_sample_count(VkSampleCountFlagBits sample_count)
+{
+	this->sample_count = sample_count;
+	msaa_samples = sample_count;
 
-	VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptor_layout, nullptr, descriptor_set_layout));
+	const SyncPoint submitted_point = sync.get_submitted_point(SYNC_QUEUE_GRAPHICS);
+	for (auto frame_buffer : frame_buffers) {
+		deletion_queue.destroy_framebuffer(submitted_point, frame_buffer);
+	}
+	frame_buffers.assign(swapchain.images.size(), VK_NULL_HANDLE);
+	frame_buffer_views.assign(swapchain.images.size(), {});
+	deletion_queue.destroy_pipeline(submitted_point, graphics_pipeline);
+	deletion_queue.destroy_render_pass(submitted_point, render_pass);
+	deletion_queue.destroy_render_pass(submitted_point, late_render_pass);
+	deletion_queue.destroy_render_pass(submitted_point, discard_render_pass);
+	render_pass = VK_NULL_HANDLE;
+	late_render_pass = VK_NULL_HANDLE;
+	discard_render_pass = VK_NULL_HANDLE;
+
+	if (!dynamic_rendering) {
+		create_render_passes();
+	}
+	create_graphics_pipeline(&graphics_pipeline);
+	request_redraw();
+}
 
-	return true;
+bool VulkanRenderer::create_descriptor_set_layout(VkDescriptorSetLayout* descriptor_set_layout)
+{
+	std::vector<VkDescriptorSetLayoutBinding> layout_bindings(2);
+	layout_bindings[0].binding = 0;
+	layout_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	layout_bindings[0].descriptorCount = 1;
+	layout_bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	layout_bindings[0].pImmutableSamplers = nullptr;
+
+	// Levels of detail sampled per texture, written by the fragment shaders for the texture streaming
+	layout_bindings[1].binding = 1;
+	layout_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	layout_bindings[1].descriptorCount = 1;
+	layout_bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	layout_bindings[1].pImmutableSamplers = nullptr;
+
+	// The layout is owned by the descriptor allocator
+	*descriptor_set_layout = descriptor_allocator.get_layout(layout_bindings);
+
+	return *descriptor_set_layout != VK_NULL_HANDLE;
 }
 
 void VulkanRenderer::create_pipeline_layout(VkPipelineLayout* pipeline_layout)
 {
+	// The bindless textures are bound once per frame, after the per draw descriptor set
+	std::vector<VkDescriptorSetLayout> set_layouts = { descriptor_set_layout };
+	if (bindless_table.is_created()) {
+		set_layouts.push_back(bindless_table.get_layout());
+	}
+
+	// The render queue pushes the per draw constants
+	VkPushConstantRange push_constant_range = VulkanRenderQueue::get_push_constant_range();
+
 	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {};
 	pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipeline_layout_create_info.pushConstantRangeCount = 0;
-	pipeline_layout_create_info.pPushConstantRanges = nullptr;
-	pipeline_layout_create_info.setLayoutCount = 1;
-	pipeline_layout_create_info.pSetLayouts = &descriptor_set_layout;
+	pipeline_layout_create_info.pushConstantRangeCount = 1;
+	pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
+	pipeline_layout_create_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
+	pipeline_layout_create_info.pSetLayouts = set_layouts.data();
 
 	VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pipeline_layout_create_info, nullptr, pipeline_layout));
 }
 
-void VulkanRenderer::create_render_pass(VkRenderPass* render_pass)
+void VulkanRenderer::create_render_passes()
 {
-	std::array<VkAttachmentDescription, 2> attachments{};
+	create_render_pass(&render_pass, false, true);
+	create_render_pass(&late_render_pass, true, false);
+	create_render_pass(&discard_render_pass, false, false);
+}
+
+/**
+* Create the render pass of the early or the late draws
+* The early pass clears the attachments and keeps the depth for the depth pyramid,
+* the late pass draws on top of it
+* When multisampled, the color is resolved into the swapchain image at the end of every pass
+* All the passes are compatible with the frame buffers, the attachments stay in their attachment layouts,
+* the render graph transitions them and orders the passes with the other passes of the frame
+*
+* @param render_pass Created render pass
+* @param late Create the late pass
+* @param store_attachments Store the depth and the multisampled color for a following pass, otherwise they may
+* never leave the tile memory of their lazily allocated images
+*/
+void VulkanRenderer::create_render_pass(VkRenderPass* render_pass, bool late, bool store_attachments)
+{
+	const bool multisampled = sample_count != VK_SAMPLE_COUNT_1_BIT;
+
+	std::array<VkAttachmentDescription, 3> attachments{};
 	attachments[0].format = swapchain.image_format;
-	attachments[0].samples = MULTISAMPLE_LEVEL;
-	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].samples = sample_count;
+	attachments[0].loadOp = late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[0].storeOp = (store_attachments || !multisampled) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 	attachments[1].format = depth_buffer.format;
-	attachments[1].samples = MULTISAMPLE_LEVEL;
-	attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[1].samples = sample_count;
+	attachments[1].loadOp = late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+	attachments[1].storeOp = store_attachments ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+	// The swapchain image, fully overwritten by the resolve
+	attachments[2].format = swapchain.image_format;
+	attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[2].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[2].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[2].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
 	VkAttachmentReference color_reference = {};
 	color_reference.attachment = 0;
 	color_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
@@ -371,71 +646,160 @@ void VulkanRenderer::create_render_pass(VkRenderPass* render_pass)
 	depth_reference.attachment = 1;
 	depth_reference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentReference resolve_reference = {};
+	resolve_reference.attachment = 2;
+	resolve_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
 	VkSubpassDescription sub_pass_description = {};
 	sub_pass_description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	sub_pass_description.inputAttachmentCount = 0;
 	sub_pass_description.pInputAttachments = nullptr;
 	sub_pass_description.colorAttachmentCount = 1;
 	sub_pass_description.pColorAttachments = &color_reference;
-	sub_pass_description.pResolveAttachments = nullptr;
+	sub_pass_description.pResolveAttachments = multisampled ? &resolve_reference : nullptr;
 	sub_pass_description.pDepthStencilAttachment = &depth_reference;
 	sub_pass_description.preserveAttachmentCount = 0;
 	sub_pass_description.pPreserveAttachments = nullptr;
 
-	std::array<VkSubpassDependency, 2> dependencies;
-
-	// First dependency at the start of the renderpass
-	// Does the transition from final to initial layout 
-	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;								// Producer of the dependency 
-	dependencies[0].dstSubpass = 0;													// Consumer is our single subpass that will wait for the execution depdendency
-	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-	// Second dependency at the end the renderpass
-	// Does the transition from the initial to the final layout
-	dependencies[1].srcSubpass = 0;													// Producer of the dependency is our single subpass
-	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;								// Consumer are all commands outside of the renderpass
-	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-	dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-	dependencies[1].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-	dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
 	VkRenderPassCreateInfo render_pass_create_info = {};
 	render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	render_pass_create_info.attachmentCount = static_cast<uint32_t>(attachments.size());
+	render_pass_create_info.attachmentCount = multisampled ? 3 : 2;
 	render_pass_create_info.pAttachments = attachments.data();
 	render_pass_create_info.subpassCount = 1;
 	render_pass_create_info.pSubpasses = &sub_pass_description;
-	render_pass_create_info.dependencyCount = static_cast<uint32_t>(dependencies.size());
-	render_pass_create_info.pDependencies = dependencies.data();
+	render_pass_create_info.dependencyCount = 0;
+	render_pass_create_info.pDependencies = nullptr;
 
 	VK_CHECK_RESULT(vkCreateRenderPass(device, &render_pass_create_info, nullptr, render_pass));
 }
 
-void VulkanRenderer::create_frame_buffer(const uint32_t &width, const uint32_t &height, std::vector<VkFramebuffer>& frame_buffers)
+void VulkanRenderer::destroy_frame_buffers()
 {
-	frame_buffers.resize(swapchain.images.size());
-	for (uint32_t i = 0; i < frame_buffers.size(); i++)
-	{
-		std::array<VkImageView, 2> frame_buffers_attachments;
-		frame_buffers_attachments[0] = swapchain.images[i].view;
-		frame_buffers_attachments[1] = depth_buffer.view;
+	for (uint32_t i = 0; i < frame_buffers.size(); i++) {
+		vkDestroyFramebuffer(device, frame_buffers[i], nullptr);
+	}
+	frame_buffers.assign(swapchain.images.size(), VK_NULL_HANDLE);
+	frame_buffer_views.assign(swapchain.images.size(), {});
+}
+
+/**
+* Get the frame buffer of a swapchain image, recreated when the render graph gave the attachments new views
+* The previous frame buffer of the image is no longer used once the fence of the image was waited on
+*
+* @param index Index of the swapchain image
+* @param color_view View of the multisampled color attachment, null when the swapchain image is rendered to
+* @param depth_view View of the depth attachment of the frame
+*/
+VkFramebuffer VulkanRenderer::get_frame_buffer(uint32_t index, VkImageView color_view, VkImageView depth_view, const uint32_t &width, const uint32_t &height)
+{
+	std::array<VkImageView, 2> views = { color_view, depth_view };
+	if (frame_buffers[index] != VK_NULL_HANDLE && frame_buffer_views[index] == views) {
+		return frame_buffers[index];
+	}
+	vkDestroyFramebuffer(device, frame_buffers[index], nullptr);
+
+	// The attachments of the render passes, the swapchain image is the resolve attachment when multisampled
+	std::vector<VkImageView> frame_buffers_attachments;
+	if (color_view != VK_NULL_HANDLE) {
+		frame_buffers_attachments = { color_view, depth_view, swapchain.images[index].view };
+	}
+	else {
+		frame_buffers_attachments = { swapchain.images[index].view, depth_view };
+	}
+
+	VkFramebufferCreateInfo frame_buffer_create_info = {};
+	frame_buffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	frame_buffer_create_info.renderPass = render_pass;
+	frame_buffer_create_info.attachmentCount = static_cast<uint32_t>(frame_buffers_attachments.size());
+	frame_buffer_create_info.pAttachments = frame_buffers_attachments.data();
+	frame_buffer_create_info.width = width;
+	frame_buffer_create_info.height = height;
+	frame_buffer_create_info.layers = 1;
 
-		VkFramebufferCreateInfo frame_buffer_create_info = {};
-		frame_buffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		frame_buffer_create_info.renderPass = render_pass;
-		frame_buffer_create_info.attachmentCount = static_cast<uint32_t>(frame_buffers_attachments.size());
-		frame_buffer_create_info.pAttachments = frame_buffers_attachments.data();
-		frame_buffer_create_info.width = width;
-		frame_buffer_create_info.height = height;
-		frame_buffer_create_info.layers = 1;
+	VK_CHECK_RESULT(vkCreateFramebuffer(device, &frame_buffer_create_info, nullptr, &frame_buffers[index]));
+	frame_buffer_views[index] = views;
 
-		VK_CHECK_RESULT(vkCreateFramebuffer(device, &frame_buffer_create_info, nullptr, &frame_buffers[i]));
+	return frame_buffers[index];
+}
+
+/**
+* Begin the rendering of the early or the late draws
+* With dynamic rendering the attachments are given directly, otherwise the render pass created
+* for the same operations is begun with the frame buffer of the targets
+*
+* @param command_buffer Command buffer of the frame
+* @param targets Attachments of the frame
+* @param late Load the attachments instead of clearing them
+* @param store_attachments Store the depth and the multisampled color for a following pass
+*/
+void VulkanRenderer::begin_rendering(VkCommandBuffer command_buffer, const RenderTargets& targets, bool late, bool store_attachments)
+{
+	// Set clear values for all framebuffer attachments with loadOp set to clear
+	std::array<VkClearValue, 2> clear_values;
+	clear_values[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
+	clear_values[1].depthStencil = { 1.0f, 0 };
+
+	VkRect2D render_area = {};
+	render_area.extent.width = targets.width;
+	render_area.extent.height = targets.height;
+
+#ifdef VK_KHR_dynamic_rendering
+	if (dynamic_rendering) {
+		const bool multisampled = targets.multisampled_color != VK_NULL_HANDLE;
+
+		VkRenderingAttachmentInfoKHR color_attachment = {};
+		color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		color_attachment.imageView = multisampled ? targets.multisampled_color : targets.color;
+		color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		color_attachment.resolveMode = multisampled ? VK_RESOLVE_MODE_AVERAGE_BIT_KHR : VK_RESOLVE_MODE_NONE_KHR;
+		color_attachment.resolveImageView = multisampled ? targets.color : VK_NULL_HANDLE;
+		color_attachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		color_attachment.loadOp = late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		color_attachment.storeOp = (store_attachments || !multisampled) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		color_attachment.clearValue = clear_values[0];
+
+		VkRenderingAttachmentInfoKHR depth_attachment = {};
+		depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR;
+		depth_attachment.imageView = targets.depth;
+		depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		depth_attachment.resolveMode = VK_RESOLVE_MODE_NONE_KHR;
+		depth_attachment.loadOp = late ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+		depth_attachment.storeOp = store_attachments ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		depth_attachment.clearValue = clear_values[1];
+
+		VkRenderingInfoKHR rendering_info = {};
+		rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR;
+		rendering_info.renderArea = render_area;
+		rendering_info.layerCount = 1;
+		rendering_info.colorAttachmentCount = 1;
+		rendering_info.pColorAttachments = &color_attachment;
+		rendering_info.pDepthAttachment = &depth_attachment;
+
+		device.cmd_begin_rendering(command_buffer, &rendering_info);
+		return;
 	}
+#endif
+
+	VkRenderPassBeginInfo render_pass_begin_info = {};
+	render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	render_pass_begin_info.renderPass = late ? late_render_pass : (store_attachments ? render_pass : discard_render_pass);
+	render_pass_begin_info.framebuffer = targets.frame_buffer;
+	render_pass_begin_info.renderArea = render_area;
+	render_pass_begin_info.clearValueCount = late ? 0 : static_cast<uint32_t>(clear_values.size());
+	render_pass_begin_info.pClearValues = late ? nullptr : clear_values.data();
+
+	vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void VulkanRenderer::end_rendering(VkCommandBuffer command_buffer)
+{
+#ifdef VK_KHR_dynamic_rendering
+	if (dynamic_rendering) {
+		device.cmd_end_rendering(command_buffer);
+		return;
+	}
+#endif
+	vkCmdEndRenderPass(command_buffer);
 }
 
 void VulkanRenderer::create_uniform_buffer(VulkanBuffer* uniform_buffer)
@@ -457,25 +821,48 @@ void VulkanRenderer::create_uniform_buffer(VulkanBuffer* uniform_buffer)
 	uniform_buffer->buffer_info.range = sizeof(mvp_matrix);
 }
 
-void VulkanRenderer::update_uniform_buffer(const uint32_t &width, const uint32_t &height, VulkanBuffer* uniform_buffer)
+/**
+* Create the uniform buffers and the sets of the frames in flight that have none yet
+*/
+void VulkanRenderer::create_frame_uniforms(uint32_t frames_count)
 {
-	mvp_matrix.projection = glm::perspective(glm::radians(60.0f), (float)width / (float)height, 0.1f, 256.0f);
+	while (uniform_buffers.size() < frames_count) {
+		VulkanBuffer uniform_buffer = {};
+		create_uniform_buffer(&uniform_buffer);
+		uniform_buffers.push_back(uniform_buffer);
+
+		VkDescriptorSet descriptor_set;
+		create_descriptor_set(uniform_buffer, &descriptor_set);
+		descriptor_sets.push_back(descriptor_set);
+	}
+}
+
+/**
+* Projection and view of a viewport size, the model is left unchanged
+*/
+void VulkanRenderer::update_camera(const uint32_t &width, const uint32_t &height)
+{
+	mvp_matrix.projection = glm::perspective(glm::radians(CAMERA_FOV), (float)width / (float)height, CAMERA_Z_NEAR, CAMERA_Z_FAR);
 	mvp_matrix.view = glm::lookAt(
 		glm::vec3(0.0f, 0.0f, -10.0f),
 		glm::vec3(0.0f, 0.0f, 0.0f),
 		glm::vec3(0.0f, 1.0f, 0.0f));
+}
 
-	mvp_matrix.model = glm::mat4(1.0f);
-	mvp_matrix.model = glm::translate(mvp_matrix.model, glm::vec3(0.0f, 0.0f, 0.0f));
-	mvp_matrix.model = glm::rotate(mvp_matrix.model, glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+/**
+* Write the matrices to the uniform buffer of a frame, the previous frame of its image must be complete
+*/
+void VulkanRenderer::write_uniform_buffer(uint32_t index)
+{
+	VulkanBuffer& uniform_buffer = uniform_buffers[index];
 
 	uint8_t* data;
-	VK_CHECK_RESULT(vkMapMemory(device, uniform_buffer->memory, 0, sizeof(mvp_matrix), 0, (void**)&data));
+	VK_CHECK_RESULT(vkMapMemory(device, uniform_buffer.memory, 0, sizeof(mvp_matrix), 0, (void**)&data));
 	memcpy(data, &mvp_matrix, sizeof(mvp_matrix));
-	vkUnmapMemory(device, uniform_buffer->memory);
+	vkUnmapMemory(device, uniform_buffer.memory);
 }
 
-void VulkanRenderer::create_vertex_buffer(VulkanBuffer* vertex_buffer, VulkanIndexBuffer* index_buffer)
+void VulkanRenderer::create_scene()
 {
 	std::vector<Vertex> vertex_buffer_data =
 	{
@@ -483,89 +870,142 @@ void VulkanRenderer::create_vertex_buffer(VulkanBuffer* vertex_buffer, VulkanInd
 		{ { -1.0f, 1.0f, 0.0f },{ 0.0f, 1.0f, 0.0f } },
 		{ { 0.0f, -1.0f, 0.0f },{ 0.0f, 0.0f, 1.0f } }
 	};
-	uint32_t vertex_buffer_size = static_cast<uint32_t>(vertex_buffer_data.size()) * sizeof(Vertex);
-
 	std::vector<uint32_t> index_buffer_data = { 0, 1, 2 };
-	index_buffer->count = static_cast<uint32_t>(index_buffer_data.size());
-	uint32_t index_buffer_size = index_buffer->count * sizeof(uint32_t);
-
-	uint8_t * data;
-
-	// vertex buffer
-	VkBufferCreateInfo vertex_buffer_create_info = {};
-	vertex_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	vertex_buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-	vertex_buffer_create_info.size = vertex_buffer_size;
-	VK_CHECK_RESULT(vkCreateBuffer(device, &vertex_buffer_create_info, nullptr, &vertex_buffer->buffer));
 
-	VkMemoryRequirements memory_requirements;
-	vkGetBufferMemoryRequirements(device, vertex_buffer->buffer, &memory_requirements);
-
-	VkMemoryAllocateInfo memory_allocate_info = {};
-	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memory_allocate_info.allocationSize = memory_requirements.size;
-	memory_allocate_info.memoryTypeIndex = get_memory_type_index(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &memory_allocate_info, nullptr, &(vertex_buffer->memory)));
-	VK_CHECK_RESULT(vkMapMemory(device, vertex_buffer->memory, 0, memory_requirements.size, 0, (void **)&data));
-	memcpy(data, vertex_buffer_data.data(), vertex_buffer_size);
-	vkUnmapMemory(device, vertex_buffer->memory);
-	VK_CHECK_RESULT(vkBindBufferMemory(device, vertex_buffer->buffer, vertex_buffer->memory, 0));
-
-	// index buffer
-	VkBufferCreateInfo index_buffer_create_info = {};
-	index_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	index_buffer_create_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
-	index_buffer_create_info.size = index_buffer_size;
-	VK_CHECK_RESULT(vkCreateBuffer(device, &index_buffer_create_info, nullptr, &index_buffer->buffer));
-	vkGetBufferMemoryRequirements(device, index_buffer->buffer, &memory_requirements);
-	memory_allocate_info.allocationSize = memory_requirements.size;
-	memory_allocate_info.memoryTypeIndex = get_memory_type_index(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device, &memory_allocate_info, nullptr, &(index_buffer->memory)));
-	VK_CHECK_RESULT(vkMapMemory(device, index_buffer->memory, 0, memory_requirements.size, 0, (void **)&data));
-	memcpy(data, index_buffer_data.data(), index_buffer_size);
-	vkUnmapMemory(device, index_buffer->memory);
-	VK_CHECK_RESULT(vkBindBufferMemory(device, index_buffer->buffer, index_buffer->memory, 0));
+	uint32_t triangle = mesh_cache.add(vertex_buffer_data, index_buffer_data);
+	add_object(triangle, 0, glm::mat4(1.0f), glm::vec4(1.0f));
 }
 
-bool VulkanRenderer::create_descriptor_pool(VkDescriptorPool *descriptor_pool)
+/**
+* Add an object to the scene
+* Objects sharing a mesh and a material are drawn with a single instanced draw
+*
+* @param mesh Index of the mesh in the mesh cache
+* @param material Index of the material, the handle of a streamed texture samples it once resident
+* @param transform Model transform of the object
+* @param color Color multiplied with the vertex colors
+*
+* @return Index of the object
+*/
+uint32_t VulkanRenderer::add_object(uint32_t mesh, uint32_t material, const glm::mat4& transform, const glm::vec4& color)
 {
-	VkDescriptorPoolSize type_count[1];
-	type_count[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	type_count[0].descriptorCount = 1;
+	RenderObject object = {};
+	object.mesh = mesh;
+	object.material = material;
+	object.lod = 0;
+	object.transform = transform;
+	object.color = color;
+	render_objects.push_back(object);
+
+	render_objects_dirty = true;
+	request_redraw();
+
+	return static_cast<uint32_t>(render_objects.size() - 1);
+}
 
-	VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
-	descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	descriptor_pool_create_info.maxSets = 1;
-	descriptor_pool_create_info.poolSizeCount = 1;
-	descriptor_pool_create_info.pPoolSizes = type_count;
+/**
+* Select the level of detail of each object from its projected geometric error
+* The coarsest level whose error covers less than LOD_PIXEL_ERROR pixels is kept,
+* scaled by 2^lod_bias
+*
+* @param height Height of the viewport in pixels
+*/
+void VulkanRenderer::select_lods(const uint32_t &height)
+{
+	// Pixels covered by one object space unit at a distance of one
+	const float projection_scale = static_cast<float>(height) / (2.0f * std::tan(glm::radians(CAMERA_FOV) * 0.5f));
+	const float threshold = LOD_PIXEL_ERROR * std::exp2(lod_bias);
+	const glm::mat4 model_view = mvp_matrix.view * mvp_matrix.model;
+
+	for (auto& object : render_objects) {
+		const VulkanMesh& mesh = mesh_cache.get(object.mesh);
+		if (mesh.lods.size() < 2) {
+			continue;
+		}
+
+		float scale = std::max(std::max(
+			glm::length(glm::vec3(object.transform[0])),
+			glm::length(glm::vec3(object.transform[1]))),
+			glm::length(glm::vec3(object.transform[2])));
+		glm::vec4 center = model_view * object.transform * glm::vec4(glm::vec3(mesh.bounding_sphere), 1.0f);
+		float distance = std::max(glm::length(glm::vec3(center)) - mesh.bounding_sphere.w * scale, CAMERA_Z_NEAR);
+		float pixels_per_unit = projection_scale * scale / distance;
+
+		// Switching to a coarser level than the current one requires a margin
+		// so that objects near the threshold do not flicker between two levels
+		uint32_t lod = 0;
+		for (uint32_t i = static_cast<uint32_t>(mesh.lods.size()) - 1; i > 0; --i) {
+			float level_threshold = (i > object.lod) ? threshold * (1.0f - LOD_HYSTERESIS) : threshold;
+			if (mesh.lods[i].error * pixels_per_unit <= level_threshold) {
+				lod = i;
+				break;
+			}
+		}
+
+		if (lod != object.lod) {
+			object.lod = lod;
+			render_objects_dirty = true;
+		}
+	}
+}
 
-	VK_CHECK_RESULT(vkCreateDescriptorPool(device, &descriptor_pool_create_info, nullptr, descriptor_pool));
+/**
+* Start streaming a texture, its mip tail is resident after a few frames
+* and its detailed levels follow as they get sampled
+*
+* @param path Path of a KTX2 or DDS file
+* @return Handle of the texture
+*/
+uint32_t VulkanRenderer::load_texture(const std::string& path)
+{
+	request_redraw();
+	return texture_streamer.load(path);
+}
 
+/**
+* Write the pass and resource graph of the last rendered frame in the Graphviz dot format
+*
+* @param path Path of the dot file
+*/
+bool VulkanRenderer::write_render_graph(const std::string& path)
+{
+	std::ofstream stream(path);
+	if (!stream) {
+		std::cout << "Could not open " << path << "\n";
+		return false;
+	}
+	render_graph.write_graphviz(stream);
 	return true;
 }
 
-void VulkanRenderer::create_descriptor_set(VkDescriptorSet* descriptor_set)
+void VulkanRenderer::set_object_transform(uint32_t object, const glm::mat4& transform)
 {
-	VkDescriptorSetAllocateInfo alloc_info = {};
-	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	alloc_info.descriptorPool = descriptor_pool;
-	alloc_info.descriptorSetCount = 1;
-	alloc_info.pSetLayouts = &descriptor_set_layout;
-
-	VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &alloc_info, descriptor_set));
-
-	VkWriteDescriptorSet write_descriptor_set = {};
-
-	write_descriptor_set = {};
-	write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	write_descriptor_set.dstSet = *descriptor_set;
-	write_descriptor_set.descriptorCount = 1;
-	write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	write_descriptor_set.pBufferInfo = &uniform_buffer.buffer_info;
-	write_descriptor_set.dstArrayElement = 0;
-	write_descriptor_set.dstBinding = 0;
+	render_objects[object].transform = transform;
+	render_objects_dirty = true;
+	request_redraw();
+}
 
-	vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+/**
+* Get the set of the frame resources from the descriptor allocator cache
+* Sets of materials created at runtime come from the same cache
+*
+* @param uniform_buffer Uniform buffer of the frame
+* @param descriptor_set Set
+*/
+void VulkanRenderer::create_descriptor_set(const VulkanBuffer& uniform_buffer, VkDescriptorSet* descriptor_set)
+{
+	std::vector<DescriptorBinding> bindings(2);
+	bindings[0] = {};
+	bindings[0].binding = 0;
+	bindings[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	bindings[0].buffer_info = uniform_buffer.buffer_info;
+
+	bindings[1] = {};
+	bindings[1].binding = 1;
+	bindings[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[1].buffer_info = texture_streamer.get_feedback_buffer().buffer_info;
+
+	*descriptor_set = descriptor_allocator.get_cached(descriptor_set_layout, bindings);
 }
 
 void VulkanRenderer::create_pipeline_cache(VkPipelineCache* pipeline_cache)
@@ -596,14 +1036,18 @@ void VulkanRenderer::create_graphics_pipeline(VkPipeline* pipeline)
 	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	input_assembly.primitiveRestartEnable = VK_FALSE;
 
-	// Vertex input binding
-	VkVertexInputBindingDescription vertex_input_binding = {};
-	vertex_input_binding.binding = 0;
-	vertex_input_binding.stride = sizeof(Vertex);
-	vertex_input_binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	// Vertex input bindings
+	// Binding 0 is the per vertex stream, binding 1 the per instance stream
+	std::array<VkVertexInputBindingDescription, 2> vertex_input_bindings;
+	vertex_input_bindings[0].binding = 0;
+	vertex_input_bindings[0].stride = sizeof(Vertex);
+	vertex_input_bindings[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	vertex_input_bindings[1].binding = 1;
+	vertex_input_bindings[1].stride = sizeof(InstanceData);
+	vertex_input_bindings[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
 
 	// Inpute attribute bindings describe shader attribute locations and memory layouts
-	std::array<VkVertexInputAttributeDescription, 2> vertex_input_attributes;
+	std::array<VkVertexInputAttributeDescription, 7> vertex_input_attributes;
 	// Attribute location 0: Position
 	vertex_input_attributes[0].binding = 0;
 	vertex_input_attributes[0].location = 0;
@@ -614,13 +1058,25 @@ void VulkanRenderer::create_graphics_pipeline(VkPipeline* pipeline)
 	vertex_input_attributes[1].location = 1;
 	vertex_input_attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
 	vertex_input_attributes[1].offset = offsetof(Vertex, color);
+	// Attribute locations 2 to 5: Instance model matrix columns
+	for (uint32_t i = 0; i < 4; i++) {
+		vertex_input_attributes[2 + i].binding = 1;
+		vertex_input_attributes[2 + i].location = 2 + i;
+		vertex_input_attributes[2 + i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		vertex_input_attributes[2 + i].offset = offsetof(InstanceData, model) + i * sizeof(glm::vec4);
+	}
+	// Attribute location 6: Instance color
+	vertex_input_attributes[6].binding = 1;
+	vertex_input_attributes[6].location = 6;
+	vertex_input_attributes[6].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	vertex_input_attributes[6].offset = offsetof(InstanceData, color);
 
 	// Vertex input state used for pipeline creation
 	VkPipelineVertexInputStateCreateInfo vertex_input_state = {};
 	vertex_input_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertex_input_state.vertexBindingDescriptionCount = 1;
-	vertex_input_state.pVertexBindingDescriptions = &vertex_input_binding;
-	vertex_input_state.vertexAttributeDescriptionCount = 2;
+	vertex_input_state.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_input_bindings.size());
+	vertex_input_state.pVertexBindingDescriptions = vertex_input_bindings.data();
+	vertex_input_state.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_input_attributes.size());
 	vertex_input_state.pVertexAttributeDescriptions = vertex_input_attributes.data();
 
 	// Shaders
@@ -636,7 +1092,13 @@ void VulkanRenderer::create_graphics_pipeline(VkPipeline* pipeline)
 	shader_stages[1].pSpecializationInfo = nullptr;
 	shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 	shader_stages[1].pName = "main";
-	shader_stages[1].module = shader_loader.load(device, "D:\\Documents\\Vulkan\\Projects\\vulkan-renderer\\vulkan-renderer-core\\Data\\shaders\\simple.frag.spv");
+	// The textures can only be sampled through the bindless descriptors
+	if (bindless_table.is_created()) {
+		shader_stages[1].module = shader_loader.load(device, "D:\\Documents\\Vulkan\\Projects\\vulkan-renderer\\vulkan-renderer-core\\Data\\shaders\\bindless.frag.spv");
+	}
+	else {
+		shader_stages[1].module = shader_loader.load(device, "D:\\Documents\\Vulkan\\Projects\\vulkan-renderer\\vulkan-renderer-core\\Data\\shaders\\simple.frag.spv");
+	}
 
 	// Rasterization state
 	VkPipelineRasterizationStateCreateInfo rasterization_state = {};
@@ -683,11 +1145,11 @@ void VulkanRenderer::create_graphics_pipeline(VkPipeline* pipeline)
 	depth_stencil_state.front = depth_stencil_state.back;
 
 	// Multi sampling state
-	// This example does not make use fo multi sampling (for anti-aliasing), the state must still be set and passed to the pipeline
+	// The pipeline rasterizes as many samples as the attachments of the render passes have
 	VkPipelineMultisampleStateCreateInfo multisample_state = {};
 	multisample_state.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 	multisample_state.pSampleMask = nullptr;
-	multisample_state.rasterizationSamples = MULTISAMPLE_LEVEL;
+	multisample_state.rasterizationSamples = sample_count;
 	multisample_state.sampleShadingEnable = VK_FALSE;
 	multisample_state.alphaToCoverageEnable = VK_FALSE;
 	multisample_state.alphaToOneEnable = VK_FALSE;
@@ -713,7 +1175,21 @@ void VulkanRenderer::create_graphics_pipeline(VkPipeline* pipeline)
 	pipeline_create_info.renderPass = render_pass;
 	pipeline_create_info.subpass = 0;
 
+#ifdef VK_KHR_dynamic_rendering
+	// Without a render pass the pipeline declares the formats of the attachments it renders to
+	VkPipelineRenderingCreateInfoKHR rendering_create_info = {};
+	rendering_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR;
+	rendering_create_info.colorAttachmentCount = 1;
+	rendering_create_info.pColorAttachmentFormats = &swapchain.image_format;
+	rendering_create_info.depthAttachmentFormat = depth_buffer.format;
+	if (dynamic_rendering) {
+		pipeline_create_info.pNext = &rendering_create_info;
+		pipeline_create_info.renderPass = VK_NULL_HANDLE;
+	}
+#endif
+
 	VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipeline_create_info, nullptr, pipeline));
+	device.set_object_name(VK_OBJECT_TYPE_PIPELINE, reinterpret_cast<uint64_t>(*pipeline), "graphics_pipeline");
 
 	vkDestroyShaderModule(device, shader_stages[0].module, nullptr);
 	vkDestroyShaderModule(device, shader_stages[1].module, nullptr);
@@ -726,88 +1202,410 @@ void VulkanRenderer::create_semaphores()
 
 	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &image_acquired_semaphore));
 	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &render_complete_semaphore));
-
-	VkFenceCreateInfo fence_create_info = {};
-	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	// Create in signaled state so we don't wait on first render of each command buffer
-	fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-	draw_fences.resize(command_buffers.size());
-	for (auto& fence : draw_fences)
-	{
-		VK_CHECK_RESULT(vkCreateFence(device, &fence_create_info, nullptr, &fence));
-	}
 }
 
-void VulkanRenderer::create_command_buffer(const uint32_t &width, const uint32_t &height, std::vector<VkCommandBuffer>& command_buffers)
+void VulkanRenderer::record_command_buffer(uint32_t index, const uint32_t &width, const uint32_t &height)
 {
 	VkCommandBufferBeginInfo cmdBufInfo = {};
 	cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	// Attachments of the render passes, known once the render graph is compiled
+	RenderTargets targets = {};
+	targets.width = width;
+	targets.height = height;
+
+	// Update dynamic viewport state
+	VkViewport viewport = {};
+	viewport.height = (float)height;
+	viewport.width = (float)width;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	// Update dynamic scissor state
+	VkRect2D scissor = {};
+	scissor.extent.width = width;
+	scissor.extent.height = height;
+	scissor.offset = { 0, 0 };
+
+	// Indirect draws need a non zero firstInstance to address the instance stream
+	const bool cluster_culling_active = cluster_culling_enabled && device.features.drawIndirectFirstInstance == VK_TRUE;
+	const glm::mat4 model_view = mvp_matrix.view * mvp_matrix.model;
+	VkBuffer instance_buffer = instance_batcher.get_instance_buffer(index);
+
+	// The passes of the frame and the resources they share, the graph records the barriers between them
+	render_graph.reset();
+
+	// The image acquired semaphore is waited on at the color attachment output stage
+	uint32_t color = render_graph.import_image("swapchain", swapchain.images[index].image, swapchain.images[index].view, VK_IMAGE_ASPECT_COLOR_BIT,
+		{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED, RENDER_GRAPH_QUEUE_GRAPHICS }, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	// The depth only outlives the render passes when the depth pyramid samples it,
+	// otherwise it is a transient attachment that may never be backed by memory
+	RenderGraphImageDescription depth_description = {};
+	depth_description.format = depth_buffer.format;
+	depth_description.width = width;
+	depth_description.height = height;
+	depth_description.samples = sample_count;
+	depth_description.aspect = depth_buffer.aspect;
+	uint32_t depth = render_graph.create_image("depth", depth_description);
+
+	// The multisampled color is only read by the resolves of the render passes
+	uint32_t multisampled_color = RENDER_GRAPH_INVALID;
+	if (sample_count != VK_SAMPLE_COUNT_1_BIT) {
+		RenderGraphImageDescription color_description = {};
+		color_description.format = swapchain.image_format;
+		color_description.width = width;
+		color_description.height = height;
+		color_description.samples = sample_count;
+		color_description.aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		multisampled_color = render_graph.create_image("multisampled_color", color_description);
+	}
 
-	// Set clear values for all framebuffer attachments with loadOp set to clear
-	// We use two attachments (color and depth) that are cleared at the start of the subpass and as such we need to set clear values for both
-	VkClearValue clearValues[2];
-	clearValues[0].color = { { 0.0f, 0.0f, 0.2f, 1.0f } };
-	clearValues[1].depthStencil = { 1.0f, 0 };
-
-	VkRenderPassBeginInfo renderPassBeginInfo = {};
-	renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassBeginInfo.renderPass = render_pass;
-	renderPassBeginInfo.renderArea.offset.x = 0;
-	renderPassBeginInfo.renderArea.offset.y = 0;
-	renderPassBeginInfo.renderArea.extent.width = width;
-	renderPassBeginInfo.renderArea.extent.height = height;
-	renderPassBeginInfo.clearValueCount = 2;
-	renderPassBeginInfo.pClearValues = clearValues;
-
-	for (int32_t i = 0; i < command_buffers.size(); ++i)
-	{
-		// Set target frame buffer
-		renderPassBeginInfo.framebuffer = frame_buffers[i];
+	// The culling buffers are owned by the frame and the pyramid is read by the culling of the previous frame
+	// The culling and the pyramid run on the async compute queue when there is one, the early culling is the
+	// first pass so that it overlaps with the end of the previous frame on the graphics queue
+	uint32_t pass = RENDER_GRAPH_INVALID;
+	uint32_t cluster_draws = RENDER_GRAPH_INVALID;
+	uint32_t pyramid = RENDER_GRAPH_INVALID;
+	if (cluster_culling_active) {
+		cluster_culling.occlusion_culling = occlusion_culling;
+		cluster_draws = render_graph.import_buffer("cluster_draws", { 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, RENDER_GRAPH_QUEUE_COMPUTE });
+		pyramid = render_graph.import_image("depth_pyramid", depth_pyramid.get_image(), depth_pyramid.get_view(), VK_IMAGE_ASPECT_COLOR_BIT,
+			{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, depth_pyramid.get_layout(), RENDER_GRAPH_QUEUE_COMPUTE }, VK_IMAGE_LAYOUT_UNDEFINED);
+
+		pass = render_graph.add_pass("cull_early", [&](VkCommandBuffer command_buffer) {
+			cluster_culling.cull_early(command_buffer, index, instance_batcher.get_batches(), mesh_cache, instance_buffer, model_view, mvp_matrix.projection, CAMERA_Z_NEAR, depth_pyramid);
+		}, false, RENDER_GRAPH_QUEUE_COMPUTE);
+		render_graph.read(pass, pyramid, RENDER_GRAPH_ACCESS_STORAGE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		render_graph.write(pass, cluster_draws, RENDER_GRAPH_ACCESS_STORAGE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	}
 
-		VK_CHECK_RESULT(vkBeginCommandBuffer(command_buffers[i], &cmdBufInfo));
+	pass = render_graph.add_pass("texture_streaming", [&](VkCommandBuffer command_buffer) {
+		// Upload the streamed texture levels and apply the residency changes
+		texture_streamer.update(command_buffer, index);
+
+		// Materials whose texture becomes resident sample it from their next draw
+		if (bindless_table.is_created()) {
+			for (auto texture : texture_streamer.get_updated_textures()) {
+				VkImageView view = texture_streamer.get_view(texture);
+				if (view == VK_NULL_HANDLE) {
+					continue;
+				}
+				if (texture >= material_textures.size()) {
+					material_textures.resize(texture + 1, BINDLESS_INVALID_HANDLE);
+				}
+				if (material_textures[texture] == BINDLESS_INVALID_HANDLE) {
+					material_textures[texture] = bindless_table.add_texture(view, texture_streamer.get_sampler());
+				}
+				else {
+					bindless_table.set_texture(material_textures[texture], view, texture_streamer.get_sampler());
+				}
+			}
+			bindless_table.update(index);
+		}
+	}, true);
+
+	// The draws are queued once the early culling filled the indirect draws
+	// Without the late pass the depth is not needed after the render pass
+	pass = render_graph.add_pass("opaque", [&](VkCommandBuffer command_buffer) {
+		queue_draws(index, cluster_culling_active);
+		bind_bindless_set(command_buffer, index);
 
-		// Start the first sub pass specified in our default render pass setup by the base class
 		// This will clear the color and depth attachment
-		vkCmdBeginRenderPass(command_buffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		begin_rendering(command_buffer, targets, false, cluster_culling_active);
+		vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+		vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+		render_queue.record(command_buffer, RENDER_PASS_OPAQUE);
+		end_rendering(command_buffer);
+	});
+	render_graph.write(pass, color, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT);
+	render_graph.write(pass, depth, RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT);
+	if (multisampled_color != RENDER_GRAPH_INVALID) {
+		render_graph.write(pass, multisampled_color, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT);
+	}
+	if (cluster_culling_active) {
+		render_graph.read(pass, cluster_draws, RENDER_GRAPH_ACCESS_INDIRECT);
+	}
+
+	// Build the depth pyramid from the early draws and draw the meshlets they did not actually hide
+	if (cluster_culling_active) {
+		pass = render_graph.add_pass("depth_pyramid", [&](VkCommandBuffer command_buffer) {
+			depth_pyramid.build(command_buffer);
+		}, false, RENDER_GRAPH_QUEUE_COMPUTE);
+		render_graph.read(pass, depth, RENDER_GRAPH_ACCESS_SAMPLED, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		render_graph.write(pass, pyramid, RENDER_GRAPH_ACCESS_STORAGE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		pass = render_graph.add_pass("cull_late", [&](VkCommandBuffer command_buffer) {
+			cluster_culling.cull_late(command_buffer, index);
+		}, false, RENDER_GRAPH_QUEUE_COMPUTE);
+		render_graph.read(pass, pyramid, RENDER_GRAPH_ACCESS_STORAGE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		render_graph.read(pass, cluster_draws, RENDER_GRAPH_ACCESS_INDIRECT);
+		render_graph.write(pass, cluster_draws, RENDER_GRAPH_ACCESS_STORAGE, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+		pass = render_graph.add_pass("opaque_late", [&](VkCommandBuffer command_buffer) {
+			bind_bindless_set(command_buffer, index);
+			begin_rendering(command_buffer, targets, true, false);
+			vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+			vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+			render_queue.record(command_buffer, RENDER_PASS_OPAQUE_LATE);
+			end_rendering(command_buffer);
+		});
+		// The resolve overwrites the swapchain image, the late pass loads the multisampled color instead
+		if (multisampled_color != RENDER_GRAPH_INVALID) {
+			render_graph.read(pass, multisampled_color, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT);
+			render_graph.write(pass, multisampled_color, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT);
+		}
+		else {
+			render_graph.read(pass, color, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT);
+		}
+		render_graph.write(pass, color, RENDER_GRAPH_ACCESS_COLOR_ATTACHMENT);
+		render_graph.read(pass, depth, RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT);
+		render_graph.write(pass, depth, RENDER_GRAPH_ACCESS_DEPTH_ATTACHMENT);
+		render_graph.read(pass, cluster_draws, RENDER_GRAPH_ACCESS_INDIRECT);
+	}
+
+	// The feedback buffer is synchronized by the streamer itself
+	render_graph.add_pass("feedback_readback", [&](VkCommandBuffer command_buffer) {
+		texture_streamer.record_feedback_readback(command_buffer, index);
+	}, true);
+
+	render_graph.compile();
+
+	VkImageView depth_view = render_graph.get_image_view(depth);
+	targets.color = swapchain.images[index].view;
+	targets.multisampled_color = multisampled_color != RENDER_GRAPH_INVALID ? render_graph.get_image_view(multisampled_color) : VK_NULL_HANDLE;
+	targets.depth = depth_view;
+	if (!dynamic_rendering) {
+		targets.frame_buffer = get_frame_buffer(index, targets.multisampled_color, depth_view, width, height);
+	}
+
+	// The first level descriptor of the depth pyramid is shared by the frames in flight,
+	// the graph only creates a new depth when its description or its uses change
+	// The pyramid of the previous depth is retired as on a resize, the frames in flight may still use it
+	if (cluster_culling_active && (depth_pyramid.get_depth_view() != depth_view || depth_pyramid.get_depth_samples() != sample_count)) {
+		if (depth_pyramid.get_depth_view() != VK_NULL_HANDLE) {
+			const SyncPoint submitted_point = sync.get_submitted_point(SYNC_QUEUE_GRAPHICS);
+			VulkanDepthPyramid retired_depth_pyramid = depth_pyramid;
+			deletion_queue.defer(submitted_point, [retired_depth_pyramid]() mutable {
+				retired_depth_pyramid.shutdown();
+			});
+
+			depth_pyramid = VulkanDepthPyramid();
+			depth_pyramid.create(&device, width, height);
+		}
+		depth_pyramid.set_depth_view(depth_view, sample_count);
+	}
 
-		// Update dynamic viewport state
-		VkViewport viewport = {};
-		viewport.height = (float)height;
-		viewport.width = (float)width;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-		vkCmdSetViewport(command_buffers[i], 0, 1, &viewport);
+	// The transient descriptor sets of the previous submission of the frame are released
+	descriptor_allocator.begin_frame(index);
+
+	// The command pools are created with VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+	// beginning a command buffer implicitly resets it
+	// The graph transitions the color attachment to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR after the last pass
+	for (uint32_t submission = 0; submission < render_graph.get_submission_count(); ++submission) {
+		VkCommandBuffer command_buffer = get_submission_command_buffer(index, submission);
+		VK_CHECK_RESULT(vkBeginCommandBuffer(command_buffer, &cmdBufInfo));
+		render_graph.execute(submission, command_buffer);
+		VK_CHECK_RESULT(vkEndCommandBuffer(command_buffer));
+	}
+}
 
-		// Update dynamic scissor state
-		VkRect2D scissor = {};
-		scissor.extent.width = width;
-		scissor.extent.height = height;
-		scissor.offset = { 0, 0 };
-		vkCmdSetScissor(command_buffers[i], 0, 1, &scissor);
+/**
+* Command buffer of a submission of the frame, allocated from the pool of the submission queue the first time it is needed
+*/
+VkCommandBuffer VulkanRenderer::get_submission_command_buffer(uint32_t index, uint32_t submission)
+{
+	FrameSubmissions& frame = frame_submissions[index];
+	const RenderGraphQueue queue = render_graph.get_submission_queue(submission);
+	VkCommandPool pool = queue == RENDER_GRAPH_QUEUE_COMPUTE ? compute_command_pool : command_pool;
 
-		// Bind descriptor sets describing shader binding points
-		vkCmdBindDescriptorSets(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+	if (submission >= frame.command_buffers.size()) {
+		frame.command_buffers.resize(submission + 1, VK_NULL_HANDLE);
+		frame.queues.resize(submission + 1, RENDER_GRAPH_QUEUE_GRAPHICS);
+	}
+	// The fence of the frame was waited, its command buffers are no longer used
+	if (frame.command_buffers[submission] != VK_NULL_HANDLE && frame.queues[submission] != queue) {
+		VkCommandPool previous_pool = frame.queues[submission] == RENDER_GRAPH_QUEUE_COMPUTE ? compute_command_pool : command_pool;
+		vkFreeCommandBuffers(device, previous_pool, 1, &frame.command_buffers[submission]);
+		frame.command_buffers[submission] = VK_NULL_HANDLE;
+	}
+	if (frame.command_buffers[submission] == VK_NULL_HANDLE) {
+		std::vector<VkCommandBuffer> command_buffers;
+		allocate_command_buffer(device, pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1, command_buffers);
+		frame.command_buffers[submission] = command_buffers[0];
+		frame.queues[submission] = queue;
+	}
+	return frame.command_buffers[submission];
+}
 
-		// Bind the rendering pipeline
-		// The pipeline (state object) contains all states of the rendering pipeline, binding it will set all the states specified at pipeline creation time
-		vkCmdBindPipeline(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline);
+/**
+* Submit the command buffers of the frame in order, each one waiting for the previous one
+* The first submission waits for the uploads the frame reads, the first graphics submission waits for the
+* swapchain image, the last one signals the render complete semaphore and the value of the frame on the
+* graphics timeline, which is only reached once all the submissions completed
+*/
+void VulkanRenderer::submit_frame(uint32_t index)
+{
+	FrameSubmissions& frame = frame_submissions[index];
+	const uint32_t count = render_graph.get_submission_count();
 
-		// Bind triangle vertex buffer (contains position and colors)
-		VkDeviceSize offsets[1] = { 0 };
-		vkCmdBindVertexBuffers(command_buffers[i], 0, 1, &vertex_buffer.buffer, offsets);
+	VkSemaphoreCreateInfo semaphore_create_info = {};
+	semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	while (frame.semaphores.size() + 1 < count) {
+		VkSemaphore semaphore;
+		VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &semaphore));
+		frame.semaphores.push_back(semaphore);
+	}
 
-		// Bind triangle index buffer
-		vkCmdBindIndexBuffer(command_buffers[i], index_buffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+	std::vector<VkSemaphore> wait_semaphores;
+	std::vector<VkPipelineStageFlags> wait_stages;
+	bool image_acquired = false;
+	for (uint32_t submission = 0; submission < count; ++submission) {
+		const bool graphics = frame.queues[submission] == RENDER_GRAPH_QUEUE_GRAPHICS;
+		const bool last = submission + 1 == count;
+
+		wait_semaphores.clear();
+		if (submission > 0) {
+			wait_semaphores.push_back(frame.semaphores[submission - 1]);
+		}
+		wait_stages.assign(wait_semaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		if (graphics && !image_acquired) {
+			wait_semaphores.push_back(image_acquired_semaphore);
+			wait_stages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+			image_acquired = true;
+		}
+
+		VkSubmitInfo submit_info = {};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
+		submit_info.pWaitSemaphores = wait_semaphores.data();
+		submit_info.pWaitDstStageMask = wait_stages.data();
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &frame.command_buffers[submission];
+		submit_info.signalSemaphoreCount = 1;
+		submit_info.pSignalSemaphores = last ? &render_complete_semaphore : &frame.semaphores[submission];
+
+		const uint64_t value = sync.submit(graphics ? SYNC_QUEUE_GRAPHICS : SYNC_QUEUE_COMPUTE, submit_info);
+		if (last) {
+			frame_values[index] = value;
+		}
+	}
+}
 
-		// Draw indexed triangle
-		vkCmdDrawIndexed(command_buffers[i], index_buffer.count, 1, 0, 0, 1);
+void VulkanRenderer::destroy_frame_submissions()
+{
+	for (auto& frame : frame_submissions) {
+		for (uint32_t i = 0; i < frame.command_buffers.size(); ++i) {
+			if (frame.command_buffers[i] != VK_NULL_HANDLE) {
+				vkFreeCommandBuffers(device, frame.queues[i] == RENDER_GRAPH_QUEUE_COMPUTE ? compute_command_pool : command_pool, 1, &frame.command_buffers[i]);
+			}
+		}
+		for (auto& semaphore : frame.semaphores) {
+			vkDestroySemaphore(device, semaphore, nullptr);
+		}
+	}
+	frame_submissions.clear();
+}
 
-		vkCmdEndRenderPass(command_buffers[i]);
+/**
+* Bind the bindless textures of the frame, each draw pass binds them as the passes may be recorded in different command buffers
+*/
+void VulkanRenderer::bind_bindless_set(VkCommandBuffer command_buffer, uint32_t index)
+{
+	if (!bindless_table.is_created()) {
+		return;
+	}
+	VkDescriptorSet bindless_set = bindless_table.get_descriptor_set(index);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, DESCRIPTOR_SET_BINDLESS, 1, &bindless_set, 0, nullptr);
+}
 
-		// Ending the render pass will add an implicit barrier transitioning the frame buffer color attachment to 
-		// VK_IMAGE_LAYOUT_PRESENT_SRC_KHR for presenting it to the windowing system
-		VK_CHECK_RESULT(vkEndCommandBuffer(command_buffers[i]));
+/**
+* Queue the draw packets of the frame and sort them
+* One draw packet per batch of objects sharing a mesh and a material, and per pass drawing the batch
+* The queue sorts the packets and skips the redundant pipeline, descriptor set and buffer binds
+*
+* @param index Index of the frame in flight
+* @param cluster_culling_active The batches are drawn from the output of the cluster culling
+*/
+void VulkanRenderer::queue_draws(uint32_t index, bool cluster_culling_active)
+{
+	const glm::mat4 model_view = mvp_matrix.view * mvp_matrix.model;
+	VkBuffer instance_buffer = instance_batcher.get_instance_buffer(index);
+
+	render_queue.clear();
+	const uint32_t pipeline_id = render_queue.get_pipeline_id(graphics_pipeline);
+	VkDescriptorSet descriptor_set = descriptor_sets[index];
+	const uint32_t descriptor_set_id = render_queue.get_descriptor_set_id(descriptor_set);
+
+	const auto& instances = instance_batcher.get_instances();
+	const auto& batches = instance_batcher.get_batches();
+	for (uint32_t batch_index = 0; batch_index < batches.size(); ++batch_index) {
+		const InstanceBatch& batch = batches[batch_index];
+		const VulkanMesh& mesh = mesh_cache.get(batch.mesh);
+		const VulkanMeshLod& lod = mesh.lods[batch.lod];
+
+		// Sort the batch on its closest instance
+		const glm::mat4 batch_view = model_view * batch.transform;
+		float depth = 1.0f;
+		for (uint32_t i = batch.first_instance; i < batch.first_instance + batch.instance_count; ++i) {
+			glm::vec4 view_position = batch_view * instances[i].model * glm::vec4(glm::vec3(mesh.bounding_sphere), 1.0f);
+			depth = std::min(depth, (-view_position.z - mesh.bounding_sphere.w) / CAMERA_Z_FAR);
+		}
+
+		DrawPacket packet = {};
+		packet.key = VulkanRenderQueue::make_sort_key(RENDER_PASS_OPAQUE, pipeline_id, descriptor_set_id, batch.mesh, depth);
+		packet.pipeline = graphics_pipeline;
+		packet.pipeline_layout = pipeline_layout;
+		packet.descriptor_set = descriptor_set;
+		VulkanRenderQueue::pack_transform(mvp_matrix.model * batch.transform, packet.constants);
+		packet.constants.object = batch_index;
+		packet.constants.material = batch.material;
+		packet.constants.texture = (batch.material < material_textures.size()) ? material_textures[batch.material] : BINDLESS_INVALID_HANDLE;
+		packet.constants.flags = 0;
+		packet.vertex_buffer = mesh.vertex_buffer.buffer;
+		packet.instance_buffer = instance_buffer;
+		packet.index_buffer = mesh.index_buffer.buffer;
+		packet.first_index = lod.first_index;
+		packet.index_count = lod.index_count;
+		packet.first_instance = batch.first_instance;
+		packet.instance_count = batch.instance_count;
+
+		// The visible meshlets of every instance are drawn from the culling output
+		if (cluster_culling_active && cluster_culling.get_draw(batch_index).max_draw_count > 0) {
+			const ClusterDraw& draw = cluster_culling.get_draw(batch_index);
+			packet.indirect_buffer = draw.indirect_buffer;
+			packet.indirect_offset = draw.indirect_offset;
+			packet.count_buffer = draw.count_buffer;
+			packet.count_offset = draw.count_offset;
+			packet.max_draw_count = draw.max_draw_count;
+			render_queue.push(packet);
+
+			// The meshlets occluded by the previous frame depth but visible in the depth of the early draws
+			const ClusterDraw& late_draw = cluster_culling.get_late_draw(batch_index);
+			if (late_draw.max_draw_count > 0) {
+				packet.key = VulkanRenderQueue::make_sort_key(RENDER_PASS_OPAQUE_LATE, pipeline_id, descriptor_set_id, batch.mesh, depth);
+				packet.indirect_offset = late_draw.indirect_offset;
+				packet.count_offset = late_draw.count_offset;
+				packet.max_draw_count = late_draw.max_draw_count;
+				render_queue.push(packet);
+			}
+		}
+		else {
+			render_queue.push(packet);
+		}
+	}
+
+	render_queue.sort();
+}
+
+DebugStatistics VulkanRenderer::get_debug_statistics() const
+{
+	VulkanDebug* debug = instance.get_debug();
+	if (debug == nullptr) {
+		DebugStatistics statistics = {};
+		return statistics;
 	}
+	return debug->get_statistics();
 }
 
 uint32_t VulkanRenderer::get_memory_type_index(uint32_t type_bits, VkMemoryPropertyFlags properties)
@@ -4,6 +4,9 @@
 #include <iostream>
 #include <array>
 #include <vector>
+#include <fstream>
+#include <deque>
+#include <chrono>
 
 #include <Windows.h>
 
@@ -16,32 +19,39 @@
 #include "VulkanSwapchain.h"
 #include "VulkanPresentationSurface.h"
 #include "VulkanShader.h"
+#include "VulkanBuffer.h"
+#include "VulkanMesh.h"
+#include "VulkanInstancing.h"
+#include "VulkanRenderQueue.h"
+#include "VulkanClusterCulling.h"
+#include "VulkanDepthPyramid.h"
+#include "VulkanTextureStreamer.h"
+#include "VulkanBindlessTable.h"
+#include "VulkanDescriptorAllocator.h"
+#include "VulkanRenderGraph.h"
+#include "VulkanFramePacer.h"
+#include "VulkanSync.h"
+#include "VulkanDeletionQueue.h"
+#include "VulkanTransferQueue.h"
 
 #include "VulkanTools.h"
 #include "../Framework/Properties.h"
 
+/** @brief Format of the depth attachment, the image is a transient image of the render graph */
 struct DepthBuffer {
 	VkFormat format;
-	VkImage image;
-	VkImageView view;
-	VkDeviceMemory memory;
+	VkImageAspectFlags aspect;
 };
 
-struct VulkanBuffer {
-	VkBuffer buffer;
-	VkDeviceMemory memory;
-	VkDescriptorBufferInfo buffer_info;
-};
-
-struct VulkanIndexBuffer {
-	VkBuffer buffer;
-	VkDeviceMemory memory;
-	uint32_t count;
-};
-
-struct Vertex {
-	float position[3];
-	float color[3];
+/** @brief Attachments of the render passes of a frame, the frame buffer is null with dynamic rendering */
+struct RenderTargets {
+	VkImageView color;
+	/* null when single sampled, otherwise resolved into the color */
+	VkImageView multisampled_color;
+	VkImageView depth;
+	VkFramebuffer frame_buffer;
+	uint32_t width;
+	uint32_t height;
 };
 
 struct ModelViewProjectMatrix {
@@ -64,7 +74,49 @@ public:
 
 	bool							initialize_(int hWnd, int width, int height);
 
+	uint32_t						add_object(uint32_t mesh, uint32_t material, const glm::mat4& transform, const glm::vec4& color);
+	void							set_object_transform(uint32_t object, const glm::mat4& transform);
+	uint32_t						load_texture(const std::string& path);
+	bool							write_render_graph(const std::string& path);
+	const PresentConfiguration&		get_present_configuration() const { return swapchain.get_configuration(); };
+
+	/** @brief Seconds to wait before the next frame, hosts driven by a timer start it with this delay */
+	double							get_frame_delay() const { return frame_pacer.get_frame_delay(); };
+	/** @brief Sleep until the next frame, hosts call it before sampling the input */
+	void							wait_for_frame() { frame_pacer.wait_for_frame(); };
+	const FramePacerStatistics&		get_frame_pacer_statistics() const { return frame_pacer.get_statistics(); };
+	const TransferStatistics&		get_transfer_statistics() const { return transfer_queue.get_statistics(); };
+	/** @brief Name of the physical device rendered with */
+	std::string						get_device_name() const { return device.properties.deviceName; };
+	/** @brief Messages of the debug messenger, all 0 when debugging is disabled */
+	DebugStatistics					get_debug_statistics() const;
+
+	bool							needs_redraw() const;
+	void							request_redraw();
+
 	bool							is_paused;
+	/** @brief Level of detail quality knob, positive values select coarser levels */
+	float							lod_bias;
+	/** @brief Cull the meshlets on the GPU and draw the visible ones indirectly */
+	bool							cluster_culling_enabled;
+	/** @brief Cull the meshlets hidden behind the depth of the previous frame, then of the early draws */
+	bool							occlusion_culling;
+	/** @brief Samples per pixel, lowered to a count the device supports, changing it recreates the render passes and the pipeline */
+	uint32_t						msaa_samples;
+	/** @brief Latency, power and throughput tradeoff of the presentation, changing it recreates the swapchain */
+	PresentPolicy					present_policy;
+	/** @brief Frame rate cap, 0 does not cap the frame rate */
+	float							target_fps;
+	/** @brief Start the frames as late as they can be to lower the input latency */
+	bool							frame_pacing;
+	/** @brief Render only the frames where the scene, the camera, the resources or the settings changed */
+	bool							on_demand_rendering;
+	/** @brief UUID or part of the name of the physical device to render with, read by initialize, empty selects the device with the best score */
+	std::string						preferred_device;
+	/** @brief Layers and debug extension loaded with the instance, read by initialize, DEBUG_LEVEL_NONE costs nothing */
+	DebugLevel						debug_level;
+	/** @brief Least severe validation messages reported, read by initialize */
+	DebugSeverity					debug_severity;
 
 private:
 
@@ -78,28 +130,99 @@ private:
 	VulkanPresentationSurface		presentation_surface;
 	/* @brief VulkanShader */
 	VulkanShader					shader_loader;
+	/* @brief Meshes */
+	VulkanMeshCache					mesh_cache;
+	/* @brief Instanced batching */
+	VulkanInstanceBatcher			instance_batcher;
+	/* @brief Sorted draw packets */
+	VulkanRenderQueue				render_queue;
+	/* @brief Meshlet culling */
+	VulkanClusterCulling			cluster_culling;
+	/* @brief Hierarchical depth of the early draws */
+	VulkanDepthPyramid				depth_pyramid;
+	/* @brief Timelines of the queues */
+	VulkanSync						sync;
+	/* @brief Objects released while the GPU may still use them */
+	VulkanDeletionQueue				deletion_queue;
+	/* @brief Uploads on the transfer queue */
+	VulkanTransferQueue				transfer_queue;
+	/* @brief Texture streaming */
+	VulkanTextureStreamer			texture_streamer;
+	/* @brief Descriptor sets of the frames and of the materials */
+	VulkanDescriptorAllocator		descriptor_allocator;
+	/* @brief Bindless descriptors of the textures, not created without descriptor indexing */
+	VulkanBindlessTable				bindless_table;
+	/* @brief Passes of the frame */
+	VulkanRenderGraph				render_graph;
+	/* @brief Start of the frames */
+	VulkanFramePacer				frame_pacer;
+
+	/* bindless handle of the texture of each material, a material is the handle of a streamed texture */
+	std::vector<uint32_t>			material_textures;
+
+	/* scene */
+	std::vector<RenderObject>		render_objects;
+	bool							render_objects_dirty;
+
+	/* settings of the last rendered frame, a change of the public knobs is a change of the frame */
+	struct RenderSettings {
+		float lod_bias;
+		bool cluster_culling;
+		bool occlusion_culling;
+	};
+	RenderSettings					rendered_settings;
+	/* frames still to render on demand, a change is followed by the frames the GPU feedback of the streaming and the occlusion needs */
+	uint32_t						redraw_frames;
 
 	/* buffers */
 	VkCommandPool					command_pool;
-	std::vector<VkCommandBuffer>	command_buffers;
+	/* pool of the async compute family, null without async compute */
+	VkCommandPool					compute_command_pool;
+
+	/* command buffers of the submissions the render graph splits a frame into, with the queue of their pool */
+	struct FrameSubmissions {
+		std::vector<VkCommandBuffer> command_buffers;
+		std::vector<RenderGraphQueue> queues;
+		/* signaled by each submission but the last, waited by the next one */
+		std::vector<VkSemaphore> semaphores;
+	};
+	std::vector<FrameSubmissions>	frame_submissions;
+
+	/* the passes are rendered without render pass and frame buffer objects, none of them is created */
+	bool							dynamic_rendering;
 
 	std::vector<VkFramebuffer>		frame_buffers;
+	/* multisampled color and depth attachments of each frame buffer */
+	std::vector<std::array<VkImageView, 2>>	frame_buffer_views;
 	
 	DepthBuffer						depth_buffer;
-	VulkanBuffer					uniform_buffer;
-	VulkanBuffer					vertex_buffer;
-	VulkanIndexBuffer				index_buffer;;
+	/* samples of the color and depth attachments, the multisampled color is resolved into the swapchain image */
+	VkSampleCountFlagBits			sample_count;
+	/* camera of each frame in flight, written by the frame once the previous frame of its image completed,
+	   the buffers are only added so that the cached descriptor sets reading them stay valid */
+	std::vector<VulkanBuffer>		uniform_buffers;
 	uint32_t						current_buffer_index = 0;
 
 	VkRenderPass					render_pass;
+	/* draws the meshlets found visible once the depth pyramid is built, on top of the render pass output */
+	VkRenderPass					late_render_pass;
+	/* draws everything when there is no late pass, the depth and the multisampled color are not stored */
+	VkRenderPass					discard_render_pass;
 	VkSemaphore						image_acquired_semaphore;
 	VkSemaphore						render_complete_semaphore;
-	std::vector<VkFence>			draw_fences;
+	/* graphics timeline value of the last submission of each frame in flight, 0 before its first submission */
+	std::vector<uint64_t>			frame_values;
+
+	/* last size requested by resize, applied once it stopped changing */
+	bool							resize_pending;
+	uint32_t						pending_width;
+	uint32_t						pending_height;
+	std::chrono::steady_clock::time_point	resize_time;
 
 	/* pipeline */
 	VkPipelineLayout				pipeline_layout;
-	VkDescriptorPool				descriptor_pool;
-	VkDescriptorSet					descriptor_set;
+	/* set of each frame in flight, reading its uniform buffer */
+	std::vector<VkDescriptorSet>	descriptor_sets;
 	VkDescriptorSetLayout			descriptor_set_layout;
 	
 	VkPipeline						graphics_pipeline;
@@ -109,7 +232,9 @@ private:
 
 	bool							is_ready;
 
-	bool create_depth_buffer(const uint32_t width, const uint32_t height, DepthBuffer* depth_buffer);
+	bool select_depth_format(DepthBuffer* depth_buffer);
+	VkSampleCountFlagBits select_sample_count(uint32_t samples);
+	void set_sample_count(VkSampleCountFlagBits sample_count);
 
 	bool create_buffer(VkDevice logical_device, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer & buffer);
 	bool create_command_pool(VkDevice logical_device, VkCommandPoolCreateFlags parameters, uint32_t queue_family, VkCommandPool* command_pool);
@@ -118,22 +243,35 @@ private:
 	bool create_descriptor_set_layout(VkDescriptorSetLayout* descriptor_set_layout);
 	void create_pipeline_layout(VkPipelineLayout* pipeline_layout);
 
-	void create_render_pass(VkRenderPass* render_pass);
-	void create_frame_buffer(const uint32_t &width, const uint32_t &height, std::vector<VkFramebuffer> & frame_buffers);
+	void create_render_passes();
+	void create_render_pass(VkRenderPass* render_pass, bool late, bool store_attachments);
+	void destroy_frame_buffers();
+	VkFramebuffer get_frame_buffer(uint32_t index, VkImageView color_view, VkImageView depth_view, const uint32_t &width, const uint32_t &height);
+	void begin_rendering(VkCommandBuffer command_buffer, const RenderTargets& targets, bool late, bool store_attachments);
+	void end_rendering(VkCommandBuffer command_buffer);
 
 	void create_uniform_buffer(VulkanBuffer* uniform_buffer);
-	void update_uniform_buffer(const uint32_t &width, const uint32_t &height, VulkanBuffer* uniform_buffer);
-	void create_vertex_buffer(VulkanBuffer* vertex_buffer, VulkanIndexBuffer* index_buffer);
+	void create_frame_uniforms(uint32_t frames_count);
+	void update_camera(const uint32_t &width, const uint32_t &height);
+	void write_uniform_buffer(uint32_t index);
+	void create_scene();
+	void select_lods(const uint32_t &height);
 
-	bool create_descriptor_pool(VkDescriptorPool *descriptor_pool);
-	void create_descriptor_set(VkDescriptorSet* descriptor_set);
+	void create_descriptor_set(const VulkanBuffer& uniform_buffer, VkDescriptorSet* descriptor_set);
 
 	void create_pipeline_cache(VkPipelineCache* pipeline_cache);
 	void create_graphics_pipeline(VkPipeline* pipeline);
 
-	void create_command_buffer(const uint32_t &width, const uint32_t &height, std::vector<VkCommandBuffer>&command_buffers);
+	void record_command_buffer(uint32_t index, const uint32_t &width, const uint32_t &height);
+	VkCommandBuffer get_submission_command_buffer(uint32_t index, uint32_t submission);
+	void submit_frame(uint32_t index);
+	void destroy_frame_submissions();
+	void bind_bindless_set(VkCommandBuffer command_buffer, uint32_t index);
+	void queue_draws(uint32_t index, bool cluster_culling_active);
 
 	void create_semaphores();
+	bool recreate_swapchain(uint32_t width, uint32_t height);
+	void release_retired(uint64_t completed_frame);
 	uint32_t get_memory_type_index(uint32_t type_bits, VkMemoryPropertyFlags properties);
 
 	
@@ -160,9 +298,6 @@ private:
 	bool reset_command_buffer(VkCommandBuffer command_buffer, bool release_resources);
 	bool reset_command_pool(VkDevice logical_device, VkCommandPool command_pool, bool release_resources);
 	bool create_semaphore(VkDevice logical_device, VkSemaphore & semaphore);
-	bool create_fence(VkDevice logical_device, bool signaled, VkFence  & fence);
-	bool wait_for_fences(VkDevice logical_device, std::vector<VkFence> const & fences, VkBool32 wait_for_all, uint64_t timeout);
-	bool reset_fences(VkDevice logical_device, std::vector<VkFence> const & fences);
 	//bool submit_command_buffers_to_queue(VkQueue queue, std::vector<WaitSemaphoreInfo> wait_semaphore_infos, std::vector<VkCommandBuffer> command_buffers, std::vector<VkSemaphore> signal_semaphores, VkFence fence);
 	bool wait_for_all_submitted_commands_to_be_finished(VkDevice logical_device);
 
@@ -43,54 +43,6 @@ bool VulkanRenderer::create_semaphore(
 	return true;
 }
 
-bool VulkanRenderer::create_fence(
-	VkDevice logical_device,
-	bool signaled,
-	VkFence  & fence)
-{
-	VkFenceCreateInfo fence_create_info = {};
-	fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fence_create_info.flags = signaled ? VK_FENCE_CREATE_SIGNALED_BIT : 0u;
-
-	VkResult result = vkCreateFence(logical_device, &fence_create_info, nullptr, &fence);
-	if (VK_SUCCESS != result) {
-		std::cout << "Could not create a fence." << std::endl;
-		return false;
-	}
-	return true;
-}
-
-bool VulkanRenderer::wait_for_fences(
-	VkDevice logical_device,
-	std::vector<VkFence> const & fences,
-	VkBool32 wait_for_all,
-	uint64_t timeout)
-{
-	if (fences.size() > 0) {
-		VkResult result = vkWaitForFences(logical_device, static_cast<uint32_t>(fences.size()), fences.data(), wait_for_all, timeout);
-		if (VK_SUCCESS != result) {
-			std::cout << "Waiting on fence failed." << std::endl;
-			return false;
-		}
-		return true;
-	}
-	return false;
-}
-
-bool VulkanRenderer::reset_fences(
-	VkDevice logical_device,
-	std::vector<VkFence> const & fences)
-{
-	if (fences.size() > 0) {
-		VkResult result = vkResetFences(logical_device, static_cast<uint32_t>(fences.size()), fences.data());
-		if (VK_SUCCESS != result) {
-			std::cout << "Error occurred when tried to reset fences." << std::endl;
-			return false;
-		}
-		return VK_SUCCESS == result;
-	}
-	return false;
-}
 /*
 bool VulkanRenderer::submit_command_buffers_to_queue(
 	VkQueue queue,
@@ -5,6 +5,8 @@ VulkanSwapchain::VulkanSwapchain()
 	, physical_device(VK_NULL_HANDLE)
 	, logical_device(VK_NULL_HANDLE)
 	, swapchain(VK_NULL_HANDLE)
+	, policy(DEFAULT_PRESENT_POLICY)
+	, configuration({})
 {
 }
 
@@ -22,53 +24,118 @@ bool VulkanSwapchain::create(VulkanInstance instance, VulkanDevice device, Vulka
 	this->width = *width;
 	this->height = *height;
 
-	return create_swapchain();
+	std::vector<SwapchainBuffer> no_images;
+	if (!create_swapchain(VK_NULL_HANDLE, no_images)) {
+		return false;
+	}
+
+	*width = this->width;
+	*height = this->height;
+	return true;
 }
 
-void VulkanSwapchain::shutdown()
+/**
+* Recreate the swapchain for a new size, handing the old swapchain over to the new one
+* The old swapchain and the views of its images are destroyed by release_retired once the frames
+* that may present them completed, the images already acquired from it can still be presented
+* When the new swapchain cannot be created the old one and its images stay current
+*
+* @param width Requested width, set to the width of the new swapchain
+* @param height Requested height, set to the height of the new swapchain
+* @param frame Last frame submitted with the old swapchain
+*/
+bool VulkanSwapchain::recreate(uint32_t* width, uint32_t* height, uint64_t frame)
 {
-	std::cout << "Destroy swap chain images\n";
-	for (uint32_t i = 0; i < images.size(); i++) {
-		vkDestroyImageView(logical_device, images[i].view, nullptr);
+	const uint32_t old_width = this->width;
+	const uint32_t old_height = this->height;
+	this->width = *width;
+	this->height = *height;
+
+	RetiredSwapchain old = {};
+	old.frame = frame;
+	old.swapchain = swapchain;
+	if (!create_swapchain(old.swapchain, old.images)) {
+		this->width = old_width;
+		this->height = old_height;
+		return false;
 	}
+	retired.push_back(old);
 
-	std::cout << "Destroy swap chain\n";
-	if (swapchain) {
-		vkDestroySwapchainKHR(logical_device, swapchain, nullptr);
-		swapchain = VK_NULL_HANDLE;
+	*width = this->width;
+	*height = this->height;
+	return true;
+}
+
+/**
+* Destroy the retired swapchains whose frames completed
+* The presentation of their last images is not tracked by the fences, it is assumed to be done
+* once the frames submitted after it completed
+*
+* @param completed_frame Last frame known to be completed
+*/
+void VulkanSwapchain::release_retired(uint64_t completed_frame)
+{
+	while (!retired.empty() && retired.front().frame <= completed_frame) {
+		destroy_swapchain(retired.front().swapchain, retired.front().images);
+		retired.pop_front();
 	}
 }
 
-bool VulkanSwapchain::create_swapchain()
+void VulkanSwapchain::shutdown()
 {
-	VkSwapchainKHR old_swapchain = swapchain;
+	for (auto& old : retired) {
+		destroy_swapchain(old.swapchain, old.images);
+	}
+	retired.clear();
 
-	// Create the swapchain
-	create_swapchain(old_swapchain);
+	std::cout << "Destroy swap chain\n";
+	destroy_swapchain(swapchain, images);
+	swapchain = VK_NULL_HANDLE;
+}
 
-	// Destroy the old swapchain
-	if (old_swapchain != VK_NULL_HANDLE) {
-		vkDestroySwapchainKHR(logical_device, old_swapchain, nullptr);
-		old_swapchain = VK_NULL_HANDLE;
+void VulkanSwapchain::destroy_swapchain(VkSwapchainKHR swapchain, std::vector<SwapchainBuffer>& images)
+{
+	for (auto& image : images) {
+		vkDestroyImageView(logical_device, image.view, nullptr);
 	}
+	images.clear();
 
-	// Create the swapchain buffers
-	if (!create_swapchain_buffers(image_format, images)) {
-		return false;
+	if (swapchain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(logical_device, swapchain, nullptr);
 	}
-
-	return true;
 }
 
-bool VulkanSwapchain::create_swapchain(const VkSwapchainKHR &old_swapchain)
+/**
+* Create a swapchain and the views of its images, they replace the current ones only once both are created
+*
+* @param old_swapchain Swapchain handed over to the new one
+* @param old_images Set to the images of the replaced swapchain, unchanged on failure
+*/
+bool VulkanSwapchain::create_swapchain(const VkSwapchainKHR &old_swapchain, std::vector<SwapchainBuffer> &old_images)
 {
-	// Get the presentation mode (triple buffer)
+	// Get the presentation mode of the policy
+	std::vector<VkPresentModeKHR> desired_present_modes;
+	switch (policy) {
+	case PRESENT_POLICY_LOW_LATENCY:
+		desired_present_modes = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	case PRESENT_POLICY_POWER_SAVING:
+		desired_present_modes = { VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_FIFO_KHR };
+		break;
+	case PRESENT_POLICY_THROUGHPUT:
+		desired_present_modes = { VK_PRESENT_MODE_MAILBOX_KHR };
+		break;
+	}
 	VkPresentModeKHR presentation_mode;
-	get_presentation_mode(presentation_surface, VK_PRESENT_MODE_MAILBOX_KHR, presentation_mode);
+	if (!get_presentation_mode(presentation_surface, desired_present_modes, presentation_mode)) {
+		std::cout << "Could not select a present mode for the present policy " << policy << std::endl;
+		return false;
+	}
 
 	// Get image format and color space
+	VkFormat format;
 	VkColorSpaceKHR image_color_space;
-	if (!presentation_surface.get_format(physical_device, { VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, image_format, image_color_space)) {
+	if (!presentation_surface.get_format(physical_device, { VK_FORMAT_B8G8R8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR }, format, image_color_space)) {
 		return false;
 	}
 
@@ -78,8 +145,14 @@ bool VulkanSwapchain::create_swapchain(const VkSwapchainKHR &old_swapchain)
 		return false;
 	}
 
-	// Get the number of swapchain images
-	uint32_t images_count = surface_capabilities.minImageCount + 1;
+	// Get the number of swapchain images, every image queued for presentation adds a frame of latency
+	uint32_t images_count = surface_capabilities.minImageCount;
+	if (policy == PRESENT_POLICY_POWER_SAVING) {
+		images_count += 1;
+	}
+	else if (policy == PRESENT_POLICY_THROUGHPUT) {
+		images_count += 2;
+	}
 	if ((surface_capabilities.maxImageCount > 0) && (images_count > surface_capabilities.maxImageCount)) {
 		images_count = surface_capabilities.maxImageCount;
 	}
@@ -137,8 +210,6 @@ bool VulkanSwapchain::create_swapchain(const VkSwapchainKHR &old_swapchain)
 	{
 		// If the surface size is defined, the swap chain size must match
 		image_size = surface_capabilities.currentExtent;
-		width = surface_capabilities.currentExtent.width;
-		height = surface_capabilities.currentExtent.height;
 	}
 
 	//image_size.width = std::clamp(image_size.width, surface_capabilities.minImageExtent.width, surface_capabilities.maxImageExtent.width);
@@ -149,7 +220,7 @@ bool VulkanSwapchain::create_swapchain(const VkSwapchainKHR &old_swapchain)
 	swapchain_create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
 	swapchain_create_info.surface = presentation_surface;
 	swapchain_create_info.minImageCount = images_count;
-	swapchain_create_info.imageFormat = image_format;
+	swapchain_create_info.imageFormat = format;
 	swapchain_create_info.imageColorSpace = image_color_space;
 	swapchain_create_info.imageExtent = image_size;
 	swapchain_create_info.imageUsage = image_usage;
@@ -163,15 +234,41 @@ bool VulkanSwapchain::create_swapchain(const VkSwapchainKHR &old_swapchain)
 	swapchain_create_info.clipped = VK_TRUE;
 	swapchain_create_info.compositeAlpha = composite_alpha;
 
-	VkResult result = vkCreateSwapchainKHR(logical_device, &swapchain_create_info, nullptr, &swapchain);
-	if (result != VK_SUCCESS || swapchain == VK_NULL_HANDLE) {
+	VkSwapchainKHR new_swapchain = VK_NULL_HANDLE;
+	VkResult result = vkCreateSwapchainKHR(logical_device, &swapchain_create_info, nullptr, &new_swapchain);
+	if (result != VK_SUCCESS || new_swapchain == VK_NULL_HANDLE) {
 		throw std::runtime_error("Could not create a swapchain");
 	}
+
+	// Create the swapchain buffers
+	std::vector<SwapchainBuffer> new_images;
+	if (!create_swapchain_buffers(new_swapchain, format, new_images)) {
+		destroy_swapchain(new_swapchain, new_images);
+		return false;
+	}
+
+	swapchain = new_swapchain;
+	old_images.swap(images);
+	images.swap(new_images);
+	image_format = format;
+	width = image_size.width;
+	height = image_size.height;
+
+	// The driver may create more images than requested
+	configuration.policy = policy;
+	configuration.present_mode = presentation_mode;
+	configuration.images_count = static_cast<uint32_t>(images.size());
+	std::cout << "Swapchain " << width << "x" << height << ", present mode " << presentation_mode << ", " << configuration.images_count << " images\n";
 	
 	return true;
 }
 
-bool VulkanSwapchain::get_presentation_mode(VkSurfaceKHR presentation_surface, VkPresentModeKHR desired_present_mode, VkPresentModeKHR & present_mode)
+/**
+* Select the first supported present mode of a list, VK_PRESENT_MODE_FIFO_KHR otherwise
+*
+* @param desired_present_modes Present modes, by order of preference
+*/
+bool VulkanSwapchain::get_presentation_mode(VkSurfaceKHR presentation_surface, const std::vector<VkPresentModeKHR> & desired_present_modes, VkPresentModeKHR & present_mode)
 {
 	// Enumerate supported present modes
 	uint32_t present_modes_count = 0;
@@ -191,10 +288,12 @@ bool VulkanSwapchain::get_presentation_mode(VkSurfaceKHR presentation_surface, V
 	}
 
 	// Select present mode
-	for (auto & current_present_mode : present_modes) {
-		if (current_present_mode == desired_present_mode) {
-			present_mode = desired_present_mode;
-			return true;
+	for (auto & desired_present_mode : desired_present_modes) {
+		for (auto & current_present_mode : present_modes) {
+			if (current_present_mode == desired_present_mode) {
+				present_mode = desired_present_mode;
+				return true;
+			}
 		}
 	}
 
@@ -210,7 +309,7 @@ bool VulkanSwapchain::get_presentation_mode(VkSurfaceKHR presentation_surface, V
 	return false;
 }
 
-bool VulkanSwapchain::get_swapchain_images(std::vector<VkImage> & swapchain_images)
+bool VulkanSwapchain::get_swapchain_images(VkSwapchainKHR swapchain, std::vector<VkImage> & swapchain_images)
 {
 	uint32_t images_count = 0;
 	VkResult result = VK_SUCCESS;
@@ -231,35 +330,39 @@ bool VulkanSwapchain::get_swapchain_images(std::vector<VkImage> & swapchain_imag
 	return true;
 }
 
-bool VulkanSwapchain::acquire_next_image_index(VkSemaphore semaphore, VkFence fence, uint32_t *image_index)
+/**
+* Acquire the next image to render to
+* The swapchain is not recreated here, on VK_ERROR_OUT_OF_DATE_KHR no image was acquired and
+* the owner of the swapchain must recreate it along with the resources of its images
+*/
+VkResult VulkanSwapchain::acquire_next_image_index(VkSemaphore semaphore, VkFence fence, uint32_t *image_index)
 {
 	VkResult result = vkAcquireNextImageKHR(logical_device, swapchain, UINT64_MAX, semaphore, fence, image_index);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
 		std::cout << "The swapchain needs to be recreated." << std::endl;
-		return create_swapchain();
 	}
 	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
 		std::cout << "Could not acquire next swapchain image." << std::endl;
-		return false;
 	}
 
-	return true;
+	return result;
 }
 
-bool VulkanSwapchain::create_swapchain_buffers(VkFormat image_format, std::vector<SwapchainBuffer> & swapchain_buffers)
+bool VulkanSwapchain::create_swapchain_buffers(VkSwapchainKHR swapchain, VkFormat image_format, std::vector<SwapchainBuffer> & swapchain_buffers)
 {
 	std::vector<VkImage> images;
-	if (!get_swapchain_images(images)) {
+	if (!get_swapchain_images(swapchain, images)) {
 		return false;
 	}
 
-	swapchain_buffers.resize(images.size());
+	swapchain_buffers.reserve(images.size());
 	for (uint32_t i = 0; i < images.size(); i++) {
-		swapchain_buffers[i].image = images[i];
+		SwapchainBuffer swapchain_buffer = {};
+		swapchain_buffer.image = images[i];
 
 		VkImageViewCreateInfo view_create_info = {};
 		view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-		view_create_info.image = swapchain_buffers[i].image;
+		view_create_info.image = swapchain_buffer.image;
 		view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
 		view_create_info.format = image_format;
 		view_create_info.components.r = VK_COMPONENT_SWIZZLE_R;
@@ -272,19 +375,27 @@ bool VulkanSwapchain::create_swapchain_buffers(VkFormat image_format, std::vecto
 		view_create_info.subresourceRange.baseArrayLayer = 0;
 		view_create_info.subresourceRange.layerCount = 1;
 
-		VkResult result = vkCreateImageView(logical_device, &view_create_info, nullptr, &swapchain_buffers[i].view);
+		VkResult result = vkCreateImageView(logical_device, &view_create_info, nullptr, &swapchain_buffer.view);
 		if ((VK_SUCCESS != result) || (VK_NULL_HANDLE == swapchain)) {
 			std::cout << "Could not create image view.\n";
 			return false;
 		}
+		// Only the created views are destroyed on failure
+		swapchain_buffers.push_back(swapchain_buffer);
 	}
 	return true;
 }
 
-VkResult VulkanSwapchain::queue_present(VkQueue queue, uint32_t image_index, VkSemaphore wait_semaphore = VK_NULL_HANDLE)
+/**
+* Queue an image for presentation
+*
+* @param next Structures chained to the present info, the present times or identifier of the frame pacer
+*/
+VkResult VulkanSwapchain::queue_present(VkQueue queue, uint32_t image_index, VkSemaphore wait_semaphore, const void* next)
 {
 	VkPresentInfoKHR present_info = {};
 	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	present_info.pNext = next;
 	present_info.swapchainCount = 1;
 	present_info.pSwapchains = &swapchain;
 	present_info.pImageIndices = &image_index;
@@ -3,6 +3,7 @@
 #include <cassert>
 #include <iostream>
 #include <vector>
+#include <deque>
 #include <algorithm>
 
 #include <vulkan/vulkan.h>
@@ -19,6 +20,24 @@ struct SwapchainBuffer {
 	VkImageView view;
 };
 
+/** @brief Tradeoff the present mode and the images count of the swapchain are selected for */
+enum PresentPolicy {
+	/* IMMEDIATE, or MAILBOX, with the fewest images, frames are shown as soon as they are rendered */
+	PRESENT_POLICY_LOW_LATENCY,
+	/* FIFO relaxed, or FIFO, the frames are paced by the display and none is rendered without being shown,
+	   a late frame is shown at once instead of waiting for the next vertical blank */
+	PRESENT_POLICY_POWER_SAVING,
+	/* MAILBOX, or FIFO, with extra images so that the rendering never waits for the display */
+	PRESENT_POLICY_THROUGHPUT
+};
+
+/** @brief Configuration the swapchain was created with */
+struct PresentConfiguration {
+	PresentPolicy policy;
+	VkPresentModeKHR present_mode;
+	uint32_t images_count;
+};
+
 class VulkanSwapchain
 {
 
@@ -35,10 +54,16 @@ public:
 	uint32_t						height;
 
 	bool							create(VulkanInstance instance, VulkanDevice device, VulkanPresentationSurface presentation_surface, uint32_t* width, uint32_t* height);
+	bool							recreate(uint32_t* width, uint32_t* height, uint64_t frame);
+	void							set_policy(PresentPolicy policy) { this->policy = policy; };
+	void							release_retired(uint64_t completed_frame);
 	void							shutdown();
 
-	bool							acquire_next_image_index(VkSemaphore semaphore, VkFence fence, uint32_t* image_index);
-	VkResult						queue_present(VkQueue queue, uint32_t image_index, VkSemaphore wait_semaphore);
+	VkResult						acquire_next_image_index(VkSemaphore semaphore, VkFence fence, uint32_t* image_index);
+	VkResult						queue_present(VkQueue queue, uint32_t image_index, VkSemaphore wait_semaphore, const void* next = nullptr);
+
+	/** @brief Configuration of the current swapchain, the policy set since then applies to the next recreation */
+	const PresentConfiguration&		get_configuration() const { return configuration; };
 
 private:
 	VkInstance						instance;
@@ -47,13 +72,24 @@ private:
 
 	VkSwapchainKHR					swapchain;
 
+	/* swapchain replaced by a recreation, with the views of its images, kept until the frames presenting them completed */
+	struct RetiredSwapchain {
+		uint64_t frame;
+		VkSwapchainKHR swapchain;
+		std::vector<SwapchainBuffer> images;
+	};
+	std::deque<RetiredSwapchain>	retired;
+
 	VulkanPresentationSurface		presentation_surface;
 
+	PresentPolicy					policy;
+	PresentConfiguration			configuration;
+
 	/** @brief Swapchain stuff */
-	bool					create_swapchain();
-	bool					create_swapchain(const VkSwapchainKHR &old_swapchain);
-	bool					get_presentation_mode(VkSurfaceKHR presentation_surface, VkPresentModeKHR desired_present_mode, VkPresentModeKHR &present_mode);
-	bool					get_swapchain_images(std::vector<VkImage> &swapchain_images);
-	bool					create_swapchain_buffers(VkFormat image_format, std::vector<SwapchainBuffer> &swapchain_buffers);
+	bool					create_swapchain(const VkSwapchainKHR &old_swapchain, std::vector<SwapchainBuffer> &old_images);
+	void					destroy_swapchain(VkSwapchainKHR swapchain, std::vector<SwapchainBuffer>& images);
+	bool					get_presentation_mode(VkSurfaceKHR presentation_surface, const std::vector<VkPresentModeKHR> &desired_present_modes, VkPresentModeKHR &present_mode);
+	bool					get_swapchain_images(VkSwapchainKHR swapchain, std::vector<VkImage> &swapchain_images);
+	bool					create_swapchain_buffers(VkSwapchainKHR swapchain, VkFormat image_format, std::vector<SwapchainBuffer> &swapchain_buffers);
 };
 
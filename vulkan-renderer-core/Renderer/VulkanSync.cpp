@@ -0,0 +1,236 @@
+#include "VulkanSync.h"
+
+VulkanTimeline::VulkanTimeline()
+	: device(nullptr)
+	, queue(VK_NULL_HANDLE)
+	, submitted_value(0)
+	, completed_value(0)
+#ifdef VK_KHR_timeline_semaphore
+	, semaphore(VK_NULL_HANDLE)
+#endif
+{
+}
+
+VulkanTimeline::~VulkanTimeline()
+{
+}
+
+bool VulkanTimeline::create(VulkanDevice* device, VkQueue queue)
+{
+	this->device = device;
+	this->queue = queue;
+	submitted_value = 0;
+	completed_value = 0;
+
+#ifdef VK_KHR_timeline_semaphore
+	if (device->timeline_semaphore) {
+		VkSemaphoreTypeCreateInfoKHR semaphore_type_create_info = {};
+		semaphore_type_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+		semaphore_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+		semaphore_type_create_info.initialValue = 0;
+
+		VkSemaphoreCreateInfo semaphore_create_info = {};
+		semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphore_create_info.pNext = &semaphore_type_create_info;
+		VK_CHECK_RESULT(vkCreateSemaphore(*device, &semaphore_create_info, nullptr, &semaphore));
+	}
+#endif
+
+	return true;
+}
+
+void VulkanTimeline::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	wait(submitted_value);
+	for (auto& pending_value : pending) {
+		vkDestroyFence(*device, pending_value.fence, nullptr);
+	}
+	pending.clear();
+	for (auto fence : free_fences) {
+		vkDestroyFence(*device, fence, nullptr);
+	}
+	free_fences.clear();
+#ifdef VK_KHR_timeline_semaphore
+	vkDestroySemaphore(*device, semaphore, nullptr);
+	semaphore = VK_NULL_HANDLE;
+#endif
+
+	device = nullptr;
+}
+
+/**
+* Submit a batch that signals the next value of the timeline
+* The batch must not have a fence, its signal semaphores are signaled as well
+*
+* @return Value signaled once the batch is complete
+*/
+uint64_t VulkanTimeline::submit(const VkSubmitInfo& submit_info)
+{
+	const uint64_t value = submitted_value + 1;
+
+#ifdef VK_KHR_timeline_semaphore
+	if (semaphore != VK_NULL_HANDLE) {
+		// The binary semaphores of the batch ignore their value
+		signal_semaphores.assign(submit_info.pSignalSemaphores, submit_info.pSignalSemaphores + submit_info.signalSemaphoreCount);
+		signal_semaphores.push_back(semaphore);
+		signal_values.assign(submit_info.signalSemaphoreCount, 0);
+		signal_values.push_back(value);
+
+		VkTimelineSemaphoreSubmitInfoKHR timeline_submit_info = {};
+		timeline_submit_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timeline_submit_info.pNext = submit_info.pNext;
+		timeline_submit_info.signalSemaphoreValueCount = static_cast<uint32_t>(signal_values.size());
+		timeline_submit_info.pSignalSemaphoreValues = signal_values.data();
+
+		VkSubmitInfo timeline_info = submit_info;
+		timeline_info.pNext = &timeline_submit_info;
+		timeline_info.signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size());
+		timeline_info.pSignalSemaphores = signal_semaphores.data();
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &timeline_info, VK_NULL_HANDLE));
+
+		submitted_value = value;
+		return value;
+	}
+#endif
+
+	PendingValue pending_value = {};
+	pending_value.value = value;
+	if (free_fences.empty()) {
+		VkFenceCreateInfo fence_create_info = {};
+		fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VK_CHECK_RESULT(vkCreateFence(*device, &fence_create_info, nullptr, &pending_value.fence));
+	}
+	else {
+		pending_value.fence = free_fences.back();
+		free_fences.pop_back();
+	}
+	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submit_info, pending_value.fence));
+	pending.push_back(pending_value);
+
+	submitted_value = value;
+	return value;
+}
+
+/**
+* Last value known to be reached by the GPU, without waiting
+*/
+uint64_t VulkanTimeline::get_completed_value()
+{
+#ifdef VK_KHR_timeline_semaphore
+	if (semaphore != VK_NULL_HANDLE) {
+		VK_CHECK_RESULT(device->get_semaphore_counter_value(*device, semaphore, &completed_value));
+		return completed_value;
+	}
+#endif
+
+	// The fences are recycled once signaled
+	while (!pending.empty() && vkGetFenceStatus(*device, pending.front().fence) == VK_SUCCESS) {
+		completed_value = pending.front().value;
+		VK_CHECK_RESULT(vkResetFences(*device, 1, &pending.front().fence));
+		free_fences.push_back(pending.front().fence);
+		pending.pop_front();
+	}
+	return completed_value;
+}
+
+bool VulkanTimeline::is_complete(uint64_t value)
+{
+	return value <= completed_value || value <= get_completed_value();
+}
+
+/**
+* Block until the GPU reaches a value, the value must have been submitted
+*/
+void VulkanTimeline::wait(uint64_t value)
+{
+	assert(value <= submitted_value);
+	if (value <= completed_value) {
+		return;
+	}
+
+#ifdef VK_KHR_timeline_semaphore
+	if (semaphore != VK_NULL_HANDLE) {
+		VkSemaphoreWaitInfoKHR wait_info = {};
+		wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &semaphore;
+		wait_info.pValues = &value;
+		VK_CHECK_RESULT(device->wait_semaphores(*device, &wait_info, UINT64_MAX));
+		get_completed_value();
+		return;
+	}
+#endif
+
+	for (auto& pending_value : pending) {
+		if (pending_value.value >= value) {
+			VK_CHECK_RESULT(vkWaitForFences(*device, 1, &pending_value.fence, VK_TRUE, UINT64_MAX));
+			break;
+		}
+	}
+	get_completed_value();
+}
+
+VulkanSync::VulkanSync()
+	: device(nullptr)
+{
+}
+
+VulkanSync::~VulkanSync()
+{
+}
+
+bool VulkanSync::create(VulkanDevice* device)
+{
+	this->device = device;
+
+	timelines[SYNC_QUEUE_GRAPHICS].create(device, device->graphics_queue);
+	timelines[SYNC_QUEUE_COMPUTE].create(device, device->compute_queue);
+	timelines[SYNC_QUEUE_TRANSFER].create(device, device->transfer_queue);
+
+	return true;
+}
+
+void VulkanSync::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy timelines\n";
+	wait_idle();
+	for (auto& timeline : timelines) {
+		timeline.shutdown();
+	}
+
+	device = nullptr;
+}
+
+SyncPoint VulkanSync::get_submitted_point(SyncQueue queue) const
+{
+	SyncPoint point = { queue, timelines[queue].get_submitted_value() };
+	return point;
+}
+
+bool VulkanSync::is_complete(const SyncPoint& point)
+{
+	return timelines[point.queue].is_complete(point.value);
+}
+
+void VulkanSync::wait(const SyncPoint& point)
+{
+	timelines[point.queue].wait(point.value);
+}
+
+/**
+* Block until every submission is complete
+*/
+void VulkanSync::wait_idle()
+{
+	for (auto& timeline : timelines) {
+		timeline.wait(timeline.get_submitted_value());
+	}
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <array>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+#include "VulkanDevice.h"
+
+enum SyncQueue {
+	SYNC_QUEUE_GRAPHICS,
+	SYNC_QUEUE_COMPUTE,
+	SYNC_QUEUE_TRANSFER,
+	SYNC_QUEUE_COUNT
+};
+
+/** @brief Point of the timeline of a queue, reached once the submission signaling the value is complete */
+struct SyncPoint {
+	SyncQueue queue;
+	uint64_t value;
+};
+
+/**
+* Timeline of the submissions to a queue
+* Each submission signals the next value of a monotonic counter, values are compared instead of fences
+*
+* With VK_KHR_timeline_semaphore the submissions signal a timeline semaphore, otherwise each
+* submission signals a fence from a pool and the completed value is the value of the last signaled fence,
+* the submissions to a queue complete in order
+*/
+class VulkanTimeline
+{
+public:
+	VulkanTimeline();
+	~VulkanTimeline();
+
+	bool								create(VulkanDevice* device, VkQueue queue);
+	void								shutdown();
+
+	uint64_t							submit(const VkSubmitInfo& submit_info);
+
+	/** @brief Value of the last submission, the values are numbered from 1 */
+	uint64_t							get_submitted_value() const { return submitted_value; };
+	uint64_t							get_completed_value();
+	bool								is_complete(uint64_t value);
+	void								wait(uint64_t value);
+
+	VkQueue								get_queue() const { return queue; };
+
+private:
+	struct PendingValue {
+		uint64_t value;
+		VkFence fence;
+	};
+
+	VulkanDevice*						device;
+	VkQueue								queue;
+
+	uint64_t							submitted_value;
+	uint64_t							completed_value;
+
+	/* fences of the submissions that are not known to be complete, in submission order */
+	std::deque<PendingValue>			pending;
+	std::vector<VkFence>				free_fences;
+
+#ifdef VK_KHR_timeline_semaphore
+	/* null without the timelineSemaphore feature */
+	VkSemaphore							semaphore;
+	std::vector<VkSemaphore>			signal_semaphores;
+	std::vector<uint64_t>				signal_values;
+#endif
+};
+
+/**
+* Synchronization of the queues, one timeline per queue
+* The subsystems say when the GPU is done with something by the point of a timeline,
+* the CPU waits for points and VulkanDeletionQueue destroys the objects released at a point once it is reached
+*/
+class VulkanSync
+{
+public:
+	VulkanSync();
+	~VulkanSync();
+
+	bool								create(VulkanDevice* device);
+	void								shutdown();
+
+	VulkanTimeline&						get_timeline(SyncQueue queue) { return timelines[queue]; };
+	uint64_t							submit(SyncQueue queue, const VkSubmitInfo& submit_info) { return timelines[queue].submit(submit_info); };
+
+	SyncPoint							get_submitted_point(SyncQueue queue) const;
+	bool								is_complete(const SyncPoint& point);
+	void								wait(const SyncPoint& point);
+	void								wait_idle();
+
+private:
+	VulkanDevice*						device;
+	std::array<VulkanTimeline, SYNC_QUEUE_COUNT>			timelines;
+};
@@ -0,0 +1,338 @@
+#include "VulkanTextureLoader.h"
+
+#include <cstring>
+#include <algorithm>
+
+/* DDS pixel format flags */
+#define DDS_PIXEL_FORMAT_FOURCC			0x4
+#define DDS_PIXEL_FORMAT_RGB			0x40
+/* DDS caps2 flag of cube maps */
+#define DDS_CUBE_MAP					0x200
+/* D3D10_RESOURCE_DIMENSION_TEXTURE2D */
+#define DDS_DIMENSION_TEXTURE2D			3
+
+static uint32_t make_fourcc(char a, char b, char c, char d)
+{
+	return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+}
+
+/**
+* Read the header of a texture file, the format is detected from the file identifier
+*
+* @param path Path of the KTX2 or DDS file
+* @param file Description of the file and of its levels
+*/
+bool VulkanTextureLoader::read_header(const std::string& path, TextureFile& file)
+{
+	std::ifstream stream(path, std::ios::binary);
+	if (!stream.is_open()) {
+		std::cout << "Could not open texture " << path << std::endl;
+		return false;
+	}
+
+	file = {};
+	file.path = path;
+
+	uint8_t identifier[12] = {};
+	stream.read(reinterpret_cast<char*>(identifier), sizeof(identifier));
+	stream.seekg(0);
+
+	static const uint8_t ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	bool valid = false;
+	if (memcmp(identifier, ktx2_identifier, sizeof(ktx2_identifier)) == 0) {
+		valid = read_ktx2_header(stream, file);
+	}
+	else if (memcmp(identifier, "DDS ", 4) == 0) {
+		valid = read_dds_header(stream, file);
+	}
+
+	if (!valid || file.levels.empty()) {
+		std::cout << "Unsupported texture " << path << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+* Read consecutive levels of a texture file
+*
+* @param file Texture file
+* @param first_level Most detailed level to read
+* @param last_level Least detailed level to read
+* @param data Data of the levels, from first_level to last_level, tightly packed
+*/
+bool VulkanTextureLoader::read_levels(const TextureFile& file, uint32_t first_level, uint32_t last_level, std::vector<uint8_t>& data)
+{
+	std::ifstream stream(file.path, std::ios::binary);
+	if (!stream.is_open() || last_level >= file.levels.size() || first_level > last_level) {
+		return false;
+	}
+
+	size_t size = 0;
+	for (uint32_t level = first_level; level <= last_level; ++level) {
+		size += static_cast<size_t>(file.levels[level].size);
+	}
+	data.resize(size);
+
+	size_t offset = 0;
+	for (uint32_t level = first_level; level <= last_level; ++level) {
+		stream.seekg(static_cast<std::streamoff>(file.levels[level].offset));
+		stream.read(reinterpret_cast<char*>(data.data() + offset), static_cast<std::streamsize>(file.levels[level].size));
+		if (!stream) {
+			std::cout << "Could not read level " << level << " of texture " << file.path << std::endl;
+			return false;
+		}
+		offset += static_cast<size_t>(file.levels[level].size);
+	}
+
+	return true;
+}
+
+/**
+* Get the block dimensions of the formats a texture file may hold
+*
+* @param format Format
+* @param block Size of the block, a single texel for the uncompressed formats
+*/
+bool VulkanTextureLoader::get_format_block(VkFormat format, TextureFormatBlock& block)
+{
+	// ASTC block dimensions, in the order of the VkFormat enumeration
+	static const uint32_t astc_blocks[14][2] = {
+		{ 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+		{ 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 }
+	};
+
+	switch (format) {
+	case VK_FORMAT_R8_UNORM:
+		block = { 1, 1, 1 };
+		return true;
+	case VK_FORMAT_R8G8_UNORM:
+		block = { 1, 1, 2 };
+		return true;
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+		block = { 1, 1, 4 };
+		return true;
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		block = { 1, 1, 8 };
+		return true;
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		block = { 1, 1, 16 };
+		return true;
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+		block = { 4, 4, 8 };
+		return true;
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+		block = { 4, 4, 16 };
+		return true;
+	default:
+		break;
+	}
+
+	if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+		uint32_t index = (format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2;
+		block = { astc_blocks[index][0], astc_blocks[index][1], 16 };
+		return true;
+	}
+
+	return false;
+}
+
+/** @brief Size of a tightly packed level */
+uint64_t VulkanTextureLoader::get_level_size(VkFormat format, uint32_t width, uint32_t height)
+{
+	TextureFormatBlock block;
+	if (!get_format_block(format, block)) {
+		return 0;
+	}
+	return static_cast<uint64_t>((width + block.width - 1) / block.width) * ((height + block.height - 1) / block.height) * block.size;
+}
+
+bool VulkanTextureLoader::read_ktx2_header(std::ifstream& stream, TextureFile& file)
+{
+	struct Ktx2Header {
+		uint8_t identifier[12];
+		uint32_t vk_format;
+		uint32_t type_size;
+		uint32_t pixel_width;
+		uint32_t pixel_height;
+		uint32_t pixel_depth;
+		uint32_t layer_count;
+		uint32_t face_count;
+		uint32_t level_count;
+		uint32_t supercompression_scheme;
+		uint32_t dfd_byte_offset;
+		uint32_t dfd_byte_length;
+		uint32_t kvd_byte_offset;
+		uint32_t kvd_byte_length;
+		uint64_t sgd_byte_offset;
+		uint64_t sgd_byte_length;
+	} header;
+
+	struct Ktx2Level {
+		uint64_t byte_offset;
+		uint64_t byte_length;
+		uint64_t uncompressed_byte_length;
+	};
+
+	stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!stream) {
+		return false;
+	}
+
+	// Only single 2D images with raw levels, the Basis supercompressed files are not supported
+	if (header.vk_format == VK_FORMAT_UNDEFINED || header.supercompression_scheme != 0 ||
+		header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1) {
+		return false;
+	}
+
+	file.format = static_cast<VkFormat>(header.vk_format);
+	file.width = header.pixel_width;
+	file.height = std::max(header.pixel_height, 1u);
+
+	uint32_t level_count = std::min(std::max(header.level_count, 1u), static_cast<uint32_t>(TEXTURE_MAX_LEVELS));
+	std::vector<Ktx2Level> levels(level_count);
+	stream.read(reinterpret_cast<char*>(levels.data()), levels.size() * sizeof(Ktx2Level));
+	if (!stream) {
+		return false;
+	}
+
+	file.levels.resize(level_count);
+	for (uint32_t level = 0; level < level_count; ++level) {
+		file.levels[level].offset = levels[level].byte_offset;
+		file.levels[level].size = levels[level].byte_length;
+		file.levels[level].width = std::max(file.width >> level, 1u);
+		file.levels[level].height = std::max(file.height >> level, 1u);
+	}
+
+	return true;
+}
+
+bool VulkanTextureLoader::read_dds_header(std::ifstream& stream, TextureFile& file)
+{
+	// Magic followed by the 124 bytes DDS_HEADER
+	uint32_t header[32];
+	stream.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!stream || header[1] != 124) {
+		return false;
+	}
+
+	const uint32_t height = header[3];
+	const uint32_t width = header[4];
+	const uint32_t mip_map_count = header[7];
+	const uint32_t pixel_format_flags = header[20];
+	const uint32_t fourcc = header[21];
+	const uint32_t rgb_bit_count = header[22];
+	const uint32_t red_mask = header[23];
+	const uint32_t caps2 = header[28];
+
+	if (caps2 & DDS_CUBE_MAP) {
+		return false;
+	}
+
+	file.format = VK_FORMAT_UNDEFINED;
+	if (pixel_format_flags & DDS_PIXEL_FORMAT_FOURCC) {
+		if (fourcc == make_fourcc('D', 'X', '1', '0')) {
+			// DDS_HEADER_DXT10
+			uint32_t header_dx10[5];
+			stream.read(reinterpret_cast<char*>(header_dx10), sizeof(header_dx10));
+			if (!stream || header_dx10[1] != DDS_DIMENSION_TEXTURE2D || header_dx10[3] > 1) {
+				return false;
+			}
+			file.format = get_dxgi_format(header_dx10[0]);
+		}
+		else if (fourcc == make_fourcc('D', 'X', 'T', '1')) {
+			file.format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+		}
+		else if (fourcc == make_fourcc('D', 'X', 'T', '3')) {
+			file.format = VK_FORMAT_BC2_UNORM_BLOCK;
+		}
+		else if (fourcc == make_fourcc('D', 'X', 'T', '5')) {
+			file.format = VK_FORMAT_BC3_UNORM_BLOCK;
+		}
+		else if (fourcc == make_fourcc('A', 'T', 'I', '1') || fourcc == make_fourcc('B', 'C', '4', 'U')) {
+			file.format = VK_FORMAT_BC4_UNORM_BLOCK;
+		}
+		else if (fourcc == make_fourcc('A', 'T', 'I', '2') || fourcc == make_fourcc('B', 'C', '5', 'U')) {
+			file.format = VK_FORMAT_BC5_UNORM_BLOCK;
+		}
+	}
+	else if ((pixel_format_flags & DDS_PIXEL_FORMAT_RGB) && rgb_bit_count == 32) {
+		file.format = red_mask == 0x000000ff ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_B8G8R8A8_UNORM;
+	}
+
+	TextureFormatBlock block;
+	if (file.format == VK_FORMAT_UNDEFINED || !get_format_block(file.format, block)) {
+		return false;
+	}
+
+	file.width = width;
+	file.height = height;
+
+	// The levels follow the headers, from the most detailed one
+	uint64_t offset = static_cast<uint64_t>(stream.tellg());
+	uint32_t level_count = std::min(std::max(mip_map_count, 1u), static_cast<uint32_t>(TEXTURE_MAX_LEVELS));
+	file.levels.resize(level_count);
+	for (uint32_t level = 0; level < level_count; ++level) {
+		TextureFileLevel& file_level = file.levels[level];
+		file_level.width = std::max(width >> level, 1u);
+		file_level.height = std::max(height >> level, 1u);
+		file_level.offset = offset;
+		file_level.size = get_level_size(file.format, file_level.width, file_level.height);
+		offset += file_level.size;
+	}
+
+	return true;
+}
+
+VkFormat VulkanTextureLoader::get_dxgi_format(uint32_t dxgi_format)
+{
+	switch (dxgi_format) {
+	case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+	case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+	case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+	case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+	case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+	case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+	case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+	case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+	case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+	case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+	case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+	case 87: return VK_FORMAT_B8G8R8A8_UNORM;
+	case 91: return VK_FORMAT_B8G8R8A8_SRGB;
+	case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+	case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+	case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+	case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+	default: return VK_FORMAT_UNDEFINED;
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#define TEXTURE_MAX_LEVELS				16
+
+struct TextureFileLevel {
+	/** @brief Offset of the level data in the file */
+	uint64_t offset;
+	/** @brief Size of the level data, tightly packed */
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+/**
+* Description of a KTX2 or DDS texture file
+* Levels are ordered from the most detailed one
+*/
+struct TextureFile {
+	std::string path;
+	VkFormat format;
+	uint32_t width;
+	uint32_t height;
+	std::vector<TextureFileLevel> levels;
+};
+
+/** @brief Size in texels and in bytes of the blocks of a format */
+struct TextureFormatBlock {
+	uint32_t width;
+	uint32_t height;
+	uint32_t size;
+};
+
+/**
+* Reader of 2D KTX2 and DDS texture files
+* Only the header is parsed when opening a file, the levels are read on demand
+* so that a texture can be streamed one mip level at a time
+*/
+class VulkanTextureLoader
+{
+public:
+	static bool					read_header(const std::string& path, TextureFile& file);
+	static bool					read_levels(const TextureFile& file, uint32_t first_level, uint32_t last_level, std::vector<uint8_t>& data);
+
+	static bool					get_format_block(VkFormat format, TextureFormatBlock& block);
+	static uint64_t				get_level_size(VkFormat format, uint32_t width, uint32_t height);
+
+private:
+	static bool					read_ktx2_header(std::ifstream& stream, TextureFile& file);
+	static bool					read_dds_header(std::ifstream& stream, TextureFile& file);
+	static VkFormat				get_dxgi_format(uint32_t dxgi_format);
+};
@@ -0,0 +1,745 @@
+#include "VulkanTextureStreamer.h"
+
+#include <algorithm>
+
+/* First level of the mip tail of a texture file */
+static uint32_t get_tail_level(const TextureFile& file)
+{
+	uint32_t level = 0;
+	while (level + 1 < file.levels.size() && std::max(file.levels[level].width, file.levels[level].height) > TEXTURE_MIP_TAIL_SIZE) {
+		level++;
+	}
+	return level;
+}
+
+VulkanTextureStreamer::VulkanTextureStreamer()
+	: device(nullptr)
+	, transfer_queue(nullptr)
+	, deletion_queue(nullptr)
+	, worker_pool(nullptr)
+	, frames_count(0)
+	, frame(0)
+	, sampler(VK_NULL_HANDLE)
+	, feedback_buffer({})
+	, feedback_cleared(false)
+	, stopping(false)
+	, statistics({})
+{
+}
+
+VulkanTextureStreamer::~VulkanTextureStreamer()
+{
+}
+
+bool VulkanTextureStreamer::create(VulkanDevice* device, uint32_t frames_count, VulkanTransferQueue* transfer_queue, VulkanDeletionQueue* deletion_queue, VulkanWorkerPool* worker_pool)
+{
+	this->device = device;
+	this->transfer_queue = transfer_queue;
+	this->deletion_queue = deletion_queue;
+	this->worker_pool = worker_pool;
+	this->frames_count = frames_count;
+	frame = 0;
+	stopping = false;
+	feedback_cleared = false;
+	statistics = {};
+	std::fill(std::begin(heap_usage), std::end(heap_usage), 0);
+	std::fill(std::begin(heap_budget), std::end(heap_budget), 0);
+
+	VkSamplerCreateInfo sampler_create_info = {};
+	sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_create_info.magFilter = VK_FILTER_LINEAR;
+	sampler_create_info.minFilter = VK_FILTER_LINEAR;
+	sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+	sampler_create_info.anisotropyEnable = device->features.samplerAnisotropy;
+	sampler_create_info.maxAnisotropy = device->features.samplerAnisotropy ? 8.0f : 1.0f;
+	sampler_create_info.minLod = 0.0f;
+	sampler_create_info.maxLod = VK_LOD_CLAMP_NONE;
+	VK_CHECK_RESULT(vkCreateSampler(*device, &sampler_create_info, nullptr, &sampler));
+
+	device->create_buffer(
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		TEXTURE_MAX_COUNT * sizeof(int32_t),
+		&feedback_buffer);
+
+	for (uint32_t i = 0; i < TEXTURE_STREAMING_THREADS; ++i) {
+		threads.push_back(std::thread(&VulkanTextureStreamer::run_loader, this));
+	}
+
+	return true;
+}
+
+void VulkanTextureStreamer::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy texture streamer\n";
+	{
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		stopping = true;
+		jobs.clear();
+	}
+	jobs_condition.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+	results.clear();
+
+	for (auto& upload : uploads) {
+		destroy_image(upload.image);
+	}
+	uploads.clear();
+	for (auto& texture : textures) {
+		vkDestroyImageView(*device, texture.view, nullptr);
+		vkDestroyImage(*device, texture.image, nullptr);
+		vkFreeMemory(*device, texture.memory, nullptr);
+	}
+	textures.clear();
+
+	for (auto& readback : feedback_readbacks) {
+		device->destroy_buffer(&readback);
+	}
+	feedback_readbacks.clear();
+	device->destroy_buffer(&feedback_buffer);
+
+	vkDestroySampler(*device, sampler, nullptr);
+	sampler = VK_NULL_HANDLE;
+
+	device = nullptr;
+}
+
+/**
+* Start streaming a texture
+*
+* @param path Path of the KTX2 or DDS file
+* @return Handle of the texture, TEXTURE_INVALID when the texture count limit is reached
+*/
+uint32_t VulkanTextureStreamer::load(const std::string& path)
+{
+	if (textures.size() >= TEXTURE_MAX_COUNT) {
+		std::cout << "Texture count limit reached, could not load " << path << std::endl;
+		return TEXTURE_INVALID;
+	}
+
+	StreamedTexture texture = {};
+	texture.state = TEXTURE_STATE_LOADING;
+	texture.resident_level = TEXTURE_MAX_LEVELS;
+	texture.requested_level = TEXTURE_MAX_LEVELS;
+	texture.pending = true;
+	textures.push_back(texture);
+
+	LoadJob job = {};
+	job.texture = static_cast<uint32_t>(textures.size() - 1);
+	job.file.path = path;
+	job.format = VK_FORMAT_UNDEFINED;
+	job.first_level = TEXTURE_INVALID;
+	queue_job(job);
+
+	return job.texture;
+}
+
+/**
+* Apply the streaming decisions of a frame
+* Must be recorded outside of a render pass, before the draws sampling the textures
+*
+* @param command_buffer Command buffer of the frame
+* @param frame_index Index of the frame in flight, its previous submission is complete
+*/
+void VulkanTextureStreamer::update(VkCommandBuffer command_buffer, uint32_t frame_index)
+{
+	frame++;
+	frames_count = std::max(frames_count, frame_index + 1);
+	updated_textures.clear();
+	statistics.uploaded_levels = 0;
+	statistics.evicted_levels = 0;
+
+	update_heap_budgets();
+	read_feedback(frame_index);
+
+	// The content of the feedback buffer is undefined until its first clear
+	if (!feedback_cleared) {
+		vkCmdFillBuffer(command_buffer, feedback_buffer.buffer, 0, VK_WHOLE_SIZE, TEXTURE_FEEDBACK_NONE);
+
+		VkMemoryBarrier memory_barrier = {};
+		memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+		feedback_cleared = true;
+	}
+
+	// The levels uploaded on the transfer queue replace the texture images once complete
+	apply_uploads(command_buffer);
+
+	// Upload the levels read by the loaders
+	VkDeviceSize uploaded = 0;
+	while (uploaded < TEXTURE_UPLOAD_BYTES_PER_FRAME) {
+		LoadResult result;
+		{
+			std::lock_guard<std::mutex> lock(results_mutex);
+			if (results.empty()) {
+				break;
+			}
+			result = std::move(results.front());
+			results.pop_front();
+		}
+		uploaded += result.data.size();
+		upload(command_buffer, result);
+	}
+
+	request_levels();
+
+	statistics.resident_bytes = 0;
+	statistics.budget_bytes = 0;
+	statistics.pending_loads = 0;
+	for (uint32_t heap = 0; heap < device->get_memory_properties().memoryHeapCount; ++heap) {
+		statistics.resident_bytes += heap_usage[heap];
+		if (device->get_memory_properties().memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			statistics.budget_bytes += heap_budget[heap];
+		}
+	}
+	for (auto& texture : textures) {
+		statistics.pending_loads += texture.pending ? 1 : 0;
+	}
+}
+
+/**
+* Copy the feedback of the frame to its readback buffer and clear it for the next frame
+* Must be recorded outside of a render pass, after the draws sampling the textures
+*
+* @param command_buffer Command buffer of the frame
+* @param frame_index Index of the frame in flight
+*/
+void VulkanTextureStreamer::record_feedback_readback(VkCommandBuffer command_buffer, uint32_t frame_index)
+{
+	while (feedback_readbacks.size() <= frame_index) {
+		VulkanBuffer readback = {};
+		device->create_buffer(
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			feedback_buffer.size,
+			&readback);
+		std::fill_n(static_cast<int32_t*>(readback.mapped), TEXTURE_MAX_COUNT, TEXTURE_FEEDBACK_NONE);
+		feedback_readbacks.push_back(readback);
+	}
+
+	VkMemoryBarrier memory_barrier = {};
+	memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy region = { 0, 0, feedback_buffer.size };
+	vkCmdCopyBuffer(command_buffer, feedback_buffer.buffer, feedback_readbacks[frame_index].buffer, 1, &region);
+
+	// The clear waits for the copy, the next frame shaders and the host wait for both
+	memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+	vkCmdFillBuffer(command_buffer, feedback_buffer.buffer, 0, VK_WHOLE_SIZE, TEXTURE_FEEDBACK_NONE);
+
+	memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanTextureStreamer::run_loader()
+{
+	while (true) {
+		LoadJob job;
+		{
+			std::unique_lock<std::mutex> lock(jobs_mutex);
+			jobs_condition.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (stopping) {
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		LoadResult result = {};
+		result.texture = job.texture;
+		result.file = std::move(job.file);
+		result.format = job.format;
+		result.first_level = job.first_level;
+		result.last_level = job.last_level;
+
+		// A new texture starts with its mip tail
+		result.success = true;
+		if (result.first_level == TEXTURE_INVALID) {
+			result.success = VulkanTextureLoader::read_header(result.file.path, result.file);
+			if (result.success) {
+				result.first_level = get_tail_level(result.file);
+				result.last_level = static_cast<uint32_t>(result.file.levels.size() - 1);
+			}
+		}
+		if (result.success) {
+			result.success = VulkanTextureLoader::read_levels(result.file, result.first_level, result.last_level, result.data);
+		}
+
+		// The format is selected on the mip tail, the following levels are transcoded to the same format
+		if (result.success && result.format == VK_FORMAT_UNDEFINED) {
+			result.format = VulkanTextureTranscoder::select_format(*device, result.file.format, result.data.data(), result.data.size());
+			if (result.format == VK_FORMAT_UNDEFINED) {
+				std::cout << "Format " << result.file.format << " of texture " << result.file.path << " is not supported" << std::endl;
+				result.success = false;
+			}
+		}
+		if (result.success && result.format != result.file.format) {
+			result.success = transcode_levels(result);
+		}
+
+		std::lock_guard<std::mutex> lock(results_mutex);
+		results.push_back(std::move(result));
+	}
+}
+
+bool VulkanTextureStreamer::transcode_levels(LoadResult& result)
+{
+	std::vector<uint8_t> data;
+	std::vector<uint8_t> level_data;
+	size_t offset = 0;
+	for (uint32_t level = result.first_level; level <= result.last_level; ++level) {
+		const TextureFileLevel& file_level = result.file.levels[level];
+		if (!VulkanTextureTranscoder::transcode(result.file.format, result.format, file_level.width, file_level.height, result.data.data() + offset, level_data, worker_pool)) {
+			return false;
+		}
+		data.insert(data.end(), level_data.begin(), level_data.end());
+		offset += static_cast<size_t>(file_level.size);
+	}
+	result.data = std::move(data);
+	return true;
+}
+
+void VulkanTextureStreamer::queue_job(const LoadJob& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(jobs_mutex);
+		jobs.push_back(job);
+	}
+	jobs_condition.notify_one();
+}
+
+/**
+* Read the levels of detail sampled during the previous submission of the frame
+* The levels are relative to the resident level, the residency may have changed since,
+* at worst one more level is requested or kept for a frame
+*/
+void VulkanTextureStreamer::read_feedback(uint32_t frame_index)
+{
+	if (frame_index >= feedback_readbacks.size()) {
+		return;
+	}
+
+	const int32_t* feedback = static_cast<const int32_t*>(feedback_readbacks[frame_index].mapped);
+	for (uint32_t i = 0; i < textures.size(); ++i) {
+		StreamedTexture& texture = textures[i];
+		if (texture.state != TEXTURE_STATE_READY || feedback[i] == TEXTURE_FEEDBACK_NONE) {
+			continue;
+		}
+
+		int32_t level = static_cast<int32_t>(texture.resident_level) + feedback[i];
+		texture.requested_level = static_cast<uint32_t>(std::min(std::max(level, 0), static_cast<int32_t>(texture.tail_level)));
+		texture.last_used_frame = frame;
+	}
+}
+
+/* Queue the read of the next more detailed level of the textures sampled with more detail than resident */
+void VulkanTextureStreamer::request_levels()
+{
+	for (uint32_t i = 0; i < textures.size(); ++i) {
+		StreamedTexture& texture = textures[i];
+		if (texture.state != TEXTURE_STATE_READY || texture.pending || texture.requested_level >= texture.resident_level) {
+			continue;
+		}
+
+		LoadJob job = {};
+		job.texture = i;
+		job.file = texture.file;
+		job.format = texture.format;
+		job.first_level = texture.resident_level - 1;
+		job.last_level = texture.resident_level - 1;
+		queue_job(job);
+		texture.pending = true;
+	}
+}
+
+void VulkanTextureStreamer::upload(VkCommandBuffer command_buffer, LoadResult& result)
+{
+	StreamedTexture& texture = textures[result.texture];
+
+	if (texture.state == TEXTURE_STATE_LOADING) {
+		if (!result.success) {
+			texture.state = TEXTURE_STATE_FAILED;
+			texture.pending = false;
+			return;
+		}
+		texture.file = std::move(result.file);
+		texture.format = result.format;
+		texture.tail_level = result.first_level;
+		texture.resident_level = static_cast<uint32_t>(texture.file.levels.size());
+		texture.requested_level = texture.tail_level;
+		texture.last_used_frame = frame;
+		if (!stage_levels(command_buffer, result)) {
+			texture.state = TEXTURE_STATE_FAILED;
+			texture.pending = false;
+		}
+		return;
+	}
+
+	// The level must extend the resident levels, it is requested again otherwise
+	if (!result.success || result.last_level + 1 != texture.resident_level || !stage_levels(command_buffer, result)) {
+		texture.pending = false;
+	}
+}
+
+/**
+* Upload loaded levels on the transfer queue into a new image of the texture
+* The image replaces the texture image once the upload ticket is complete, the texture stays pending until then
+*
+* @param command_buffer Command buffer of the frame, records the evictions making room for the image
+* @param result Levels to upload, the new image holds the levels from the first one
+*/
+bool VulkanTextureStreamer::stage_levels(VkCommandBuffer command_buffer, const LoadResult& result)
+{
+	StreamedTexture& texture = textures[result.texture];
+	const TextureFile& file = texture.file;
+
+	TextureImage image;
+	if (!allocate_image(command_buffer, result.texture, result.first_level, &image)) {
+		return false;
+	}
+
+	// The data is staged before the copies are recorded so that both are in the same batch
+	VkBuffer staging_buffer;
+	VkDeviceSize staging_offset;
+	if (!transfer_queue->stage(result.data.data(), result.data.size(), &staging_buffer, &staging_offset)) {
+		destroy_image(image);
+		return false;
+	}
+	VkCommandBuffer transfer_command_buffer = transfer_queue->get_command_buffer();
+
+	VkImageMemoryBarrier image_barrier = {};
+	image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_barrier.srcAccessMask = 0;
+	image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.image = image.image;
+	image_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, static_cast<uint32_t>(file.levels.size()) - image.resident_level, 0, 1 };
+	vkCmdPipelineBarrier(transfer_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+
+	std::vector<VkBufferImageCopy> regions;
+	VkDeviceSize offset = staging_offset;
+	for (uint32_t level = result.first_level; level <= result.last_level; ++level) {
+		VkBufferImageCopy region = {};
+		region.bufferOffset = offset;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - image.resident_level, 0, 1 };
+		region.imageExtent = { file.levels[level].width, file.levels[level].height, 1 };
+		regions.push_back(region);
+		offset += VulkanTextureLoader::get_level_size(texture.format, file.levels[level].width, file.levels[level].height);
+	}
+	vkCmdCopyBufferToImage(transfer_command_buffer, staging_buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+	// The image is released to the graphics family, which acquires it in replace_image
+	if (device->async_transfer) {
+		image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		image_barrier.dstAccessMask = 0;
+		image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		image_barrier.srcQueueFamilyIndex = device->transfer_queue_family_index;
+		image_barrier.dstQueueFamilyIndex = device->graphics_queue_family_index;
+		vkCmdPipelineBarrier(transfer_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+	}
+
+	PendingUpload upload = {};
+	upload.texture = result.texture;
+	upload.image = image;
+	upload.levels = result.last_level - result.first_level + 1;
+	upload.ticket = transfer_queue->get_ticket();
+	uploads.push_back(upload);
+	texture.uploading = true;
+
+	return true;
+}
+
+/**
+* Replace the images of the textures whose upload is complete, the uploads complete in ticket order
+*
+* @param command_buffer Command buffer of the frame
+*/
+void VulkanTextureStreamer::apply_uploads(VkCommandBuffer command_buffer)
+{
+	while (!uploads.empty() && transfer_queue->is_complete(uploads.front().ticket)) {
+		const PendingUpload& upload = uploads.front();
+		StreamedTexture& texture = textures[upload.texture];
+		replace_image(command_buffer, upload.texture, upload.image, true);
+		texture.uploading = false;
+		texture.pending = false;
+		if (texture.state == TEXTURE_STATE_LOADING) {
+			texture.state = TEXTURE_STATE_READY;
+		}
+		statistics.uploaded_levels += upload.levels;
+		uploads.pop_front();
+	}
+}
+
+/**
+* Move a texture to a new image holding the levels from resident_level, the texture only gives back levels
+*
+* @param command_buffer Command buffer of the frame
+* @param texture Texture
+* @param resident_level Most detailed level of the new image
+*/
+bool VulkanTextureStreamer::reallocate(VkCommandBuffer command_buffer, uint32_t texture_index, uint32_t resident_level)
+{
+	TextureImage image;
+	if (!allocate_image(command_buffer, texture_index, resident_level, &image)) {
+		return false;
+	}
+	replace_image(command_buffer, texture_index, image, false);
+	return true;
+}
+
+/**
+* Create an image holding the levels from resident_level of a texture, growing textures make room in the budget
+*
+* @param command_buffer Command buffer of the frame, records the evictions
+* @param texture Texture
+* @param resident_level Most detailed level of the image
+* @param image Image to fill
+*/
+bool VulkanTextureStreamer::allocate_image(VkCommandBuffer command_buffer, uint32_t texture_index, uint32_t resident_level, TextureImage* image)
+{
+	StreamedTexture& texture = textures[texture_index];
+	const TextureFile& file = texture.file;
+	const uint32_t levels_count = static_cast<uint32_t>(file.levels.size()) - resident_level;
+
+	VkImageCreateInfo image_create_info = {};
+	image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_create_info.imageType = VK_IMAGE_TYPE_2D;
+	image_create_info.format = texture.format;
+	image_create_info.extent = { file.levels[resident_level].width, file.levels[resident_level].height, 1 };
+	image_create_info.mipLevels = levels_count;
+	image_create_info.arrayLayers = 1;
+	image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_create_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+	image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	image->resident_level = resident_level;
+	if (vkCreateImage(*device, &image_create_info, nullptr, &image->image) != VK_SUCCESS) {
+		std::cout << "Could not create the image of texture " << file.path << std::endl;
+		return false;
+	}
+
+	VkMemoryRequirements memory_requirements;
+	vkGetImageMemoryRequirements(*device, image->image, &memory_requirements);
+
+	VkMemoryAllocateInfo memory_allocate_info = {};
+	memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memory_allocate_info.allocationSize = memory_requirements.size;
+	device->get_memory_type(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &memory_allocate_info.memoryTypeIndex);
+	image->heap = device->get_memory_properties().memoryTypes[memory_allocate_info.memoryTypeIndex].heapIndex;
+	image->size = memory_requirements.size;
+
+	// Growing textures make room in the budget, the mip tail is always allowed
+	const bool grows = resident_level < texture.resident_level && texture.image != VK_NULL_HANDLE;
+	image->memory = VK_NULL_HANDLE;
+	if ((grows && !reserve_memory(command_buffer, image->heap, image->size, texture_index)) ||
+		vkAllocateMemory(*device, &memory_allocate_info, nullptr, &image->memory) != VK_SUCCESS) {
+		vkDestroyImage(*device, image->image, nullptr);
+		return false;
+	}
+	VK_CHECK_RESULT(vkBindImageMemory(*device, image->image, image->memory, 0));
+
+	return true;
+}
+
+void VulkanTextureStreamer::destroy_image(const TextureImage& image)
+{
+	vkDestroyImage(*device, image.image, nullptr);
+	vkFreeMemory(*device, image.memory, nullptr);
+}
+
+/**
+* Make a new image the image of a texture
+* The levels resident in both images are copied, the previous image is released with the frame
+*
+* @param command_buffer Command buffer of the frame
+* @param texture Texture
+* @param image New image
+* @param uploaded The image was uploaded on the transfer queue, it is in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+*/
+void VulkanTextureStreamer::replace_image(VkCommandBuffer command_buffer, uint32_t texture_index, const TextureImage& image, bool uploaded)
+{
+	StreamedTexture& texture = textures[texture_index];
+	const TextureFile& file = texture.file;
+	const uint32_t levels_count = static_cast<uint32_t>(file.levels.size()) - image.resident_level;
+
+	VkImageMemoryBarrier image_barrier = {};
+	image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	image_barrier.srcAccessMask = 0;
+	image_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	image_barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.image = image.image;
+	image_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levels_count, 0, 1 };
+	if (uploaded) {
+		// Acquire the image released by the transfer family, the upload is complete
+		image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		if (device->async_transfer) {
+			image_barrier.srcQueueFamilyIndex = device->transfer_queue_family_index;
+			image_barrier.dstQueueFamilyIndex = device->graphics_queue_family_index;
+		}
+		else {
+			image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		}
+	}
+	vkCmdPipelineBarrier(command_buffer, uploaded ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+
+	// Copy the levels resident in both images
+	const uint32_t first_copied_level = std::max(image.resident_level, texture.resident_level);
+	if (texture.image != VK_NULL_HANDLE && first_copied_level < file.levels.size()) {
+		VkImageMemoryBarrier source_barrier = image_barrier;
+		source_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		source_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		source_barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		source_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		source_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		source_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		source_barrier.image = texture.image;
+		source_barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, first_copied_level - texture.resident_level, static_cast<uint32_t>(file.levels.size()) - first_copied_level, 0, 1 };
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &source_barrier);
+
+		std::vector<VkImageCopy> regions;
+		for (uint32_t level = first_copied_level; level < file.levels.size(); ++level) {
+			VkImageCopy region = {};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - texture.resident_level, 0, 1 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level - image.resident_level, 0, 1 };
+			region.extent = { file.levels[level].width, file.levels[level].height, 1 };
+			regions.push_back(region);
+		}
+		vkCmdCopyImage(command_buffer, texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+	}
+
+	image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	image_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+
+	VkImageViewCreateInfo view_create_info = {};
+	view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	view_create_info.image = image.image;
+	view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_create_info.format = texture.format;
+	view_create_info.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levels_count, 0, 1 };
+	VkImageView view;
+	VK_CHECK_RESULT(vkCreateImageView(*device, &view_create_info, nullptr, &view));
+
+	// The previous image may still be sampled by the frames in flight, and by the frame copying it
+	if (texture.image != VK_NULL_HANDLE) {
+		const SyncPoint point = deletion_queue->get_next_point(SYNC_QUEUE_GRAPHICS);
+		deletion_queue->destroy_image_view(point, texture.view);
+		deletion_queue->destroy_image(point, texture.image);
+		deletion_queue->free_memory(point, texture.memory);
+		heap_usage[texture.memory_heap] -= texture.memory_size;
+	}
+
+	texture.image = image.image;
+	texture.view = view;
+	texture.memory = image.memory;
+	texture.memory_size = image.size;
+	texture.memory_heap = image.heap;
+	texture.resident_level = image.resident_level;
+	heap_usage[image.heap] += image.size;
+
+	updated_textures.push_back(texture_index);
+}
+
+/**
+* Make room in the texture budget of a heap by giving back the most detailed level
+* of the least recently sampled textures
+* Only the textures not sampled during the last frames, or holding more detail than sampled, are evicted
+*
+* @param command_buffer Command buffer of the frame
+* @param heap Memory heap
+* @param size Size of the allocation
+* @param texture Texture the room is made for, never evicted
+*/
+bool VulkanTextureStreamer::reserve_memory(VkCommandBuffer command_buffer, uint32_t heap, VkDeviceSize size, uint32_t texture)
+{
+	while (heap_usage[heap] + size > heap_budget[heap]) {
+		uint32_t victim = TEXTURE_INVALID;
+		for (uint32_t i = 0; i < textures.size(); ++i) {
+			const StreamedTexture& candidate = textures[i];
+			// The textures being uploaded keep the levels their new image is completed with
+			if (i == texture || candidate.state != TEXTURE_STATE_READY || candidate.uploading || candidate.memory_heap != heap || candidate.resident_level >= candidate.tail_level) {
+				continue;
+			}
+			const bool unused = candidate.last_used_frame + frames_count < frame;
+			const bool over_detailed = candidate.requested_level > candidate.resident_level;
+			if (!unused && !over_detailed) {
+				continue;
+			}
+			if (victim == TEXTURE_INVALID || candidate.last_used_frame < textures[victim].last_used_frame) {
+				victim = i;
+			}
+		}
+
+		if (victim == TEXTURE_INVALID || !reallocate(command_buffer, victim, textures[victim].resident_level + 1)) {
+			return false;
+		}
+		// The level is streamed again once sampled again
+		textures[victim].requested_level = std::max(textures[victim].requested_level, textures[victim].resident_level);
+		statistics.evicted_levels++;
+	}
+
+	return true;
+}
+
+/**
+* Compute the budget of the textures on each heap
+* The budget reported by VK_EXT_memory_budget accounts for the other applications and
+* for the rest of the renderer, without the extension the budget is a fraction of the heap size
+*/
+void VulkanTextureStreamer::update_heap_budgets()
+{
+	const VkPhysicalDeviceMemoryProperties& memory_properties = device->get_memory_properties();
+	for (uint32_t heap = 0; heap < memory_properties.memoryHeapCount; ++heap) {
+		heap_budget[heap] = static_cast<VkDeviceSize>(memory_properties.memoryHeaps[heap].size * TEXTURE_BUDGET_FRACTION);
+	}
+
+#ifdef VK_EXT_memory_budget
+	if (device->is_extension_enabled(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {};
+		budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 memory_properties2 = {};
+		memory_properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		memory_properties2.pNext = &budget_properties;
+		vkGetPhysicalDeviceMemoryProperties2(device->physical_device, &memory_properties2);
+
+		// The usage of the process includes the textures
+		for (uint32_t heap = 0; heap < memory_properties.memoryHeapCount; ++heap) {
+			VkDeviceSize other_usage = budget_properties.heapUsage[heap] - std::min(budget_properties.heapUsage[heap], heap_usage[heap]);
+			VkDeviceSize available = budget_properties.heapBudget[heap] - std::min(budget_properties.heapBudget[heap], other_usage);
+			heap_budget[heap] = std::min(static_cast<VkDeviceSize>(budget_properties.heapBudget[heap] * TEXTURE_BUDGET_FRACTION), available);
+		}
+	}
+#endif
+}
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanTransferQueue.h"
+#include "VulkanDeletionQueue.h"
+#include "VulkanTextureLoader.h"
+#include "VulkanTextureTranscoder.h"
+#include "VulkanWorkerPool.h"
+
+#define TEXTURE_STREAMING_THREADS		2
+#define TEXTURE_MAX_COUNT				4096
+/* Levels up to this size, in texels, form the mip tail loaded with the texture */
+#define TEXTURE_MIP_TAIL_SIZE			128
+/* Fraction of the device local heap budget the textures may use */
+#define TEXTURE_BUDGET_FRACTION			0.5f
+/* Bytes staged for upload per frame, at least one level is staged */
+#define TEXTURE_UPLOAD_BYTES_PER_FRAME	(16 << 20)
+/* Feedback value of a texture that was not sampled */
+#define TEXTURE_FEEDBACK_NONE			0x7FFFFFFF
+
+#define TEXTURE_INVALID					0xFFFFFFFF
+
+struct TextureStreamingStatistics {
+	VkDeviceSize resident_bytes;
+	VkDeviceSize budget_bytes;
+	uint32_t pending_loads;
+	uint32_t uploaded_levels;
+	uint32_t evicted_levels;
+};
+
+/**
+* Streaming of mip mapped textures under a memory budget
+*
+* - the files are read by I/O threads, the mip tail first so that every texture is usable
+*   as soon as its header is read, then one more detailed level at a time
+* - the detail requested for each texture comes from the GPU feedback buffer, where the shaders
+*   sampling texture i write the smallest level of detail they computed:
+*
+*     atomicMin(textureFeedback[i], int(floor(textureQueryLod(textures[i], uv).y)));
+*
+*   the level is relative to the most detailed resident level, it is negative when more detail is needed
+* - once the budget of the device local heap is reached, the least recently sampled textures
+*   give back their most detailed levels
+*
+* Images only hold their resident levels, they are reallocated when the residency changes
+* and the released images are destroyed by the deletion queue once the frame releasing them is complete
+* The loaded levels are uploaded on the transfer queue into the new image, which replaces the
+* texture image in the first frame after the upload ticket is complete
+*/
+class VulkanTextureStreamer
+{
+public:
+	VulkanTextureStreamer();
+	~VulkanTextureStreamer();
+
+	bool								create(VulkanDevice* device, uint32_t frames_count, VulkanTransferQueue* transfer_queue, VulkanDeletionQueue* deletion_queue, VulkanWorkerPool* worker_pool);
+	void								shutdown();
+
+	uint32_t							load(const std::string& path);
+
+	void								update(VkCommandBuffer command_buffer, uint32_t frame_index);
+	void								record_feedback_readback(VkCommandBuffer command_buffer, uint32_t frame_index);
+
+	/** @brief Texture view, null until the mip tail is resident */
+	VkImageView							get_view(uint32_t texture) const { return textures[texture].view; };
+	VkSampler							get_sampler() const { return sampler; };
+	/** @brief Textures whose view changed during the last update */
+	const std::vector<uint32_t>&		get_updated_textures() const { return updated_textures; };
+	const VulkanBuffer&					get_feedback_buffer() const { return feedback_buffer; };
+	const TextureStreamingStatistics&	get_statistics() const { return statistics; };
+
+private:
+	enum TextureState {
+		TEXTURE_STATE_LOADING,
+		TEXTURE_STATE_READY,
+		TEXTURE_STATE_FAILED
+	};
+
+	struct StreamedTexture {
+		TextureFile file;
+		/* format of the image, the file levels are transcoded when it differs from the file format */
+		VkFormat format;
+		TextureState state;
+		/* first level of the mip tail */
+		uint32_t tail_level;
+		/* most detailed level held by the image, file levels count when none */
+		uint32_t resident_level;
+		/* most detailed level sampled by the GPU */
+		uint32_t requested_level;
+		bool pending;
+		/* a new image is being uploaded, the resident levels are kept until it replaces the image */
+		bool uploading;
+		uint64_t last_used_frame;
+
+		VkImage image;
+		VkImageView view;
+		VkDeviceMemory memory;
+		VkDeviceSize memory_size;
+		uint32_t memory_heap;
+	};
+
+	/* read of the levels [first_level, last_level] of a texture, the header is read and the format selected first when not known */
+	struct LoadJob {
+		uint32_t texture;
+		TextureFile file;
+		VkFormat format;
+		uint32_t first_level;
+		uint32_t last_level;
+	};
+
+	struct LoadResult {
+		uint32_t texture;
+		TextureFile file;
+		VkFormat format;
+		bool success;
+		uint32_t first_level;
+		uint32_t last_level;
+		std::vector<uint8_t> data;
+	};
+
+	struct TextureImage {
+		VkImage image;
+		VkDeviceMemory memory;
+		VkDeviceSize size;
+		uint32_t heap;
+		uint32_t resident_level;
+	};
+
+	/* image uploaded on the transfer queue, applied to its texture once the ticket is complete */
+	struct PendingUpload {
+		uint32_t texture;
+		TextureImage image;
+		uint32_t levels;
+		TransferTicket ticket;
+	};
+
+	VulkanDevice*						device;
+	VulkanTransferQueue*				transfer_queue;
+	VulkanDeletionQueue*				deletion_queue;
+	/* pool of the level transcoding, shared with the render queue */
+	VulkanWorkerPool*					worker_pool;
+	uint32_t							frames_count;
+	uint64_t							frame;
+
+	std::vector<StreamedTexture>		textures;
+	std::vector<uint32_t>				updated_textures;
+	std::deque<PendingUpload>			uploads;
+
+	VkSampler							sampler;
+
+	/* smallest level of detail sampled per texture, copied every frame to the host visible readback of the frame */
+	VulkanBuffer						feedback_buffer;
+	std::vector<VulkanBuffer>			feedback_readbacks;
+	bool								feedback_cleared;
+
+	VkDeviceSize						heap_usage[VK_MAX_MEMORY_HEAPS];
+	VkDeviceSize						heap_budget[VK_MAX_MEMORY_HEAPS];
+
+	std::vector<std::thread>			threads;
+	std::mutex							jobs_mutex;
+	std::condition_variable				jobs_condition;
+	std::deque<LoadJob>					jobs;
+	std::mutex							results_mutex;
+	std::deque<LoadResult>				results;
+	bool								stopping;
+
+	TextureStreamingStatistics			statistics;
+
+	void								run_loader();
+	bool								transcode_levels(LoadResult& result);
+	void								queue_job(const LoadJob& job);
+
+	void								read_feedback(uint32_t frame_index);
+	void								request_levels();
+	void								upload(VkCommandBuffer command_buffer, LoadResult& result);
+	bool								stage_levels(VkCommandBuffer command_buffer, const LoadResult& result);
+	void								apply_uploads(VkCommandBuffer command_buffer);
+	bool								reallocate(VkCommandBuffer command_buffer, uint32_t texture, uint32_t resident_level);
+	bool								allocate_image(VkCommandBuffer command_buffer, uint32_t texture, uint32_t resident_level, TextureImage* image);
+	void								destroy_image(const TextureImage& image);
+	void								replace_image(VkCommandBuffer command_buffer, uint32_t texture, const TextureImage& image, bool uploaded);
+	bool								reserve_memory(VkCommandBuffer command_buffer, uint32_t heap, VkDeviceSize size, uint32_t texture);
+
+	void								update_heap_budgets();
+};
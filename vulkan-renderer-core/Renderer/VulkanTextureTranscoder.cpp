@@ -0,0 +1,380 @@
+#include "VulkanTextureTranscoder.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TRANSCODER_SSE2
+#endif
+
+/* Below this number of block rows per thread the level is transcoded on the calling thread */
+#define TRANSCODER_MIN_ROWS_PER_WORKER	16
+
+static bool is_rgba8(VkFormat format)
+{
+	return format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+static bool is_srgb(VkFormat format)
+{
+	return format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK ||
+		format == VK_FORMAT_BC2_SRGB_BLOCK || format == VK_FORMAT_BC3_SRGB_BLOCK;
+}
+
+static bool is_decodable(VkFormat format)
+{
+	return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC5_SNORM_BLOCK &&
+		format != VK_FORMAT_BC4_SNORM_BLOCK && format != VK_FORMAT_BC5_SNORM_BLOCK;
+}
+
+static uint16_t pack_565(const uint8_t* color)
+{
+	return static_cast<uint16_t>((((color[0] * 31 + 127) / 255) << 11) | (((color[1] * 63 + 127) / 255) << 5) | ((color[2] * 31 + 127) / 255));
+}
+
+static void unpack_565(uint16_t packed, uint8_t* color)
+{
+	uint32_t r = (packed >> 11) & 31;
+	uint32_t g = (packed >> 5) & 63;
+	uint32_t b = packed & 31;
+	color[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+	color[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+	color[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+	color[3] = 255;
+}
+
+/**
+* Select the format a texture is uploaded in
+* Sampled source formats are kept, RGBA8 sources are compressed when the device supports BC,
+* BC sources are decoded when it does not
+*
+* @param device Device
+* @param source_format Format of the file
+* @param data Levels already read, used to detect the alpha of RGBA8 sources
+* @param size Size of the levels
+* @return Format to upload, VK_FORMAT_UNDEFINED when the texture can not be sampled
+*/
+VkFormat VulkanTextureTranscoder::select_format(const VulkanDevice& device, VkFormat source_format, const uint8_t* data, size_t size)
+{
+	const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	const bool srgb = is_srgb(source_format);
+
+	if (is_rgba8(source_format)) {
+		bool opaque = true;
+		for (size_t i = 3; i < size && opaque; i += 4) {
+			opaque = data[i] == 255;
+		}
+
+		std::vector<VkFormat> candidates;
+		if (opaque) {
+			candidates.push_back(srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+		}
+		candidates.push_back(srgb ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_BC3_UNORM_BLOCK);
+		candidates.push_back(source_format);
+		return device.get_supported_format(candidates, features);
+	}
+
+	if (device.is_format_supported(source_format, features)) {
+		return source_format;
+	}
+
+	if (is_decodable(source_format)) {
+		return device.get_supported_format({ srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM }, features);
+	}
+
+	return VK_FORMAT_UNDEFINED;
+}
+
+/**
+* Transcode a level
+*
+* @param source_format Format of the source level
+* @param target_format Format selected by select_format
+* @param width Width of the level
+* @param height Height of the level
+* @param source Source level
+* @param target Transcoded level, tightly packed
+* @param worker_pool Pool running the rows of blocks
+*/
+bool VulkanTextureTranscoder::transcode(VkFormat source_format, VkFormat target_format, uint32_t width, uint32_t height, const uint8_t* source, std::vector<uint8_t>& target, VulkanWorkerPool* worker_pool)
+{
+	const uint32_t blocks_x = (width + 3) / 4;
+	const uint32_t blocks_y = (height + 3) / 4;
+
+	uint32_t workers = std::min(worker_pool->get_workers_count(), blocks_y / TRANSCODER_MIN_ROWS_PER_WORKER);
+	workers = std::max(workers, 1u);
+	const uint32_t rows_per_worker = (blocks_y + workers - 1) / workers;
+
+	// RGBA8 to BC1 or BC3
+	if (is_rgba8(source_format) && !is_rgba8(target_format)) {
+		const bool alpha = target_format == VK_FORMAT_BC3_UNORM_BLOCK || target_format == VK_FORMAT_BC3_SRGB_BLOCK;
+		const uint32_t block_size = alpha ? 16 : 8;
+		target.resize(static_cast<size_t>(blocks_x) * blocks_y * block_size);
+
+		worker_pool->run(workers, [&](uint32_t worker) {
+			uint8_t texels[64];
+			const uint32_t end_y = std::min((worker + 1) * rows_per_worker, blocks_y);
+			for (uint32_t block_y = worker * rows_per_worker; block_y < end_y; ++block_y) {
+				for (uint32_t block_x = 0; block_x < blocks_x; ++block_x) {
+					// The texels past the edges repeat the last row and column
+					for (uint32_t y = 0; y < 4; ++y) {
+						for (uint32_t x = 0; x < 4; ++x) {
+							uint32_t source_x = std::min(block_x * 4 + x, width - 1);
+							uint32_t source_y = std::min(block_y * 4 + y, height - 1);
+							memcpy(&texels[(y * 4 + x) * 4], &source[(static_cast<size_t>(source_y) * width + source_x) * 4], 4);
+						}
+					}
+
+					uint8_t* block = &target[(static_cast<size_t>(block_y) * blocks_x + block_x) * block_size];
+					if (alpha) {
+						encode_bc4_block(texels + 3, 4, block);
+						block += 8;
+					}
+					encode_bc1_block(texels, block);
+				}
+			}
+		});
+		return true;
+	}
+
+	// BC1 to BC5 to RGBA8
+	if (is_decodable(source_format) && is_rgba8(target_format)) {
+		TextureFormatBlock format_block;
+		VulkanTextureLoader::get_format_block(source_format, format_block);
+		target.resize(static_cast<size_t>(width) * height * 4);
+
+		worker_pool->run(workers, [&](uint32_t worker) {
+			uint8_t texels[64];
+			const uint32_t end_y = std::min((worker + 1) * rows_per_worker, blocks_y);
+			for (uint32_t block_y = worker * rows_per_worker; block_y < end_y; ++block_y) {
+				for (uint32_t block_x = 0; block_x < blocks_x; ++block_x) {
+					const uint8_t* block = &source[(static_cast<size_t>(block_y) * blocks_x + block_x) * format_block.size];
+
+					switch (source_format) {
+					case VK_FORMAT_BC2_UNORM_BLOCK:
+					case VK_FORMAT_BC2_SRGB_BLOCK:
+						decode_bc1_block(block + 8, texels, true);
+						for (uint32_t i = 0; i < 16; ++i) {
+							texels[i * 4 + 3] = static_cast<uint8_t>(((block[i / 2] >> ((i & 1) * 4)) & 15) * 17);
+						}
+						break;
+					case VK_FORMAT_BC3_UNORM_BLOCK:
+					case VK_FORMAT_BC3_SRGB_BLOCK:
+						decode_bc1_block(block + 8, texels, true);
+						decode_bc4_block(block, texels + 3, 4);
+						break;
+					case VK_FORMAT_BC4_UNORM_BLOCK:
+						memset(texels, 0, sizeof(texels));
+						decode_bc4_block(block, texels, 4);
+						for (uint32_t i = 0; i < 16; ++i) {
+							texels[i * 4 + 3] = 255;
+						}
+						break;
+					case VK_FORMAT_BC5_UNORM_BLOCK:
+						memset(texels, 0, sizeof(texels));
+						decode_bc4_block(block, texels, 4);
+						decode_bc4_block(block + 8, texels + 1, 4);
+						for (uint32_t i = 0; i < 16; ++i) {
+							texels[i * 4 + 3] = 255;
+						}
+						break;
+					default:
+						decode_bc1_block(block, texels, false);
+						break;
+					}
+
+					for (uint32_t y = 0; y < 4 && block_y * 4 + y < height; ++y) {
+						for (uint32_t x = 0; x < 4 && block_x * 4 + x < width; ++x) {
+							memcpy(&target[((static_cast<size_t>(block_y) * 4 + y) * width + block_x * 4 + x) * 4], &texels[(y * 4 + x) * 4], 4);
+						}
+					}
+				}
+			}
+		});
+		return true;
+	}
+
+	std::cout << "No transcoding from format " << source_format << " to format " << target_format << std::endl;
+	return false;
+}
+
+/**
+* Encode the colors of 16 RGBA8 texels to a BC1 block
+* The endpoints are the inset corners of the colors bounding box, each texel takes
+* the palette entry closest to its projection on the box diagonal
+*/
+void VulkanTextureTranscoder::encode_bc1_block(const uint8_t* texels, uint8_t* block)
+{
+	uint8_t min_color[4];
+	uint8_t max_color[4];
+
+#ifdef TRANSCODER_SSE2
+	__m128i t0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels));
+	__m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + 16));
+	__m128i t2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + 32));
+	__m128i t3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(texels + 48));
+	__m128i minimum = _mm_min_epu8(_mm_min_epu8(t0, t1), _mm_min_epu8(t2, t3));
+	__m128i maximum = _mm_max_epu8(_mm_max_epu8(t0, t1), _mm_max_epu8(t2, t3));
+	minimum = _mm_min_epu8(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+	maximum = _mm_max_epu8(maximum, _mm_shuffle_epi32(maximum, _MM_SHUFFLE(1, 0, 3, 2)));
+	minimum = _mm_min_epu8(minimum, _mm_shuffle_epi32(minimum, _MM_SHUFFLE(2, 3, 0, 1)));
+	maximum = _mm_max_epu8(maximum, _mm_shuffle_epi32(maximum, _MM_SHUFFLE(2, 3, 0, 1)));
+	int minimum_texel = _mm_cvtsi128_si32(minimum);
+	int maximum_texel = _mm_cvtsi128_si32(maximum);
+	memcpy(min_color, &minimum_texel, 4);
+	memcpy(max_color, &maximum_texel, 4);
+#else
+	memcpy(min_color, texels, 4);
+	memcpy(max_color, texels, 4);
+	for (uint32_t i = 1; i < 16; ++i) {
+		for (uint32_t c = 0; c < 4; ++c) {
+			min_color[c] = std::min(min_color[c], texels[i * 4 + c]);
+			max_color[c] = std::max(max_color[c], texels[i * 4 + c]);
+		}
+	}
+#endif
+
+	// Inset the box by a sixteenth to reduce the error at the palette extremities
+	for (uint32_t c = 0; c < 3; ++c) {
+		uint8_t inset = static_cast<uint8_t>((max_color[c] - min_color[c]) >> 4);
+		min_color[c] = static_cast<uint8_t>(min_color[c] + inset);
+		max_color[c] = static_cast<uint8_t>(max_color[c] - inset);
+	}
+
+	uint16_t color0 = pack_565(max_color);
+	uint16_t color1 = pack_565(min_color);
+
+	uint32_t indices = 0;
+	if (color0 != color1) {
+		float direction[3] = {
+			static_cast<float>(max_color[0] - min_color[0]),
+			static_cast<float>(max_color[1] - min_color[1]),
+			static_cast<float>(max_color[2] - min_color[2])
+		};
+		float length = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+		float scale = length > 0.0f ? 3.0f / length : 0.0f;
+
+		// Position on the diagonal, from the minimum, to palette index
+		static const uint32_t palette_indices[4] = { 1, 3, 2, 0 };
+		for (uint32_t i = 0; i < 16; ++i) {
+			float projection = (texels[i * 4] - min_color[0]) * direction[0] +
+				(texels[i * 4 + 1] - min_color[1]) * direction[1] +
+				(texels[i * 4 + 2] - min_color[2]) * direction[2];
+			int step = static_cast<int>(projection * scale + 0.5f);
+			step = std::min(std::max(step, 0), 3);
+			indices |= palette_indices[step] << (i * 2);
+		}
+
+		// The four colors mode needs color0 > color1, swapping the endpoints swaps the palette pairs
+		if (color0 < color1) {
+			std::swap(color0, color1);
+			indices ^= 0x55555555;
+		}
+	}
+
+	block[0] = static_cast<uint8_t>(color0 & 0xff);
+	block[1] = static_cast<uint8_t>(color0 >> 8);
+	block[2] = static_cast<uint8_t>(color1 & 0xff);
+	block[3] = static_cast<uint8_t>(color1 >> 8);
+	memcpy(block + 4, &indices, 4);
+}
+
+/**
+* Encode one channel of 16 texels to a BC4 block, as used for the BC3 alpha
+*
+* @param texels First channel value
+* @param stride Distance between two texels values
+* @param block Encoded block
+*/
+void VulkanTextureTranscoder::encode_bc4_block(const uint8_t* texels, uint32_t stride, uint8_t* block)
+{
+	uint8_t minimum = texels[0];
+	uint8_t maximum = texels[0];
+	for (uint32_t i = 1; i < 16; ++i) {
+		minimum = std::min(minimum, texels[i * stride]);
+		maximum = std::max(maximum, texels[i * stride]);
+	}
+
+	// Eight values mode, index 0 is the maximum, 1 the minimum and 2 to 7 go from the maximum to the minimum
+	uint64_t indices = 0;
+	if (maximum != minimum) {
+		const float scale = 7.0f / (maximum - minimum);
+		for (uint32_t i = 0; i < 16; ++i) {
+			int step = static_cast<int>((texels[i * stride] - minimum) * scale + 0.5f);
+			uint64_t index = step == 7 ? 0 : (step == 0 ? 1 : static_cast<uint64_t>(8 - step));
+			indices |= index << (i * 3);
+		}
+	}
+
+	block[0] = maximum;
+	block[1] = minimum;
+	for (uint32_t i = 0; i < 6; ++i) {
+		block[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+	}
+}
+
+/**
+* Decode a BC1 block to 16 RGBA8 texels
+*
+* @param opaque Color block of BC2 or BC3, always in four colors mode
+*/
+void VulkanTextureTranscoder::decode_bc1_block(const uint8_t* block, uint8_t* texels, bool opaque)
+{
+	uint16_t color0 = static_cast<uint16_t>(block[0] | (block[1] << 8));
+	uint16_t color1 = static_cast<uint16_t>(block[2] | (block[3] << 8));
+
+	uint8_t palette[4][4];
+	unpack_565(color0, palette[0]);
+	unpack_565(color1, palette[1]);
+	for (uint32_t c = 0; c < 3; ++c) {
+		if (opaque || color0 > color1) {
+			palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c]) / 3);
+			palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c]) / 3);
+		}
+		else {
+			palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+			palette[3][c] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = (opaque || color0 > color1) ? 255 : 0;
+
+	uint32_t indices;
+	memcpy(&indices, block + 4, 4);
+	for (uint32_t i = 0; i < 16; ++i) {
+		memcpy(&texels[i * 4], palette[(indices >> (i * 2)) & 3], 4);
+	}
+}
+
+/**
+* Decode a BC4 block to one channel of 16 texels
+*
+* @param texels First channel value
+* @param stride Distance between two texels values
+*/
+void VulkanTextureTranscoder::decode_bc4_block(const uint8_t* block, uint8_t* texels, uint32_t stride)
+{
+	uint32_t palette[8];
+	palette[0] = block[0];
+	palette[1] = block[1];
+	if (palette[0] > palette[1]) {
+		for (uint32_t i = 2; i < 8; ++i) {
+			palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1]) / 7;
+		}
+	}
+	else {
+		for (uint32_t i = 2; i < 6; ++i) {
+			palette[i] = ((6 - i) * palette[0] + (i - 1) * palette[1]) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t indices = 0;
+	for (uint32_t i = 0; i < 6; ++i) {
+		indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+	}
+	for (uint32_t i = 0; i < 16; ++i) {
+		texels[i * stride] = static_cast<uint8_t>(palette[(indices >> (i * 3)) & 7]);
+	}
+}
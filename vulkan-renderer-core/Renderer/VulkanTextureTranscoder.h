@@ -0,0 +1,34 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanDevice.h"
+#include "VulkanTextureLoader.h"
+#include "VulkanWorkerPool.h"
+
+/**
+* CPU conversion of texture levels to a format the device samples
+*
+* - RGBA8 levels are encoded to BC1, or BC3 when they hold alpha, so that uncompressed
+*   sources still take a quarter to an eighth of their memory on the GPU
+* - BC1 to BC5 levels are decoded to RGBA8 on devices without BC support
+*
+* Levels are split by rows of blocks over the workers of a shared pool, the block encoder works on
+* 16 texels at once with SSE2 when available
+*/
+class VulkanTextureTranscoder
+{
+public:
+	static VkFormat				select_format(const VulkanDevice& device, VkFormat source_format, const uint8_t* data, size_t size);
+	static bool					transcode(VkFormat source_format, VkFormat target_format, uint32_t width, uint32_t height, const uint8_t* source, std::vector<uint8_t>& target, VulkanWorkerPool* worker_pool);
+
+private:
+	static void					encode_bc1_block(const uint8_t* texels, uint8_t* block);
+	static void					encode_bc4_block(const uint8_t* texels, uint32_t stride, uint8_t* block);
+	static void					decode_bc1_block(const uint8_t* block, uint8_t* texels, bool opaque);
+	static void					decode_bc4_block(const uint8_t* block, uint8_t* texels, uint32_t stride);
+};
@@ -0,0 +1,257 @@
+#include "VulkanTransferQueue.h"
+
+VulkanTransferQueue::VulkanTransferQueue()
+	: device(nullptr)
+	, timeline(nullptr)
+	, command_pool(VK_NULL_HANDLE)
+	, recording(nullptr)
+	, next_ticket(1)
+	, statistics({})
+{
+}
+
+VulkanTransferQueue::~VulkanTransferQueue()
+{
+}
+
+bool VulkanTransferQueue::create(VulkanDevice* device, VulkanSync* sync)
+{
+	this->device = device;
+	timeline = &sync->get_timeline(SYNC_QUEUE_TRANSFER);
+	next_ticket = timeline->get_submitted_value() + 1;
+	statistics = {};
+	statistics.async_transfer = device->async_transfer;
+
+	VkCommandPoolCreateInfo command_pool_create_info = {};
+	command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	command_pool_create_info.queueFamilyIndex = device->transfer_queue_family_index;
+	VK_CHECK_RESULT(vkCreateCommandPool(*device, &command_pool_create_info, nullptr, &command_pool));
+
+	return true;
+}
+
+void VulkanTransferQueue::shutdown()
+{
+	if (device == nullptr) {
+		return;
+	}
+
+	std::cout << "Destroy transfer queue\n";
+	flush();
+	timeline->wait(timeline->get_submitted_value());
+
+	for (auto batch : submitted) {
+		destroy_batch(batch);
+	}
+	submitted.clear();
+	for (auto batch : free_batches) {
+		destroy_batch(batch);
+	}
+	free_batches.clear();
+
+	vkDestroyCommandPool(*device, command_pool, nullptr);
+	command_pool = VK_NULL_HANDLE;
+
+	device = nullptr;
+}
+
+/**
+* Recycle the batches that are complete, called once per frame
+*/
+void VulkanTransferQueue::update()
+{
+	retire_batches();
+
+	statistics.frame_batches = 0;
+	statistics.frame_bytes = 0;
+}
+
+/**
+* Command buffer of the batch of the current ticket, begun on the first call after a flush
+*/
+VkCommandBuffer VulkanTransferQueue::get_command_buffer()
+{
+	if (recording == nullptr) {
+		recording = begin_batch(TRANSFER_BATCH_SIZE);
+	}
+	return recording->command_buffer;
+}
+
+/**
+* Copy data to the staging buffer of the current batch
+* The batch is submitted first when the data does not fit, the data must be staged before
+* the copies reading it are recorded so that both are in the same batch
+*
+* @param buffer Staging buffer the data was copied to
+* @param offset Offset of the data in the staging buffer
+*/
+bool VulkanTransferQueue::stage(const void* data, VkDeviceSize size, VkBuffer* buffer, VkDeviceSize* offset)
+{
+	if (recording != nullptr) {
+		VkDeviceSize aligned_offset = (recording->staging_offset + TRANSFER_STAGING_ALIGNMENT - 1) & ~static_cast<VkDeviceSize>(TRANSFER_STAGING_ALIGNMENT - 1);
+		if (aligned_offset + size > recording->staging.size) {
+			flush();
+		}
+		else {
+			recording->staging_offset = aligned_offset;
+		}
+	}
+	if (recording == nullptr) {
+		recording = begin_batch(size);
+		if (recording == nullptr) {
+			return false;
+		}
+	}
+
+	memcpy(static_cast<uint8_t*>(recording->staging.mapped) + recording->staging_offset, data, static_cast<size_t>(size));
+	*buffer = recording->staging.buffer;
+	*offset = recording->staging_offset;
+	recording->staging_offset += size;
+	statistics.frame_bytes += size;
+	return true;
+}
+
+/**
+* Copy data to a buffer created by VulkanDevice::create_buffer with VK_BUFFER_USAGE_TRANSFER_DST_BIT
+*
+* @return Ticket of the upload, TRANSFER_TICKET_INVALID when the data could not be staged
+*/
+TransferTicket VulkanTransferQueue::upload_buffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+{
+	VkBuffer staging_buffer;
+	VkDeviceSize staging_offset;
+	if (!stage(data, size, &staging_buffer, &staging_offset)) {
+		return TRANSFER_TICKET_INVALID;
+	}
+
+	VkBufferCopy region = { staging_offset, offset, size };
+	vkCmdCopyBuffer(get_command_buffer(), staging_buffer, buffer, 1, &region);
+	return next_ticket;
+}
+
+/**
+* Submit the batch of the current ticket, the following uploads get the next ticket
+*
+* @return Ticket of the submitted batch, the last submitted ticket when nothing was recorded
+*/
+TransferTicket VulkanTransferQueue::flush()
+{
+	if (recording == nullptr) {
+		return next_ticket - 1;
+	}
+
+	Batch* batch = recording;
+	recording = nullptr;
+	VK_CHECK_RESULT(vkEndCommandBuffer(batch->command_buffer));
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.commandBufferCount = 1;
+	submit_info.pCommandBuffers = &batch->command_buffer;
+	const uint64_t value = timeline->submit(submit_info);
+	assert(value == batch->ticket);
+
+	submitted.push_back(batch);
+	next_ticket = value + 1;
+	statistics.frame_batches++;
+
+	// The staging memory in flight is bounded, the oldest batch is waited for beyond
+	if (submitted.size() > TRANSFER_MAX_BATCHES) {
+		timeline->wait(submitted.front()->ticket);
+	}
+	retire_batches();
+
+	return batch->ticket;
+}
+
+/**
+* Last ticket whose uploads are complete
+*/
+TransferTicket VulkanTransferQueue::get_completed_ticket()
+{
+	return timeline->get_completed_value();
+}
+
+bool VulkanTransferQueue::is_complete(TransferTicket ticket)
+{
+	return timeline->is_complete(ticket);
+}
+
+/**
+* Block until the uploads of a ticket are complete, its batch is submitted first when it is recording
+*/
+void VulkanTransferQueue::wait(TransferTicket ticket)
+{
+	if (ticket == TRANSFER_TICKET_INVALID) {
+		return;
+	}
+	if (ticket >= next_ticket) {
+		flush();
+	}
+	timeline->wait(ticket);
+	retire_batches();
+}
+
+VulkanTransferQueue::Batch* VulkanTransferQueue::begin_batch(VkDeviceSize staging_size)
+{
+	Batch* batch = nullptr;
+	if (free_batches.empty()) {
+		batch = new Batch();
+		*batch = {};
+
+		VkCommandBufferAllocateInfo command_buffer_allocate_info = {};
+		command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		command_buffer_allocate_info.commandPool = command_pool;
+		command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		command_buffer_allocate_info.commandBufferCount = 1;
+		VK_CHECK_RESULT(vkAllocateCommandBuffers(*device, &command_buffer_allocate_info, &batch->command_buffer));
+	}
+	else {
+		batch = free_batches.back();
+		free_batches.pop_back();
+	}
+
+	// Uploads larger than a batch get a staging buffer of their size
+	staging_size = std::max(staging_size, static_cast<VkDeviceSize>(TRANSFER_BATCH_SIZE));
+	if (batch->staging.size < staging_size) {
+		device->destroy_buffer(&batch->staging);
+		if (!device->create_buffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_size, &batch->staging)) {
+			batch->staging.size = 0;
+			free_batches.push_back(batch);
+			return nullptr;
+		}
+	}
+
+	batch->ticket = next_ticket;
+	batch->staging_offset = 0;
+
+	VkCommandBufferBeginInfo begin_info = {};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	VK_CHECK_RESULT(vkBeginCommandBuffer(batch->command_buffer, &begin_info));
+
+	return batch;
+}
+
+/**
+* Recycle the complete batches
+*/
+void VulkanTransferQueue::retire_batches()
+{
+	const TransferTicket completed_ticket = timeline->get_completed_value();
+	statistics.completed_ticket = completed_ticket;
+
+	while (!submitted.empty() && submitted.front()->ticket <= completed_ticket) {
+		free_batches.push_back(submitted.front());
+		submitted.pop_front();
+	}
+	statistics.pending_batches = static_cast<uint32_t>(next_ticket - 1 - completed_ticket);
+}
+
+void VulkanTransferQueue::destroy_batch(Batch* batch)
+{
+	vkFreeCommandBuffers(*device, command_pool, 1, &batch->command_buffer);
+	device->destroy_buffer(&batch->staging);
+	delete batch;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <algorithm>
+
+#include <vulkan/vulkan.h>
+
+#include "VulkanTools.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+#include "VulkanSync.h"
+
+/* Staging bytes of a batch, a batch is submitted once its staging buffer is full */
+#define TRANSFER_BATCH_SIZE				(16 << 20)
+/* Batches submitted and not complete, the oldest one is waited for beyond */
+#define TRANSFER_MAX_BATCHES			4
+/* Alignment of the staged copies, a multiple of the texel block sizes */
+#define TRANSFER_STAGING_ALIGNMENT		16
+
+/** @brief Ticket of an upload, the transfer timeline value of the batch recording it, the uploads complete in ticket order */
+typedef uint64_t TransferTicket;
+
+#define TRANSFER_TICKET_INVALID			UINT64_MAX
+
+struct TransferStatistics {
+	/** @brief The uploads run on a transfer only family */
+	bool async_transfer;
+	/** @brief Batches and bytes submitted during the last frame */
+	uint32_t frame_batches;
+	VkDeviceSize frame_bytes;
+	uint32_t pending_batches;
+	TransferTicket completed_ticket;
+};
+
+/**
+* Uploads on the transfer queue
+*
+* - the copies are recorded into the batch of the current ticket, with their data in the staging
+*   buffer of the batch, and the batch is submitted once per frame or when its staging buffer is full
+* - each submitted batch signals the next value of the transfer timeline, which is the ticket of
+*   its uploads, callers poll is_complete with the ticket of their upload and read it once complete
+*
+* Buffers are shared with the transfer family, images uploaded on a transfer only family are released
+* to the graphics family by the caller, which acquires them once their ticket is complete
+*/
+class VulkanTransferQueue
+{
+public:
+	VulkanTransferQueue();
+	~VulkanTransferQueue();
+
+	bool								create(VulkanDevice* device, VulkanSync* sync);
+	void								shutdown();
+
+	void								update();
+
+	VkCommandBuffer						get_command_buffer();
+	bool								stage(const void* data, VkDeviceSize size, VkBuffer* buffer, VkDeviceSize* offset);
+	TransferTicket						upload_buffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+	/** @brief Ticket of the uploads recorded until the next flush */
+	TransferTicket						get_ticket() const { return next_ticket; };
+	TransferTicket						flush();
+
+	TransferTicket						get_completed_ticket();
+	bool								is_complete(TransferTicket ticket);
+	void								wait(TransferTicket ticket);
+
+	uint32_t							get_queue_family_index() const { return device->transfer_queue_family_index; };
+	const TransferStatistics&			get_statistics() const { return statistics; };
+
+private:
+	struct Batch {
+		TransferTicket ticket;
+		VkCommandBuffer command_buffer;
+		VulkanBuffer staging;
+		VkDeviceSize staging_offset;
+	};
+
+	VulkanDevice*						device;
+	VulkanTimeline*						timeline;
+	VkCommandPool						command_pool;
+
+	/* batch recording the uploads of the next ticket, null until the first upload */
+	Batch*								recording;
+	std::deque<Batch*>					submitted;
+	std::vector<Batch*>					free_batches;
+
+	/* the transfer queue is the only submitter of the transfer timeline, the ticket of a batch is its value */
+	TransferTicket						next_ticket;
+
+	TransferStatistics					statistics;
+
+	Batch*								begin_batch(VkDeviceSize staging_size);
+	void								retire_batches();
+	void								destroy_batch(Batch* batch);
+};
@@ -0,0 +1,109 @@
+#include "VulkanWorkerPool.h"
+
+VulkanWorkerPool::VulkanWorkerPool()
+	: stopping(false)
+{
+}
+
+VulkanWorkerPool::~VulkanWorkerPool()
+{
+}
+
+/**
+* Start the threads of the pool
+*
+* @param threads_count Number of threads, the calling thread of run is an additional worker
+*/
+void VulkanWorkerPool::create(uint32_t threads_count)
+{
+	stopping = false;
+	for (uint32_t i = 0; i < threads_count; ++i) {
+		threads.push_back(std::thread(&VulkanWorkerPool::run_worker, this));
+	}
+}
+
+void VulkanWorkerPool::shutdown()
+{
+	{
+		std::lock_guard<std::mutex> lock(tasks_mutex);
+		stopping = true;
+	}
+	tasks_condition.notify_all();
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	threads.clear();
+}
+
+/**
+* Run a function for each worker and return once all of them completed
+* Without threads the workers run one after the other on the calling thread
+*
+* @param workers Number of workers, the index of the worker is given to the function
+* @param function Function of a worker, called from any thread
+*/
+void VulkanWorkerPool::run(uint32_t workers, const std::function<void(uint32_t)>& function)
+{
+	if (workers <= 1 || threads.empty()) {
+		for (uint32_t worker = 0; worker < workers; ++worker) {
+			function(worker);
+		}
+		return;
+	}
+
+	Call call = { &function, workers - 1 };
+	{
+		std::lock_guard<std::mutex> lock(tasks_mutex);
+		for (uint32_t worker = 1; worker < workers; ++worker) {
+			tasks.push_back({ &call, worker });
+		}
+	}
+	tasks_condition.notify_all();
+
+	function(0);
+
+	// Run the workers of the call no thread took yet, then wait for the others
+	std::unique_lock<std::mutex> lock(tasks_mutex);
+	while (call.remaining > 0) {
+		auto task = std::find_if(tasks.begin(), tasks.end(), [&call](const Task& task) { return task.call == &call; });
+		if (task == tasks.end()) {
+			completed_condition.wait(lock);
+			continue;
+		}
+
+		Task own_task = *task;
+		tasks.erase(task);
+		lock.unlock();
+		execute(own_task);
+		lock.lock();
+	}
+}
+
+void VulkanWorkerPool::run_worker()
+{
+	while (true) {
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(tasks_mutex);
+			tasks_condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+			if (stopping) {
+				return;
+			}
+			task = tasks.front();
+			tasks.pop_front();
+		}
+
+		execute(task);
+	}
+}
+
+void VulkanWorkerPool::execute(const Task& task)
+{
+	(*task.call->function)(task.worker);
+
+	{
+		std::lock_guard<std::mutex> lock(tasks_mutex);
+		task.call->remaining--;
+	}
+	completed_condition.notify_all();
+}
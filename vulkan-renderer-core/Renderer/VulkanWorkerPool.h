@@ -0,0 +1,56 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+/**
+* Persistent threads running the chunks of the parallel CPU work, the radix sort of the render queue
+* and the transcoding of the texture levels, so that no thread is created per call
+*
+* run splits a function over a number of workers, the calling thread runs the first worker and
+* then the queued workers of its own call, so that concurrent callers never wait on busy threads
+*/
+class VulkanWorkerPool
+{
+public:
+	VulkanWorkerPool();
+	~VulkanWorkerPool();
+
+	void							create(uint32_t threads_count);
+	void							shutdown();
+
+	/** @brief Number of workers a call runs at once, the calling thread included */
+	uint32_t						get_workers_count() const { return static_cast<uint32_t>(threads.size()) + 1; };
+
+	void							run(uint32_t workers, const std::function<void(uint32_t)>& function);
+
+private:
+	struct Call {
+		const std::function<void(uint32_t)>* function;
+		/* workers not completed yet */
+		uint32_t remaining;
+	};
+
+	struct Task {
+		Call* call;
+		uint32_t worker;
+	};
+
+	std::vector<std::thread>		threads;
+	std::deque<Task>				tasks;
+	std::mutex						tasks_mutex;
+	/* signaled when a task is queued or the pool stops */
+	std::condition_variable			tasks_condition;
+	/* signaled when a task completes */
+	std::condition_variable			completed_condition;
+	bool							stopping;
+
+	void							run_worker();
+	void							execute(const Task& task);
+};
@@ -34,7 +34,10 @@ class VulkanWindow(QtGui.QWindow):
     def __init__(self, parent=None):
         super(VulkanWindow, self).__init__()
         self.vk_renderer = vk_py_renderer.VulkanRenderer()
+        # The frames are started by a single shot timer after the delay of the frame pacer
         self.timer = QtCore.QTimer(self)
+        self.timer.setSingleShot(True)
+        self.timer.setTimerType(QtCore.Qt.PreciseTimer)
         self.timer.timeout.connect(self.render)
 
         self.fps_timer = time.perf_counter() * 1000
@@ -59,11 +62,21 @@ class VulkanWindow(QtGui.QWindow):
             self.fps = 0
         self.last_elapsed_time = time.perf_counter()
 
+        # The timer stops while nothing changed, the events that change the frame start it again
+        if self.vk_renderer.needs_redraw():
+            self.timer.start(round(self.vk_renderer.get_frame_delay() * 1000))
+
+    def redraw(self):
+        self.vk_renderer.request_redraw()
+        if not self.timer.isActive():
+            self.timer.start(0)
+
     def cleanup(self):
         self.vk_renderer.cleanup()
 
     def resizeEvent(self, event):
         self.vk_renderer.resize(self.width(), self.height())
+        self.redraw()
 
 class MainWindow(QtWidgets.QMainWindow):
 
@@ -139,6 +152,7 @@ class MainWindow(QtWidgets.QMainWindow):
         tp = type(value)
         if tp == bool:
              self.vulkanWindow.vk_renderer.is_paused = value
+             self.vulkanWindow.redraw()
 
     def closeEvent(self, event):
         self.vulkanWindow.cleanup()